@@ -53,6 +53,8 @@ function(target_add_shaders tgt)
           "$<$<BOOL:${incl_dirs}>:-I$<JOIN:${incl_dirs},;-I>>"
           "$<$<CONFIG:Debug>:-g>"
           -V
+          # Subgroup operations need at least SPIR-V 1.3, etna requires Vulkan 1.3 anyway
+          --target-env vulkan1.3
           ${input_path}
           -o ${output_path}
         VERBATIM
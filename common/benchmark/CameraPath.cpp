@@ -0,0 +1,152 @@
+#include "CameraPath.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numbers>
+#include <sstream>
+#include <string>
+
+#include <etna/Assert.hpp>
+#include <spdlog/spdlog.h>
+
+
+CameraPath CameraPath::orbit(glm::vec3 center, float radius, float height, float duration)
+{
+  static constexpr std::uint32_t KEYFRAME_COUNT = 16;
+
+  CameraPath result;
+  for (std::uint32_t i = 0; i <= KEYFRAME_COUNT; ++i)
+  {
+    const float t = static_cast<float>(i) / static_cast<float>(KEYFRAME_COUNT);
+    const float angle = 2.0f * std::numbers::pi_v<float> * t;
+
+    Camera cam;
+    cam.lookAt(
+      center + glm::vec3{radius * std::cos(angle), height, radius * std::sin(angle)},
+      center,
+      {0, 1, 0});
+    result.addKeyframe(duration * t, cam);
+  }
+  return result;
+}
+
+std::optional<CameraPath> CameraPath::load(const std::filesystem::path& path)
+{
+  std::ifstream in(path);
+  if (!in)
+  {
+    spdlog::error("Unable to open camera path '{}'", path.string());
+    return std::nullopt;
+  }
+
+  CameraPath result;
+  std::string line;
+  for (std::size_t lineIdx = 1; std::getline(in, line); ++lineIdx)
+  {
+    if (line.empty() || line.front() == '#')
+      continue;
+
+    CameraKeyframe key;
+    std::istringstream fields(line);
+    fields >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.rotation.x >>
+      key.rotation.y >> key.rotation.z >> key.rotation.w;
+
+    if (!fields || (!result.keyframes.empty() && key.time < result.keyframes.back().time))
+    {
+      spdlog::error("Camera path '{}': malformed keyframe on line {}", path.string(), lineIdx);
+      return std::nullopt;
+    }
+
+    key.rotation = glm::normalize(key.rotation);
+    result.keyframes.push_back(key);
+  }
+
+  if (result.keyframes.empty())
+  {
+    spdlog::error("Camera path '{}' has no keyframes", path.string());
+    return std::nullopt;
+  }
+
+  return result;
+}
+
+bool CameraPath::save(const std::filesystem::path& path) const
+{
+  std::ofstream out(path);
+  if (!out)
+  {
+    spdlog::error("Unable to write camera path '{}'", path.string());
+    return false;
+  }
+
+  out << "# time px py pz qx qy qz qw\n";
+  // Enough digits for floats to survive the round trip
+  out.precision(9);
+  for (const auto& key : keyframes)
+    out << key.time << ' ' << key.position.x << ' ' << key.position.y << ' ' << key.position.z
+        << ' ' << key.rotation.x << ' ' << key.rotation.y << ' ' << key.rotation.z << ' '
+        << key.rotation.w << '\n';
+
+  return static_cast<bool>(out);
+}
+
+void CameraPath::addKeyframe(float time, const Camera& camera)
+{
+  ETNA_VERIFY(keyframes.empty() || keyframes.back().time <= time);
+  keyframes.push_back(CameraKeyframe{
+    .time = time,
+    .position = camera.position,
+    .rotation = camera.rotation,
+  });
+}
+
+Camera CameraPath::sample(float time, const Camera& base) const
+{
+  Camera result = base;
+  if (keyframes.empty())
+    return result;
+
+  if (time <= keyframes.front().time || keyframes.size() == 1)
+  {
+    result.position = keyframes.front().position;
+    result.rotation = keyframes.front().rotation;
+    return result;
+  }
+
+  if (time >= keyframes.back().time)
+  {
+    result.position = keyframes.back().position;
+    result.rotation = keyframes.back().rotation;
+    return result;
+  }
+
+  const auto next = std::upper_bound(
+    keyframes.begin(), keyframes.end(), time, [](float t, const CameraKeyframe& key) {
+      return t < key.time;
+    });
+  const auto i1 = static_cast<std::size_t>(next - keyframes.begin());
+  const auto i0 = i1 - 1;
+  // End points are duplicated to keep the spline going through them
+  const auto iPrev = i0 == 0 ? i0 : i0 - 1;
+  const auto iNext = i1 + 1 == keyframes.size() ? i1 : i1 + 1;
+
+  const auto& k0 = keyframes[i0];
+  const auto& k1 = keyframes[i1];
+  const float span = k1.time - k0.time;
+  const float t = span > 0 ? (time - k0.time) / span : 0;
+  const float t2 = t * t;
+  const float t3 = t2 * t;
+
+  const glm::vec3 p0 = keyframes[iPrev].position;
+  const glm::vec3 p1 = k0.position;
+  const glm::vec3 p2 = k1.position;
+  const glm::vec3 p3 = keyframes[iNext].position;
+
+  result.position = 0.5f *
+    ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 +
+     (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+  result.rotation = glm::slerp(k0.rotation, k1.rotation, t);
+
+  return result;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "scene/Camera.hpp"
+
+
+struct CameraKeyframe
+{
+  float time;
+  glm::vec3 position;
+  glm::quat rotation;
+};
+
+/**
+ * A camera flythrough for reproducible benchmarks. Positions are interpolated
+ * with a Catmull-Rom spline and rotations with slerp, so replaying a path
+ * always produces exactly the same cameras for the same times.
+ */
+class CameraPath
+{
+public:
+  // A circle around `center` looking at it, useful when nothing was recorded
+  static CameraPath orbit(glm::vec3 center, float radius, float height, float duration);
+
+  // Text format, one keyframe per line: time px py pz qx qy qz qw
+  static std::optional<CameraPath> load(const std::filesystem::path& path);
+  bool save(const std::filesystem::path& path) const;
+
+  // Keyframes must be added in the order of increasing time
+  void addKeyframe(float time, const Camera& camera);
+
+  std::span<const CameraKeyframe> getKeyframes() const { return keyframes; }
+  bool empty() const { return keyframes.empty(); }
+  float getDuration() const { return keyframes.empty() ? 0 : keyframes.back().time; }
+
+  // Time is clamped to the path's range, parameters other
+  // than position and rotation are taken from `base`
+  Camera sample(float time, const Camera& base = {}) const;
+
+private:
+  std::vector<CameraKeyframe> keyframes;
+};
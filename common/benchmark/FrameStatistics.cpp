@@ -0,0 +1,139 @@
+#include "FrameStatistics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+
+#include <spdlog/spdlog.h>
+
+
+namespace
+{
+
+// Nearest-rank percentile of sorted samples
+double percentile(const std::vector<double>& sorted, double p)
+{
+  const auto rank = static_cast<std::size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+  return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+}
+
+MetricSummary summarize_samples(std::vector<double> values)
+{
+  MetricSummary result{.count = values.size()};
+  if (values.empty())
+    return result;
+
+  std::sort(values.begin(), values.end());
+  result.mean =
+    std::accumulate(values.begin(), values.end(), 0.0) / static_cast<double>(values.size());
+  result.p50 = percentile(values, 0.50);
+  result.p95 = percentile(values, 0.95);
+  result.p99 = percentile(values, 0.99);
+  result.max = values.back();
+  return result;
+}
+
+} // namespace
+
+void FrameStatistics::record(std::string_view metric, double value)
+{
+  auto it = samples.find(metric);
+  if (it == samples.end())
+    it = samples.emplace(std::string{metric}, std::vector<double>{}).first;
+  it->second.push_back(value);
+}
+
+BenchmarkSummary FrameStatistics::summarize() const
+{
+  BenchmarkSummary result;
+  for (const auto& [name, values] : samples)
+    result.emplace(name, summarize_samples(values));
+  return result;
+}
+
+bool FrameStatistics::writeJson(const std::filesystem::path& path) const
+{
+  std::ofstream out(path);
+  if (!out)
+  {
+    spdlog::error("Unable to write benchmark report '{}'", path.string());
+    return false;
+  }
+
+  // Metric names are plain identifiers, so nothing needs escaping
+  out << "{\n  \"metrics\": {";
+  bool first = true;
+  for (const auto& [name, s] : summarize())
+  {
+    out << (first ? "\n" : ",\n");
+    out << fmt::format(
+      "    \"{}\": {{\"count\": {}, \"mean\": {}, \"p50\": {}, \"p95\": {}, \"p99\": {}, "
+      "\"max\": {}}}",
+      name,
+      s.count,
+      s.mean,
+      s.p50,
+      s.p95,
+      s.p99,
+      s.max);
+    first = false;
+  }
+  out << "\n  }\n}\n";
+
+  return static_cast<bool>(out);
+}
+
+bool FrameStatistics::writeCsv(const std::filesystem::path& path) const
+{
+  std::ofstream out(path);
+  if (!out)
+  {
+    spdlog::error("Unable to write benchmark report '{}'", path.string());
+    return false;
+  }
+
+  out << "metric,count,mean,p50,p95,p99,max\n";
+  for (const auto& [name, s] : summarize())
+    out << fmt::format(
+      "{},{},{},{},{},{},{}\n", name, s.count, s.mean, s.p50, s.p95, s.p99, s.max);
+
+  return static_cast<bool>(out);
+}
+
+std::optional<BenchmarkSummary> FrameStatistics::readCsv(const std::filesystem::path& path)
+{
+  std::ifstream in(path);
+  if (!in)
+  {
+    spdlog::error("Unable to open benchmark report '{}'", path.string());
+    return std::nullopt;
+  }
+
+  BenchmarkSummary result;
+  std::string line;
+  // Skip the header
+  std::getline(in, line);
+  for (std::size_t lineIdx = 2; std::getline(in, line); ++lineIdx)
+  {
+    if (line.empty())
+      continue;
+
+    std::replace(line.begin(), line.end(), ',', ' ');
+    std::istringstream fields(line);
+
+    std::string name;
+    MetricSummary s;
+    fields >> name >> s.count >> s.mean >> s.p50 >> s.p95 >> s.p99 >> s.max;
+    if (!fields)
+    {
+      spdlog::error("Benchmark report '{}': malformed line {}", path.string(), lineIdx);
+      return std::nullopt;
+    }
+
+    result.emplace(std::move(name), s);
+  }
+
+  return result;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+struct MetricSummary
+{
+  std::size_t count = 0;
+  double mean = 0;
+  double p50 = 0;
+  double p95 = 0;
+  double p99 = 0;
+  double max = 0;
+};
+
+using BenchmarkSummary = std::map<std::string, MetricSummary, std::less<>>;
+
+/**
+ * Collects per-frame samples of named metrics, e.g. CPU frame time, GPU time of
+ * a pass or the amount of draw calls, and summarizes them into a report.
+ * Metric names should mention units, like `cpu_frame_ms`.
+ */
+class FrameStatistics
+{
+public:
+  void record(std::string_view metric, double value);
+
+  std::size_t getMetricCount() const { return samples.size(); }
+  BenchmarkSummary summarize() const;
+
+  // Both formats contain the same summary, CSV is what `benchmark_compare` reads
+  bool writeJson(const std::filesystem::path& path) const;
+  bool writeCsv(const std::filesystem::path& path) const;
+
+  static std::optional<BenchmarkSummary> readCsv(const std::filesystem::path& path);
+
+private:
+  std::map<std::string, std::vector<double>, std::less<>> samples;
+};
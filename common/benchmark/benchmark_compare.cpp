@@ -0,0 +1,77 @@
+#include <cstdlib>
+#include <string>
+
+#include <spdlog/spdlog.h>
+
+#include "FrameStatistics.hpp"
+
+
+// Compares two benchmark reports written by FrameStatistics::writeCsv.
+// All metrics are assumed to be "lower is better". Returns non-zero
+// if the new report regressed in any metric by more than the threshold.
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    spdlog::info("Usage: benchmark_compare <baseline.csv> <new.csv> [threshold_percent = 5]");
+    return 2;
+  }
+
+  const auto baseline = FrameStatistics::readCsv(argv[1]);
+  const auto current = FrameStatistics::readCsv(argv[2]);
+  if (!baseline || !current)
+    return 2;
+
+  const double threshold = (argc > 3 ? std::strtod(argv[3], nullptr) : 5.0) / 100.0;
+
+  // Relative change, positive means the new report is slower
+  const auto change = [](double before, double after) {
+    if (before == 0)
+      return after == 0 ? 0.0 : 1.0;
+    return (after - before) / before;
+  };
+
+  fmt::print(
+    "{:<32} {:>12} {:>12} {:>9} {:>12} {:>12} {:>9}\n",
+    "metric",
+    "mean",
+    "new mean",
+    "change",
+    "p95",
+    "new p95",
+    "change");
+
+  bool regressed = false;
+  for (const auto& [name, before] : *baseline)
+  {
+    const auto it = current->find(name);
+    if (it == current->end())
+    {
+      fmt::print("{:<32} missing from the new report\n", name);
+      continue;
+    }
+    const auto& after = it->second;
+
+    const double meanChange = change(before.mean, after.mean);
+    const double p95Change = change(before.p95, after.p95);
+    const bool isRegression = meanChange > threshold || p95Change > threshold;
+    regressed |= isRegression;
+
+    fmt::print(
+      "{:<32} {:>12.4f} {:>12.4f} {:>+8.1f}% {:>12.4f} {:>12.4f} {:>+8.1f}%{}\n",
+      name,
+      before.mean,
+      after.mean,
+      100 * meanChange,
+      before.p95,
+      after.p95,
+      100 * p95Change,
+      isRegression ? "  REGRESSION" : "");
+  }
+
+  for (const auto& [name, s] : *current)
+    if (!baseline->contains(name))
+      fmt::print("{:<32} new metric, mean {:.4f}\n", name, s.mean);
+
+  return regressed ? 1 : 0;
+}
@@ -0,0 +1,280 @@
+#include "ComputePrimitives.hpp"
+
+#include <algorithm>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+
+#include "render_utils/MemoryTracker.hpp"
+#include "Primitives.h"
+
+
+static_assert(PRIMITIVES_WORKGROUP_SIZE == RADIX_BUCKETS);
+static_assert(sizeof(PrimitiveParams) == 4 * sizeof(std::uint32_t));
+
+static std::uint32_t div_ceil(std::uint32_t a, std::uint32_t b)
+{
+  return a / b + (a % b != 0 ? 1 : 0);
+}
+
+static void memory_barrier(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineStageFlags2 src_stage,
+  vk::AccessFlags2 src_access,
+  vk::PipelineStageFlags2 dst_stage,
+  vk::AccessFlags2 dst_access)
+{
+  const vk::MemoryBarrier2 barrier{
+    .srcStageMask = src_stage,
+    .srcAccessMask = src_access,
+    .dstStageMask = dst_stage,
+    .dstAccessMask = dst_access,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+}
+
+static constexpr auto COMPUTE_STAGE = vk::PipelineStageFlagBits2::eComputeShader;
+static constexpr auto COMPUTE_ACCESS =
+  vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite;
+static constexpr auto TRANSFER_STAGE = vk::PipelineStageFlagBits2::eTransfer;
+static constexpr auto TRANSFER_ACCESS = vk::AccessFlagBits2::eTransferWrite;
+
+// Fills happen in the transfer stage and must not race with compute shaders on either side
+static void fill_zero(vk::CommandBuffer cmd_buf, const etna::Buffer& buffer, vk::DeviceSize size)
+{
+  memory_barrier(cmd_buf, COMPUTE_STAGE, COMPUTE_ACCESS, TRANSFER_STAGE, TRANSFER_ACCESS);
+  cmd_buf.fillBuffer(buffer.get(), 0, size, 0);
+  memory_barrier(cmd_buf, TRANSFER_STAGE, TRANSFER_ACCESS, COMPUTE_STAGE, COMPUTE_ACCESS);
+}
+
+static etna::ComputePipeline create_pipeline(const char* name, const char* spirv_path)
+{
+  if (etna::get_program_id(name) == etna::ShaderProgramId::Invalid)
+    etna::create_program(name, {spirv_path});
+  return etna::get_context().getPipelineManager().createComputePipeline(name, {});
+}
+
+ComputePrimitives::ComputePrimitives(CreateInfo info)
+  : maxCount{info.maxCount}
+  , maxKeyType{info.maxKeyType}
+{
+  ETNA_VERIFY(maxCount > 0);
+
+  auto& ctx = etna::get_context();
+
+  // All of these are supported by lavapipe as well
+  const auto properties = ctx.getPhysicalDevice()
+                            .getProperties2<
+                              vk::PhysicalDeviceProperties2,
+                              vk::PhysicalDeviceSubgroupProperties>()
+                            .get<vk::PhysicalDeviceSubgroupProperties>();
+  ETNA_VERIFY(properties.supportedStages & vk::ShaderStageFlagBits::eCompute);
+  ETNA_VERIFY(properties.supportedOperations & vk::SubgroupFeatureFlagBits::eArithmetic);
+  ETNA_VERIFY(properties.supportedOperations & vk::SubgroupFeatureFlagBits::eBallot);
+
+  reducePipeline = create_pipeline("gpgpu_reduce", GPGPU_SHADERS_ROOT "reduce.comp.spv");
+  scanPipeline = create_pipeline("gpgpu_scan", GPGPU_SHADERS_ROOT "scan.comp.spv");
+  compactPipeline = create_pipeline("gpgpu_compact", GPGPU_SHADERS_ROOT "compact.comp.spv");
+  histogramPipeline =
+    create_pipeline("gpgpu_radix_histogram", GPGPU_SHADERS_ROOT "radix_histogram.comp.spv");
+  scatterPipeline =
+    create_pipeline("gpgpu_radix_scatter", GPGPU_SHADERS_ROOT "radix_scatter.comp.spv");
+
+  // Histograms of radix sort are scanned as well
+  const std::uint32_t maxBlocks = div_ceil(maxCount, RADIX_BLOCK_SIZE);
+  const std::uint32_t maxHistogramWords = RADIX_BUCKETS * maxBlocks;
+  maxScanTiles = div_ceil(std::max(maxCount, maxHistogramWords), SCAN_TILE_SIZE);
+
+  auto createScratch = [](vk::DeviceSize size, const char* name) {
+    return create_tracked_buffer(MemoryCategory::Other, etna::Buffer::CreateInfo{
+      .size = size,
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = name,
+    });
+  };
+
+  const vk::DeviceSize word = sizeof(std::uint32_t);
+  const vk::DeviceSize keyWords = maxKeyType == KeyType::Uint64 ? 2 : 1;
+  const vk::DeviceSize statusWords = 1 + SCAN_STATUS_STRIDE * vk::DeviceSize{maxScanTiles};
+  scanStatus = createScratch(statusWords * word, "gpgpu_scan_status");
+  compactOffsets = createScratch(maxCount * word, "gpgpu_compact_offsets");
+  histograms = createScratch(maxHistogramWords * word, "gpgpu_radix_histograms");
+  histogramOffsets = createScratch(maxHistogramWords * word, "gpgpu_radix_offsets");
+  tmpKeys = createScratch(maxCount * keyWords * word, "gpgpu_radix_keys");
+  tmpValues = createScratch(maxCount * word, "gpgpu_radix_values");
+}
+
+void ComputePrimitives::dispatch(
+  vk::CommandBuffer cmd_buf,
+  const etna::ComputePipeline& pipeline,
+  const char* program,
+  std::vector<etna::Binding> bindings,
+  const PrimitiveParams& params,
+  std::uint32_t group_count)
+{
+  auto programInfo = etna::get_shader_program(program);
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0), cmd_buf, std::move(bindings));
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, {set.getVkSet()}, {});
+  cmd_buf.pushConstants<PrimitiveParams>(
+    pipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, {params});
+
+  // NOTE: 65535 is the minimal maxComputeWorkGroupCount guaranteed by the spec
+  constexpr std::uint32_t MAX_GROUPS = 65535;
+  cmd_buf.dispatch(std::min(group_count, MAX_GROUPS), div_ceil(group_count, MAX_GROUPS), 1);
+
+  // Etna only tracks images, so every primitive makes its results visible to the next one
+  memory_barrier(cmd_buf, COMPUTE_STAGE, COMPUTE_ACCESS, COMPUTE_STAGE, COMPUTE_ACCESS);
+}
+
+void ComputePrimitives::reduce(
+  vk::CommandBuffer cmd_buf,
+  const etna::Buffer& input,
+  const etna::Buffer& sum,
+  std::uint32_t count)
+{
+  ETNA_VERIFY(count <= maxCount);
+
+  fill_zero(cmd_buf, sum, sizeof(std::uint32_t));
+  dispatch(
+    cmd_buf,
+    reducePipeline,
+    "gpgpu_reduce",
+    {etna::Binding{0, input.genBinding()}, etna::Binding{1, sum.genBinding()}},
+    PrimitiveParams{.count = count, .mode = 0, .shift = 0, .blockCount = 0},
+    std::min(div_ceil(count, PRIMITIVES_WORKGROUP_SIZE), REDUCE_MAX_WORKGROUPS));
+}
+
+void ComputePrimitives::scan(
+  vk::CommandBuffer cmd_buf,
+  const etna::Buffer& input,
+  const etna::Buffer& output,
+  std::uint32_t count,
+  std::uint32_t mode)
+{
+  const std::uint32_t tileCount = div_ceil(count, SCAN_TILE_SIZE);
+  ETNA_VERIFY(tileCount <= maxScanTiles);
+  if (tileCount == 0)
+    return;
+
+  const vk::DeviceSize statusWords = 1 + SCAN_STATUS_STRIDE * vk::DeviceSize{tileCount};
+  fill_zero(cmd_buf, scanStatus, statusWords * sizeof(std::uint32_t));
+  dispatch(
+    cmd_buf,
+    scanPipeline,
+    "gpgpu_scan",
+    {
+      etna::Binding{0, input.genBinding()},
+      etna::Binding{1, output.genBinding()},
+      etna::Binding{2, scanStatus.genBinding()},
+    },
+    PrimitiveParams{.count = count, .mode = mode, .shift = 0, .blockCount = 0},
+    tileCount);
+}
+
+void ComputePrimitives::exclusiveScan(
+  vk::CommandBuffer cmd_buf,
+  const etna::Buffer& input,
+  const etna::Buffer& output,
+  std::uint32_t count)
+{
+  ETNA_VERIFY(count <= maxCount);
+  scan(cmd_buf, input, output, count, SCAN_LOAD_VALUES);
+}
+
+void ComputePrimitives::compact(
+  vk::CommandBuffer cmd_buf,
+  const etna::Buffer& input,
+  const etna::Buffer& flags,
+  const etna::Buffer& output,
+  const etna::Buffer& kept_count,
+  std::uint32_t count)
+{
+  ETNA_VERIFY(count <= maxCount);
+
+  // Overwritten by the last element, unless there are no elements at all
+  fill_zero(cmd_buf, kept_count, sizeof(std::uint32_t));
+
+  scan(cmd_buf, flags, compactOffsets, count, SCAN_LOAD_PREDICATE);
+  dispatch(
+    cmd_buf,
+    compactPipeline,
+    "gpgpu_compact",
+    {
+      etna::Binding{0, input.genBinding()},
+      etna::Binding{1, flags.genBinding()},
+      etna::Binding{2, compactOffsets.genBinding()},
+      etna::Binding{3, output.genBinding()},
+      etna::Binding{4, kept_count.genBinding()},
+    },
+    PrimitiveParams{.count = count, .mode = 0, .shift = 0, .blockCount = 0},
+    div_ceil(count, PRIMITIVES_WORKGROUP_SIZE));
+}
+
+void ComputePrimitives::sort(
+  vk::CommandBuffer cmd_buf,
+  const etna::Buffer& keys,
+  const etna::Buffer& values,
+  std::uint32_t count,
+  KeyType key_type)
+{
+  ETNA_VERIFY(count <= maxCount);
+  ETNA_VERIFY(key_type == KeyType::Uint32 || maxKeyType == KeyType::Uint64);
+  if (count == 0)
+    return;
+
+  const std::uint32_t keyWords = key_type == KeyType::Uint64 ? 2 : 1;
+  const std::uint32_t blockCount = div_ceil(count, RADIX_BLOCK_SIZE);
+
+  // Both key sizes take an even amount of passes, so the result ends up in the input buffers
+  const etna::Buffer* srcKeys = &keys;
+  const etna::Buffer* srcValues = &values;
+  const etna::Buffer* dstKeys = &tmpKeys;
+  const etna::Buffer* dstValues = &tmpValues;
+
+  for (std::uint32_t shift = 0; shift < 32 * keyWords; shift += RADIX_BITS)
+  {
+    const PrimitiveParams params{
+      .count = count,
+      .mode = keyWords,
+      .shift = shift,
+      .blockCount = blockCount,
+    };
+
+    dispatch(
+      cmd_buf,
+      histogramPipeline,
+      "gpgpu_radix_histogram",
+      {etna::Binding{0, srcKeys->genBinding()}, etna::Binding{1, histograms.genBinding()}},
+      params,
+      blockCount);
+
+    scan(cmd_buf, histograms, histogramOffsets, RADIX_BUCKETS * blockCount, SCAN_LOAD_VALUES);
+
+    dispatch(
+      cmd_buf,
+      scatterPipeline,
+      "gpgpu_radix_scatter",
+      {
+        etna::Binding{0, srcKeys->genBinding()},
+        etna::Binding{1, srcValues->genBinding()},
+        etna::Binding{2, histogramOffsets.genBinding()},
+        etna::Binding{3, dstKeys->genBinding()},
+        etna::Binding{4, dstValues->genBinding()},
+      },
+      params,
+      blockCount);
+
+    std::swap(srcKeys, dstKeys);
+    std::swap(srcValues, dstValues);
+  }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/DescriptorSet.hpp>
+
+
+struct PrimitiveParams;
+
+/**
+ * Data-parallel building blocks of compute passes over buffers of 32-bit unsigned
+ * integers: reduction, exclusive scan, stream compaction and key-value radix sort.
+ * Everything is recorded into a command buffer. Inputs have to be visible to compute
+ * shaders when the commands start and results are visible to compute shaders once
+ * they finish; barriers for other consumers are up to the caller.
+ *
+ * Scratch memory is allocated once for the biggest input, so calls never allocate.
+ * Calls reuse the same scratch memory, so commands of two calls must not overlap,
+ * which is always true for commands recorded into a single queue.
+ */
+class ComputePrimitives
+{
+public:
+  enum class KeyType
+  {
+    Uint32,
+    // Stored as pairs of 32-bit words, low word first, just like uint64_t on the CPU
+    Uint64,
+  };
+
+  struct CreateInfo
+  {
+    std::uint32_t maxCount;
+    // Scratch memory for 64-bit keys is twice as big
+    KeyType maxKeyType = KeyType::Uint64;
+  };
+
+  explicit ComputePrimitives(CreateInfo info);
+
+  // The sum is written to the first word of `sum`, which needs transfer dst usage.
+  // Just like on the CPU, it wraps around on overflow.
+  void reduce(
+    vk::CommandBuffer cmd_buf,
+    const etna::Buffer& input,
+    const etna::Buffer& sum,
+    std::uint32_t count);
+
+  void exclusiveScan(
+    vk::CommandBuffer cmd_buf,
+    const etna::Buffer& input,
+    const etna::Buffer& output,
+    std::uint32_t count);
+
+  // Keeps elements of `input` with non-zero `flags` in their original order. The amount
+  // of kept elements is written to the first word of `kept_count`, which needs transfer
+  // dst usage.
+  void compact(
+    vk::CommandBuffer cmd_buf,
+    const etna::Buffer& input,
+    const etna::Buffer& flags,
+    const etna::Buffer& output,
+    const etna::Buffer& kept_count,
+    std::uint32_t count);
+
+  // Stable, sorted in place. Values are 32-bit, e.g. indices of whatever is being sorted.
+  void sort(
+    vk::CommandBuffer cmd_buf,
+    const etna::Buffer& keys,
+    const etna::Buffer& values,
+    std::uint32_t count,
+    KeyType key_type);
+
+  std::uint32_t getMaxCount() const { return maxCount; }
+
+private:
+  void scan(
+    vk::CommandBuffer cmd_buf,
+    const etna::Buffer& input,
+    const etna::Buffer& output,
+    std::uint32_t count,
+    std::uint32_t mode);
+
+  void dispatch(
+    vk::CommandBuffer cmd_buf,
+    const etna::ComputePipeline& pipeline,
+    const char* program,
+    std::vector<etna::Binding> bindings,
+    const PrimitiveParams& params,
+    std::uint32_t group_count);
+
+private:
+  std::uint32_t maxCount;
+  KeyType maxKeyType;
+  std::uint32_t maxScanTiles;
+
+  etna::ComputePipeline reducePipeline;
+  etna::ComputePipeline scanPipeline;
+  etna::ComputePipeline compactPipeline;
+  etna::ComputePipeline histogramPipeline;
+  etna::ComputePipeline scatterPipeline;
+
+  etna::Buffer scanStatus;
+  etna::Buffer compactOffsets;
+  etna::Buffer histograms;
+  etna::Buffer histogramOffsets;
+  // Every radix sort pass moves elements between these and the sorted buffers
+  etna::Buffer tmpKeys;
+  etna::Buffer tmpValues;
+};
@@ -0,0 +1,152 @@
+#include "KernelTuner.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <spdlog/spdlog.h>
+
+
+KernelTuner::KernelTuner(std::uint32_t repetitions_count)
+  : repetitions{repetitions_count}
+{
+  auto& ctx = etna::get_context();
+
+  const auto limits = ctx.getPhysicalDevice().getProperties().limits;
+  if (!limits.timestampComputeAndGraphics)
+    return;
+  nsPerTick = static_cast<double>(limits.timestampPeriod);
+
+  auto pool = ctx.getDevice().createQueryPoolUnique(vk::QueryPoolCreateInfo{
+    .queryType = vk::QueryType::eTimestamp,
+    .queryCount = 2 * repetitions,
+  });
+  ETNA_CHECK_VK_RESULT(pool.result);
+  queryPool = std::move(pool.value);
+
+  cmdMgr = ctx.createOneShotCmdMgr();
+}
+
+double KernelTuner::measure(
+  const Kernel& kernel, const TunedComputePipeline& pipeline, std::uint32_t size)
+{
+  // Resets descriptor pools, sets of the previous submission aren't used anymore
+  etna::begin_frame();
+
+  auto cmdBuf = cmdMgr->start();
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+
+  cmdBuf.resetQueryPool(queryPool.get(), 0, 2 * repetitions);
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+
+  // Runs write the same memory, so they must not overlap, or they'd be timed together
+  const vk::MemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .dstAccessMask =
+      vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+  };
+  const vk::DependencyInfo dependency{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  };
+
+  // The first run warms up caches and clocks and isn't timed
+  kernel.record(cmdBuf, pipeline, size);
+  for (std::uint32_t i = 0; i < repetitions; ++i)
+  {
+    cmdBuf.pipelineBarrier2(dependency);
+    cmdBuf.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, queryPool.get(), 2 * i);
+    kernel.record(cmdBuf, pipeline, size);
+    cmdBuf.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, queryPool.get(), 2 * i + 1);
+  }
+
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+  cmdMgr->submitAndWait(std::move(cmdBuf));
+
+  etna::end_frame();
+
+  std::vector<std::uint64_t> timestamps(2 * repetitions);
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().getQueryPoolResults(
+    queryPool.get(),
+    0,
+    2 * repetitions,
+    timestamps.size() * sizeof(std::uint64_t),
+    timestamps.data(),
+    sizeof(std::uint64_t),
+    vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait));
+
+  std::vector<double> milliseconds(repetitions);
+  for (std::uint32_t i = 0; i < repetitions; ++i)
+    milliseconds[i] =
+      static_cast<double>(timestamps[2 * i + 1] - timestamps[2 * i]) * nsPerTick * 1e-6;
+
+  std::nth_element(
+    milliseconds.begin(), milliseconds.begin() + repetitions / 2, milliseconds.end());
+  return milliseconds[repetitions / 2];
+}
+
+std::optional<KernelTuner::Result> KernelTuner::tune(const Kernel& kernel, TuningCache& cache)
+{
+  if (!queryPool)
+  {
+    spdlog::warn("Timestamps are not supported, unable to tune '{}'", kernel.program);
+    return std::nullopt;
+  }
+
+  const auto limits = etna::get_context().getPhysicalDevice().getProperties().limits;
+
+  Result result;
+  for (const auto& candidate : kernel.candidates)
+  {
+    if (
+      candidate.invocations() > limits.maxComputeWorkGroupInvocations ||
+      candidate.x > limits.maxComputeWorkGroupSize[0] ||
+      candidate.y > limits.maxComputeWorkGroupSize[1] ||
+      candidate.z > limits.maxComputeWorkGroupSize[2])
+      continue;
+
+    const TunedComputePipeline pipeline{{
+      .program = kernel.program,
+      .spirvPath = kernel.spirvPath,
+      .workgroupSize = candidate,
+    }};
+
+    auto& times = result.milliseconds.emplace_back();
+    for (std::uint32_t size : kernel.problemSizes)
+      times.push_back(measure(kernel, pipeline, size));
+
+    result.candidates.push_back(candidate);
+  }
+
+  if (result.candidates.empty())
+  {
+    spdlog::warn("None of the workgroup sizes of '{}' are supported", kernel.program);
+    return std::nullopt;
+  }
+
+  // Relative times, so that the biggest problem doesn't decide everything on its own
+  std::vector<double> fastest(kernel.problemSizes.size(), std::numeric_limits<double>::max());
+  for (const auto& times : result.milliseconds)
+    for (std::size_t i = 0; i < times.size(); ++i)
+      fastest[i] = std::min(fastest[i], times[i]);
+
+  double bestScore = std::numeric_limits<double>::max();
+  for (std::size_t c = 0; c < result.candidates.size(); ++c)
+  {
+    double score = 0;
+    for (std::size_t i = 0; i < fastest.size(); ++i)
+      score += result.milliseconds[c][i] / std::max(fastest[i], 1e-6);
+
+    if (score < bestScore)
+    {
+      bestScore = score;
+      result.best = result.candidates[c];
+    }
+  }
+
+  cache.store(kernel.program, result.best);
+  return result;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+
+#include "TunedComputePipeline.hpp"
+#include "TuningCache.hpp"
+
+
+/**
+ * Finds the fastest workgroup size of a compute kernel on the current device. Every
+ * candidate size gets its own specialized pipeline, which is timed with timestamp
+ * queries on every problem size. Problem sizes matter, as small problems favour small
+ * workgroups that fill all of the GPU, while big ones favour whatever uses its caches
+ * best. The winner has the lowest time relative to the best one, summed over problem
+ * sizes, and goes into the tuning cache, where TunedComputePipeline picks it up.
+ */
+class KernelTuner
+{
+public:
+  struct Kernel
+  {
+    // Same as for TunedComputePipeline
+    const char* program;
+    const char* spirvPath;
+    // Sizes the device doesn't support are skipped
+    std::vector<WorkgroupSize> candidates;
+    // Whatever `record` makes of them, e.g. element or pixel counts
+    std::vector<std::uint32_t> problemSizes;
+    // Records a single run over a problem of the given size. The pipeline is already
+    // bound, descriptor sets and push constants are up to this, along with dispatching
+    // enough workgroups of the pipeline's size.
+    std::function<void(vk::CommandBuffer, const TunedComputePipeline&, std::uint32_t)> record;
+  };
+
+  struct Result
+  {
+    WorkgroupSize best;
+    // Candidates that were actually measured
+    std::vector<WorkgroupSize> candidates;
+    // Median milliseconds of a run, indexed by candidate and then by problem size
+    std::vector<std::vector<double>> milliseconds;
+  };
+
+  // Every measurement is the median of `repetitions` runs after a warm-up one
+  explicit KernelTuner(std::uint32_t repetitions = 7);
+
+  // nullopt if timestamps aren't supported on the queue
+  std::optional<Result> tune(const Kernel& kernel, TuningCache& cache);
+
+private:
+  double measure(const Kernel& kernel, const TunedComputePipeline& pipeline, std::uint32_t size);
+
+private:
+  std::uint32_t repetitions;
+  double nsPerTick = 0;
+  vk::UniqueQueryPool queryPool;
+  std::unique_ptr<etna::OneShotCmdMgr> cmdMgr;
+};
@@ -0,0 +1,112 @@
+#include "TunedComputePipeline.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <vector>
+
+#include <etna/Assert.hpp>
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <spdlog/spdlog.h>
+
+
+static std::vector<std::uint32_t> read_spirv(const char* path)
+{
+  std::ifstream file{path, std::ios::binary | std::ios::ate};
+  ETNA_VERIFYF(file, "Unable to open shader '{}'", path);
+
+  const auto size = static_cast<std::size_t>(file.tellg());
+  std::vector<std::uint32_t> words(size / sizeof(std::uint32_t));
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(words.data()), static_cast<std::streamsize>(size));
+  return words;
+}
+
+TunedComputePipeline::TunedComputePipeline(const CreateInfo& info)
+  : workgroupSize{info.workgroupSize}
+{
+  auto& ctx = etna::get_context();
+
+  if (etna::get_program_id(info.program) == etna::ShaderProgramId::Invalid)
+    etna::create_program(info.program, {info.spirvPath});
+  base = ctx.getPipelineManager().createComputePipeline(info.program, {});
+
+  if (info.cache != nullptr)
+    if (auto cached = info.cache->find(info.program))
+      workgroupSize = *cached;
+
+  const auto limits = ctx.getPhysicalDevice().getProperties().limits;
+  ETNA_VERIFYF(
+    workgroupSize.invocations() <= limits.maxComputeWorkGroupInvocations &&
+      workgroupSize.x <= limits.maxComputeWorkGroupSize[0] &&
+      workgroupSize.y <= limits.maxComputeWorkGroupSize[1] &&
+      workgroupSize.z <= limits.maxComputeWorkGroupSize[2],
+    "Workgroup size {}x{}x{} of '{}' is not supported by the device",
+    workgroupSize.x,
+    workgroupSize.y,
+    workgroupSize.z,
+    info.program);
+
+  const auto spirv = read_spirv(info.spirvPath);
+  auto module = ctx.getDevice().createShaderModuleUnique(vk::ShaderModuleCreateInfo{
+    .codeSize = spirv.size() * sizeof(std::uint32_t),
+    .pCode = spirv.data(),
+  });
+  ETNA_CHECK_VK_RESULT(module.result);
+
+  static constexpr std::array<vk::SpecializationMapEntry, 3> ENTRIES{
+    vk::SpecializationMapEntry{0, offsetof(WorkgroupSize, x), sizeof(std::uint32_t)},
+    vk::SpecializationMapEntry{1, offsetof(WorkgroupSize, y), sizeof(std::uint32_t)},
+    vk::SpecializationMapEntry{2, offsetof(WorkgroupSize, z), sizeof(std::uint32_t)},
+  };
+  const vk::SpecializationInfo specialization{
+    .mapEntryCount = static_cast<std::uint32_t>(ENTRIES.size()),
+    .pMapEntries = ENTRIES.data(),
+    .dataSize = sizeof(workgroupSize),
+    .pData = &workgroupSize,
+  };
+
+  auto created = ctx.getDevice().createComputePipelineUnique(
+    {},
+    vk::ComputePipelineCreateInfo{
+      .stage =
+        vk::PipelineShaderStageCreateInfo{
+          .stage = vk::ShaderStageFlagBits::eCompute,
+          .module = module.value.get(),
+          .pName = "main",
+          .pSpecializationInfo = &specialization,
+        },
+      .layout = base.getVkPipelineLayout(),
+    });
+  ETNA_CHECK_VK_RESULT(created.result);
+  pipeline = std::move(created.value);
+
+  spdlog::debug(
+    "Compute pipeline '{}' uses {}x{}x{} workgroups",
+    info.program,
+    workgroupSize.x,
+    workgroupSize.y,
+    workgroupSize.z);
+}
+
+vk::Extent3D TunedComputePipeline::groupCount(
+  std::uint32_t x, std::uint32_t y, std::uint32_t z) const
+{
+  return {
+    (x + workgroupSize.x - 1) / workgroupSize.x,
+    (y + workgroupSize.y - 1) / workgroupSize.y,
+    (z + workgroupSize.z - 1) / workgroupSize.z,
+  };
+}
+
+vk::Extent3D TunedComputePipeline::linearGroupCount(std::uint32_t invocations) const
+{
+  // The minimum of maxComputeWorkGroupCount guaranteed by the spec
+  constexpr std::uint32_t MAX_GROUP_COUNT = 65535;
+
+  const auto total = groupCount(invocations).width;
+  const auto x = std::clamp(total, 1u, MAX_GROUP_COUNT);
+  return {x, (total + x - 1) / x, 1};
+}
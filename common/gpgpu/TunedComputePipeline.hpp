@@ -0,0 +1,50 @@
+#pragma once
+
+#include <etna/Vulkan.hpp>
+#include <etna/ComputePipeline.hpp>
+
+#include "TuningCache.hpp"
+
+
+/**
+ * A compute pipeline with the workgroup size chosen at creation time through
+ * specialization constants 0, 1 and 2. Shaders declare it like this, the sizes
+ * given being the defaults:
+ *   layout(local_size_x = 32, local_size_x_id = 0, local_size_y_id = 1) in;
+ * The layout comes from etna's pipeline for the same program, so descriptor sets
+ * and push constants work just like with etna::ComputePipeline. etna doesn't know
+ * about the specialized pipeline though, so it isn't recreated on shader reloads.
+ */
+class TunedComputePipeline
+{
+public:
+  struct CreateInfo
+  {
+    // Created from `spirvPath` unless etna already has a program with this name
+    const char* program;
+    const char* spirvPath;
+    // Used when the cache has nothing for this device, or there's no cache
+    WorkgroupSize workgroupSize;
+    const TuningCache* cache = nullptr;
+  };
+
+  TunedComputePipeline() = default;
+  explicit TunedComputePipeline(const CreateInfo& info);
+
+  vk::Pipeline getVkPipeline() const { return pipeline.get(); }
+  vk::PipelineLayout getVkPipelineLayout() const { return base.getVkPipelineLayout(); }
+  WorkgroupSize getWorkgroupSize() const { return workgroupSize; }
+
+  // Enough workgroups to cover a grid of invocations
+  vk::Extent3D groupCount(std::uint32_t x, std::uint32_t y = 1, std::uint32_t z = 1) const;
+  // For 1D kernels over more workgroups than fit into X, the rest goes into Y and the
+  // shader has to flatten gl_GlobalInvocationID using gl_NumWorkGroups.x
+  vk::Extent3D linearGroupCount(std::uint32_t invocations) const;
+
+  explicit operator bool() const { return static_cast<bool>(pipeline); }
+
+private:
+  etna::ComputePipeline base;
+  vk::UniquePipeline pipeline;
+  WorkgroupSize workgroupSize;
+};
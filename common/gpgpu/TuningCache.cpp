@@ -0,0 +1,76 @@
+#include "TuningCache.hpp"
+
+#include <fstream>
+#include <sstream>
+
+#include <etna/GlobalContext.hpp>
+#include <spdlog/spdlog.h>
+
+
+static std::string entry_key(std::string_view device, std::string_view kernel)
+{
+  std::string key{device};
+  key += ' ';
+  key += kernel;
+  return key;
+}
+
+std::string TuningCache::currentDeviceKey()
+{
+  const auto properties = etna::get_context().getPhysicalDevice().getProperties();
+  return fmt::format(
+    "{:04x}:{:04x}:{:08x}", properties.vendorID, properties.deviceID, properties.driverVersion);
+}
+
+TuningCache::TuningCache(std::filesystem::path cache_path)
+  : path{std::move(cache_path)}
+  , deviceKey{currentDeviceKey()}
+{
+  std::ifstream in(path);
+  if (!in)
+    return;
+
+  std::string line;
+  for (std::size_t lineIdx = 1; std::getline(in, line); ++lineIdx)
+  {
+    if (line.empty() || line.front() == '#')
+      continue;
+
+    std::string device;
+    std::string kernel;
+    WorkgroupSize size;
+    std::istringstream fields(line);
+    fields >> device >> kernel >> size.x >> size.y >> size.z;
+
+    if (!fields || size.invocations() == 0)
+    {
+      spdlog::warn("Tuning cache '{}': skipping malformed line {}", path.string(), lineIdx);
+      continue;
+    }
+
+    entries[entry_key(device, kernel)] = size;
+  }
+}
+
+std::optional<WorkgroupSize> TuningCache::find(std::string_view kernel) const
+{
+  if (auto it = entries.find(entry_key(deviceKey, kernel)); it != entries.end())
+    return it->second;
+  return std::nullopt;
+}
+
+void TuningCache::store(std::string_view kernel, WorkgroupSize size)
+{
+  entries[entry_key(deviceKey, kernel)] = size;
+
+  std::ofstream out(path);
+  if (!out)
+  {
+    spdlog::error("Unable to write tuning cache '{}'", path.string());
+    return;
+  }
+
+  out << "# vendor:device:driver kernel x y z\n";
+  for (const auto& [key, entry] : entries)
+    out << key << ' ' << entry.x << ' ' << entry.y << ' ' << entry.z << '\n';
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <compare>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+
+
+struct WorkgroupSize
+{
+  std::uint32_t x = 1;
+  std::uint32_t y = 1;
+  std::uint32_t z = 1;
+
+  std::uint32_t invocations() const { return x * y * z; }
+  auto operator<=>(const WorkgroupSize&) const = default;
+};
+
+/**
+ * Best workgroup sizes of compute kernels found by KernelTuner. What's best depends on
+ * the GPU and even the driver version, so entries are keyed by both and a single file
+ * can be shared between machines. Text format, one entry per line:
+ * vendor:device:driver kernel x y z
+ */
+class TuningCache
+{
+public:
+  // Shared by all apps of the repo
+  static constexpr const char* DEFAULT_PATH = GRAPHICS_COURSE_ROOT "/tuning_cache.txt";
+
+  // A missing file is just an empty cache
+  explicit TuningCache(std::filesystem::path cache_path = DEFAULT_PATH);
+
+  // For the current device and driver
+  std::optional<WorkgroupSize> find(std::string_view kernel) const;
+  // Writes the whole cache back right away
+  void store(std::string_view kernel, WorkgroupSize size);
+
+  // Identifies the GPU etna runs on along with its driver
+  static std::string currentDeviceKey();
+
+private:
+  std::filesystem::path path;
+  std::string deviceKey;
+  // Keyed by "device kernel"
+  std::map<std::string, WorkgroupSize, std::less<>> entries;
+};
@@ -0,0 +1,48 @@
+#ifndef PRIMITIVES_H_INCLUDED
+#define PRIMITIVES_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Radix sort ranks a whole workgroup at once and relies on it being exactly one bucket per thread
+#define PRIMITIVES_WORKGROUP_SIZE 256
+
+// Every workgroup of a scan processes a tile of consecutive elements
+#define SCAN_ITEMS_PER_THREAD 4
+#define SCAN_TILE_SIZE (PRIMITIVES_WORKGROUP_SIZE * SCAN_ITEMS_PER_THREAD)
+
+#define SCAN_LOAD_VALUES 0u
+// Scans 1 for every non-zero input and 0 otherwise, used for compaction
+#define SCAN_LOAD_PREDICATE 1u
+
+// Tile status of the decoupled look-back
+#define SCAN_TILE_NOT_READY 0u
+#define SCAN_TILE_AGGREGATE 1u
+#define SCAN_TILE_PREFIX 2u
+
+// Per-tile status words: flag, aggregate and inclusive prefix. The first
+// word of the status buffer is the counter handing out tiles.
+#define SCAN_STATUS_STRIDE 3u
+
+// Enough workgroups to saturate any GPU, the rest is done with a grid-stride loop
+#define REDUCE_MAX_WORKGROUPS 1024u
+
+#define RADIX_BITS 8u
+#define RADIX_BUCKETS 256u
+// Blocks are big so that histograms of all blocks stay small next to the keys
+#define RADIX_TILES_PER_BLOCK 16u
+#define RADIX_BLOCK_SIZE (PRIMITIVES_WORKGROUP_SIZE * RADIX_TILES_PER_BLOCK)
+
+struct PrimitiveParams
+{
+  shader_uint count;
+  // SCAN_LOAD_* for scans, amount of 32-bit words per key for radix sort
+  shader_uint mode;
+  // Of the current radix sort digit, in bits
+  shader_uint shift;
+  // Of radix sort, histograms are stored digit-major for all blocks
+  shader_uint blockCount;
+};
+
+
+#endif // PRIMITIVES_H_INCLUDED
@@ -0,0 +1,11 @@
+#ifndef PRIMITIVES_COMMON_GLSL_INCLUDED
+#define PRIMITIVES_COMMON_GLSL_INCLUDED
+
+// Big dispatches are split into rows of at most 65535 workgroups,
+// workgroups past the end of the last row must exit on their own
+uint workgroup_index()
+{
+  return gl_WorkGroupID.x + gl_WorkGroupID.y * gl_NumWorkGroups.x;
+}
+
+#endif // PRIMITIVES_COMMON_GLSL_INCLUDED
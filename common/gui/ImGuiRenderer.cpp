@@ -1,5 +1,8 @@
 #include "ImGuiRenderer.hpp"
 
+#include <cstring>
+
+#include <imgui_internal.h>
 #include <backends/imgui_impl_vulkan.h>
 #include <backends/imgui_impl_glfw.h>
 #include <etna/GlobalContext.hpp>
@@ -7,6 +10,9 @@
 #include <etna/Profiling.hpp>
 
 
+// The font atlas takes one, the rest are for textures shown with ImGui::Image
+static constexpr std::uint32_t MAX_GUI_TEXTURES = 8;
+
 void ImGuiRenderer::enableImGuiForWindow(GLFWwindow* window)
 {
   ImGui_ImplGlfw_InitForVulkan(window, true);
@@ -32,25 +38,14 @@ PFN_vkVoidFunction vulkan_loader_function(const char* function_name, void*)
 
 void ImGuiRenderer::createDescriptorPool()
 {
-  using Sz = vk::DescriptorPoolSize;
-  using Type = vk::DescriptorType;
-
+  // ImGui's backend only ever allocates sets with a single texture in them
   std::array descrTypes{
-    Sz{Type::eSampler, 1000},
-    Sz{Type::eCombinedImageSampler, 1000},
-    Sz{Type::eSampledImage, 1000},
-    Sz{Type::eStorageImage, 1000},
-    Sz{Type::eUniformTexelBuffer, 1000},
-    Sz{Type::eStorageTexelBuffer, 1000},
-    Sz{Type::eUniformBuffer, 1000},
-    Sz{Type::eStorageBuffer, 1000},
-    Sz{Type::eUniformBufferDynamic, 1000},
-    Sz{Type::eStorageBufferDynamic, 1000},
-    Sz{Type::eInputAttachment, 100}};
+    vk::DescriptorPoolSize{vk::DescriptorType::eCombinedImageSampler, MAX_GUI_TEXTURES},
+  };
 
   vk::DescriptorPoolCreateInfo info{
     .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
-    .maxSets = static_cast<std::uint32_t>(descrTypes.size() * 1000),
+    .maxSets = MAX_GUI_TEXTURES,
     .poolSizeCount = static_cast<std::uint32_t>(descrTypes.size()),
     .pPoolSizes = descrTypes.data(),
   };
@@ -105,23 +100,75 @@ void ImGuiRenderer::initImGui(vk::Format a_target_format)
 
 void ImGuiRenderer::nextFrame()
 {
-  ImGui_ImplVulkan_NewFrame();
+  nextRenderFrame();
+  nextPlatformFrame();
+}
+
+void ImGuiRenderer::nextPlatformFrame()
+{
   ImGui_ImplGlfw_NewFrame();
 }
 
+void ImGuiRenderer::nextRenderFrame()
+{
+  ImGui_ImplVulkan_NewFrame();
+}
+
+bool ImGuiRenderer::hasPendingInput()
+{
+  // Backends only queue events that change something, e.g. the same mouse position is dropped
+  return ImGui::GetCurrentContext()->InputEventsQueue.Size > 0;
+}
+
+bool ImGuiRenderer::drawDataChanged(const ImDrawData* im_draw_data)
+{
+  auto append = [this](const void* data, std::size_t size) {
+    const auto offset = drawDataScratch.size();
+    drawDataScratch.resize(offset + size);
+    std::memcpy(drawDataScratch.data() + offset, data, size);
+  };
+
+  drawDataScratch.clear();
+  append(&im_draw_data->DisplaySize, sizeof(im_draw_data->DisplaySize));
+  for (const ImDrawList* list : im_draw_data->CmdLists)
+  {
+    append(list->VtxBuffer.Data, list->VtxBuffer.size_in_bytes());
+    append(list->IdxBuffer.Data, list->IdxBuffer.size_in_bytes());
+    for (const ImDrawCmd& cmd : list->CmdBuffer)
+    {
+      append(&cmd.ClipRect, sizeof(cmd.ClipRect));
+      append(&cmd.TextureId, sizeof(cmd.TextureId));
+      append(&cmd.VtxOffset, sizeof(cmd.VtxOffset));
+      append(&cmd.IdxOffset, sizeof(cmd.IdxOffset));
+      append(&cmd.ElemCount, sizeof(cmd.ElemCount));
+    }
+  }
+
+  // Copying is way cheaper than recording and rendering the GUI, even for big ones
+  const bool changed = drawDataScratch != drawDataSnapshot;
+  std::swap(drawDataScratch, drawDataSnapshot);
+  return changed;
+}
+
 void ImGuiRenderer::render(
   vk::CommandBuffer cmd_buf,
   vk::Rect2D rect,
   vk::Image image,
   vk::ImageView image_view,
-  ImDrawData* im_draw_data)
+  ImDrawData* im_draw_data,
+  vk::AttachmentLoadOp load_op)
 {
   ETNA_PROFILE_GPU(cmd_buf, renderGui)
 
   etna::RenderTargetState renderTargets(
     cmd_buf,
     rect,
-    {{.image = image, .view = image_view, .loadOp = vk::AttachmentLoadOp::eLoad}},
+    {{
+      .image = image,
+      .view = image_view,
+      .loadOp = load_op,
+      .clearColorValue = std::array{0.0f, 0.0f, 0.0f, 0.0f},
+    }},
     {});
 
   ImGui_ImplVulkan_RenderDrawData(im_draw_data, cmd_buf);
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <vector>
+
 #include <etna/Vulkan.hpp>
 
 
@@ -17,13 +20,27 @@ public:
   explicit ImGuiRenderer(vk::Format target_format);
 
   void nextFrame();
+  // GLFW may only be used on the main thread, so when frames are drawn on another one,
+  // the two halves of nextFrame are called separately
+  static void nextPlatformFrame();
+  void nextRenderFrame();
+
+  // Whether ImGui got any input that it didn't process in a frame yet.
+  // Must be called under the same lock that polling the OS window is done with.
+  static bool hasPendingInput();
 
+  // Compares the draw data with what it was the previous time this was called,
+  // frames that look exactly the same don't need to be rendered again
+  bool drawDataChanged(const ImDrawData* im_draw_data);
+
+  // Clear the target to transparent black to get the GUI premultiplied by alpha
   void render(
     vk::CommandBuffer cmd_buf,
     vk::Rect2D rect,
     vk::Image image,
     vk::ImageView image_view,
-    ImDrawData* im_draw_data);
+    ImDrawData* im_draw_data,
+    vk::AttachmentLoadOp load_op = vk::AttachmentLoadOp::eLoad);
 
   ~ImGuiRenderer();
 
@@ -31,6 +48,9 @@ private:
   vk::UniqueDescriptorPool descriptorPool;
   ImGuiContext* context;
 
+  std::vector<std::byte> drawDataSnapshot;
+  std::vector<std::byte> drawDataScratch;
+
   void initImGui(vk::Format target_format);
   void cleanupImGui();
   void createDescriptorPool();
@@ -0,0 +1,274 @@
+#include "AsyncUploader.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <etna/Assert.hpp>
+#include <etna/GlobalContext.hpp>
+
+#include "MemoryTracker.hpp"
+
+
+// Keeps every staging allocation suitably aligned for copies
+static constexpr vk::DeviceSize STAGING_ALIGNMENT = 16;
+
+AsyncUploader::AsyncUploader(CreateInfo info)
+  : stagingSize{(info.stagingSize + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1)}
+  , batchSize{info.batchSize}
+{
+  auto& ctx = etna::get_context();
+
+  staging = create_tracked_buffer(
+    MemoryCategory::Staging,
+    etna::Buffer::CreateInfo{
+      .size = stagingSize,
+      .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+      .name = info.name,
+    });
+  stagingData = staging.map();
+
+  auto pool = ctx.getDevice().createCommandPoolUnique(vk::CommandPoolCreateInfo{
+    .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+    .queueFamilyIndex = ctx.getQueueFamilyIdx(),
+  });
+  ETNA_CHECK_VK_RESULT(pool.result);
+  commandPool = std::move(pool.value);
+}
+
+AsyncUploader::~AsyncUploader()
+{
+  waitIdle();
+}
+
+AsyncUploader::Batch& AsyncUploader::currentBatch()
+{
+  if (current)
+    return *current;
+
+  if (inFlight.empty())
+  {
+    busySince = std::chrono::steady_clock::now();
+    busyBytes = 0;
+  }
+
+  auto device = etna::get_context().getDevice();
+
+  if (!freeBatches.empty())
+  {
+    current.emplace(std::move(freeBatches.back()));
+    freeBatches.pop_back();
+    ETNA_CHECK_VK_RESULT(device.resetFences({current->fence.get()}));
+  }
+  else
+  {
+    current.emplace();
+
+    auto cmdBufs = device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+      .commandPool = commandPool.get(),
+      .level = vk::CommandBufferLevel::ePrimary,
+      .commandBufferCount = 1,
+    });
+    ETNA_CHECK_VK_RESULT(cmdBufs.result);
+    current->cmdBuf = std::move(cmdBufs.value.front());
+
+    auto fence = device.createFenceUnique(vk::FenceCreateInfo{});
+    ETNA_CHECK_VK_RESULT(fence.result);
+    current->fence = std::move(fence.value);
+  }
+
+  current->id = nextBatch++;
+  current->ringBytes = 0;
+  current->uploadedBytes = 0;
+  current->callbacks.clear();
+
+  ETNA_CHECK_VK_RESULT(current->cmdBuf->begin(vk::CommandBufferBeginInfo{
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+  }));
+
+  return *current;
+}
+
+std::optional<vk::DeviceSize> AsyncUploader::tryAllocate(vk::DeviceSize size)
+{
+  if (used == 0)
+    head = tail = 0;
+
+  // Free space is [head, stagingSize) + [0, tail) or [head, tail)
+  vk::DeviceSize offset;
+  vk::DeviceSize consumed = size;
+  if (head > tail || used == 0)
+  {
+    if (head + size <= stagingSize)
+      offset = head;
+    else if (size <= tail)
+    {
+      offset = 0;
+      consumed += stagingSize - head;
+    }
+    else
+      return std::nullopt;
+  }
+  else if (head + size <= tail)
+    offset = head;
+  else
+    return std::nullopt;
+
+  head = offset + size;
+  used += consumed;
+  currentBatch().ringBytes += consumed;
+  return offset;
+}
+
+vk::DeviceSize AsyncUploader::allocate(vk::DeviceSize size)
+{
+  size = (size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+  ETNA_VERIFY(size <= stagingSize);
+
+  while (true)
+  {
+    if (auto offset = tryAllocate(size))
+      return *offset;
+
+    // The ring is full of data the GPU may still be reading
+    if (current && current->ringBytes > 0)
+      flush();
+    ETNA_VERIFY(!inFlight.empty());
+    retireOldest(true);
+  }
+}
+
+AsyncUploader::BatchId AsyncUploader::uploadBuffer(
+  const etna::Buffer& dst,
+  vk::DeviceSize offset,
+  std::span<const std::byte> data,
+  Callback on_complete)
+{
+  // Several chunks fit into the ring at once, so copying a chunk on the GPU
+  // overlaps with filling the next one on the CPU
+  const vk::DeviceSize maxChunk = stagingSize / 4;
+
+  while (!data.empty())
+  {
+    const vk::DeviceSize chunk = std::min<vk::DeviceSize>(data.size(), maxChunk);
+    const vk::DeviceSize srcOffset = allocate(chunk);
+
+    std::memcpy(stagingData + srcOffset, data.data(), chunk);
+
+    auto& batch = currentBatch();
+    batch.cmdBuf->copyBuffer(
+      staging.get(),
+      dst.get(),
+      {vk::BufferCopy{.srcOffset = srcOffset, .dstOffset = offset, .size = chunk}});
+    batch.uploadedBytes += chunk;
+
+    data = data.subspan(chunk);
+    offset += chunk;
+
+    if (batch.uploadedBytes >= batchSize && !data.empty())
+      flush();
+  }
+
+  auto& batch = currentBatch();
+  if (on_complete)
+    batch.callbacks.push_back(std::move(on_complete));
+  const BatchId id = batch.id;
+
+  if (batch.uploadedBytes >= batchSize)
+    flush();
+
+  return id;
+}
+
+void AsyncUploader::flush(Callback on_complete)
+{
+  if (on_complete)
+  {
+    if (current)
+      current->callbacks.push_back(std::move(on_complete));
+    else if (!inFlight.empty())
+      inFlight.back().callbacks.push_back(std::move(on_complete));
+    else
+      on_complete();
+  }
+
+  if (!current)
+    return;
+
+  auto cmdBuf = current->cmdBuf.get();
+
+  // Later submissions may use the data in any way
+  const vk::MemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+    .dstAccessMask = vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite,
+  };
+  cmdBuf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+
+  ETNA_CHECK_VK_RESULT(etna::get_context().getQueue().submit(
+    {vk::SubmitInfo{
+      .commandBufferCount = 1,
+      .pCommandBuffers = &cmdBuf,
+    }},
+    current->fence.get()));
+
+  busyBytes += current->uploadedBytes;
+  inFlight.push_back(std::move(*current));
+  current.reset();
+}
+
+void AsyncUploader::retireOldest(bool block)
+{
+  auto device = etna::get_context().getDevice();
+  auto& batch = inFlight.front();
+
+  if (block)
+    ETNA_CHECK_VK_RESULT(device.waitForFences({batch.fence.get()}, VK_TRUE, ~std::uint64_t{0}));
+
+  used -= batch.ringBytes;
+  tail = (tail + batch.ringBytes) % stagingSize;
+  lastCompletedBatch = batch.id;
+
+  auto callbacks = std::move(batch.callbacks);
+  freeBatches.push_back(std::move(batch));
+  inFlight.pop_front();
+
+  if (inFlight.empty() && !current)
+    lastBusyPeriod = BusyPeriod{
+      .bytes = busyBytes,
+      .seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - busySince).count(),
+    };
+
+  for (auto& callback : callbacks)
+    callback();
+}
+
+void AsyncUploader::poll()
+{
+  auto device = etna::get_context().getDevice();
+  while (!inFlight.empty() &&
+         device.getFenceStatus(inFlight.front().fence.get()) == vk::Result::eSuccess)
+    retireOldest(false);
+}
+
+void AsyncUploader::wait(BatchId batch)
+{
+  if (current && current->id <= batch)
+    flush();
+
+  while (!inFlight.empty() && inFlight.front().id <= batch)
+    retireOldest(true);
+}
+
+void AsyncUploader::waitIdle()
+{
+  flush();
+  while (!inFlight.empty())
+    retireOldest(true);
+}
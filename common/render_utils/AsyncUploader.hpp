@@ -0,0 +1,126 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+
+
+/**
+ * Uploads data to GPU buffers through a ring of persistently mapped staging memory.
+ * Many small uploads are batched into a single submission, and the CPU only waits
+ * when the ring is full of data the GPU hasn't copied yet, so big uploads are
+ * limited by bandwidth rather than by a round trip per staging buffer worth of data.
+ *
+ * Every batch ends with a barrier, so uploaded data is visible to everything
+ * submitted to the queue afterwards, no waiting is needed before using it.
+ */
+class AsyncUploader
+{
+public:
+  struct CreateInfo
+  {
+    vk::DeviceSize stagingSize = 64 * 1024 * 1024;
+    // A batch is submitted once it has this much data, so that the GPU
+    // starts copying while the CPU is still filling the ring
+    vk::DeviceSize batchSize = 8 * 1024 * 1024;
+    std::string_view name = "upload_ring";
+  };
+
+  using BatchId = std::uint64_t;
+  using Callback = std::function<void()>;
+
+  explicit AsyncUploader(CreateInfo info);
+  // Waits for all uploads to finish
+  ~AsyncUploader();
+
+  // The data is copied right away, so it may be freed after the call. Returns the batch
+  // containing the end of the upload. The callback runs once that batch is complete.
+  BatchId uploadBuffer(
+    const etna::Buffer& dst,
+    vk::DeviceSize offset,
+    std::span<const std::byte> data,
+    Callback on_complete = {});
+
+  template <class T>
+  BatchId uploadBuffer(
+    const etna::Buffer& dst,
+    vk::DeviceSize offset,
+    std::span<const T> data,
+    Callback on_complete = {})
+  {
+    return uploadBuffer(dst, offset, std::as_bytes(data), std::move(on_complete));
+  }
+
+  // Submits the current batch, uploads are not started before this or a wait.
+  // The callback runs once everything uploaded so far is complete.
+  void flush(Callback on_complete = {});
+  // Recycles staging memory of finished batches and runs their callbacks, never blocks
+  void poll();
+  bool isComplete(BatchId batch) const { return batch <= lastCompletedBatch; }
+  void wait(BatchId batch);
+  void waitIdle();
+
+  // From the first upload after being idle to noticing that the last one finished
+  struct BusyPeriod
+  {
+    std::uint64_t bytes = 0;
+    double seconds = 0;
+
+    double gigabytesPerSecond() const
+    {
+      return seconds > 0 ? 1e-9 * static_cast<double>(bytes) / seconds : 0;
+    }
+  };
+  const BusyPeriod& getLastBusyPeriod() const { return lastBusyPeriod; }
+
+private:
+  struct Batch
+  {
+    BatchId id = 0;
+    vk::UniqueCommandBuffer cmdBuf;
+    vk::UniqueFence fence;
+    // Includes space wasted when wrapping around
+    vk::DeviceSize ringBytes = 0;
+    std::uint64_t uploadedBytes = 0;
+    std::vector<Callback> callbacks;
+  };
+
+  Batch& currentBatch();
+  std::optional<vk::DeviceSize> tryAllocate(vk::DeviceSize size);
+  vk::DeviceSize allocate(vk::DeviceSize size);
+  void retireOldest(bool block);
+
+private:
+  vk::DeviceSize stagingSize;
+  vk::DeviceSize batchSize;
+
+  etna::Buffer staging;
+  std::byte* stagingData = nullptr;
+
+  // Ring state: allocations happen at head, finished batches free space at tail
+  vk::DeviceSize head = 0;
+  vk::DeviceSize tail = 0;
+  vk::DeviceSize used = 0;
+
+  vk::UniqueCommandPool commandPool;
+  std::optional<Batch> current;
+  std::deque<Batch> inFlight;
+  std::vector<Batch> freeBatches;
+
+  BatchId nextBatch = 1;
+  BatchId lastCompletedBatch = 0;
+
+  std::chrono::steady_clock::time_point busySince;
+  std::uint64_t busyBytes = 0;
+  BusyPeriod lastBusyPeriod;
+
+  AsyncUploader(const AsyncUploader&) = delete;
+  AsyncUploader& operator=(const AsyncUploader&) = delete;
+};
@@ -0,0 +1,267 @@
+#include "DrawList.hpp"
+
+#include <algorithm>
+#include <array>
+#include <barrier>
+#include <bit>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <numeric>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+#include <etna/Assert.hpp>
+
+
+// 8 bit digits keep histograms in L1 and still need only 8 passes over 64 bit keys
+static constexpr std::uint32_t DIGIT_BITS = 8;
+static constexpr std::uint32_t BUCKET_COUNT = 1u << DIGIT_BITS;
+static constexpr std::uint32_t DIGIT_COUNT = 64 / DIGIT_BITS;
+
+using Histogram = std::array<std::uint32_t, BUCKET_COUNT>;
+
+static std::uint32_t digit_of(std::uint64_t key, std::uint32_t digit)
+{
+  return static_cast<std::uint32_t>(key >> (digit * DIGIT_BITS)) & (BUCKET_COUNT - 1);
+}
+
+// Threads kept waiting between sorts, starting a thread costs about as much
+// as sorting several thousand keys
+class DrawList::Workers
+{
+public:
+  ~Workers()
+  {
+    // Stopping wakes the waiting threads up
+    threads.clear();
+  }
+
+  // Runs the job on the calling thread as thread 0 and on workers as the others
+  void run(std::uint32_t thread_count, const std::function<void(std::uint32_t)>& job)
+  {
+    {
+      std::unique_lock lock{mutex};
+      while (threads.size() + 1 < thread_count)
+      {
+        const auto thread = static_cast<std::uint32_t>(threads.size() + 1);
+        threads.emplace_back(
+          [this, thread, seen = generation](std::stop_token stop) { work(stop, thread, seen); });
+      }
+
+      currentJob = &job;
+      jobThreadCount = thread_count;
+      running = thread_count - 1;
+      ++generation;
+    }
+    wake.notify_all();
+
+    job(0);
+
+    std::unique_lock lock{mutex};
+    finished.wait(lock, [this] { return running == 0; });
+    currentJob = nullptr;
+  }
+
+private:
+  void work(std::stop_token stop, std::uint32_t thread, std::uint64_t seen)
+  {
+    std::unique_lock lock{mutex};
+    while (wake.wait(lock, stop, [&] { return generation != seen; }))
+    {
+      seen = generation;
+      if (thread >= jobThreadCount)
+        continue;
+
+      // The job can't change until every thread of it is done
+      const auto& job = *currentJob;
+      lock.unlock();
+      job(thread);
+      lock.lock();
+
+      if (--running == 0)
+        finished.notify_one();
+    }
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable_any wake;
+  std::condition_variable finished;
+
+  const std::function<void(std::uint32_t)>* currentJob = nullptr;
+  std::uint32_t jobThreadCount = 0;
+  std::uint32_t running = 0;
+  std::uint64_t generation = 0;
+
+  // Last, so that threads are stopped before anything they use is destroyed
+  std::vector<std::jthread> threads;
+};
+
+DrawList::DrawList() = default;
+
+DrawList::~DrawList() = default;
+
+std::uint64_t DrawList::makeKey(
+  std::uint32_t pass,
+  std::uint32_t pipeline,
+  std::uint32_t material,
+  std::uint32_t mesh,
+  float depth)
+{
+  ETNA_VERIFY(pass < (1u << PASS_BITS));
+  ETNA_VERIFY(pipeline < (1u << PIPELINE_BITS));
+  ETNA_VERIFY(material < (1u << MATERIAL_BITS));
+  ETNA_VERIFY(mesh < (1u << MESH_BITS));
+
+  // Bits of non-negative floats are ordered just like the floats themselves,
+  // so the most significant ones are a coarse but monotonic depth
+  const auto depthBits =
+    std::bit_cast<std::uint32_t>(std::max(depth, 0.0f)) >> (31 - DEPTH_BITS);
+
+  return (std::uint64_t{pass} << PASS_SHIFT) | (std::uint64_t{pipeline} << PIPELINE_SHIFT) |
+    (std::uint64_t{material} << MATERIAL_SHIFT) | (std::uint64_t{mesh} << MESH_SHIFT) |
+    (std::uint64_t{depthBits} << DEPTH_SHIFT);
+}
+
+void DrawList::clear()
+{
+  draws.clear();
+  keys.clear();
+  order.clear();
+}
+
+void DrawList::reserve(std::size_t count)
+{
+  draws.reserve(count);
+  keys.reserve(count);
+}
+
+void DrawList::add(std::uint64_t key, Draw draw)
+{
+  keys.push_back(key);
+  draws.push_back(draw);
+}
+
+void DrawList::sort(std::uint32_t max_threads)
+{
+  const std::size_t n = keys.size();
+
+  order.resize(n);
+  std::iota(order.begin(), order.end(), 0u);
+  tmpKeys.resize(n);
+  tmpOrder.resize(n);
+  if (n == 0)
+    return;
+
+  std::uint32_t threadCount = max_threads != 0 ? max_threads : std::thread::hardware_concurrency();
+  // Every thread should get enough keys to be worth starting it
+  threadCount = std::min<std::uint32_t>(
+    threadCount, static_cast<std::uint32_t>(n / (PARALLEL_THRESHOLD / 4)));
+
+  if (n < PARALLEL_THRESHOLD || threadCount <= 1)
+    sortSingleThreaded();
+  else
+    sortParallel(threadCount);
+}
+
+void DrawList::sortSingleThreaded()
+{
+  const std::size_t n = keys.size();
+
+  // Histograms of all digits are gathered in a single pass over the keys
+  std::array<Histogram, DIGIT_COUNT> histograms{};
+  for (std::uint64_t key : keys)
+    for (std::uint32_t digit = 0; digit < DIGIT_COUNT; ++digit)
+      ++histograms[digit][digit_of(key, digit)];
+
+  for (std::uint32_t digit = 0; digit < DIGIT_COUNT; ++digit)
+  {
+    auto& histogram = histograms[digit];
+
+    // Unused key fields are the same in every key, there is nothing to sort by
+    if (histogram[digit_of(keys[0], digit)] == n)
+      continue;
+
+    std::uint32_t offset = 0;
+    for (auto& count : histogram)
+      offset += std::exchange(count, offset);
+
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      const std::uint32_t pos = histogram[digit_of(keys[i], digit)]++;
+      tmpKeys[pos] = keys[i];
+      tmpOrder[pos] = order[i];
+    }
+
+    keys.swap(tmpKeys);
+    order.swap(tmpOrder);
+  }
+}
+
+void DrawList::sortParallel(std::uint32_t thread_count)
+{
+  const std::size_t n = keys.size();
+
+  // Every thread scatters its own part of the keys right after the parts of
+  // previous threads within every bucket, so the sort stays stable
+  std::vector<Histogram> offsets(thread_count);
+  std::uint32_t digit = 0;
+  bool scattering = false;
+  bool skipDigit = false;
+
+  // Runs on one of the threads once all of them finish a phase
+  auto onPhaseDone = [&]() noexcept {
+    if (!scattering)
+    {
+      std::uint32_t offset = 0;
+      skipDigit = false;
+      for (std::uint32_t bucket = 0; bucket < BUCKET_COUNT; ++bucket)
+      {
+        const std::uint32_t bucketStart = offset;
+        for (auto& threadOffsets : offsets)
+          offset += std::exchange(threadOffsets[bucket], offset);
+        skipDigit = skipDigit || offset - bucketStart == n;
+      }
+    }
+    else
+    {
+      if (!skipDigit)
+      {
+        keys.swap(tmpKeys);
+        order.swap(tmpOrder);
+      }
+      ++digit;
+    }
+    scattering = !scattering;
+  };
+  std::barrier sync(static_cast<std::ptrdiff_t>(thread_count), onPhaseDone);
+
+  const std::function<void(std::uint32_t)> work = [&](std::uint32_t thread) {
+    const std::size_t begin = n * thread / thread_count;
+    const std::size_t end = n * (thread + 1) / thread_count;
+    auto& threadOffsets = offsets[thread];
+
+    while (digit < DIGIT_COUNT)
+    {
+      threadOffsets.fill(0);
+      for (std::size_t i = begin; i < end; ++i)
+        ++threadOffsets[digit_of(keys[i], digit)];
+      sync.arrive_and_wait();
+
+      if (!skipDigit)
+        for (std::size_t i = begin; i < end; ++i)
+        {
+          const std::uint32_t pos = threadOffsets[digit_of(keys[i], digit)]++;
+          tmpKeys[pos] = keys[i];
+          tmpOrder[pos] = order[i];
+        }
+      sync.arrive_and_wait();
+    }
+  };
+
+  if (!workers)
+    workers = std::make_unique<Workers>();
+  workers->run(thread_count, work);
+}
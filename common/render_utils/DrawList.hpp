@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+
+/**
+ * A list of draws sorted by 64-bit keys, so that draws sharing state end up next
+ * to each other. From the most significant bits, a key consists of the pass, the
+ * pipeline, the material, the mesh and finally the depth, so state changes happen
+ * as rarely as possible and draws with the same state go front to back.
+ *
+ * Sorting is a radix sort, which is done on several threads for big lists.
+ * The threads are started by the first such sort and reused by later ones.
+ */
+class DrawList
+{
+public:
+  static constexpr std::uint32_t PASS_BITS = 4;
+  static constexpr std::uint32_t PIPELINE_BITS = 8;
+  static constexpr std::uint32_t MATERIAL_BITS = 12;
+  static constexpr std::uint32_t MESH_BITS = 16;
+  static constexpr std::uint32_t DEPTH_BITS = 24;
+  static_assert(PASS_BITS + PIPELINE_BITS + MATERIAL_BITS + MESH_BITS + DEPTH_BITS == 64);
+
+  // Lists shorter than this are sorted on the calling thread
+  static constexpr std::size_t PARALLEL_THRESHOLD = 64 * 1024;
+
+  struct Draw
+  {
+    std::uint32_t instance;
+    std::uint32_t relem;
+  };
+
+  // Depth is any non-negative distance, e.g. from the camera
+  static std::uint64_t makeKey(
+    std::uint32_t pass,
+    std::uint32_t pipeline,
+    std::uint32_t material,
+    std::uint32_t mesh,
+    float depth);
+
+  static std::uint32_t getPass(std::uint64_t key) { return field(key, PASS_SHIFT, PASS_BITS); }
+  static std::uint32_t getPipeline(std::uint64_t key)
+  {
+    return field(key, PIPELINE_SHIFT, PIPELINE_BITS);
+  }
+  static std::uint32_t getMaterial(std::uint64_t key)
+  {
+    return field(key, MATERIAL_SHIFT, MATERIAL_BITS);
+  }
+  static std::uint32_t getMesh(std::uint64_t key) { return field(key, MESH_SHIFT, MESH_BITS); }
+
+  DrawList();
+  ~DrawList();
+
+  void clear();
+  void reserve(std::size_t count);
+  void add(std::uint64_t key, Draw draw);
+
+  // 0 means as many threads as the hardware has
+  void sort(std::uint32_t max_threads = 0);
+
+  std::size_t size() const { return keys.size(); }
+  bool empty() const { return keys.empty(); }
+
+  // Valid after sort, in the sorted order
+  std::span<const std::uint64_t> getKeys() const { return keys; }
+  Draw getDraw(std::size_t i) const { return draws[order[i]]; }
+
+private:
+  static constexpr std::uint32_t DEPTH_SHIFT = 0;
+  static constexpr std::uint32_t MESH_SHIFT = DEPTH_SHIFT + DEPTH_BITS;
+  static constexpr std::uint32_t MATERIAL_SHIFT = MESH_SHIFT + MESH_BITS;
+  static constexpr std::uint32_t PIPELINE_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+  static constexpr std::uint32_t PASS_SHIFT = PIPELINE_SHIFT + PIPELINE_BITS;
+
+  static std::uint32_t field(std::uint64_t key, std::uint32_t shift, std::uint32_t bits)
+  {
+    return static_cast<std::uint32_t>((key >> shift) & ((std::uint64_t{1} << bits) - 1));
+  }
+
+  void sortSingleThreaded();
+  void sortParallel(std::uint32_t thread_count);
+
+  class Workers;
+
+private:
+  std::vector<Draw> draws;
+  // Sorted together, draws themselves are never moved
+  std::vector<std::uint64_t> keys;
+  std::vector<std::uint32_t> order;
+
+  std::vector<std::uint64_t> tmpKeys;
+  std::vector<std::uint32_t> tmpOrder;
+
+  std::unique_ptr<Workers> workers;
+};
@@ -0,0 +1,123 @@
+#include "GpuTimer.hpp"
+
+#include <etna/Assert.hpp>
+#include <etna/GlobalContext.hpp>
+
+
+GpuTimer::GpuTimer(std::uint32_t max_zones)
+  : maxZones{max_zones}
+{
+  auto& ctx = etna::get_context();
+
+  const auto limits = ctx.getPhysicalDevice().getProperties().limits;
+  // Without this, timestamps may not be written on the graphics queue
+  if (!limits.timestampComputeAndGraphics)
+    return;
+  nsPerTick = static_cast<double>(limits.timestampPeriod);
+
+  const auto framesInFlight =
+    static_cast<std::uint32_t>(ctx.getMainWorkCount().multiBufferingCount());
+
+  auto queryPool = ctx.getDevice().createQueryPoolUnique(vk::QueryPoolCreateInfo{
+    .queryType = vk::QueryType::eTimestamp,
+    .queryCount = 2 * maxZones * framesInFlight,
+  });
+  ETNA_CHECK_VK_RESULT(queryPool.result);
+  pool = std::move(queryPool.value);
+
+  frames.emplace(ctx.getMainWorkCount(), [this](std::size_t i) {
+    return FrameQueries{.firstQuery = static_cast<std::uint32_t>(2 * maxZones * i)};
+  });
+
+  timestamps.resize(2 * maxZones);
+}
+
+void GpuTimer::beginFrame(vk::CommandBuffer cmd_buf)
+{
+  if (!pool)
+    return;
+
+  auto& frame = frames->get();
+
+  if (frame.submitted && !frame.zoneNames.empty())
+  {
+    const auto queryCount = static_cast<std::uint32_t>(2 * frame.zoneNames.size());
+    // The frame that used these queries has already been waited for,
+    // so this doesn't block. Keep the old results if something went wrong.
+    const auto result = etna::get_context().getDevice().getQueryPoolResults(
+      pool.get(),
+      frame.firstQuery,
+      queryCount,
+      queryCount * sizeof(std::uint64_t),
+      timestamps.data(),
+      sizeof(std::uint64_t),
+      vk::QueryResultFlagBits::e64);
+
+    if (result == vk::Result::eSuccess)
+    {
+      lastResults.clear();
+      for (std::size_t i = 0; i < frame.zoneNames.size(); ++i)
+      {
+        const auto ticks = timestamps[2 * i + 1] - timestamps[2 * i];
+        const double ms = static_cast<double>(ticks) * nsPerTick * 1e-6;
+
+        // Zones that show up for the first time start from their current value
+        auto [it, inserted] = smoothed.try_emplace(frame.zoneNames[i], ms);
+        if (!inserted)
+          it->second += static_cast<double>(smoothingFactor) * (ms - it->second);
+
+        lastResults.push_back(ZoneTiming{
+          .name = std::move(frame.zoneNames[i]),
+          .milliseconds = ms,
+          .smoothedMilliseconds = it->second,
+          .depth = frame.zoneDepths[i],
+        });
+      }
+    }
+  }
+
+  cmd_buf.resetQueryPool(pool.get(), frame.firstQuery, 2 * maxZones);
+  frame.zoneNames.clear();
+  frame.zoneDepths.clear();
+  frame.openZones = 0;
+  frame.submitted = true;
+}
+
+std::uint32_t GpuTimer::beginZone(vk::CommandBuffer cmd_buf, std::string_view name)
+{
+  if (!pool)
+    return NO_ZONE;
+
+  auto& frame = frames->get();
+  if (frame.zoneNames.size() == maxZones)
+    return NO_ZONE;
+
+  const auto zone = static_cast<std::uint32_t>(frame.zoneNames.size());
+  frame.zoneNames.emplace_back(name);
+  frame.zoneDepths.push_back(frame.openZones++);
+
+  cmd_buf.writeTimestamp2(
+    vk::PipelineStageFlagBits2::eAllCommands, pool.get(), frame.firstQuery + 2 * zone);
+
+  return zone;
+}
+
+void GpuTimer::endZone(vk::CommandBuffer cmd_buf, std::uint32_t zone)
+{
+  if (zone == NO_ZONE)
+    return;
+
+  auto& frame = frames->get();
+  frame.openZones -= 1;
+
+  cmd_buf.writeTimestamp2(
+    vk::PipelineStageFlagBits2::eAllCommands, pool.get(), frame.firstQuery + 2 * zone + 1);
+}
+
+std::optional<double> GpuTimer::getSmoothedMilliseconds(std::string_view name) const
+{
+  for (const auto& zone : lastResults)
+    if (zone.name == name)
+      return zone.smoothedMilliseconds;
+  return std::nullopt;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/GpuSharedResource.hpp>
+
+
+/**
+ * Measures GPU time of named zones with timestamp queries. Every frame in flight
+ * has its own range of queries, and results are read back when the range is
+ * reused, so reading never stalls, but timings lag behind by the amount of
+ * frames in flight. Unlike ETNA_PROFILE_GPU, this works without a profiler attached.
+ */
+class GpuTimer
+{
+public:
+  struct ZoneTiming
+  {
+    std::string name;
+    // Of the frame the results came from
+    double milliseconds;
+    // Exponential moving average over frames, much easier to read in a GUI
+    double smoothedMilliseconds;
+    // Amount of zones this one is nested in
+    std::uint32_t depth;
+  };
+
+  explicit GpuTimer(std::uint32_t max_zones = 32);
+
+  // Collects results of the frame that previously used this frame's queries and resets
+  // them. Must be recorded outside of rendering and before any zones of the frame.
+  void beginFrame(vk::CommandBuffer cmd_buf);
+
+  // Zones past `max_zones` are silently not measured
+  std::uint32_t beginZone(vk::CommandBuffer cmd_buf, std::string_view name);
+  void endZone(vk::CommandBuffer cmd_buf, std::uint32_t zone);
+
+  // In the order zones were begun, empty if timestamps are not supported
+  std::span<const ZoneTiming> getResults() const { return lastResults; }
+  // Smoothed time of a zone from the last results, nullopt if it wasn't recorded
+  std::optional<double> getSmoothedMilliseconds(std::string_view name) const;
+
+  // Weight of the newest frame in smoothed timings
+  float smoothingFactor = 0.05f;
+
+  class Scope
+  {
+  public:
+    Scope(GpuTimer& timer, vk::CommandBuffer cmd_buf, std::string_view name)
+      : timer{timer}
+      , cmdBuf{cmd_buf}
+      , zone{timer.beginZone(cmd_buf, name)}
+    {
+    }
+    ~Scope() { timer.endZone(cmdBuf, zone); }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    GpuTimer& timer;
+    vk::CommandBuffer cmdBuf;
+    std::uint32_t zone;
+  };
+
+private:
+  static constexpr std::uint32_t NO_ZONE = ~std::uint32_t{0};
+
+  struct FrameQueries
+  {
+    std::uint32_t firstQuery;
+    std::vector<std::string> zoneNames;
+    std::vector<std::uint32_t> zoneDepths;
+    std::uint32_t openZones = 0;
+    // Queries that were never written can't be read
+    bool submitted = false;
+  };
+
+  std::uint32_t maxZones;
+  double nsPerTick = 0;
+  vk::UniqueQueryPool pool;
+
+  std::optional<etna::GpuSharedResource<FrameQueries>> frames;
+
+  std::vector<std::uint64_t> timestamps;
+  std::vector<ZoneTiming> lastResults;
+  std::unordered_map<std::string, double> smoothed;
+
+  GpuTimer(const GpuTimer&) = delete;
+  GpuTimer& operator=(const GpuTimer&) = delete;
+};
@@ -0,0 +1,165 @@
+#include "MemoryTracker.hpp"
+
+#include <fstream>
+
+#include <etna/GlobalContext.hpp>
+#include <spdlog/spdlog.h>
+#include <vk_mem_alloc.h>
+
+
+const char* memory_category_name(MemoryCategory category)
+{
+  switch (category)
+  {
+  case MemoryCategory::Geometry:
+    return "geometry";
+  case MemoryCategory::Textures:
+    return "textures";
+  case MemoryCategory::RenderTargets:
+    return "render_targets";
+  case MemoryCategory::Staging:
+    return "staging";
+  case MemoryCategory::Uniforms:
+    return "uniforms";
+  case MemoryCategory::Transforms:
+    return "transforms";
+  case MemoryCategory::Other:
+    return "other";
+  }
+  return "unknown";
+}
+
+void MemoryTracker::track(MemoryCategory category, std::string_view name, vk::DeviceSize bytes)
+{
+  auto it = resources.find(name);
+  if (it == resources.end())
+    resources.emplace(std::string{name}, Resource{category, bytes});
+  else
+    it->second = Resource{category, bytes};
+}
+
+void MemoryTracker::untrack(std::string_view name)
+{
+  if (auto it = resources.find(name); it != resources.end())
+    resources.erase(it);
+}
+
+void MemoryTracker::untrackPrefix(std::string_view prefix)
+{
+  untrack(prefix);
+
+  // Names of the copies are all sorted right after the prefix with the separator
+  const auto group = fmt::format("{}/", prefix);
+  auto it = resources.lower_bound(group);
+  while (it != resources.end() && it->first.starts_with(group))
+    it = resources.erase(it);
+}
+
+std::array<vk::DeviceSize, MEMORY_CATEGORY_COUNT> MemoryTracker::getCategoryTotals() const
+{
+  std::array<vk::DeviceSize, MEMORY_CATEGORY_COUNT> result{};
+  for (const auto& [name, res] : resources)
+    result[static_cast<std::size_t>(res.category)] += res.bytes;
+  return result;
+}
+
+std::vector<MemoryTracker::HeapBudget> MemoryTracker::queryHeapBudgets()
+{
+  VmaAllocator allocator = etna::get_context().getVmaAllocator();
+
+  const VkPhysicalDeviceMemoryProperties* memProps = nullptr;
+  vmaGetMemoryProperties(allocator, &memProps);
+
+  std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+  vmaGetHeapBudgets(allocator, budgets.data());
+
+  std::vector<HeapBudget> result;
+  result.reserve(memProps->memoryHeapCount);
+  for (std::uint32_t i = 0; i < memProps->memoryHeapCount; ++i)
+    result.push_back(HeapBudget{
+      .deviceLocal = (memProps->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0,
+      .usage = budgets[i].usage,
+      .budget = budgets[i].budget,
+      .blockBytes = budgets[i].statistics.blockBytes,
+      .allocationBytes = budgets[i].statistics.allocationBytes,
+      .allocationCount = budgets[i].statistics.allocationCount,
+    });
+
+  return result;
+}
+
+bool MemoryTracker::writeJson(const std::filesystem::path& path) const
+{
+  std::ofstream out(path);
+  if (!out)
+  {
+    spdlog::error("Unable to write memory report '{}'", path.string());
+    return false;
+  }
+
+  const auto totals = getCategoryTotals();
+  out << "{\n  \"categories\": {";
+  for (std::size_t i = 0; i < MEMORY_CATEGORY_COUNT; ++i)
+    out << fmt::format(
+      "{}\n    \"{}\": {}",
+      i == 0 ? "" : ",",
+      memory_category_name(static_cast<MemoryCategory>(i)),
+      totals[i]);
+
+  // Resource names are debug names we set ourselves, so nothing needs escaping
+  out << "\n  },\n  \"resources\": [";
+  bool first = true;
+  for (const auto& [name, res] : resources)
+  {
+    out << fmt::format(
+      "{}\n    {{\"name\": \"{}\", \"category\": \"{}\", \"bytes\": {}}}",
+      first ? "" : ",",
+      name,
+      memory_category_name(res.category),
+      res.bytes);
+    first = false;
+  }
+
+  out << "\n  ],\n  \"heaps\": [";
+  const auto heaps = queryHeapBudgets();
+  for (std::size_t i = 0; i < heaps.size(); ++i)
+    out << fmt::format(
+      "{}\n    {{\"device_local\": {}, \"usage\": {}, \"budget\": {}, \"block_bytes\": {}, "
+      "\"allocation_bytes\": {}, \"allocation_count\": {}}}",
+      i == 0 ? "" : ",",
+      heaps[i].deviceLocal,
+      heaps[i].usage,
+      heaps[i].budget,
+      heaps[i].blockBytes,
+      heaps[i].allocationBytes,
+      heaps[i].allocationCount);
+  out << "\n  ]\n}\n";
+
+  return static_cast<bool>(out);
+}
+
+MemoryTracker& get_memory_tracker()
+{
+  static MemoryTracker tracker;
+  return tracker;
+}
+
+// Etna doesn't expose VMA allocations of its resources, but VMA allocates exactly
+// what the memory requirements ask for, alignment and padding included
+etna::Buffer create_tracked_buffer(MemoryCategory category, etna::Buffer::CreateInfo info)
+{
+  auto& ctx = etna::get_context();
+  auto buffer = ctx.createBuffer(info);
+  get_memory_tracker().track(
+    category, info.name, ctx.getDevice().getBufferMemoryRequirements(buffer.get()).size);
+  return buffer;
+}
+
+etna::Image create_tracked_image(MemoryCategory category, etna::Image::CreateInfo info)
+{
+  auto& ctx = etna::get_context();
+  auto image = ctx.createImage(info);
+  get_memory_tracker().track(
+    category, info.name, ctx.getDevice().getImageMemoryRequirements(image.get()).size);
+  return image;
+}
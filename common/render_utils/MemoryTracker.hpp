@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/Image.hpp>
+
+
+enum class MemoryCategory
+{
+  Geometry,
+  Textures,
+  RenderTargets,
+  Staging,
+  Uniforms,
+  // Per-instance and per-joint matrices in storage buffers
+  Transforms,
+  Other,
+};
+
+inline constexpr std::size_t MEMORY_CATEGORY_COUNT = 7;
+
+const char* memory_category_name(MemoryCategory category);
+
+/**
+ * Accounts for GPU resources by category and reports VMA's view of the memory
+ * heaps, so that we know how much headroom is left. Resources are identified
+ * by their debug names, re-tracking a name replaces the previous size.
+ * Sizes are those of the allocations, including alignment and padding.
+ */
+class MemoryTracker
+{
+public:
+  struct Resource
+  {
+    MemoryCategory category;
+    vk::DeviceSize bytes;
+  };
+
+  struct HeapBudget
+  {
+    bool deviceLocal;
+    // Everything allocated from this heap by the process, according to the driver
+    vk::DeviceSize usage;
+    vk::DeviceSize budget;
+    // VMA's own memory blocks and the part of them occupied by allocations
+    vk::DeviceSize blockBytes;
+    vk::DeviceSize allocationBytes;
+    std::uint32_t allocationCount;
+  };
+
+  void track(MemoryCategory category, std::string_view name, vk::DeviceSize bytes);
+  void untrack(std::string_view name);
+  // Untracks the resource with this name along with its per-frame copies, which are
+  // named after it with a separator, e.g. "culled_indices/0" and "culled_indices/1"
+  void untrackPrefix(std::string_view prefix);
+
+  const std::map<std::string, Resource, std::less<>>& getResources() const { return resources; }
+  std::array<vk::DeviceSize, MEMORY_CATEGORY_COUNT> getCategoryTotals() const;
+
+  // Requires an initialized etna context
+  static std::vector<HeapBudget> queryHeapBudgets();
+
+  bool writeJson(const std::filesystem::path& path) const;
+
+private:
+  std::map<std::string, Resource, std::less<>> resources;
+};
+
+MemoryTracker& get_memory_tracker();
+
+// Create a resource and track it under its name
+etna::Buffer create_tracked_buffer(MemoryCategory category, etna::Buffer::CreateInfo info);
+etna::Image create_tracked_image(MemoryCategory category, etna::Image::CreateInfo info);
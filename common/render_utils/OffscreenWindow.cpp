@@ -0,0 +1,72 @@
+#include "OffscreenWindow.hpp"
+
+#include <fmt/format.h>
+#include <etna/Assert.hpp>
+#include <etna/GlobalContext.hpp>
+
+#include "MemoryTracker.hpp"
+
+
+OffscreenWindow::OffscreenWindow(CreateInfo info)
+  : resolution{info.resolution}
+  , format{info.format}
+{
+  auto& ctx = etna::get_context();
+
+  images.reserve(info.imageCount);
+  availableSems.reserve(info.imageCount);
+  for (std::uint32_t i = 0; i < info.imageCount; ++i)
+  {
+    images.push_back(create_tracked_image(MemoryCategory::RenderTargets, etna::Image::CreateInfo{
+      .extent = vk::Extent3D{resolution.x, resolution.y, 1},
+      .name = fmt::format("offscreen_frame{}", i),
+      .format = format,
+      .imageUsage =
+        vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+    }));
+
+    auto sem = ctx.getDevice().createSemaphoreUnique(vk::SemaphoreCreateInfo{});
+    ETNA_CHECK_VK_RESULT(sem.result);
+    availableSems.push_back(std::move(sem.value));
+  }
+
+  // So that the first acquire lands on the first image
+  current = info.imageCount - 1;
+}
+
+std::optional<etna::Window::SwapchainImage> OffscreenWindow::acquireNext()
+{
+  current = (current + 1) % static_cast<std::uint32_t>(images.size());
+
+  // Images are reused only after as many frames as there are images, and by then the
+  // per-frame command manager has already waited for the frame that used it.
+  // Still, the frame's submit waits for this semaphore, so it has to be signalled.
+  const vk::Semaphore available = availableSems[current].get();
+  ETNA_CHECK_VK_RESULT(etna::get_context().getQueue().submit(
+    {vk::SubmitInfo{
+      .signalSemaphoreCount = 1,
+      .pSignalSemaphores = &available,
+    }},
+    nullptr));
+
+  return etna::Window::SwapchainImage{
+    .image = images[current].get(),
+    .view = images[current].getView({}),
+    .available = available,
+  };
+}
+
+bool OffscreenWindow::present(vk::Semaphore wait, vk::ImageView /*which*/)
+{
+  // Binary semaphores have to be waited on before being signalled again
+  const vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+  ETNA_CHECK_VK_RESULT(etna::get_context().getQueue().submit(
+    {vk::SubmitInfo{
+      .waitSemaphoreCount = 1,
+      .pWaitSemaphores = &wait,
+      .pWaitDstStageMask = &waitStage,
+    }},
+    nullptr));
+
+  return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Image.hpp>
+#include <etna/Window.hpp>
+#include <glm/glm.hpp>
+
+
+/**
+ * Stand-in for etna::Window for machines without a display. Frames are rendered
+ * into a ring of offscreen images instead of swapchain images, while acquiring
+ * and presenting keep the semaphore protocol of a real window, so the frame
+ * delivery code stays the same. Works on software implementations like lavapipe.
+ */
+class OffscreenWindow
+{
+public:
+  struct CreateInfo
+  {
+    glm::uvec2 resolution = {};
+    vk::Format format = vk::Format::eB8G8R8A8Srgb;
+    // Must not be less than the amount of frames in flight
+    std::uint32_t imageCount = 3;
+  };
+
+  // Presented images are expected to be transitioned into this layout
+  static constexpr vk::ImageLayout PRESENT_LAYOUT = vk::ImageLayout::eTransferSrcOptimal;
+
+  explicit OffscreenWindow(CreateInfo info);
+
+  std::optional<etna::Window::SwapchainImage> acquireNext();
+  bool present(vk::Semaphore wait, vk::ImageView which);
+
+  vk::Format getCurrentFormat() const { return format; }
+  glm::uvec2 getResolution() const { return resolution; }
+
+private:
+  glm::uvec2 resolution;
+  vk::Format format;
+
+  std::vector<etna::Image> images;
+  std::vector<vk::UniqueSemaphore> availableSems;
+  std::uint32_t current = 0;
+
+  OffscreenWindow(const OffscreenWindow&) = delete;
+  OffscreenWindow& operator=(const OffscreenWindow&) = delete;
+};
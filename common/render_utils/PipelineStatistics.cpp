@@ -0,0 +1,87 @@
+#include "PipelineStatistics.hpp"
+
+#include <array>
+
+#include <etna/Assert.hpp>
+#include <etna/GlobalContext.hpp>
+
+
+PipelineStatistics::PipelineStatistics()
+{
+  auto& ctx = etna::get_context();
+
+  if (!ctx.getPhysicalDevice().getFeatures().pipelineStatisticsQuery)
+    return;
+
+  const auto framesInFlight =
+    static_cast<std::uint32_t>(ctx.getMainWorkCount().multiBufferingCount());
+
+  // Results are written in the order of bits, so keep these in sync with Result
+  auto queryPool = ctx.getDevice().createQueryPoolUnique(vk::QueryPoolCreateInfo{
+    .queryType = vk::QueryType::ePipelineStatistics,
+    .queryCount = framesInFlight,
+    .pipelineStatistics = vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
+      vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations,
+  });
+  ETNA_CHECK_VK_RESULT(queryPool.result);
+  pool = std::move(queryPool.value);
+
+  frames.emplace(ctx.getMainWorkCount(), [](std::size_t i) {
+    return FrameQuery{.query = static_cast<std::uint32_t>(i)};
+  });
+}
+
+void PipelineStatistics::beginFrame(vk::CommandBuffer cmd_buf)
+{
+  if (!pool)
+    return;
+
+  auto& frame = frames->get();
+
+  if (frame.ended)
+  {
+    // The frame that used this query has already been waited for, so this doesn't block
+    std::array<std::uint64_t, 2> values{};
+    const auto result = etna::get_context().getDevice().getQueryPoolResults(
+      pool.get(),
+      frame.query,
+      1,
+      sizeof(values),
+      values.data(),
+      sizeof(values),
+      vk::QueryResultFlagBits::e64);
+
+    if (result == vk::Result::eSuccess)
+      lastResult = Result{
+        .vertexShaderInvocations = values[0],
+        .fragmentShaderInvocations = values[1],
+      };
+  }
+
+  cmd_buf.resetQueryPool(pool.get(), frame.query, 1);
+  frame.begun = false;
+  frame.ended = false;
+}
+
+void PipelineStatistics::begin(vk::CommandBuffer cmd_buf)
+{
+  if (!pool)
+    return;
+
+  auto& frame = frames->get();
+  ETNA_VERIFY(!frame.begun);
+  cmd_buf.beginQuery(pool.get(), frame.query, {});
+  frame.begun = true;
+}
+
+void PipelineStatistics::end(vk::CommandBuffer cmd_buf)
+{
+  if (!pool)
+    return;
+
+  auto& frame = frames->get();
+  if (!frame.begun || frame.ended)
+    return;
+  cmd_buf.endQuery(pool.get(), frame.query);
+  frame.ended = true;
+}
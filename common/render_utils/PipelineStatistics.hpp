@@ -0,0 +1,50 @@
+#pragma once
+
+#include <optional>
+
+#include <etna/Vulkan.hpp>
+#include <etna/GpuSharedResource.hpp>
+
+
+/**
+ * Counts shader invocations of a single range of commands per frame with a pipeline
+ * statistics query. Just like GpuTimer, results are read back when the query of a
+ * frame in flight is reused, so they lag behind. The pipelineStatisticsQuery feature
+ * has to be enabled when creating the device.
+ */
+class PipelineStatistics
+{
+public:
+  struct Result
+  {
+    std::uint64_t vertexShaderInvocations;
+    std::uint64_t fragmentShaderInvocations;
+  };
+
+  PipelineStatistics();
+
+  // Must be recorded outside of rendering, before begin()
+  void beginFrame(vk::CommandBuffer cmd_buf);
+
+  // At most once per frame, both outside of rendering
+  void begin(vk::CommandBuffer cmd_buf);
+  void end(vk::CommandBuffer cmd_buf);
+
+  // Empty until some frame finishes with a complete range
+  const std::optional<Result>& getLastResult() const { return lastResult; }
+
+private:
+  struct FrameQuery
+  {
+    std::uint32_t query;
+    bool begun = false;
+    bool ended = false;
+  };
+
+  vk::UniqueQueryPool pool;
+  std::optional<etna::GpuSharedResource<FrameQuery>> frames;
+  std::optional<Result> lastResult;
+
+  PipelineStatistics(const PipelineStatistics&) = delete;
+  PipelineStatistics& operator=(const PipelineStatistics&) = delete;
+};
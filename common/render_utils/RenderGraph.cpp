@@ -0,0 +1,394 @@
+#include "RenderGraph.hpp"
+
+#include <algorithm>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+#include <etna/Assert.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+
+#include "MemoryTracker.hpp"
+
+
+namespace
+{
+
+struct UsageState
+{
+  vk::PipelineStageFlags2 stages;
+  vk::AccessFlags2 access;
+  vk::ImageLayout layout;
+  vk::ImageUsageFlags imageUsage;
+
+  bool writes() const
+  {
+    constexpr auto WRITE_ACCESS = vk::AccessFlagBits2::eColorAttachmentWrite |
+      vk::AccessFlagBits2::eDepthStencilAttachmentWrite | vk::AccessFlagBits2::eShaderStorageWrite |
+      vk::AccessFlagBits2::eTransferWrite;
+    return static_cast<bool>(access & WRITE_ACCESS);
+  }
+};
+
+UsageState usage_state(RenderGraph::Usage usage)
+{
+  using Stage = vk::PipelineStageFlagBits2;
+  using Access = vk::AccessFlagBits2;
+  using Layout = vk::ImageLayout;
+  using ImageUsage = vk::ImageUsageFlagBits;
+
+  switch (usage)
+  {
+  case RenderGraph::Usage::ColorAttachment:
+    return {
+      Stage::eColorAttachmentOutput,
+      Access::eColorAttachmentRead | Access::eColorAttachmentWrite,
+      Layout::eColorAttachmentOptimal,
+      ImageUsage::eColorAttachment};
+  case RenderGraph::Usage::DepthAttachment:
+    return {
+      Stage::eEarlyFragmentTests | Stage::eLateFragmentTests,
+      Access::eDepthStencilAttachmentRead | Access::eDepthStencilAttachmentWrite,
+      Layout::eDepthStencilAttachmentOptimal,
+      ImageUsage::eDepthStencilAttachment};
+  case RenderGraph::Usage::SampledInFragment:
+    return {
+      Stage::eFragmentShader,
+      Access::eShaderSampledRead,
+      Layout::eShaderReadOnlyOptimal,
+      ImageUsage::eSampled};
+  case RenderGraph::Usage::SampledInCompute:
+    return {
+      Stage::eComputeShader,
+      Access::eShaderSampledRead,
+      Layout::eShaderReadOnlyOptimal,
+      ImageUsage::eSampled};
+  case RenderGraph::Usage::StorageInCompute:
+    return {
+      Stage::eComputeShader,
+      Access::eShaderStorageRead | Access::eShaderStorageWrite,
+      Layout::eGeneral,
+      ImageUsage::eStorage};
+  case RenderGraph::Usage::TransferSrc:
+    return {
+      Stage::eTransfer,
+      Access::eTransferRead,
+      Layout::eTransferSrcOptimal,
+      ImageUsage::eTransferSrc};
+  case RenderGraph::Usage::TransferDst:
+    break;
+  }
+  return {
+    Stage::eTransfer,
+    Access::eTransferWrite,
+    Layout::eTransferDstOptimal,
+    ImageUsage::eTransferDst};
+}
+
+vk::ImageAspectFlags aspect_of(vk::Format format)
+{
+  switch (format)
+  {
+  case vk::Format::eD16Unorm:
+  case vk::Format::eD32Sfloat:
+  case vk::Format::eX8D24UnormPack32:
+    return vk::ImageAspectFlagBits::eDepth;
+  case vk::Format::eD16UnormS8Uint:
+  case vk::Format::eD24UnormS8Uint:
+  case vk::Format::eD32SfloatS8Uint:
+    return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+  default:
+    return vk::ImageAspectFlagBits::eColor;
+  }
+}
+
+} // namespace
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::use(ResourceId resource, Usage usage)
+{
+  ETNA_VERIFY(resource < graph.resources.size());
+  graph.passes[pass].accesses.push_back(Access{resource, usage});
+  graph.resources[resource].usage |= usage_state(usage).imageUsage;
+  return *this;
+}
+
+RenderGraph::RenderGraph(std::string name)
+  : name{std::move(name)}
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+  release();
+}
+
+RenderGraph::ResourceId RenderGraph::createImage(ImageInfo info)
+{
+  ETNA_VERIFY(!compiled);
+  resources.push_back(Resource{.info = std::move(info), .transient = true});
+  return static_cast<ResourceId>(resources.size() - 1);
+}
+
+RenderGraph::ResourceId RenderGraph::importImage(std::string name, vk::Format format)
+{
+  ETNA_VERIFY(!compiled);
+  resources.push_back(
+    Resource{.info = {.name = std::move(name), .format = format}, .transient = false});
+  return static_cast<ResourceId>(resources.size() - 1);
+}
+
+void RenderGraph::bindImported(ResourceId resource, vk::Image image, vk::ImageView view)
+{
+  auto& res = resources[resource];
+  ETNA_VERIFY(!res.transient);
+  res.image = image;
+  res.view = view;
+}
+
+RenderGraph::PassBuilder RenderGraph::addPass(std::string name, Execute execute)
+{
+  ETNA_VERIFY(!compiled);
+  passes.push_back(Pass{.name = std::move(name), .execute = std::move(execute)});
+  return PassBuilder{*this, passes.size() - 1};
+}
+
+void RenderGraph::compile()
+{
+  ETNA_VERIFY(!compiled);
+
+  lifetimes.resize(resources.size());
+  for (std::size_t i = 0; i < resources.size(); ++i)
+    lifetimes[i] = Lifetime{
+      .name = resources[i].info.name,
+      .transient = resources[i].transient,
+      .firstPass = passes.size(),
+      .lastPass = 0,
+      .heap = 0,
+      .bytes = 0,
+    };
+
+  for (std::size_t i = 0; i < passes.size(); ++i)
+    for (const auto& access : passes[i].accesses)
+    {
+      auto& lifetime = lifetimes[access.resource];
+      lifetime.firstPass = std::min(lifetime.firstPass, i);
+      lifetime.lastPass = std::max(lifetime.lastPass, i);
+    }
+
+  allocateTransients();
+  compiled = true;
+}
+
+void RenderGraph::allocateTransients()
+{
+  auto device = etna::get_context().getDevice();
+
+  std::vector<ResourceId> transients;
+  std::vector<vk::MemoryRequirements> requirements(resources.size());
+  for (ResourceId i = 0; i < resources.size(); ++i)
+  {
+    auto& res = resources[i];
+    if (!res.transient)
+      continue;
+
+    if (lifetimes[i].firstPass > lifetimes[i].lastPass)
+    {
+      spdlog::warn("Render graph image '{}' is never used, skipping it", res.info.name);
+      continue;
+    }
+
+    auto image = device.createImageUnique(vk::ImageCreateInfo{
+      .imageType = vk::ImageType::e2D,
+      .format = res.info.format,
+      .extent = vk::Extent3D{res.info.extent.width, res.info.extent.height, 1},
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = vk::SampleCountFlagBits::e1,
+      .tiling = vk::ImageTiling::eOptimal,
+      .usage = res.usage,
+      .sharingMode = vk::SharingMode::eExclusive,
+      .initialLayout = vk::ImageLayout::eUndefined,
+    });
+    ETNA_CHECK_VK_RESULT(image.result);
+    res.ownedImage = std::move(image.value);
+    res.image = res.ownedImage.get();
+
+    requirements[i] = device.getImageMemoryRequirements(res.image);
+    lifetimes[i].bytes = requirements[i].size;
+    transients.push_back(i);
+  }
+
+  // Greedily place the biggest images first, each into the first heap
+  // where it doesn't overlap in time with anything already placed there
+  std::sort(transients.begin(), transients.end(), [&](ResourceId a, ResourceId b) {
+    return requirements[a].size > requirements[b].size;
+  });
+
+  std::vector<vk::MemoryRequirements> heapRequirements;
+  std::vector<std::vector<ResourceId>> heapMembers;
+  for (ResourceId id : transients)
+  {
+    const auto& req = requirements[id];
+    const auto& lifetime = lifetimes[id];
+
+    std::size_t heap = 0;
+    for (; heap < heapMembers.size(); ++heap)
+    {
+      if ((heapRequirements[heap].memoryTypeBits & req.memoryTypeBits) == 0)
+        continue;
+
+      const bool overlaps =
+        std::any_of(heapMembers[heap].begin(), heapMembers[heap].end(), [&](ResourceId other) {
+          return lifetimes[other].firstPass <= lifetime.lastPass &&
+            lifetime.firstPass <= lifetimes[other].lastPass;
+        });
+      if (!overlaps)
+        break;
+    }
+
+    if (heap == heapMembers.size())
+    {
+      heapRequirements.push_back(req);
+      heapMembers.emplace_back();
+    }
+    else
+    {
+      auto& heapReq = heapRequirements[heap];
+      heapReq.size = std::max(heapReq.size, req.size);
+      heapReq.alignment = std::max(heapReq.alignment, req.alignment);
+      heapReq.memoryTypeBits &= req.memoryTypeBits;
+    }
+    heapMembers[heap].push_back(id);
+    lifetimes[id].heap = heap;
+  }
+
+  VmaAllocator allocator = etna::get_context().getVmaAllocator();
+  const VmaAllocationCreateInfo allocInfo{.usage = VMA_MEMORY_USAGE_GPU_ONLY};
+
+  aliasingReport = {};
+  for (std::size_t heap = 0; heap < heapMembers.size(); ++heap)
+  {
+    const VkMemoryRequirements req = heapRequirements[heap];
+    VmaAllocation allocation = nullptr;
+    ETNA_CHECK_VK_RESULT(static_cast<vk::Result>(
+      vmaAllocateMemory(allocator, &req, &allocInfo, &allocation, nullptr)));
+    heaps.push_back(allocation);
+
+    const auto heapName = fmt::format("{}_heap{}", name, heap);
+    vmaSetAllocationName(allocator, allocation, heapName.c_str());
+    get_memory_tracker().track(MemoryCategory::RenderTargets, heapName, req.size);
+
+    aliasingReport.allocatedBytes += req.size;
+    for (ResourceId id : heapMembers[heap])
+    {
+      auto& res = resources[id];
+      ETNA_CHECK_VK_RESULT(
+        static_cast<vk::Result>(vmaBindImageMemory(allocator, allocation, res.image)));
+      aliasingReport.requiredBytes += requirements[id].size;
+
+      auto view = device.createImageViewUnique(vk::ImageViewCreateInfo{
+        .image = res.image,
+        .viewType = vk::ImageViewType::e2D,
+        .format = res.info.format,
+        .subresourceRange =
+          {
+            .aspectMask = aspect_of(res.info.format),
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+          },
+      });
+      ETNA_CHECK_VK_RESULT(view.result);
+      res.ownedView = std::move(view.value);
+      res.view = res.ownedView.get();
+    }
+  }
+  aliasingReport.heapCount = heaps.size();
+
+  spdlog::info(
+    "Render graph '{}': {} transient images in {} heaps, {:.2f} of {:.2f} MiB saved by aliasing",
+    name,
+    transients.size(),
+    heaps.size(),
+    static_cast<double>(aliasingReport.savedBytes()) / (1024.0 * 1024.0),
+    static_cast<double>(aliasingReport.requiredBytes) / (1024.0 * 1024.0));
+}
+
+void RenderGraph::release()
+{
+  // Images have to go before the memory they are bound to
+  for (auto& res : resources)
+  {
+    res.ownedView.reset();
+    res.ownedImage.reset();
+  }
+
+  VmaAllocator allocator = etna::get_context().getVmaAllocator();
+  for (std::size_t heap = 0; heap < heaps.size(); ++heap)
+  {
+    vmaFreeMemory(allocator, heaps[heap]);
+    get_memory_tracker().untrack(fmt::format("{}_heap{}", name, heap));
+  }
+  heaps.clear();
+}
+
+void RenderGraph::execute(vk::CommandBuffer cmd_buf)
+{
+  ETNA_VERIFY(compiled);
+
+  auto& tracker = etna::get_context().getResourceTracker();
+
+  // Writes have to be waited for even if the state doesn't change, e.g. when
+  // one pass reads depth written by the previous one as an attachment as well
+  std::vector<bool> written(resources.size(), false);
+
+  for (std::size_t i = 0; i < passes.size(); ++i)
+  {
+    const auto& pass = passes[i];
+
+    for (const auto& access : pass.accesses)
+    {
+      const auto& res = resources[access.resource];
+      ETNA_VERIFY(res.image);
+
+      // The memory was used by another image since the last frame, so the old contents
+      // are discarded. The barrier also waits for whatever touched the memory before.
+      if (res.transient && lifetimes[access.resource].firstPass == i)
+        tracker.setExternalTextureState(
+          res.image,
+          vk::PipelineStageFlagBits2::eAllCommands,
+          vk::AccessFlagBits2::eMemoryWrite,
+          vk::ImageLayout::eUndefined);
+
+      const auto state = usage_state(access.usage);
+      etna::set_state(
+        cmd_buf,
+        res.image,
+        state.stages,
+        state.access,
+        state.layout,
+        aspect_of(res.info.format),
+        written[access.resource] ? etna::ForceSetState::eTrue : etna::ForceSetState::eFalse);
+    }
+
+    for (const auto& access : pass.accesses)
+      written[access.resource] = usage_state(access.usage).writes();
+
+    // All of the pass's barriers are issued together, and the ones that
+    // don't change anything are dropped by etna's state tracking
+    etna::flush_barriers(cmd_buf);
+
+    pass.execute(cmd_buf);
+  }
+}
+
+vk::Image RenderGraph::getImage(ResourceId resource) const
+{
+  return resources[resource].image;
+}
+
+vk::ImageView RenderGraph::getView(ResourceId resource) const
+{
+  return resources[resource].view;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <vk_mem_alloc.h>
+
+
+/**
+ * A frame graph for a fixed set of passes. Passes declare how they use images,
+ * and the graph inserts all barriers needed before each pass in one go.
+ * Transient images are owned by the graph and only live between their first and
+ * last use within the frame, so images whose lifetimes don't overlap are placed
+ * into the same memory.
+ *
+ * Passes run in the order they were added. The graph is rebuilt from scratch
+ * when anything about it changes, e.g. the resolution.
+ */
+class RenderGraph
+{
+public:
+  using ResourceId = std::uint32_t;
+  using Execute = std::function<void(vk::CommandBuffer)>;
+
+  enum class Usage
+  {
+    ColorAttachment,
+    DepthAttachment,
+    SampledInFragment,
+    SampledInCompute,
+    StorageInCompute,
+    TransferSrc,
+    TransferDst,
+  };
+
+  struct ImageInfo
+  {
+    std::string name;
+    vk::Extent2D extent = {};
+    vk::Format format = vk::Format::eUndefined;
+  };
+
+  class PassBuilder
+  {
+  public:
+    PassBuilder& use(ResourceId resource, Usage usage);
+
+  private:
+    friend class RenderGraph;
+    PassBuilder(RenderGraph& graph, std::size_t pass)
+      : graph{graph}
+      , pass{pass}
+    {
+    }
+
+    RenderGraph& graph;
+    std::size_t pass;
+  };
+
+  struct Lifetime
+  {
+    std::string name;
+    bool transient;
+    // Indices of passes, inclusive
+    std::size_t firstPass;
+    std::size_t lastPass;
+    // Index of the shared allocation, only for transient images
+    std::size_t heap;
+    vk::DeviceSize bytes;
+  };
+
+  struct AliasingReport
+  {
+    // Sum of the sizes of all transient images
+    vk::DeviceSize requiredBytes = 0;
+    // What the shared allocations actually take
+    vk::DeviceSize allocatedBytes = 0;
+    std::size_t heapCount = 0;
+
+    vk::DeviceSize savedBytes() const { return requiredBytes - allocatedBytes; }
+  };
+
+  // The name prefixes debug names of the graph's allocations
+  explicit RenderGraph(std::string name);
+  ~RenderGraph();
+
+  // Transient images are created by compile()
+  ResourceId createImage(ImageInfo info);
+  // Imported images are provided every frame with bindImported(),
+  // the format is only needed to know the image's aspect
+  ResourceId importImage(std::string name, vk::Format format);
+  void bindImported(ResourceId resource, vk::Image image, vk::ImageView view);
+
+  PassBuilder addPass(std::string name, Execute execute);
+
+  // Computes lifetimes and allocates transient images, no passes may be added after this
+  void compile();
+  void execute(vk::CommandBuffer cmd_buf);
+
+  vk::Image getImage(ResourceId resource) const;
+  vk::ImageView getView(ResourceId resource) const;
+
+  const std::vector<Lifetime>& getLifetimes() const { return lifetimes; }
+  const AliasingReport& getAliasingReport() const { return aliasingReport; }
+  std::size_t getPassCount() const { return passes.size(); }
+  const std::string& getPassName(std::size_t pass) const { return passes[pass].name; }
+
+private:
+  struct Resource
+  {
+    ImageInfo info;
+    bool transient;
+    vk::ImageUsageFlags usage;
+
+    vk::UniqueImage ownedImage;
+    vk::UniqueImageView ownedView;
+    vk::Image image;
+    vk::ImageView view;
+  };
+
+  struct Access
+  {
+    ResourceId resource;
+    Usage usage;
+  };
+
+  struct Pass
+  {
+    std::string name;
+    Execute execute;
+    std::vector<Access> accesses;
+  };
+
+  void allocateTransients();
+  void release();
+
+private:
+  std::string name;
+  std::vector<Resource> resources;
+  std::vector<Pass> passes;
+  bool compiled = false;
+
+  std::vector<Lifetime> lifetimes;
+  std::vector<VmaAllocation> heaps;
+  AliasingReport aliasingReport;
+
+  RenderGraph(const RenderGraph&) = delete;
+  RenderGraph& operator=(const RenderGraph&) = delete;
+};
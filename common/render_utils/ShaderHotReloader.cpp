@@ -0,0 +1,450 @@
+#include "ShaderHotReloader.hpp"
+
+#include <fstream>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+
+#include <fmt/format.h>
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <glslang/Public/ShaderLang.h>
+#include <glslang/Public/ResourceLimits.h>
+#include <glslang/SPIRV/GlslangToSpv.h>
+#include <spdlog/spdlog.h>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <map>
+#endif
+
+
+namespace fs = std::filesystem;
+
+static constexpr std::chrono::milliseconds POLL_INTERVAL{100};
+// Editors often save a file in several steps, wait for all of them
+static constexpr std::chrono::milliseconds SETTLE_TIME{50};
+
+static std::optional<EShLanguage> stage_of(const fs::path& path)
+{
+  const auto ext = path.extension();
+  if (ext == ".vert")
+    return EShLangVertex;
+  if (ext == ".tesc")
+    return EShLangTessControl;
+  if (ext == ".tese")
+    return EShLangTessEvaluation;
+  if (ext == ".geom")
+    return EShLangGeometry;
+  if (ext == ".frag")
+    return EShLangFragment;
+  if (ext == ".comp")
+    return EShLangCompute;
+  return std::nullopt;
+}
+
+static bool is_header(const fs::path& path)
+{
+  const auto ext = path.extension();
+  return ext == ".h" || ext == ".glsl";
+}
+
+static std::optional<std::string> read_file(const fs::path& path)
+{
+  std::ifstream file{path, std::ios::binary};
+  if (!file)
+    return std::nullopt;
+  return std::string{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+}
+
+// Written next to the target and renamed over it, so a reload never sees half a file
+static bool write_spirv(const fs::path& path, std::span<const unsigned int> spirv)
+{
+  auto tmpPath = path;
+  tmpPath += ".tmp";
+  {
+    std::ofstream file{tmpPath, std::ios::binary};
+    file.write(reinterpret_cast<const char*>(spirv.data()), spirv.size_bytes());
+    if (!file)
+      return false;
+  }
+
+  std::error_code ec;
+  fs::rename(tmpPath, path, ec);
+  return !ec;
+}
+
+namespace
+{
+
+// Mimics glslangValidator: local includes are searched next to the including file first
+class DirectoryIncluder : public glslang::TShader::Includer
+{
+public:
+  explicit DirectoryIncluder(std::span<const fs::path> include_dirs)
+    : includeDirs{include_dirs}
+  {
+  }
+
+  IncludeResult* includeLocal(
+    const char* header_name, const char* includer_name, std::size_t depth) override
+  {
+    if (auto* result = tryInclude(fs::path{includer_name}.parent_path() / header_name))
+      return result;
+    return includeSystem(header_name, includer_name, depth);
+  }
+
+  IncludeResult* includeSystem(const char* header_name, const char*, std::size_t) override
+  {
+    for (const auto& dir : includeDirs)
+      if (auto* result = tryInclude(dir / header_name))
+        return result;
+    return nullptr;
+  }
+
+  void releaseInclude(IncludeResult* result) override
+  {
+    if (result == nullptr)
+      return;
+    delete static_cast<std::string*>(result->userData);
+    delete result;
+  }
+
+private:
+  IncludeResult* tryInclude(const fs::path& path)
+  {
+    auto text = read_file(path);
+    if (!text)
+      return nullptr;
+    auto* content = new std::string(std::move(*text));
+    return new IncludeResult(path.string(), content->data(), content->size(), content);
+  }
+
+  std::span<const fs::path> includeDirs;
+};
+
+// Reports files created or rewritten in a set of directories
+class DirectoryWatcher
+{
+public:
+  explicit DirectoryWatcher(std::span<const fs::path> dirs);
+  ~DirectoryWatcher();
+
+  // Returns as soon as anything changes or after the timeout
+  std::vector<fs::path> waitForChanges(std::chrono::milliseconds timeout);
+
+private:
+#if defined(__linux__)
+  int inotifyFd = -1;
+  std::unordered_map<int, fs::path> watchedDirs;
+#else
+  // There is no portable way to watch files, so timestamps are polled instead
+  std::vector<fs::path> watchedDirs;
+  std::map<fs::path, fs::file_time_type> writeTimes;
+
+  std::vector<fs::path> scan();
+#endif
+
+  DirectoryWatcher(const DirectoryWatcher&) = delete;
+  DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+};
+
+#if defined(__linux__)
+
+DirectoryWatcher::DirectoryWatcher(std::span<const fs::path> dirs)
+  : inotifyFd{inotify_init1(IN_NONBLOCK | IN_CLOEXEC)}
+{
+  if (inotifyFd < 0)
+  {
+    spdlog::error("Unable to initialize inotify, shaders will not be hot reloaded");
+    return;
+  }
+
+  // Many editors save by writing a new file and renaming it over the old one
+  for (const auto& dir : dirs)
+  {
+    const int wd = inotify_add_watch(inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0)
+      spdlog::error("Unable to watch shader directory '{}'", dir.string());
+    else
+      watchedDirs.emplace(wd, dir);
+  }
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+  if (inotifyFd >= 0)
+    close(inotifyFd);
+}
+
+std::vector<fs::path> DirectoryWatcher::waitForChanges(std::chrono::milliseconds timeout)
+{
+  if (inotifyFd < 0)
+  {
+    std::this_thread::sleep_for(timeout);
+    return {};
+  }
+
+  pollfd pollFd{.fd = inotifyFd, .events = POLLIN, .revents = 0};
+  if (poll(&pollFd, 1, static_cast<int>(timeout.count())) <= 0)
+    return {};
+
+  std::vector<fs::path> changed;
+  alignas(inotify_event) char buffer[4096];
+  ssize_t length;
+  while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+  {
+    for (char* ptr = buffer; ptr < buffer + length;)
+    {
+      const auto* event = reinterpret_cast<const inotify_event*>(ptr);
+      if (auto it = watchedDirs.find(event->wd); it != watchedDirs.end() && event->len > 0)
+        changed.push_back(it->second / event->name);
+      ptr += sizeof(inotify_event) + event->len;
+    }
+  }
+  return changed;
+}
+
+#else
+
+DirectoryWatcher::DirectoryWatcher(std::span<const fs::path> dirs)
+  : watchedDirs{dirs.begin(), dirs.end()}
+{
+  scan();
+}
+
+DirectoryWatcher::~DirectoryWatcher() = default;
+
+std::vector<fs::path> DirectoryWatcher::waitForChanges(std::chrono::milliseconds timeout)
+{
+  std::this_thread::sleep_for(timeout);
+  return scan();
+}
+
+std::vector<fs::path> DirectoryWatcher::scan()
+{
+  std::vector<fs::path> changed;
+  for (const auto& dir : watchedDirs)
+  {
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator{dir, ec})
+    {
+      if (!entry.is_regular_file())
+        continue;
+      const auto writeTime = entry.last_write_time(ec);
+      auto [it, inserted] = writeTimes.try_emplace(entry.path(), writeTime);
+      if (!inserted && it->second != writeTime)
+      {
+        it->second = writeTime;
+        changed.push_back(entry.path());
+      }
+    }
+  }
+  return changed;
+}
+
+#endif
+
+} // namespace
+
+static std::optional<std::vector<unsigned int>> compile_shader(
+  const fs::path& path,
+  EShLanguage stage,
+  std::span<const fs::path> include_dirs,
+  std::string& log)
+{
+  const auto source = read_file(path);
+  if (!source)
+  {
+    log += fmt::format("Unable to read '{}'\n", path.string());
+    return std::nullopt;
+  }
+
+  const std::string name = path.string();
+  const char* sourceText = source->c_str();
+  const char* sourceName = name.c_str();
+
+  // Same environment as glslangValidator -V --target-env vulkan1.3, which builds
+  // the shaders normally
+  glslang::TShader shader{stage};
+  shader.setStringsWithLengthsAndNames(&sourceText, nullptr, &sourceName, 1);
+  shader.setEnvInput(glslang::EShSourceGlsl, stage, glslang::EShClientVulkan, 100);
+  shader.setEnvClient(glslang::EShClientVulkan, glslang::EShTargetVulkan_1_3);
+  shader.setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_6);
+
+  const auto messages = static_cast<EShMessages>(EShMsgSpvRules | EShMsgVulkanRules);
+
+  DirectoryIncluder includer{include_dirs};
+  if (!shader.parse(GetDefaultResources(), 100, false, messages, includer))
+  {
+    log += shader.getInfoLog();
+    return std::nullopt;
+  }
+
+  glslang::TProgram program;
+  program.addShader(&shader);
+  if (!program.link(messages))
+  {
+    log += program.getInfoLog();
+    return std::nullopt;
+  }
+
+  glslang::SpvOptions options;
+#ifndef NDEBUG
+  options.generateDebugInfo = true;
+#endif
+
+  std::vector<unsigned int> spirv;
+  glslang::GlslangToSpv(*program.getIntermediate(stage), spirv, &options);
+  return spirv;
+}
+
+ShaderHotReloader::ShaderHotReloader(CreateInfo create_info)
+  : info{std::move(create_info)}
+  , worker{[this](std::stop_token stop) { work(stop); }}
+{
+}
+
+ShaderHotReloader::~ShaderHotReloader()
+{
+  worker.request_stop();
+  worker.join();
+}
+
+bool ShaderHotReloader::reloadIfReady()
+{
+  // Binaries are written under the same lock, so etna never reads a mix of two batches
+  std::lock_guard lock{mutex};
+  if (status.generation == reloadedGeneration)
+    return false;
+  reloadedGeneration = status.generation;
+
+  // etna recreates pipelines in place, so only the frames still in flight have to finish.
+  // Everything slow, i.e. compilation, has already happened on the worker.
+  ETNA_CHECK_VK_RESULT(etna::get_context().getQueue().waitIdle());
+  etna::reload_shaders();
+
+  spdlog::info(
+    "Reloaded {} shaders compiled in {:.1f} ms",
+    status.compiledShaders,
+    std::chrono::duration<double, std::milli>(status.compileTime).count());
+  return true;
+}
+
+void ShaderHotReloader::requestRebuild()
+{
+  std::lock_guard lock{mutex};
+  rebuildRequested = true;
+}
+
+ShaderHotReloader::Status ShaderHotReloader::getStatus() const
+{
+  std::lock_guard lock{mutex};
+  return status;
+}
+
+void ShaderHotReloader::work(std::stop_token stop)
+{
+  glslang::InitializeProcess();
+
+  std::vector<fs::path> watchedDirs = info.sourceDirectories;
+  watchedDirs.insert(
+    watchedDirs.end(), info.includeDirectories.begin(), info.includeDirectories.end());
+  DirectoryWatcher watcher{watchedDirs};
+
+  while (!stop.stop_requested())
+  {
+    auto changed = watcher.waitForChanges(POLL_INTERVAL);
+    if (!changed.empty())
+    {
+      std::this_thread::sleep_for(SETTLE_TIME);
+      auto moreChanged = watcher.waitForChanges(std::chrono::milliseconds{0});
+      changed.insert(changed.end(), moreChanged.begin(), moreChanged.end());
+    }
+
+    bool rebuildAll = false;
+    {
+      std::lock_guard lock{mutex};
+      rebuildAll = std::exchange(rebuildRequested, false);
+    }
+
+    bool sourcesChanged = false;
+    for (const auto& path : changed)
+    {
+      if (stage_of(path).has_value())
+      {
+        dirty.insert(path);
+        sourcesChanged = true;
+      }
+      // Nobody tracks which shader includes what, so recompile everything
+      else if (is_header(path))
+        rebuildAll = true;
+    }
+
+    if (rebuildAll)
+      for (const auto& dir : info.sourceDirectories)
+      {
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator{dir, ec})
+          if (entry.is_regular_file() && stage_of(entry.path()).has_value())
+            dirty.insert(entry.path());
+      }
+
+    // Shaders that failed to compile stay dirty, but are only retried once
+    // something changes, instead of failing again on every poll
+    if (!dirty.empty() && (sourcesChanged || rebuildAll))
+      compileDirty();
+  }
+
+  glslang::FinalizeProcess();
+}
+
+void ShaderHotReloader::compileDirty()
+{
+  {
+    std::lock_guard lock{mutex};
+    status.compiling = true;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+
+  std::string log;
+  std::vector<std::pair<fs::path, std::vector<unsigned int>>> compiled;
+  compiled.reserve(dirty.size());
+  for (const auto& path : dirty)
+    if (auto spirv = compile_shader(path, *stage_of(path), info.includeDirectories, log))
+      compiled.emplace_back(path, std::move(*spirv));
+
+  const auto compileTime = std::chrono::steady_clock::now() - start;
+
+  std::lock_guard lock{mutex};
+  status.compiling = false;
+
+  // Shaders that compiled stay dirty too, a partial batch could mismatch the old binaries
+  if (compiled.size() != dirty.size())
+  {
+    spdlog::warn("Shader hot reload failed, keeping the old shaders:\n{}", log);
+    status.errorLog = std::move(log);
+    return;
+  }
+
+  for (const auto& [path, spirv] : compiled)
+  {
+    const auto outputPath = info.outputDirectory / (path.filename().string() + ".spv");
+    if (!write_spirv(outputPath, spirv))
+    {
+      status.errorLog = fmt::format("Unable to write '{}'", outputPath.string());
+      return;
+    }
+  }
+
+  dirty.clear();
+  status.errorLog.clear();
+  status.compiledShaders = compiled.size();
+  status.compileTime = compileTime;
+  ++status.generation;
+}
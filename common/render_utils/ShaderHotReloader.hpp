@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Watches shader sources and recompiles them to SPIR-V on a background thread
+ * with an in-process glslang, so that editing a shader never freezes the app.
+ * Sources are compiled to `<output dir>/<file name>.spv`, the same files that
+ * target_add_shaders produces and etna programs are created from.
+ *
+ * Compiled binaries are only written when every dirty shader compiles, otherwise
+ * the old binaries (and thus the old pipelines) stay and the error log is kept.
+ *
+ * Only available when RENDER_UTILS_SHADER_HOT_RELOAD is defined, i.e. when
+ * render_utils was built with the Vulkan SDK's glslang.
+ */
+class ShaderHotReloader
+{
+public:
+  struct CreateInfo
+  {
+    // Every shader stage source in these directories is compiled
+    std::vector<std::filesystem::path> sourceDirectories;
+    // Searched for includes after the directory of the including file.
+    // Changing any header recompiles all shaders.
+    std::vector<std::filesystem::path> includeDirectories;
+    std::filesystem::path outputDirectory;
+  };
+
+  struct Status
+  {
+    // Empty unless the last compilation failed
+    std::string errorLog;
+    std::size_t compiledShaders = 0;
+    std::chrono::steady_clock::duration compileTime{};
+    // Incremented every time new binaries are written
+    std::uint32_t generation = 0;
+    bool compiling = false;
+  };
+
+  explicit ShaderHotReloader(CreateInfo info);
+  ~ShaderHotReloader();
+
+  // Call at a frame boundary, outside of command buffer recording.
+  // Reloads etna programs and pipelines if new binaries are ready.
+  // Returns whether anything was reloaded.
+  bool reloadIfReady();
+
+  // Recompiles all shaders, even if none of them changed
+  void requestRebuild();
+
+  Status getStatus() const;
+
+private:
+  void work(std::stop_token stop);
+  void compileDirty();
+
+private:
+  CreateInfo info;
+
+  mutable std::mutex mutex;
+  Status status;
+  std::set<std::filesystem::path> dirty;
+  bool rebuildRequested = false;
+  std::uint32_t reloadedGeneration = 0;
+
+  std::jthread worker;
+
+  ShaderHotReloader(const ShaderHotReloader&) = delete;
+  ShaderHotReloader& operator=(const ShaderHotReloader&) = delete;
+};
@@ -0,0 +1,29 @@
+#ifndef COMPACT_VERTEX_H_INCLUDED
+#define COMPACT_VERTEX_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Bit layout of the compact 20-byte vertex format, see CompactVertex below.
+#define COMPACT_VERTEX_POSITION_MASK 0x0000FFFFu
+#define COMPACT_VERTEX_POSITION_MAX 65535.0f
+#define COMPACT_VERTEX_BITANGENT_SIGN_BIT 0x80000000u
+
+// Positions are 16-bit unorms inside of the mesh's bounding box. The box is
+// scaled uniformly so that dequantization is a similarity transform and can be
+// folded into the model matrix without affecting normals.
+// Normals and tangents are octahedral-encoded into a pair of 16-bit snorms.
+// Texture coordinates are a pair of half floats.
+struct CompactVertex
+{
+  // x in the low 16 bits, y in the high 16 bits
+  shader_uint positionXY;
+  // z in the low 16 bits, bitangent sign in the highest bit, other bits are reserved
+  shader_uint positionZAndFlags;
+  shader_uint normal;
+  shader_uint tangent;
+  shader_uint texCoord;
+};
+
+
+#endif // COMPACT_VERTEX_H_INCLUDED
@@ -3,6 +3,8 @@
 
 // NOTE: .glsl extension is used for helper files with shader code
 
+#include "compact_vertex.h"
+
 vec3 decode_normal(uint a_data)
 {
   const uint a_enc_x = (a_data  & 0x0000FFFFu);
@@ -22,4 +24,50 @@ vec3 decode_normal(uint a_data)
   return vec3(x, y, z);
 }
 
+// Inverse of decode_normal, for shaders that produce vertices
+uint encode_normal(vec3 normal)
+{
+  const int x = int(normal.x * 32767.0f);
+  const int y = int(normal.y * 32767.0f);
+
+  const uint sign = normal.z >= 0.0f ? 0u : 1u;
+  const uint sx = (uint(x) & 0x0000FFFEu) | sign;
+  const uint sy = (uint(y) & 0x0000FFFFu) << 16;
+
+  return sx | sy;
+}
+
+vec3 decode_octahedral(vec2 enc)
+{
+  vec3 n = vec3(enc, 1.0f - abs(enc.x) - abs(enc.y));
+  const float t = max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return normalize(n);
+}
+
+// Returns coordinates inside of the mesh's unit bounding box,
+// use the dequantization matrix of the mesh to get back to mesh space.
+vec3 decode_compact_position(uint position_xy, uint position_z_and_flags)
+{
+  return vec3(
+    unpackUnorm2x16(position_xy),
+    float(position_z_and_flags & COMPACT_VERTEX_POSITION_MASK) / COMPACT_VERTEX_POSITION_MAX);
+}
+
+vec3 decode_compact_direction(uint data)
+{
+  return decode_octahedral(unpackSnorm2x16(data));
+}
+
+float decode_compact_bitangent_sign(uint position_z_and_flags)
+{
+  return (position_z_and_flags & COMPACT_VERTEX_BITANGENT_SIGN_BIT) != 0 ? -1.0f : 1.0f;
+}
+
+vec2 decode_compact_tex_coord(uint data)
+{
+  return unpackHalf2x16(data);
+}
+
 #endif // UNPACK_ATTRIBUTES_GLSL_INCLUDED
@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "render_utils/DrawList.hpp"
+
+
+// Times sorting of random keys the way the shadowmap sample builds them.
+// The goal is under 1 ms for 200k keys on one core, which the sort doesn't reach yet.
+// Usage: draw_list_benchmark [key_count = 200000] [repeats = 50] [max_threads = all cores]
+int main(int argc, char** argv)
+{
+  const std::size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200'000;
+  const std::uint32_t repeats = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 50;
+  const std::uint32_t maxThreads =
+    argc > 3 ? std::strtoul(argv[3], nullptr, 10) : std::thread::hardware_concurrency();
+
+  std::mt19937 rng{42};
+  std::uniform_int_distribution<std::uint32_t> mesh{0, (1u << DrawList::MESH_BITS) - 1};
+  std::uniform_real_distribution<float> depth{0.1f, 1000.0f};
+  std::vector<std::uint64_t> keys(count);
+  for (auto& key : keys)
+    key = DrawList::makeKey(0, 0, 0, mesh(rng), depth(rng));
+
+  const auto measure = [&](std::uint32_t max_threads) {
+    DrawList list;
+    std::vector<double> times;
+    // The first sort allocates and starts the threads, so it isn't counted
+    for (std::uint32_t repeat = 0; repeat <= repeats; ++repeat)
+    {
+      list.clear();
+      list.reserve(count);
+      for (std::uint32_t i = 0; i < count; ++i)
+        list.add(keys[i], {i, 0});
+
+      const auto start = std::chrono::steady_clock::now();
+      list.sort(max_threads);
+      const std::chrono::duration<double, std::milli> time =
+        std::chrono::steady_clock::now() - start;
+      if (repeat > 0)
+        times.push_back(time.count());
+    }
+
+    std::ranges::sort(times);
+    fmt::print(
+      "{:>8} keys, {:>2} threads: median {:.3f} ms, min {:.3f} ms\n",
+      count,
+      max_threads,
+      times[times.size() / 2],
+      times.front());
+  };
+
+  measure(1);
+  for (std::uint32_t threads = 2; threads <= maxThreads; threads *= 2)
+    measure(threads);
+
+  return EXIT_SUCCESS;
+}
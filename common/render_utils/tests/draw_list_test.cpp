@@ -0,0 +1,73 @@
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+
+#include <spdlog/spdlog.h>
+
+#include "render_utils/DrawList.hpp"
+
+
+// Sorts random keys with few distinct values, so that equal keys are common,
+// and checks that the draws of equal keys keep the order they were added in
+static bool check_sort(std::size_t count, std::uint32_t max_threads)
+{
+  std::mt19937 rng{static_cast<std::uint32_t>(count)};
+  std::uniform_int_distribution<std::uint32_t> mesh{0, 15};
+  std::uniform_int_distribution<std::uint32_t> material{0, 3};
+  std::uniform_real_distribution<float> depth{0.0f, 4.0f};
+
+  DrawList list;
+  // Sorts twice, so that the same worker threads are used again
+  for (std::uint32_t round = 0; round < 2; ++round)
+  {
+    list.clear();
+    list.reserve(count);
+    for (std::uint32_t i = 0; i < count; ++i)
+    {
+      // Coarse depths make plenty of equal keys
+      const float d = static_cast<float>(static_cast<std::uint32_t>(depth(rng)));
+      list.add(DrawList::makeKey(0, 0, material(rng), mesh(rng), d), {i, 0});
+    }
+    list.sort(max_threads);
+
+    const auto keys = list.getKeys();
+    if (keys.size() != count)
+    {
+      spdlog::error("{} keys with {} threads: got {} keys back", count, max_threads, keys.size());
+      return false;
+    }
+
+    for (std::size_t i = 1; i < count; ++i)
+    {
+      if (keys[i - 1] > keys[i])
+      {
+        spdlog::error("{} keys with {} threads: not sorted at {}", count, max_threads, i);
+        return false;
+      }
+      if (keys[i - 1] == keys[i] && list.getDraw(i - 1).instance >= list.getDraw(i).instance)
+      {
+        spdlog::error("{} keys with {} threads: not stable at {}", count, max_threads, i);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+int main()
+{
+  bool passed = true;
+
+  passed &= check_sort(0, 1);
+  passed &= check_sort(1, 1);
+  passed &= check_sort(1000, 1);
+  // Single-threaded radix sort
+  passed &= check_sort(DrawList::PARALLEL_THRESHOLD * 2, 1);
+  // Parallel radix sort, with a thread count not dividing the key count evenly
+  passed &= check_sort(DrawList::PARALLEL_THRESHOLD * 2 + 7, 3);
+  passed &= check_sort(DrawList::PARALLEL_THRESHOLD * 4, 4);
+
+  if (passed)
+    spdlog::info("All draw list tests passed");
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
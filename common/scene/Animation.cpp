@@ -0,0 +1,214 @@
+#include "Animation.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ANIMATION_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define ANIMATION_USE_SSE 0
+#endif
+
+
+// See D. Eberly, "A Fast and Accurate Algorithm for Computing SLERP"
+static constexpr float SLERP_MU = 1.90110745351730037f;
+// 1 / (i (2i + 1)) and i / (2i + 1) for i in [1, 8], last ones are corrected by mu
+static constexpr float SLERP_U[8]{
+  1.0f / (1 * 3),
+  1.0f / (2 * 5),
+  1.0f / (3 * 7),
+  1.0f / (4 * 9),
+  1.0f / (5 * 11),
+  1.0f / (6 * 13),
+  1.0f / (7 * 15),
+  SLERP_MU / (8 * 17),
+};
+static constexpr float SLERP_V[8]{
+  1.0f / 3,
+  2.0f / 5,
+  3.0f / 7,
+  4.0f / 9,
+  5.0f / 11,
+  6.0f / 13,
+  7.0f / 15,
+  SLERP_MU * 8 / 17,
+};
+
+static glm::vec4 slerp_scalar(glm::vec4 from, glm::vec4 to, float t)
+{
+  float x = glm::dot(from, to);
+  const float sign = x >= 0 ? 1.0f : -1.0f;
+  x *= sign;
+
+  const float xm1 = x - 1.0f;
+  const float d = 1.0f - t;
+  const float sqrT = t * t;
+  const float sqrD = d * d;
+
+  float cT = 1.0f;
+  float cD = 1.0f;
+  for (int i = 7; i >= 0; --i)
+  {
+    cT = 1.0f + (SLERP_U[i] * sqrT - SLERP_V[i]) * xm1 * cT;
+    cD = 1.0f + (SLERP_U[i] * sqrD - SLERP_V[i]) * xm1 * cD;
+  }
+
+  return from * (d * cD) + to * (sign * t * cT);
+}
+
+void slerp_batch(
+  std::span<const glm::vec4> from,
+  std::span<const glm::vec4> to,
+  std::span<const float> factors,
+  std::span<glm::vec4> results)
+{
+  std::size_t i = 0;
+
+#if ANIMATION_USE_SSE
+  // Four quaternions at a time, transposed so that every lane is a separate quaternion
+  for (; i + 4 <= results.size(); i += 4)
+  {
+    __m128 a0 = _mm_loadu_ps(&from[i + 0].x);
+    __m128 a1 = _mm_loadu_ps(&from[i + 1].x);
+    __m128 a2 = _mm_loadu_ps(&from[i + 2].x);
+    __m128 a3 = _mm_loadu_ps(&from[i + 3].x);
+    _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+
+    __m128 b0 = _mm_loadu_ps(&to[i + 0].x);
+    __m128 b1 = _mm_loadu_ps(&to[i + 1].x);
+    __m128 b2 = _mm_loadu_ps(&to[i + 2].x);
+    __m128 b3 = _mm_loadu_ps(&to[i + 3].x);
+    _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+
+    const __m128 t = _mm_loadu_ps(&factors[i]);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    __m128 x = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(a0, b0), _mm_mul_ps(a1, b1)),
+      _mm_add_ps(_mm_mul_ps(a2, b2), _mm_mul_ps(a3, b3)));
+    // Take the shortest arc by flipping the sign bit of negative dot products
+    const __m128 signBit = _mm_and_ps(x, _mm_set1_ps(-0.0f));
+    x = _mm_xor_ps(x, signBit);
+
+    const __m128 xm1 = _mm_sub_ps(x, one);
+    const __m128 d = _mm_sub_ps(one, t);
+    const __m128 sqrT = _mm_mul_ps(t, t);
+    const __m128 sqrD = _mm_mul_ps(d, d);
+
+    __m128 cT = one;
+    __m128 cD = one;
+    for (int k = 7; k >= 0; --k)
+    {
+      const __m128 u = _mm_set1_ps(SLERP_U[k]);
+      const __m128 v = _mm_set1_ps(SLERP_V[k]);
+      cT = _mm_add_ps(one, _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u, sqrT), v), xm1), cT));
+      cD = _mm_add_ps(one, _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u, sqrD), v), xm1), cD));
+    }
+    cT = _mm_xor_ps(_mm_mul_ps(t, cT), signBit);
+    cD = _mm_mul_ps(d, cD);
+
+    __m128 r0 = _mm_add_ps(_mm_mul_ps(a0, cD), _mm_mul_ps(b0, cT));
+    __m128 r1 = _mm_add_ps(_mm_mul_ps(a1, cD), _mm_mul_ps(b1, cT));
+    __m128 r2 = _mm_add_ps(_mm_mul_ps(a2, cD), _mm_mul_ps(b2, cT));
+    __m128 r3 = _mm_add_ps(_mm_mul_ps(a3, cD), _mm_mul_ps(b3, cT));
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+    _mm_storeu_ps(&results[i + 0].x, r0);
+    _mm_storeu_ps(&results[i + 1].x, r1);
+    _mm_storeu_ps(&results[i + 2].x, r2);
+    _mm_storeu_ps(&results[i + 3].x, r3);
+  }
+#endif
+
+  for (; i < results.size(); ++i)
+    results[i] = slerp_scalar(from[i], to[i], factors[i]);
+}
+
+void lerp_batch(
+  std::span<const glm::vec4> from,
+  std::span<const glm::vec4> to,
+  std::span<const float> factors,
+  std::span<glm::vec4> results)
+{
+  // Simple enough for compilers to vectorize on their own
+  for (std::size_t i = 0; i < results.size(); ++i)
+    results[i] = from[i] + (to[i] - from[i]) * factors[i];
+}
+
+void AnimationPlayer::Batch::clear()
+{
+  channels.clear();
+  from.clear();
+  to.clear();
+  factors.clear();
+  results.clear();
+}
+
+AnimationPlayer::AnimationPlayer(const AnimationClip& clip_)
+  : clip{&clip_}
+  , cursors(clip_.channels.size(), 0)
+{
+}
+
+void AnimationPlayer::apply(float time, SceneGraph& graph)
+{
+  if (clip->duration > 0)
+    time = std::fmod(time, clip->duration);
+
+  rotations.clear();
+  vectors.clear();
+
+  for (std::uint32_t channelIdx = 0; channelIdx < clip->channels.size(); ++channelIdx)
+  {
+    const auto& channel = clip->channels[channelIdx];
+    const auto& times = channel.times;
+    if (times.empty())
+      continue;
+
+    // Playing forward almost always hits the cached key or the one after it,
+    // anything else (e.g. wrapping around) falls back to a binary search.
+    auto& cursor = cursors[channelIdx];
+    const auto lastKey = static_cast<std::uint32_t>(times.size() - 1);
+    if (cursor > lastKey || time < times[cursor])
+      cursor = static_cast<std::uint32_t>(
+        std::max<std::ptrdiff_t>(
+          std::upper_bound(times.begin(), times.end(), time) - times.begin() - 1, 0));
+    else
+      while (cursor < lastKey && times[cursor + 1] <= time)
+        ++cursor;
+
+    const auto next = std::min(cursor + 1, lastKey);
+    float factor = 0;
+    if (next != cursor && channel.interpolation == AnimationInterpolation::Linear)
+      factor = std::clamp((time - times[cursor]) / (times[next] - times[cursor]), 0.0f, 1.0f);
+
+    auto& batch = channel.path == AnimationPath::Rotation ? rotations : vectors;
+    batch.channels.push_back(channelIdx);
+    batch.from.push_back(channel.values[cursor]);
+    batch.to.push_back(channel.values[next]);
+    batch.factors.push_back(factor);
+  }
+
+  rotations.results.resize(rotations.channels.size());
+  slerp_batch(rotations.from, rotations.to, rotations.factors, rotations.results);
+
+  vectors.results.resize(vectors.channels.size());
+  lerp_batch(vectors.from, vectors.to, vectors.factors, vectors.results);
+
+  for (std::size_t i = 0; i < rotations.channels.size(); ++i)
+  {
+    const auto& q = rotations.results[i];
+    graph.setRotation(
+      clip->channels[rotations.channels[i]].node, glm::normalize(glm::quat(q.w, q.x, q.y, q.z)));
+  }
+
+  for (std::size_t i = 0; i < vectors.channels.size(); ++i)
+  {
+    const auto& channel = clip->channels[vectors.channels[i]];
+    if (channel.path == AnimationPath::Translation)
+      graph.setTranslation(channel.node, glm::vec3(vectors.results[i]));
+    else
+      graph.setScale(channel.node, glm::vec3(vectors.results[i]));
+  }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "SceneGraph.hpp"
+
+
+enum class AnimationPath
+{
+  Translation,
+  Rotation,
+  Scale,
+};
+
+enum class AnimationInterpolation
+{
+  Step,
+  Linear,
+};
+
+// Animates a single property of a single scene graph node
+struct AnimationChannel
+{
+  std::uint32_t node;
+  AnimationPath path;
+  AnimationInterpolation interpolation;
+  std::vector<float> times;
+  // Rotations are xyzw quaternions, translations and scales only use xyz
+  std::vector<glm::vec4> values;
+};
+
+struct AnimationClip
+{
+  std::string name;
+  float duration = 0;
+  std::vector<AnimationChannel> channels;
+};
+
+/**
+ * Samples a clip and writes the result into the scene graph. Every channel
+ * remembers the keyframe it was sampled at last time, so playing forward only
+ * ever looks at the next key or two. Interpolation of all channels of a kind
+ * is done in a single batch.
+ */
+class AnimationPlayer
+{
+public:
+  explicit AnimationPlayer(const AnimationClip& clip);
+
+  // Time wraps around the clip's duration
+  void apply(float time, SceneGraph& graph);
+
+  std::size_t getChannelCount() const { return cursors.size(); }
+
+private:
+  const AnimationClip* clip;
+  std::vector<std::uint32_t> cursors;
+
+  struct Batch
+  {
+    std::vector<std::uint32_t> channels;
+    std::vector<glm::vec4> from;
+    std::vector<glm::vec4> to;
+    std::vector<float> factors;
+    std::vector<glm::vec4> results;
+
+    void clear();
+  };
+  Batch rotations;
+  Batch vectors;
+};
+
+// Quaternions are xyzw. Uses a polynomial approximation of slerp that
+// does not need any trigonometry and therefore vectorizes well.
+void slerp_batch(
+  std::span<const glm::vec4> from,
+  std::span<const glm::vec4> to,
+  std::span<const float> factors,
+  std::span<glm::vec4> results);
+
+void lerp_batch(
+  std::span<const glm::vec4> from,
+  std::span<const glm::vec4> to,
+  std::span<const float> factors,
+  std::span<glm::vec4> results);
@@ -0,0 +1,119 @@
+#include "Meshlets.hpp"
+
+#include <algorithm>
+#include <limits>
+
+
+static Meshlet compute_meshlet_bounds(
+  std::span<const glm::vec3> positions, std::span<const std::uint32_t> indices)
+{
+  const std::size_t triangleCount = indices.size() / 3;
+
+  glm::vec3 center{0};
+  for (auto idx : indices)
+    center += positions[idx];
+  center /= static_cast<float>(indices.size());
+
+  float radius = 0;
+  for (auto idx : indices)
+    radius = std::max(radius, glm::distance(center, positions[idx]));
+
+  // NOTE: degenerate triangles have no meaningful normal, so we don't let them
+  // affect the cone. If all of the triangles are degenerate, the cone is disabled.
+  glm::vec3 axis{0};
+  std::vector<glm::vec3> normals;
+  normals.reserve(triangleCount);
+  for (std::size_t i = 0; i < triangleCount; ++i)
+  {
+    const glm::vec3 p0 = positions[indices[3 * i + 0]];
+    const glm::vec3 p1 = positions[indices[3 * i + 1]];
+    const glm::vec3 p2 = positions[indices[3 * i + 2]];
+
+    const glm::vec3 n = cross(p1 - p0, p2 - p0);
+    const float len = length(n);
+    if (len <= std::numeric_limits<float>::epsilon())
+      continue;
+
+    normals.push_back(n / len);
+    axis += normals.back();
+  }
+
+  float cutoff = 1;
+  if (!normals.empty() && length(axis) > std::numeric_limits<float>::epsilon())
+  {
+    axis = normalize(axis);
+
+    float minDot = 1;
+    for (const auto& n : normals)
+      minDot = std::min(minDot, dot(n, axis));
+
+    // When the normals span more than a hemisphere (with a bit of
+    // a safety margin), the cone test can never succeed.
+    if (minDot > 0.1f)
+      cutoff = std::sqrt(1 - minDot * minDot);
+  }
+
+  return Meshlet{
+    .boundingSphere = glm::vec4(center, radius),
+    .normalCone = glm::vec4(axis, cutoff),
+    .firstIndex = 0,
+    .triangleCount = static_cast<std::uint32_t>(triangleCount),
+    .vertexOffset = 0,
+    .padding = 0,
+  };
+}
+
+void build_meshlets(
+  std::vector<Meshlet>& meshlets,
+  std::span<const glm::vec3> positions,
+  std::span<const std::uint32_t> indices,
+  std::uint32_t first_index,
+  std::uint32_t vertex_offset)
+{
+  // Which meshlet has last referenced a vertex, used to count unique vertices
+  constexpr std::uint32_t NONE = std::numeric_limits<std::uint32_t>::max();
+  std::vector<std::uint32_t> lastMeshlet(positions.size(), NONE);
+
+  std::size_t meshletBegin = 0;
+  std::uint32_t meshletVertices = 0;
+  std::uint32_t currentMeshlet = 0;
+
+  auto flush = [&](std::size_t meshlet_end) {
+    if (meshlet_end == meshletBegin)
+      return;
+
+    auto meshletIndices = indices.subspan(meshletBegin, meshlet_end - meshletBegin);
+    auto& meshlet = meshlets.emplace_back(compute_meshlet_bounds(positions, meshletIndices));
+    meshlet.firstIndex = first_index + static_cast<std::uint32_t>(meshletBegin);
+    meshlet.vertexOffset = vertex_offset;
+
+    meshletBegin = meshlet_end;
+    meshletVertices = 0;
+    ++currentMeshlet;
+  };
+
+  for (std::size_t tri = 0; tri + 2 < indices.size(); tri += 3)
+  {
+    std::uint32_t newVertices = 0;
+    for (std::size_t i = 0; i < 3; ++i)
+      if (lastMeshlet[indices[tri + i]] != currentMeshlet)
+        ++newVertices;
+
+    const std::size_t triangles = (tri - meshletBegin) / 3;
+    if (
+      meshletVertices + newVertices > MESHLET_MAX_VERTICES || triangles + 1 > MESHLET_MAX_TRIANGLES)
+      flush(tri);
+
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+      auto& last = lastMeshlet[indices[tri + i]];
+      if (last != currentMeshlet)
+      {
+        last = currentMeshlet;
+        ++meshletVertices;
+      }
+    }
+  }
+
+  flush(indices.size() - indices.size() % 3);
+}
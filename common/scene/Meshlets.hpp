@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Meshlet.h"
+
+
+// These limits are the ones recommended for mesh shading hardware, which keeps
+// the door open for mesh shaders, but nothing here actually requires them.
+inline constexpr std::uint32_t MESHLET_MAX_VERTICES = 64;
+inline constexpr std::uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+/**
+ * Splits a single relem into meshlets and appends them to `meshlets`.
+ * Triangles are clustered greedily in index buffer order, so every meshlet
+ * is a contiguous range of the original index buffer and no index re-ordering
+ * is required. `indices` must be relative to `positions`.
+ */
+void build_meshlets(
+  std::vector<Meshlet>& meshlets,
+  std::span<const glm::vec3> positions,
+  std::span<const std::uint32_t> indices,
+  std::uint32_t first_index,
+  std::uint32_t vertex_offset);
@@ -0,0 +1,154 @@
+#include "SceneGraph.hpp"
+
+#include <algorithm>
+
+#include <etna/Assert.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCENE_GRAPH_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define SCENE_GRAPH_USE_SSE 0
+#endif
+
+
+// Local transforms are affine, so the bottom row of `local` is known to be (0, 0, 0, 1)
+static glm::mat4x4 compose_affine(const glm::mat4x4& parent, const glm::mat4x4& local)
+{
+#if SCENE_GRAPH_USE_SSE
+  // Every column of the result is a combination of the parent's columns
+  const __m128 p0 = _mm_loadu_ps(&parent[0].x);
+  const __m128 p1 = _mm_loadu_ps(&parent[1].x);
+  const __m128 p2 = _mm_loadu_ps(&parent[2].x);
+  const __m128 p3 = _mm_loadu_ps(&parent[3].x);
+
+  glm::mat4x4 result;
+  for (int col = 0; col < 4; ++col)
+  {
+    __m128 r = _mm_add_ps(
+      _mm_add_ps(
+        _mm_mul_ps(p0, _mm_set1_ps(local[col].x)), _mm_mul_ps(p1, _mm_set1_ps(local[col].y))),
+      _mm_mul_ps(p2, _mm_set1_ps(local[col].z)));
+    if (col == 3)
+      r = _mm_add_ps(r, p3);
+    _mm_storeu_ps(&result[col].x, r);
+  }
+  return result;
+#else
+  return parent * local;
+#endif
+}
+
+void SceneGraph::clear()
+{
+  parents.clear();
+  subtreeSizes.clear();
+  instances.clear();
+  translations.clear();
+  rotations.clear();
+  scales.clear();
+  worldTransforms.clear();
+  dirtyFlags.clear();
+  dirtyNodes.clear();
+  changedInstances.clear();
+}
+
+std::uint32_t SceneGraph::addNode(
+  std::uint32_t parent,
+  glm::vec3 translation,
+  glm::quat rotation,
+  glm::vec3 scale,
+  std::uint32_t instance)
+{
+  const auto node = getNodeCount();
+
+  // Pre-order means that the parent's subtree currently ends right at the new node
+  ETNA_VERIFY(parent == NO_PARENT || parent + subtreeSizes[parent] == node);
+
+  parents.push_back(parent);
+  subtreeSizes.push_back(1);
+  instances.push_back(instance);
+  translations.push_back(translation);
+  rotations.push_back(rotation);
+  scales.push_back(scale);
+  worldTransforms.emplace_back(1.0f);
+  dirtyFlags.push_back(0);
+
+  for (auto ancestor = parent; ancestor != NO_PARENT; ancestor = parents[ancestor])
+    ++subtreeSizes[ancestor];
+
+  // Recomputing roots recomputes everything
+  if (parent == NO_PARENT)
+    markDirty(node);
+
+  return node;
+}
+
+void SceneGraph::markDirty(std::uint32_t node)
+{
+  if (dirtyFlags[node] != 0)
+    return;
+  dirtyFlags[node] = 1;
+  dirtyNodes.push_back(node);
+}
+
+void SceneGraph::setTranslation(std::uint32_t node, glm::vec3 translation)
+{
+  translations[node] = translation;
+  markDirty(node);
+}
+
+void SceneGraph::setRotation(std::uint32_t node, glm::quat rotation)
+{
+  rotations[node] = rotation;
+  markDirty(node);
+}
+
+void SceneGraph::setScale(std::uint32_t node, glm::vec3 scale)
+{
+  scales[node] = scale;
+  markDirty(node);
+}
+
+std::span<const std::uint32_t> SceneGraph::updateWorldTransforms(
+  std::span<glm::mat4x4> instance_matrices)
+{
+  changedInstances.clear();
+
+  // Sorting dirty nodes makes nested dirty subtrees trivial to skip,
+  // and the traversal becomes a sequence of forward linear sweeps.
+  std::sort(dirtyNodes.begin(), dirtyNodes.end());
+
+  std::uint32_t processedEnd = 0;
+  for (auto dirtyNode : dirtyNodes)
+  {
+    dirtyFlags[dirtyNode] = 0;
+
+    if (dirtyNode < processedEnd)
+      continue;
+
+    processedEnd = dirtyNode + subtreeSizes[dirtyNode];
+    for (std::uint32_t node = dirtyNode; node < processedEnd; ++node)
+    {
+      glm::mat4x4 local = glm::mat4_cast(rotations[node]);
+      local[0] *= scales[node].x;
+      local[1] *= scales[node].y;
+      local[2] *= scales[node].z;
+      local[3] = glm::vec4(translations[node], 1.0f);
+
+      const auto parent = parents[node];
+      worldTransforms[node] =
+        parent == NO_PARENT ? local : compose_affine(worldTransforms[parent], local);
+
+      if (instances[node] != NO_INSTANCE)
+      {
+        instance_matrices[instances[node]] = worldTransforms[node];
+        changedInstances.push_back(instances[node]);
+      }
+    }
+  }
+
+  dirtyNodes.clear();
+
+  return changedInstances;
+}
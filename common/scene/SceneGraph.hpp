@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+
+/**
+ * Persistent node hierarchy of a scene. Nodes are stored as structure-of-arrays in
+ * depth-first pre-order, so parents always precede their children and every subtree
+ * is a contiguous range of nodes. Changing a local transform only marks the node dirty,
+ * world transforms of dirty subtrees are recomputed lazily in `updateWorldTransforms`.
+ */
+class SceneGraph
+{
+public:
+  static constexpr std::uint32_t NO_NODE = ~std::uint32_t{0};
+  static constexpr std::uint32_t NO_PARENT = NO_NODE;
+  static constexpr std::uint32_t NO_INSTANCE = ~std::uint32_t{0};
+
+  void clear();
+
+  // Nodes have to be added in depth-first pre-order, so the parent has to be
+  // either the last added node or one of its ancestors.
+  std::uint32_t addNode(
+    std::uint32_t parent,
+    glm::vec3 translation,
+    glm::quat rotation,
+    glm::vec3 scale,
+    std::uint32_t instance = NO_INSTANCE);
+
+  std::uint32_t getNodeCount() const { return static_cast<std::uint32_t>(parents.size()); }
+  std::uint32_t getParent(std::uint32_t node) const { return parents[node]; }
+  std::uint32_t getInstance(std::uint32_t node) const { return instances[node]; }
+  std::uint32_t getSubtreeSize(std::uint32_t node) const { return subtreeSizes[node]; }
+
+  glm::vec3 getTranslation(std::uint32_t node) const { return translations[node]; }
+  glm::quat getRotation(std::uint32_t node) const { return rotations[node]; }
+  glm::vec3 getScale(std::uint32_t node) const { return scales[node]; }
+
+  void setTranslation(std::uint32_t node, glm::vec3 translation);
+  void setRotation(std::uint32_t node, glm::quat rotation);
+  void setScale(std::uint32_t node, glm::vec3 scale);
+
+  // Valid after `updateWorldTransforms`
+  const glm::mat4x4& getWorldTransform(std::uint32_t node) const { return worldTransforms[node]; }
+
+  // Recomputes world transforms of dirty subtrees and writes the ones belonging to
+  // instances into `instance_matrices`. Returns the instances that were changed,
+  // the span is valid until the next call.
+  std::span<const std::uint32_t> updateWorldTransforms(std::span<glm::mat4x4> instance_matrices);
+
+  std::size_t getDirtyNodeCount() const { return dirtyNodes.size(); }
+
+private:
+  void markDirty(std::uint32_t node);
+
+private:
+  std::vector<std::uint32_t> parents;
+  std::vector<std::uint32_t> subtreeSizes;
+  std::vector<std::uint32_t> instances;
+
+  std::vector<glm::vec3> translations;
+  std::vector<glm::quat> rotations;
+  std::vector<glm::vec3> scales;
+
+  std::vector<glm::mat4x4> worldTransforms;
+
+  // Flags prevent the same node from getting into the list twice
+  std::vector<std::uint8_t> dirtyFlags;
+  std::vector<std::uint32_t> dirtyNodes;
+
+  std::vector<std::uint32_t> changedInstances;
+};
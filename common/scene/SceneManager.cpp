@@ -1,18 +1,25 @@
 #include "SceneManager.hpp"
 
+#include <algorithm>
+#include <limits>
 #include <stack>
+#include <utility>
 
 #include <spdlog/spdlog.h>
 #include <fmt/std.h>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
+#include <glm/packing.hpp>
 #include <etna/GlobalContext.hpp>
-#include <etna/OneShotCmdMgr.hpp>
+#include <etna/Profiling.hpp>
+
+#include "render_utils/MemoryTracker.hpp"
+
+#include "Meshlets.hpp"
 
 
 SceneManager::SceneManager()
-  : oneShotCommands{etna::get_context().createOneShotCmdMgr()}
-  , transferHelper{etna::BlockingTransferHelper::CreateInfo{.stagingSize = 4096 * 4096 * 4}}
+  : uploader{AsyncUploader::CreateInfo{.stagingSize = STAGING_SIZE, .name = "scene_upload_ring"}}
 {
 }
 
@@ -53,82 +60,283 @@ std::optional<tinygltf::Model> SceneManager::loadModel(std::filesystem::path pat
   return model;
 }
 
+namespace
+{
+
+struct AccessorView
+{
+  const std::byte* data;
+  std::size_t stride;
+  std::size_t componentSize;
+};
+
+} // namespace
+
+static AccessorView view_accessor(const tinygltf::Model& model, const tinygltf::Accessor& accessor)
+{
+  const auto& bufView = model.bufferViews[accessor.bufferView];
+  const std::size_t componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+  return AccessorView{
+    .data = reinterpret_cast<const std::byte*>(model.buffers[bufView.buffer].data.data()) +
+      bufView.byteOffset + accessor.byteOffset,
+    .stride = bufView.byteStride != 0
+      ? bufView.byteStride
+      : componentSize * tinygltf::GetNumComponentsInType(accessor.type),
+    .componentSize = componentSize,
+  };
+}
+
+// Floats and normalized integers, as allowed for weights and animation outputs
+static float read_normalized(const std::byte* ptr, int component_type)
+{
+  switch (component_type)
+  {
+  case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+    float value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    return static_cast<float>(std::to_integer<std::uint8_t>(*ptr)) / 255.0f;
+  case TINYGLTF_COMPONENT_TYPE_BYTE:
+    return std::max(static_cast<float>(static_cast<std::int8_t>(*ptr)) / 127.0f, -1.0f);
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+    std::uint16_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return static_cast<float>(value) / 65535.0f;
+  }
+  case TINYGLTF_COMPONENT_TYPE_SHORT: {
+    std::int16_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return std::max(static_cast<float>(value) / 32767.0f, -1.0f);
+  }
+  default:
+    return 0;
+  }
+}
+
+static std::uint32_t read_index(const std::byte* ptr, int component_type)
+{
+  switch (component_type)
+  {
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    return std::to_integer<std::uint32_t>(*ptr);
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+    std::uint16_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+    std::uint32_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+  }
+  default:
+    return 0;
+  }
+}
+
+// glTF guarantees that node matrices are decomposable into TRS
+static void decompose_trs(
+  const glm::mat4x4& transform, glm::vec3& translation, glm::quat& rotation, glm::vec3& scale)
+{
+  translation = glm::vec3(transform[3]);
+
+  scale = glm::vec3(
+    glm::length(glm::vec3(transform[0])),
+    glm::length(glm::vec3(transform[1])),
+    glm::length(glm::vec3(transform[2])));
+  if (glm::determinant(glm::mat3x3(transform)) < 0.0f)
+    scale.x = -scale.x;
+
+  auto safeDivisor = [](float value) { return value != 0.0f ? value : 1.0f; };
+  rotation = glm::quat_cast(glm::mat3x3(
+    glm::vec3(transform[0]) / safeDivisor(scale.x),
+    glm::vec3(transform[1]) / safeDivisor(scale.y),
+    glm::vec3(transform[2]) / safeDivisor(scale.z)));
+}
+
 SceneManager::ProcessedInstances SceneManager::processInstances(const tinygltf::Model& model) const
 {
-  std::vector nodeTransforms(model.nodes.size(), glm::identity<glm::mat4x4>());
+  ProcessedInstances result;
+  result.graphNodes.resize(model.nodes.size(), SceneGraph::NO_NODE);
 
-  for (std::size_t nodeIdx = 0; nodeIdx < model.nodes.size(); ++nodeIdx)
+  if (model.scenes.empty())
+    return result;
+
+  const auto& scene = model.scenes[model.defaultScene >= 0 ? model.defaultScene : 0];
+
+  // Depth-first traversal visits nodes in exactly the order the graph wants them
+  struct StackEntry
+  {
+    int node;
+    std::uint32_t graphParent;
+  };
+  std::stack<StackEntry> stack;
+  for (auto it = scene.nodes.rbegin(); it != scene.nodes.rend(); ++it)
+    stack.push({*it, SceneGraph::NO_PARENT});
+
+  while (!stack.empty())
   {
+    const auto [nodeIdx, graphParent] = stack.top();
+    stack.pop();
+
     const auto& node = model.nodes[nodeIdx];
-    auto& transform = nodeTransforms[nodeIdx];
+
+    glm::vec3 translation{0};
+    glm::quat rotation{1, 0, 0, 0};
+    glm::vec3 scale{1};
 
     if (!node.matrix.empty())
     {
+      glm::mat4x4 transform;
       for (int i = 0; i < 4; ++i)
         for (int j = 0; j < 4; ++j)
           transform[i][j] = static_cast<float>(node.matrix[4 * i + j]);
+      decompose_trs(transform, translation, rotation, scale);
     }
     else
     {
       if (!node.scale.empty())
-        transform = scale(
-          transform,
-          glm::vec3(
-            static_cast<float>(node.scale[0]),
-            static_cast<float>(node.scale[1]),
-            static_cast<float>(node.scale[2])));
+        scale = glm::vec3(
+          static_cast<float>(node.scale[0]),
+          static_cast<float>(node.scale[1]),
+          static_cast<float>(node.scale[2]));
 
       if (!node.rotation.empty())
-        transform *= mat4_cast(glm::quat(
+        rotation = glm::quat(
           static_cast<float>(node.rotation[3]),
           static_cast<float>(node.rotation[0]),
           static_cast<float>(node.rotation[1]),
-          static_cast<float>(node.rotation[2])));
+          static_cast<float>(node.rotation[2]));
 
       if (!node.translation.empty())
-        transform = translate(
-          transform,
-          glm::vec3(
-            static_cast<float>(node.translation[0]),
-            static_cast<float>(node.translation[1]),
-            static_cast<float>(node.translation[2])));
+        translation = glm::vec3(
+          static_cast<float>(node.translation[0]),
+          static_cast<float>(node.translation[1]),
+          static_cast<float>(node.translation[2]));
     }
+
+    std::uint32_t instance = SceneGraph::NO_INSTANCE;
+    if (node.mesh >= 0)
+    {
+      instance = static_cast<std::uint32_t>(result.meshes.size());
+      result.meshes.push_back(node.mesh);
+      result.skins.push_back(node.skin >= 0 ? static_cast<std::uint32_t>(node.skin) : NO_SKIN);
+    }
+
+    const auto graphNode =
+      result.graph.addNode(graphParent, translation, rotation, scale, instance);
+    result.graphNodes[nodeIdx] = graphNode;
+
+    for (auto it = node.children.rbegin(); it != node.children.rend(); ++it)
+      stack.push({*it, graphNode});
   }
 
-  std::stack<std::size_t> vertices;
-  for (auto vert : model.scenes[model.defaultScene].nodes)
-    vertices.push(vert);
+  // World matrices get filled in by the first graph update
+  result.matrices.resize(result.meshes.size(), glm::identity<glm::mat4x4>());
+
+  return result;
+}
+
+std::vector<Skin> SceneManager::processSkins(
+  const tinygltf::Model& model, std::span<const std::uint32_t> graph_nodes) const
+{
+  std::vector<Skin> result;
+  result.reserve(model.skins.size());
 
-  while (!vertices.empty())
+  for (const auto& gltfSkin : model.skins)
   {
-    auto vert = vertices.top();
-    vertices.pop();
+    auto& skin = result.emplace_back();
+
+    skin.joints.reserve(gltfSkin.joints.size());
+    for (auto joint : gltfSkin.joints)
+      skin.joints.push_back(graph_nodes[joint]);
 
-    for (auto child : model.nodes[vert].children)
+    skin.inverseBindMatrices.resize(gltfSkin.joints.size(), glm::identity<glm::mat4x4>());
+    if (gltfSkin.inverseBindMatrices >= 0)
     {
-      nodeTransforms[child] = nodeTransforms[vert] * nodeTransforms[child];
-      vertices.push(child);
+      const auto& accessor = model.accessors[gltfSkin.inverseBindMatrices];
+      ETNA_VERIFY(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
+
+      const auto view = view_accessor(model, accessor);
+      const std::size_t count = std::min(accessor.count, skin.inverseBindMatrices.size());
+      for (std::size_t i = 0; i < count; ++i)
+        std::memcpy(
+          &skin.inverseBindMatrices[i], view.data + i * view.stride, sizeof(glm::mat4x4));
     }
   }
 
-  ProcessedInstances result;
+  return result;
+}
 
-  // Don't overallocate matrices, they are pretty chonky.
+std::vector<AnimationClip> SceneManager::processAnimations(
+  const tinygltf::Model& model, std::span<const std::uint32_t> graph_nodes) const
+{
+  std::vector<AnimationClip> result;
+  result.reserve(model.animations.size());
+
+  for (const auto& animation : model.animations)
   {
-    std::size_t totalNodesWithMeshes = 0;
-    for (std::size_t i = 0; i < model.nodes.size(); ++i)
-      if (model.nodes[i].mesh >= 0)
-        ++totalNodesWithMeshes;
-    result.matrices.reserve(totalNodesWithMeshes);
-    result.meshes.reserve(totalNodesWithMeshes);
-  }
+    auto& clip = result.emplace_back();
+    clip.name = animation.name;
 
-  for (std::size_t i = 0; i < model.nodes.size(); ++i)
-    if (model.nodes[i].mesh >= 0)
+    for (const auto& gltfChannel : animation.channels)
     {
-      result.matrices.push_back(nodeTransforms[i]);
-      result.meshes.push_back(model.nodes[i].mesh);
+      if (
+        gltfChannel.target_node < 0 ||
+        graph_nodes[gltfChannel.target_node] == SceneGraph::NO_NODE)
+        continue;
+
+      AnimationChannel channel{
+        .node = graph_nodes[gltfChannel.target_node],
+        .path = AnimationPath::Translation,
+        .interpolation = AnimationInterpolation::Linear,
+        .times = {},
+        .values = {},
+      };
+
+      if (gltfChannel.target_path == "rotation")
+        channel.path = AnimationPath::Rotation;
+      else if (gltfChannel.target_path == "scale")
+        channel.path = AnimationPath::Scale;
+      else if (gltfChannel.target_path != "translation")
+      {
+        spdlog::warn("glTF: Morph target animations are not supported, skipping a channel!");
+        continue;
+      }
+
+      const auto& sampler = animation.samplers[gltfChannel.sampler];
+      // NOTE: cubic splines are played back linearly through their keyframe values
+      const bool cubic = sampler.interpolation == "CUBICSPLINE";
+      if (sampler.interpolation == "STEP")
+        channel.interpolation = AnimationInterpolation::Step;
+
+      const auto& input = model.accessors[sampler.input];
+      const auto inputView = view_accessor(model, input);
+      channel.times.resize(input.count);
+      for (std::size_t i = 0; i < input.count; ++i)
+        channel.times[i] =
+          read_normalized(inputView.data + i * inputView.stride, input.componentType);
+
+      const auto& output = model.accessors[sampler.output];
+      const auto outputView = view_accessor(model, output);
+      const int components = channel.path == AnimationPath::Rotation ? 4 : 3;
+      channel.values.resize(input.count, glm::vec4{0});
+      for (std::size_t i = 0; i < input.count; ++i)
+      {
+        // Cubic spline keys are (in-tangent, value, out-tangent) triples
+        const std::byte* ptr = outputView.data + (cubic ? 3 * i + 1 : i) * outputView.stride;
+        for (int c = 0; c < components; ++c)
+          channel.values[i][c] =
+            read_normalized(ptr + c * outputView.componentSize, output.componentType);
+      }
+
+      if (!channel.times.empty())
+        clip.duration = std::max(clip.duration, channel.times.back());
+      clip.channels.push_back(std::move(channel));
     }
+  }
 
   return result;
 }
@@ -145,6 +353,36 @@ static std::uint32_t encode_normal(glm::vec3 normal)
   return sx | sy;
 }
 
+// Inverse of encode_normal, mirrors decode_normal from unpack_attributes.glsl
+static glm::vec3 decode_normal(std::uint32_t data)
+{
+  const float sign = (data & 0x0001u) != 0 ? -1.0f : 1.0f;
+  const auto sx = static_cast<std::int16_t>(data & 0xfffeu);
+  const auto sy = static_cast<std::int16_t>(data >> 16);
+
+  const float x = static_cast<float>(sx) / 32767.0f;
+  const float y = static_cast<float>(sy) / 32767.0f;
+  const float z = sign * std::sqrt(std::max(1.0f - x * x - y * y, 0.0f));
+
+  return {x, y, z};
+}
+
+static std::uint32_t encode_octahedral(glm::vec3 dir)
+{
+  const float l1 = std::abs(dir.x) + std::abs(dir.y) + std::abs(dir.z);
+  // Missing normals and tangents are zero, any direction will do
+  if (l1 == 0.0f)
+    return glm::packSnorm2x16(glm::vec2{0});
+
+  dir /= l1;
+  glm::vec2 enc{dir.x, dir.y};
+  if (dir.z < 0.0f)
+    enc = (1.0f - glm::abs(glm::vec2{enc.y, enc.x})) *
+      glm::vec2{enc.x >= 0.0f ? 1.0f : -1.0f, enc.y >= 0.0f ? 1.0f : -1.0f};
+
+  return glm::packSnorm2x16(enc);
+}
+
 SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model& model) const
 {
   // NOTE: glTF assets can have pretty wonky data layouts which are not appropriate
@@ -191,6 +429,7 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
     result.meshes.push_back(Mesh{
       .firstRelem = static_cast<std::uint32_t>(result.relems.size()),
       .relemCount = static_cast<std::uint32_t>(mesh.primitives.size()),
+      .dequantizationTm = glm::identity<glm::mat4x4>(),
     });
 
     for (const auto& prim : mesh.primitives)
@@ -238,6 +477,9 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
         .vertexOffset = static_cast<std::uint32_t>(result.vertices.size()),
         .indexOffset = static_cast<std::uint32_t>(result.indices.size()),
         .indexCount = static_cast<std::uint32_t>(accessors[0]->count),
+        .vertexCount = static_cast<std::uint32_t>(accessors[1]->count),
+        .firstMeshlet = static_cast<std::uint32_t>(result.meshlets.size()),
+        .meshletCount = 0,
       });
 
       const std::size_t vertexCount = accessors[1]->count;
@@ -295,7 +537,8 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
         // NOTE: if tangents are not available, one could use http://mikktspace.com/
         // NOTE: if normals are not available, reconstructing them is possible but will look ugly
         glm::vec3 normal{0};
-        glm::vec3 tangent{0};
+        // glTF tangents have the bitangent sign in w
+        glm::vec4 tangent{0};
         glm::vec2 texcoord{0};
         std::memcpy(&pos, ptrs[1], sizeof(pos));
 
@@ -310,8 +553,8 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
 
 
         vtx.positionAndNormal = glm::vec4(pos, std::bit_cast<float>(encode_normal(normal)));
-        vtx.texCoordAndTangentAndPadding =
-          glm::vec4(texcoord, std::bit_cast<float>(encode_normal(tangent)), 0);
+        vtx.texCoordAndTangentAndSign = glm::vec4(
+          texcoord, std::bit_cast<float>(encode_normal(glm::vec3(tangent))), tangent.w);
 
         ptrs[1] += strides[1];
         if (hasNormals)
@@ -322,6 +565,44 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
           ptrs[4] += strides[4];
       }
 
+      const auto jointsIt = prim.attributes.find("JOINTS_0");
+      const auto weightsIt = prim.attributes.find("WEIGHTS_0");
+      if (jointsIt != prim.attributes.end() && weightsIt != prim.attributes.end())
+      {
+        const auto& jointsAccessor = model.accessors[jointsIt->second];
+        const auto& weightsAccessor = model.accessors[weightsIt->second];
+        const auto jointsView = view_accessor(model, jointsAccessor);
+        const auto weightsView = view_accessor(model, weightsAccessor);
+
+        // Vertices of non-skinned primitives get zero weights
+        result.skinVertices.resize(result.relems.back().vertexOffset);
+        for (std::size_t i = 0; i < vertexCount; ++i)
+        {
+          glm::uvec4 joints;
+          glm::vec4 weights;
+          for (int c = 0; c < 4; ++c)
+          {
+            joints[c] = read_index(
+              jointsView.data + i * jointsView.stride + c * jointsView.componentSize,
+              jointsAccessor.componentType);
+            weights[c] = read_normalized(
+              weightsView.data + i * weightsView.stride + c * weightsView.componentSize,
+              weightsAccessor.componentType);
+          }
+
+          const float weightSum = weights.x + weights.y + weights.z + weights.w;
+          if (weightSum > 0)
+            weights /= weightSum;
+
+          result.skinVertices.push_back(SkinVertex{
+            .joints = {joints.x | (joints.y << 16), joints.z | (joints.w << 16)},
+            .weights = {
+              glm::packUnorm2x16(glm::vec2(weights.x, weights.y)),
+              glm::packUnorm2x16(glm::vec2(weights.z, weights.w))},
+          });
+        }
+      }
+
       // Indices are guaranteed to have no stride
       ETNA_VERIFY(bufViews[0]->byteStride == 0);
       const std::size_t indexCount = accessors[0]->count;
@@ -344,6 +625,88 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
           ptrs[0],
           sizeof(result.indices[0]) * indexCount);
       }
+
+      // NOTE: this is something a baker should do offline, but we
+      // don't have a baked format with meshlets yet.
+      {
+        auto& relem = result.relems.back();
+
+        std::vector<glm::vec3> positions(vertexCount);
+        for (std::size_t i = 0; i < vertexCount; ++i)
+          positions[i] = glm::vec3(result.vertices[relem.vertexOffset + i].positionAndNormal);
+
+        build_meshlets(
+          result.meshlets,
+          positions,
+          std::span{result.indices}.subspan(relem.indexOffset, relem.indexCount),
+          relem.indexOffset,
+          relem.vertexOffset);
+
+        relem.meshletCount =
+          static_cast<std::uint32_t>(result.meshlets.size()) - relem.firstMeshlet;
+      }
+    }
+  }
+
+  if (!result.skinVertices.empty())
+    result.skinVertices.resize(result.vertices.size());
+
+  return result;
+}
+
+std::vector<CompactVertex> SceneManager::compressVertices(
+  std::span<const Vertex> vertices,
+  std::span<const RenderElement> relems,
+  std::span<Mesh> meshes_data)
+{
+  std::vector<CompactVertex> result(vertices.size());
+
+  for (auto& mesh : meshes_data)
+  {
+    if (mesh.relemCount == 0)
+      continue;
+
+    // Relems of a mesh and their vertices are laid out contiguously
+    const auto& lastRelem = relems[mesh.firstRelem + mesh.relemCount - 1];
+    const std::size_t first = relems[mesh.firstRelem].vertexOffset;
+    const std::size_t last = lastRelem.vertexOffset + lastRelem.vertexCount;
+
+    glm::vec3 bboxMin{std::numeric_limits<float>::max()};
+    glm::vec3 bboxMax{std::numeric_limits<float>::lowest()};
+    for (std::size_t i = first; i < last; ++i)
+    {
+      bboxMin = glm::min(bboxMin, glm::vec3(vertices[i].positionAndNormal));
+      bboxMax = glm::max(bboxMax, glm::vec3(vertices[i].positionAndNormal));
+    }
+
+    // Uniform scale keeps dequantization a similarity transform, so normals
+    // don't need any correction when it gets folded into the model matrix.
+    const glm::vec3 extent = bboxMax - bboxMin;
+    const float scale = std::max({extent.x, extent.y, extent.z, 1e-6f});
+
+    mesh.dequantizationTm =
+      glm::scale(glm::translate(glm::identity<glm::mat4x4>(), bboxMin), glm::vec3{scale});
+
+    for (std::size_t i = first; i < last; ++i)
+    {
+      const auto& vtx = vertices[i];
+      const glm::vec3 quantized = glm::round(
+        glm::clamp((glm::vec3(vtx.positionAndNormal) - bboxMin) / scale, 0.0f, 1.0f) *
+        COMPACT_VERTEX_POSITION_MAX);
+
+      const std::uint32_t bitangentSign =
+        vtx.texCoordAndTangentAndSign.w < 0.0f ? COMPACT_VERTEX_BITANGENT_SIGN_BIT : 0u;
+
+      result[i] = CompactVertex{
+        .positionXY = static_cast<std::uint32_t>(quantized.x) |
+          (static_cast<std::uint32_t>(quantized.y) << 16),
+        .positionZAndFlags = static_cast<std::uint32_t>(quantized.z) | bitangentSign,
+        .normal = encode_octahedral(
+          decode_normal(std::bit_cast<std::uint32_t>(vtx.positionAndNormal.w))),
+        .tangent = encode_octahedral(
+          decode_normal(std::bit_cast<std::uint32_t>(vtx.texCoordAndTangentAndSign.z))),
+        .texCoord = glm::packHalf2x16(glm::vec2(vtx.texCoordAndTangentAndSign)),
+      };
     }
   }
 
@@ -351,27 +714,42 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
 }
 
 void SceneManager::uploadData(
-  std::span<const Vertex> vertices, std::span<const std::uint32_t> indices)
+  std::span<const std::byte> vertex_data,
+  std::span<const std::uint32_t> indices,
+  std::span<const Meshlet> meshlets_data)
 {
-  unifiedVbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
-    .size = vertices.size_bytes(),
-    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
+  unifiedVbuf = create_tracked_buffer(MemoryCategory::Geometry, etna::Buffer::CreateInfo{
+    .size = vertex_data.size_bytes(),
+    // Skinning reads vertices in a compute shader
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer |
+      vk::BufferUsageFlagBits::eStorageBuffer,
     .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
     .name = "unifiedVbuf",
   });
 
-  unifiedIbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+  unifiedIbuf = create_tracked_buffer(MemoryCategory::Geometry, etna::Buffer::CreateInfo{
     .size = indices.size_bytes(),
-    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
+    // Meshlet culling reads indices in a compute shader
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer |
+      vk::BufferUsageFlagBits::eStorageBuffer,
     .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
     .name = "unifiedIbuf",
   });
 
-  transferHelper.uploadBuffer<Vertex>(*oneShotCommands, unifiedVbuf, 0, vertices);
-  transferHelper.uploadBuffer<std::uint32_t>(*oneShotCommands, unifiedIbuf, 0, indices);
+  meshletBuf = create_tracked_buffer(MemoryCategory::Geometry, etna::Buffer::CreateInfo{
+    .size = meshlets_data.size_bytes(),
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "meshletBuf",
+  });
+
+  uploader.uploadBuffer<std::byte>(unifiedVbuf, 0, vertex_data);
+  uploader.uploadBuffer<std::uint32_t>(unifiedIbuf, 0, indices);
+  uploader.uploadBuffer<Meshlet>(meshletBuf, 0, meshlets_data);
 }
 
-void SceneManager::selectScene(std::filesystem::path path)
+void SceneManager::selectScene(
+  std::filesystem::path path, VertexFormat format, bool with_position_stream)
 {
   auto maybeModel = loadModel(path);
   if (!maybeModel.has_value())
@@ -383,21 +761,145 @@ void SceneManager::selectScene(std::filesystem::path path)
   // we guarantee that we don't forget to clear something
   // when re-loading a scene.
 
-  // NOTE: you might want to store these on the GPU for GPU-driven rendering.
-  auto [instMats, instMeshes] = processInstances(model);
+  auto [graph, instMats, instMeshes, instSkins, graphNodes] = processInstances(model);
+  sceneGraph = std::move(graph);
   instanceMatrices = std::move(instMats);
   instanceMeshes = std::move(instMeshes);
+  instanceSkins = std::move(instSkins);
+  sceneGraph.updateWorldTransforms(instanceMatrices);
+
+  skins = processSkins(model, graphNodes);
+  animations = processAnimations(model, graphNodes);
 
-  auto [verts, inds, relems, meshs] = processMeshes(model);
+  auto [verts, inds, relems, meshs, mshlts, skinVerts] = processMeshes(model);
 
   renderElements = std::move(relems);
   meshes = std::move(meshs);
+  meshlets = std::move(mshlts);
+  vertexFormat = format;
 
-  uploadData(verts, inds);
+  if (vertexFormat == VertexFormat::Compact)
+  {
+    auto compactVerts = compressVertices(verts, renderElements, meshes);
+    uploadData(std::as_bytes(std::span{compactVerts}), inds, meshlets);
+  }
+  else
+    uploadData(std::as_bytes(std::span{verts}), inds, meshlets);
+
+  skinVbuf = {};
+  get_memory_tracker().untrack("skinVbuf");
+  if (!skinVerts.empty())
+  {
+    skinVbuf = create_tracked_buffer(MemoryCategory::Geometry, etna::Buffer::CreateInfo{
+      .size = skinVerts.size() * sizeof(SkinVertex),
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = "skinVbuf",
+    });
+    uploader.uploadBuffer<SkinVertex>(skinVbuf, 0, skinVerts);
+  }
+
+  positionVbuf = {};
+  get_memory_tracker().untrack("positionVbuf");
+  if (with_position_stream)
+  {
+    std::vector<glm::vec3> positions(verts.size());
+    for (std::size_t i = 0; i < verts.size(); ++i)
+      positions[i] = glm::vec3(verts[i].positionAndNormal);
+
+    positionVbuf = create_tracked_buffer(MemoryCategory::Geometry, etna::Buffer::CreateInfo{
+      .size = positions.size() * sizeof(glm::vec3),
+      .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = "positionVbuf",
+    });
+    uploader.uploadBuffer<glm::vec3>(positionVbuf, 0, positions);
+  }
+
+  // Nobody waits for the uploads, they precede all rendering on the queue anyway
+  uploader.flush([this]() {
+    const auto& period = uploader.getLastBusyPeriod();
+    spdlog::info(
+      "Uploaded {:.1f} MB of scene data at {:.2f} GB/s",
+      1e-6 * static_cast<double>(period.bytes),
+      period.gigabytesPerSecond());
+  });
+
+  createInstanceBuffers();
 }
 
-etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription()
+void SceneManager::createInstanceBuffers()
 {
+  instanceBuffers.reset();
+  get_memory_tracker().untrackPrefix("instance_matrices");
+
+  if (instanceMatrices.empty())
+    return;
+
+  auto& ctx = etna::get_context();
+  instanceBuffers.emplace(ctx.getMainWorkCount(), [this](std::size_t i) {
+    InstanceBuffer result{
+      .buffer = create_tracked_buffer(MemoryCategory::Transforms, etna::Buffer::CreateInfo{
+        .size = instanceMatrices.size() * sizeof(glm::mat4x4),
+        .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+        .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+        .name = fmt::format("instance_matrices/{}", i),
+      }),
+      .pendingInstances = {},
+      .isPending = std::vector<std::uint8_t>(instanceMatrices.size(), 0),
+    };
+    std::memcpy(
+      result.buffer.map(), instanceMatrices.data(), instanceMatrices.size() * sizeof(glm::mat4x4));
+    return result;
+  });
+}
+
+void SceneManager::updateInstances()
+{
+  ZoneScoped;
+
+  uploader.poll();
+
+  const auto changed = sceneGraph.updateWorldTransforms(instanceMatrices);
+
+  if (!instanceBuffers.has_value())
+    return;
+
+  if (!changed.empty())
+    instanceBuffers->iterate([changed](InstanceBuffer& buf) {
+      for (auto instance : changed)
+        if (std::exchange(buf.isPending[instance], std::uint8_t{1}) == 0)
+          buf.pendingInstances.push_back(instance);
+    });
+
+  auto& current = instanceBuffers->get();
+  auto* matrices = reinterpret_cast<glm::mat4x4*>(current.buffer.data());
+  for (auto instance : current.pendingInstances)
+  {
+    matrices[instance] = instanceMatrices[instance];
+    current.isPending[instance] = 0;
+  }
+  current.pendingInstances.clear();
+}
+
+etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription(
+  VertexFormat format)
+{
+  if (format == VertexFormat::Compact)
+    return etna::VertexByteStreamFormatDescription{
+      .stride = sizeof(CompactVertex),
+      .attributes = {
+        etna::VertexByteStreamFormatDescription::Attribute{
+          .format = vk::Format::eR32G32B32A32Uint,
+          .offset = 0,
+        },
+        etna::VertexByteStreamFormatDescription::Attribute{
+          .format = vk::Format::eR32Uint,
+          .offset = offsetof(CompactVertex, texCoord),
+        },
+      }};
+
   return etna::VertexByteStreamFormatDescription{
     .stride = sizeof(Vertex),
     .attributes = {
@@ -411,3 +913,15 @@ etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription
       },
     }};
 }
+
+etna::VertexByteStreamFormatDescription SceneManager::getPositionFormatDescription()
+{
+  return etna::VertexByteStreamFormatDescription{
+    .stride = sizeof(glm::vec3),
+    .attributes = {
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR32G32B32Sfloat,
+        .offset = 0,
+      },
+    }};
+}
@@ -1,13 +1,22 @@
 #pragma once
 
 #include <filesystem>
+#include <optional>
 
 #include <glm/glm.hpp>
 #include <tiny_gltf.h>
 #include <etna/Buffer.hpp>
-#include <etna/BlockingTransferHelper.hpp>
+#include <etna/GpuSharedResource.hpp>
 #include <etna/VertexInput.hpp>
 
+#include "render_utils/AsyncUploader.hpp"
+
+#include "SceneGraph.hpp"
+#include "Animation.hpp"
+#include "Meshlet.h"
+#include "SkinVertex.h"
+#include "compact_vertex.h"
+
 
 // A single render element (relem) corresponds to a single draw call
 // of a certain pipeline with specific bindings (including material data)
@@ -16,6 +25,10 @@ struct RenderElement
   std::uint32_t vertexOffset;
   std::uint32_t indexOffset;
   std::uint32_t indexCount;
+  std::uint32_t vertexCount;
+  // Every relem is split into meshlets for fine-grained culling
+  std::uint32_t firstMeshlet;
+  std::uint32_t meshletCount;
   // Not implemented!
   // Material* material;
 };
@@ -27,6 +40,24 @@ struct Mesh
 {
   std::uint32_t firstRelem;
   std::uint32_t relemCount;
+  // Maps positions stored in the vertex buffer to mesh space. Compact vertices
+  // are quantized relative to the mesh's bounding box, for full vertices this is identity.
+  glm::mat4x4 dequantizationTm;
+};
+
+// Joints are scene graph nodes, missing ones are SceneGraph::NO_NODE
+struct Skin
+{
+  std::vector<std::uint32_t> joints;
+  std::vector<glm::mat4x4> inverseBindMatrices;
+};
+
+enum class VertexFormat
+{
+  // 32 bytes, see SceneManager::Vertex
+  Full,
+  // 20 bytes, see compact_vertex.h
+  Compact,
 };
 
 class SceneManager
@@ -34,44 +65,97 @@ class SceneManager
 public:
   SceneManager();
 
-  void selectScene(std::filesystem::path path);
+  // A separate position-only stream is useful for depth-only passes,
+  // as they don't need to fetch the rest of the vertex attributes.
+  void selectScene(
+    std::filesystem::path path,
+    VertexFormat format = VertexFormat::Full,
+    bool with_position_stream = false);
 
   // Every instance is a mesh drawn with a certain transform
   // NOTE: maybe you can pass some additional data through unused matrix entries?
   std::span<const glm::mat4x4> getInstanceMatrices() { return instanceMatrices; }
   std::span<const std::uint32_t> getInstanceMeshes() { return instanceMeshes; }
 
+  // Instances are nodes of the scene graph, changes of local transforms
+  // are propagated to instance matrices by `updateInstances`
+  SceneGraph& getSceneGraph() { return sceneGraph; }
+
+  static constexpr std::uint32_t NO_SKIN = ~std::uint32_t{0};
+  std::span<const std::uint32_t> getInstanceSkins() { return instanceSkins; }
+  std::span<const Skin> getSkins() { return skins; }
+
+  // Animations target scene graph nodes
+  std::span<const AnimationClip> getAnimations() { return animations; }
+
+  // Recomputes dirty parts of the scene graph and writes changed matrices into the
+  // current frame's instance buffer. Call once per frame after the frame's
+  // resources are no longer used by the GPU. Also recycles finished uploads.
+  void updateInstances();
+
+  // Instance matrices of the current frame for GPU-driven rendering
+  etna::BufferBinding genInstanceBufferBinding()
+  {
+    return instanceBuffers->get().buffer.genBinding();
+  }
+
   // Every mesh is a collection of relems
   std::span<const Mesh> getMeshes() { return meshes; }
 
   // Every relem is a single draw call
   std::span<const RenderElement> getRenderElements() { return renderElements; }
 
+  // Every meshlet is a piece of a relem
+  std::span<const Meshlet> getMeshlets() { return meshlets; }
+
   vk::Buffer getVertexBuffer() { return unifiedVbuf.get(); }
+  // Null unless the scene was loaded with a position stream.
+  // Positions are always in mesh space, no dequantization is needed.
+  vk::Buffer getPositionBuffer() { return positionVbuf.get(); }
   vk::Buffer getIndexBuffer() { return unifiedIbuf.get(); }
 
-  etna::VertexByteStreamFormatDescription getVertexFormatDescription();
+  // For reading scene geometry from compute shaders
+  etna::BufferBinding genVertexBufferBinding() const { return unifiedVbuf.genBinding(); }
+  etna::BufferBinding genIndexBufferBinding() const { return unifiedIbuf.genBinding(); }
+  // Parallel to the vertex buffer, only available if the scene has skinned meshes
+  bool hasSkinVertices() const { return static_cast<bool>(skinVbuf.get()); }
+  etna::BufferBinding genSkinVertexBufferBinding() const { return skinVbuf.genBinding(); }
+  etna::BufferBinding genMeshletBufferBinding() const { return meshletBuf.genBinding(); }
+
+  VertexFormat getVertexFormat() const { return vertexFormat; }
+  static etna::VertexByteStreamFormatDescription getVertexFormatDescription(
+    VertexFormat format = VertexFormat::Full);
+  static etna::VertexByteStreamFormatDescription getPositionFormatDescription();
 
 private:
   std::optional<tinygltf::Model> loadModel(std::filesystem::path path);
 
   struct ProcessedInstances
   {
+    SceneGraph graph;
     std::vector<glm::mat4x4> matrices;
     std::vector<std::uint32_t> meshes;
+    std::vector<std::uint32_t> skins;
+    // glTF node index to graph node index
+    std::vector<std::uint32_t> graphNodes;
   };
 
   ProcessedInstances processInstances(const tinygltf::Model& model) const;
+  std::vector<Skin> processSkins(
+    const tinygltf::Model& model, std::span<const std::uint32_t> graph_nodes) const;
+  std::vector<AnimationClip> processAnimations(
+    const tinygltf::Model& model, std::span<const std::uint32_t> graph_nodes) const;
 
   struct Vertex
   {
     // First 3 floats are position, 4th float is a packed normal
     glm::vec4 positionAndNormal;
-    // First 2 floats are tex coords, 3rd is a packed tangent, 4th is padding
-    glm::vec4 texCoordAndTangentAndPadding;
+    // First 2 floats are tex coords, 3rd is a packed tangent, 4th is the bitangent sign
+    glm::vec4 texCoordAndTangentAndSign;
   };
 
   static_assert(sizeof(Vertex) == sizeof(float) * 8);
+  static_assert(sizeof(CompactVertex) == sizeof(std::uint32_t) * 5);
 
   struct ProcessedMeshes
   {
@@ -79,20 +163,53 @@ private:
     std::vector<std::uint32_t> indices;
     std::vector<RenderElement> relems;
     std::vector<Mesh> meshes;
+    std::vector<Meshlet> meshlets;
+    // Either empty or parallel to vertices
+    std::vector<SkinVertex> skinVertices;
   };
   ProcessedMeshes processMeshes(const tinygltf::Model& model) const;
-  void uploadData(std::span<const Vertex> vertices, std::span<const std::uint32_t>);
+  // Fills in dequantization matrices of the meshes
+  static std::vector<CompactVertex> compressVertices(
+    std::span<const Vertex> vertices,
+    std::span<const RenderElement> relems,
+    std::span<Mesh> meshes_data);
+  void uploadData(
+    std::span<const std::byte> vertex_data,
+    std::span<const std::uint32_t>,
+    std::span<const Meshlet> meshlets);
+  void createInstanceBuffers();
 
 private:
+  // Enough for a 4k RGBA8 texture
+  static constexpr vk::DeviceSize STAGING_SIZE = 4096 * 4096 * 4;
+
   tinygltf::TinyGLTF loader;
-  std::unique_ptr<etna::OneShotCmdMgr> oneShotCommands;
-  etna::BlockingTransferHelper transferHelper;
+  AsyncUploader uploader;
 
   std::vector<RenderElement> renderElements;
   std::vector<Mesh> meshes;
+  std::vector<Meshlet> meshlets;
   std::vector<glm::mat4x4> instanceMatrices;
   std::vector<std::uint32_t> instanceMeshes;
+  std::vector<std::uint32_t> instanceSkins;
+  std::vector<Skin> skins;
+  std::vector<AnimationClip> animations;
+  SceneGraph sceneGraph;
+  VertexFormat vertexFormat = VertexFormat::Full;
 
   etna::Buffer unifiedVbuf;
+  etna::Buffer positionVbuf;
+  etna::Buffer skinVbuf;
   etna::Buffer unifiedIbuf;
+  etna::Buffer meshletBuf;
+
+  // Persistently mapped. Every frame in flight has its own copy, so each one
+  // remembers which instances changed since it was last written to.
+  struct InstanceBuffer
+  {
+    etna::Buffer buffer;
+    std::vector<std::uint32_t> pendingInstances;
+    std::vector<std::uint8_t> isPending;
+  };
+  std::optional<etna::GpuSharedResource<InstanceBuffer>> instanceBuffers;
 };
@@ -0,0 +1,25 @@
+#ifndef MESHLET_H_INCLUDED
+#define MESHLET_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// A meshlet is a small cluster of triangles of a single relem that
+// can be culled as a whole. All coordinates are in mesh space.
+struct Meshlet
+{
+  // xyz is the center of the bounding sphere, w is it's radius
+  shader_vec4 boundingSphere;
+  // xyz is the axis of the cone containing all triangle normals,
+  // w is the cutoff for the cone test, 1 means the cone is too wide to cull anything
+  shader_vec4 normalCone;
+  // Offset of the first index of this meshlet in the unified index buffer
+  shader_uint firstIndex;
+  shader_uint triangleCount;
+  // Indices in the unified index buffer are relative to the relem's first vertex
+  shader_uint vertexOffset;
+  shader_uint padding;
+};
+
+
+#endif // MESHLET_H_INCLUDED
@@ -0,0 +1,18 @@
+#ifndef SKIN_VERTEX_H_INCLUDED
+#define SKIN_VERTEX_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Skinning attributes of a vertex, stored separately from the vertex
+// itself as only a small part of the scene is usually skinned.
+struct SkinVertex
+{
+  // Four 16-bit indices into the joints of the skin
+  shader_uvec2 joints;
+  // Four 16-bit unorm weights
+  shader_uvec2 weights;
+};
+
+
+#endif // SKIN_VERTEX_H_INCLUDED
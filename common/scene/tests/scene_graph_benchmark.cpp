@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "scene/SceneGraph.hpp"
+
+
+static constexpr std::size_t MAX_DEPTH = 8;
+
+// Times world transform updates of a random hierarchy with random nodes changing.
+// Usage: scene_graph_benchmark [node_count = 100000] [dirty_nodes = 1000] [updates = 200]
+int main(int argc, char** argv)
+{
+  const std::uint32_t nodeCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100'000;
+  const std::uint32_t dirtyCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+  const std::uint32_t updates = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 200;
+  if (nodeCount == 0 || updates == 0)
+    return EXIT_FAILURE;
+
+  std::mt19937 rng{42};
+  std::uniform_real_distribution<float> unit{-1.0f, 1.0f};
+
+  // Pre-order means that a new node is a child of the last one or of one of its ancestors.
+  // Picking its depth at random keeps the hierarchy as shallow as that of real scenes,
+  // a random walk up and down would make it thousands of levels deep.
+  SceneGraph graph;
+  std::vector<std::uint32_t> path;
+  std::uniform_int_distribution<std::size_t> depth{1, MAX_DEPTH};
+  for (std::uint32_t node = 0; node < nodeCount; ++node)
+  {
+    path.resize(std::min(depth(rng), path.size()));
+    const auto parent = path.empty() ? SceneGraph::NO_PARENT : path.back();
+
+    path.push_back(graph.addNode(
+      parent,
+      glm::vec3(unit(rng), unit(rng), unit(rng)),
+      glm::normalize(glm::quat(1.0f, unit(rng), unit(rng), unit(rng))),
+      glm::vec3(1.0f),
+      node));
+  }
+
+  std::vector<glm::mat4x4> instanceMatrices(nodeCount);
+  // Everything is dirty after building, this isn't what is measured
+  graph.updateWorldTransforms(instanceMatrices);
+
+  std::uniform_int_distribution<std::uint32_t> anyNode{0, nodeCount - 1};
+  std::vector<double> times;
+  std::size_t changedInstances = 0;
+  for (std::uint32_t update = 0; update < updates; ++update)
+  {
+    for (std::uint32_t i = 0; i < dirtyCount; ++i)
+    {
+      const auto node = anyNode(rng);
+      const glm::quat nudge = glm::quat(1.0f, 0.01f, 0.0f, 0.0f);
+      graph.setRotation(node, glm::normalize(graph.getRotation(node) * nudge));
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    changedInstances += graph.updateWorldTransforms(instanceMatrices).size();
+    times.push_back(
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+  }
+
+  std::ranges::sort(times);
+  fmt::print(
+    "{} nodes, {} dirty per update: median {:.3f} ms, min {:.3f} ms, {:.0f} instances changed\n",
+    nodeCount,
+    dirtyCount,
+    times[times.size() / 2],
+    times.front(),
+    static_cast<double>(changedInstances) / updates);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "wsi/KeyboardKey.hpp"
+#include "wsi/MouseButton.hpp"
+
+
+struct InputEvent
+{
+  enum class Type
+  {
+    KeyPressed,
+    KeyReleased,
+    MouseButtonPressed,
+    MouseButtonReleased,
+    // Text input, already translated according to the keyboard layout
+    Character,
+  };
+
+  Type type;
+
+  // Seconds on the OsWindowingManager::getTime clock. GLFW doesn't provide the time
+  // the OS registered an event at, so this is the time GLFW handed it over to us.
+  double time;
+
+  // Only one of these is meaningful, depending on the type
+  KeyboardKey key = KeyboardKey::COUNT;
+  MouseButton mouseButton = MouseButton::COUNT;
+  char32_t codepoint = 0;
+};
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <vector>
+
 #include <etna/Vulkan.hpp>
 #include <function2/function2.hpp>
 
 #include "wsi/Keyboard.hpp"
 #include "wsi/Mouse.hpp"
+#include "wsi/InputEvent.hpp"
 
 
 struct GLFWwindow;
@@ -69,10 +72,22 @@ public:
   Keyboard keyboard;
   Mouse mouse;
 
+  // Everything that happened since the previous poll, in order. Button states change
+  // at most once per poll, so a press and a release in between two polls show up in
+  // them over two frames, while these keep the exact order and times.
+  std::vector<InputEvent> inputEvents;
+
 private:
   OsWindowingManager* owner = nullptr;
   GLFWwindow* impl = nullptr;
   OsWindowResizeCb onResize;
   OsWindowRefreshCb onRefresh;
   bool mouseWasCaptured = false;
+
+  // Arrive from GLFW callbacks during a poll
+  std::vector<InputEvent> pendingEvents;
+  // Presses and releases of buttons that already changed their state on this poll
+  std::vector<InputEvent> deferredEvents;
+  // Rising and Falling only last for a single poll
+  std::vector<InputEvent> transitionedButtons;
 };
@@ -1,5 +1,7 @@
 #include "OsWindowingManager.hpp"
 
+#include <array>
+
 #include <GLFW/glfw3.h>
 #include <etna/Assert.hpp>
 
@@ -8,11 +10,108 @@
 
 static OsWindowingManager* instance = nullptr;
 
+static KeyboardKey key_from_glfw(int glfw_key)
+{
+  static const auto table = [] {
+    std::array<KeyboardKey, GLFW_KEY_LAST + 1> result;
+    result.fill(KeyboardKey::COUNT);
+#define X(key, glfwKey) result[glfwKey] = KeyboardKey::key;
+    ALL_KEYBOARD_KEYS
+#undef X
+    return result;
+  }();
+
+  // GLFW_KEY_UNKNOWN is negative
+  if (glfw_key < 0 || glfw_key > GLFW_KEY_LAST)
+    return KeyboardKey::COUNT;
+  return table[static_cast<std::size_t>(glfw_key)];
+}
+
+// Several mouse buttons are aliases of the same GLFW one, e.g. mbLeft and mb1
+static constexpr std::array<int, static_cast<std::size_t>(MouseButton::COUNT)> GLFW_MOUSE_BUTTONS{
+#define X(mb, glfwMb) glfwMb,
+  ALL_MOUSE_BUTTONS
+#undef X
+};
+
+static MouseButton mouse_button_from_glfw(int glfw_mb)
+{
+  for (std::size_t i = 0; i < GLFW_MOUSE_BUTTONS.size(); ++i)
+    if (GLFW_MOUSE_BUTTONS[i] == glfw_mb)
+      return static_cast<MouseButton>(i);
+  return MouseButton::COUNT;
+}
+
+static void set_mouse_button(Mouse& mouse, MouseButton mb, ButtonState state)
+{
+  const int glfwMb = GLFW_MOUSE_BUTTONS[static_cast<std::size_t>(mb)];
+  for (std::size_t i = 0; i < GLFW_MOUSE_BUTTONS.size(); ++i)
+    if (GLFW_MOUSE_BUTTONS[i] == glfwMb)
+      mouse.buttons[i] = state;
+}
+
+static ButtonState* button_state(OsWindow& window, const InputEvent& event)
+{
+  switch (event.type)
+  {
+  case InputEvent::Type::KeyPressed:
+  case InputEvent::Type::KeyReleased:
+    return &window.keyboard.keys[static_cast<std::size_t>(event.key)];
+  case InputEvent::Type::MouseButtonPressed:
+  case InputEvent::Type::MouseButtonReleased:
+    return &window.mouse.buttons[static_cast<std::size_t>(event.mouseButton)];
+  default:
+    return nullptr;
+  }
+}
+
 void OsWindowingManager::onErrorCb(int /*errc*/, const char* message)
 {
   spdlog::error("GLFW: {}", message);
 }
 
+void OsWindowingManager::onKeyCb(
+  GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/)
+{
+  // Repeats are for text input, which the char callback handles
+  const auto ourKey = key_from_glfw(key);
+  if (action == GLFW_REPEAT || ourKey == KeyboardKey::COUNT)
+    return;
+
+  if (auto it = instance->windows.find(window); it != instance->windows.end())
+    it->second->pendingEvents.push_back(InputEvent{
+      .type = action == GLFW_PRESS ? InputEvent::Type::KeyPressed : InputEvent::Type::KeyReleased,
+      .time = glfwGetTime(),
+      .key = ourKey,
+    });
+}
+
+void OsWindowingManager::onCharCb(GLFWwindow* window, unsigned int codepoint)
+{
+  if (auto it = instance->windows.find(window); it != instance->windows.end())
+    it->second->pendingEvents.push_back(InputEvent{
+      .type = InputEvent::Type::Character,
+      .time = glfwGetTime(),
+      .codepoint = static_cast<char32_t>(codepoint),
+    });
+}
+
+void OsWindowingManager::onMouseButtonCb(
+  GLFWwindow* window, int button, int action, int /*mods*/)
+{
+  const auto ourButton = mouse_button_from_glfw(button);
+  if (ourButton == MouseButton::COUNT)
+    return;
+
+  if (auto it = instance->windows.find(window); it != instance->windows.end())
+    it->second->pendingEvents.push_back(InputEvent{
+      .type = action == GLFW_PRESS ? InputEvent::Type::MouseButtonPressed
+                                   : InputEvent::Type::MouseButtonReleased,
+      .time = glfwGetTime(),
+      .mouseButton = ourButton,
+    });
+}
+
 void OsWindowingManager::onMouseScrollCb(GLFWwindow* window, double xoffset, double yoffset)
 {
   if (auto it = instance->windows.find(window); it != instance->windows.end())
@@ -38,8 +137,11 @@ void OsWindowingManager::onWindowSizeCb(GLFWwindow* window, int width, int heigh
       it->second->onResize({static_cast<glm::uint>(width), static_cast<glm::uint>(height)});
 }
 
-OsWindowingManager::OsWindowingManager()
+OsWindowingManager::OsWindowingManager(bool headless)
 {
+  if (headless)
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+
   ETNA_VERIFY(glfwInit() == GLFW_TRUE);
 
   glfwSetErrorCallback(&OsWindowingManager::onErrorCb);
@@ -84,6 +186,9 @@ std::unique_ptr<OsWindow> OsWindowingManager::createWindow(OsWindow::CreateInfo
     nullptr,
     nullptr);
 
+  glfwSetKeyCallback(glfwWindow, &onKeyCb);
+  glfwSetCharCallback(glfwWindow, &onCharCb);
+  glfwSetMouseButtonCallback(glfwWindow, &onMouseButtonCb);
   glfwSetScrollCallback(glfwWindow, &onMouseScrollCb);
   glfwSetWindowCloseCallback(glfwWindow, &onWindowClosedCb);
   glfwSetWindowRefreshCallback(glfwWindow, &onWindowRefreshCb);
@@ -112,47 +217,58 @@ void OsWindowingManager::onWindowDestroyed(GLFWwindow* impl)
   glfwDestroyWindow(impl);
 }
 
-void OsWindowingManager::updateWindow(OsWindow& window)
+void OsWindowingManager::applyInputEvent(OsWindow& window, const InputEvent& event)
 {
-  auto transitionState = [](ButtonState& state, bool glfw_state) {
-    switch (state)
-    {
-    case ButtonState::Low:
-      if (glfw_state)
-        state = ButtonState::Rising;
-      break;
-    case ButtonState::Rising:
-      state = ButtonState::High;
-      break;
-    case ButtonState::High:
-      if (!glfw_state)
-        state = ButtonState::Falling;
-      break;
-    case ButtonState::Falling:
-      state = ButtonState::Low;
-      break;
-    default:
-      break;
-    }
-  };
+  ButtonState* state = button_state(window, event);
+  if (state == nullptr)
+    return;
 
-  auto processMb = [&window, &transitionState](MouseButton mb, int glfw_mb) {
-    const bool pressed = glfwGetMouseButton(window.impl, glfw_mb) == GLFW_PRESS;
-    transitionState(window.mouse.buttons[static_cast<std::size_t>(mb)], pressed);
-  };
+  // Otherwise, a press and a release within a single poll would go unnoticed
+  if (*state == ButtonState::Rising || *state == ButtonState::Falling)
+  {
+    window.deferredEvents.push_back(event);
+    return;
+  }
 
-#define X(mb, glfwMb) processMb(MouseButton::mb, glfwMb);
-  ALL_MOUSE_BUTTONS
-#undef X
+  // E.g. releases of keys that were pressed before the window got focus
+  const bool pressed = event.type == InputEvent::Type::KeyPressed ||
+    event.type == InputEvent::Type::MouseButtonPressed;
+  if (pressed == is_held_down(*state))
+    return;
 
-  auto processKey = [&window, &transitionState](KeyboardKey key, int glfw_key) {
-    const bool pressed = glfwGetKey(window.impl, glfw_key) == GLFW_PRESS;
-    transitionState(window.keyboard.keys[static_cast<std::size_t>(key)], pressed);
-  };
+  const auto newState = pressed ? ButtonState::Rising : ButtonState::Falling;
+  if (event.mouseButton != MouseButton::COUNT)
+    set_mouse_button(window.mouse, event.mouseButton, newState);
+  else
+    *state = newState;
+  window.transitionedButtons.push_back(event);
+}
 
-#define X(mb, glfwMb) processKey(KeyboardKey::mb, glfwMb);
-  ALL_KEYBOARD_KEYS
-#undef X
+void OsWindowingManager::updateWindow(OsWindow& window)
+{
+  // Only buttons that changed are touched, so this doesn't depend on the amount of keys
+  for (const auto& event : window.transitionedButtons)
+  {
+    ButtonState* state = button_state(window, event);
+    const auto settled = *state == ButtonState::Rising ? ButtonState::High : ButtonState::Low;
+    if (event.mouseButton != MouseButton::COUNT)
+      set_mouse_button(window.mouse, event.mouseButton, settled);
+    else
+      *state = settled;
+  }
+  window.transitionedButtons.clear();
+
+  // Swapping keeps the allocations around for the next poll
+  window.inputEvents.swap(window.pendingEvents);
+  window.pendingEvents.clear();
+
+  // Deferred events happened before the new ones
+  std::vector<InputEvent> deferred;
+  deferred.swap(window.deferredEvents);
+  for (const auto& event : deferred)
+    applyInputEvent(window, event);
+  for (const auto& event : window.inputEvents)
+    applyInputEvent(window, event);
 
   if (window.captureMouse)
   {
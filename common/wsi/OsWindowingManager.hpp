@@ -12,7 +12,9 @@ class OsWindowingManager
   friend class OsWindow;
 
 public:
-  OsWindowingManager();
+  // Headless mode uses GLFW's null platform, which works without
+  // a display, e.g. on build machines. Don't create windows with it.
+  explicit OsWindowingManager(bool headless = false);
   ~OsWindowingManager();
 
   OsWindowingManager(const OsWindowingManager&) = delete;
@@ -33,8 +35,12 @@ public:
 
 private:
   void updateWindow(OsWindow& window);
+  static void applyInputEvent(OsWindow& window, const InputEvent& event);
 
   static void onErrorCb(int errc, const char* message);
+  static void onKeyCb(GLFWwindow* window, int key, int scancode, int action, int mods);
+  static void onCharCb(GLFWwindow* window, unsigned int codepoint);
+  static void onMouseButtonCb(GLFWwindow* window, int button, int action, int mods);
   static void onMouseScrollCb(GLFWwindow* window, double xoffset, double yoffset);
   static void onWindowClosedCb(GLFWwindow* window);
   static void onWindowRefreshCb(GLFWwindow* window);
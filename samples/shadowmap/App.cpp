@@ -1,68 +1,265 @@
 #include "App.hpp"
 
+#include <algorithm>
+#include <thread>
+
+#include <spdlog/spdlog.h>
 #include <tracy/Tracy.hpp>
 
 #include "gui/ImGuiRenderer.hpp"
+#include "render_utils/MemoryTracker.hpp"
+
+
+// Benchmarks are simulated at a fixed rate, so that results don't depend on frame times
+static constexpr double BENCHMARK_TIME_STEP = 1.0 / 60.0;
+static constexpr std::uint32_t BENCHMARK_DEFAULT_FRAMES = 1200;
+// Pipelines are created and caches are cold during the first frames
+static constexpr std::uint32_t BENCHMARK_WARMUP_FRAMES = 16;
+static constexpr double CAMERA_RECORDING_INTERVAL = 0.5;
+// With a render thread, input is polled way more often than frames are drawn, so that
+// packets are fresh whenever the render thread picks one up
+static constexpr std::chrono::milliseconds INPUT_POLL_INTERVAL{1};
 
+static bool is_transient(ButtonState state)
+{
+  return state == ButtonState::Rising || state == ButtonState::Falling;
+}
+
+// Presses and releases only last for a single packet, so replaced packets pass them on
+static void merge_frame_packets(const FramePacket& replaced, FramePacket& latest)
+{
+  for (std::size_t i = 0; i < latest.keyboard.keys.size(); ++i)
+    if (is_transient(replaced.keyboard.keys[i]) && !is_transient(latest.keyboard.keys[i]))
+      latest.keyboard.keys[i] = replaced.keyboard.keys[i];
+
+  // The latest camera includes the movement of the replaced packet
+  latest.inputTime = std::min(latest.inputTime, replaced.inputTime);
+}
 
-App::App()
+App::App(CreateInfo info)
+  : headless{info.headless}
+  , frameLimit{info.frameLimit}
+  , useRenderThread{info.renderThread && !info.headless && !info.benchmark && info.frameLimit == 0}
+  , windowing{info.headless}
+  , recordCameraPath{std::move(info.recordCameraPath)}
 {
   glm::uvec2 initialRes = {1280, 720};
+
+  shadowCam.lookAt({-8, 10, 8}, {0, 0, 0}, {0, 1, 0});
+  mainCam.lookAt({0, 10, 10}, {0, 0, 0}, {0, 1, 0});
+
+  if (info.benchmark)
+  {
+    if (frameLimit == 0)
+      frameLimit = BENCHMARK_DEFAULT_FRAMES;
+
+    std::optional<CameraPath> path;
+    if (!info.cameraPath.empty())
+      path = CameraPath::load(info.cameraPath);
+    if (!path)
+      path = CameraPath::orbit(
+        {0, 0, 0}, 15, 8, static_cast<float>(frameLimit * BENCHMARK_TIME_STEP));
+
+    benchmark.emplace(Benchmark{
+      .cameraPath = std::move(*path),
+      .statistics = {},
+      .reportPath = std::move(info.reportPath),
+    });
+  }
+
+  renderer.reset(new Renderer(initialRes));
+
+  if (headless)
+  {
+    renderer->initVulkan({}, true, info.framesInFlight);
+    renderer->initOffscreenFrameDelivery();
+    renderer->setVertexFetchOptions(info.vertexFetch);
+    renderer->loadScene(GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town/scene.gltf");
+    return;
+  }
+
   mainWindow = windowing.createWindow(OsWindow::CreateInfo{
     .resolution = initialRes,
     .resizeable = true,
     .refreshCb =
       [this]() {
         // NOTE: this is only called when the window is being resized.
+        if (useRenderThread)
+        {
+          framePackets->push(makeFramePacket());
+          return;
+        }
         drawFrame();
         FrameMark;
       },
     .resizeCb =
       [this](glm::uvec2 res) {
+        windowResolution = res;
         if (res.x == 0 || res.y == 0)
           return;
 
-        renderer->recreateSwapchain(res);
+        // The render thread picks the new resolution up on its own
+        if (!useRenderThread)
+          renderer->recreateSwapchain(res);
       },
   });
 
-  renderer.reset(new Renderer(initialRes));
+  // The OS may not give us the resolution we asked for, e.g. on high DPI displays
+  windowResolution = mainWindow->getResolution();
 
   auto instExts = windowing.getRequiredVulkanInstanceExtensions();
-  renderer->initVulkan(instExts);
+  renderer->initVulkan(instExts, false, info.framesInFlight);
+  renderer->setVsync(info.vsync);
 
   auto surface = mainWindow->createVkSurface(etna::get_context().getInstance());
 
-  renderer->initFrameDelivery(
-    std::move(surface), [window = mainWindow.get()]() { return window->getResolution(); });
+  renderer->initFrameDelivery(std::move(surface), [this]() { return windowResolution.load(); });
 
   // TODO: this is bad design, this initialization is dependent on the current ImGui context, but we
   // pass it implicitly here instead of explicitly. Beware if trying to do something tricky.
   ImGuiRenderer::enableImGuiForWindow(mainWindow->native());
 
-  shadowCam.lookAt({-8, 10, 8}, {0, 0, 0}, {0, 1, 0});
-  mainCam.lookAt({0, 10, 10}, {0, 0, 0}, {0, 1, 0});
-
+  renderer->setVertexFetchOptions(info.vertexFetch);
   renderer->loadScene(GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town/scene.gltf");
+
+  if (useRenderThread)
+    framePackets.emplace(&merge_frame_packets);
 }
 
 void App::run()
 {
+  std::jthread renderThread;
+  if (useRenderThread)
+    renderThread = std::jthread{[this]() { renderLoop(); }};
+
   double lastTime = windowing.getTime();
-  while (!mainWindow->isBeingClosed())
+  const double startTime = lastTime;
+  double lastKeyframeTime = -CAMERA_RECORDING_INTERVAL;
+  std::uint32_t frameCount = 0;
+  while (headless || !mainWindow->isBeingClosed())
   {
+    if (frameLimit != 0 && frameCount++ == frameLimit)
+      break;
+
     const double currTime = windowing.getTime();
     const float diffTime = static_cast<float>(currTime - lastTime);
     lastTime = currTime;
 
-    windowing.poll();
+    pollWindows();
+
+    if (benchmark)
+      mainCam = benchmark->cameraPath.sample(
+        static_cast<float>(benchmark->frame * BENCHMARK_TIME_STEP), mainCam);
+    else if (mainWindow)
+      processInput(diffTime);
+
+    if (!recordCameraPath.empty() && currTime - lastKeyframeTime >= CAMERA_RECORDING_INTERVAL)
+    {
+      recordedCameraPath.addKeyframe(static_cast<float>(currTime - startTime), mainCam);
+      lastKeyframeTime = currTime;
+    }
 
-    processInput(diffTime);
+    if (useRenderThread)
+    {
+      framePackets->push(makeFramePacket());
+      std::this_thread::sleep_for(INPUT_POLL_INTERVAL);
+      continue;
+    }
 
     drawFrame();
 
+    if (benchmark)
+      recordBenchmarkFrame(1000.0 * (windowing.getTime() - currTime));
+
     FrameMark;
   }
+
+  if (useRenderThread)
+  {
+    framePackets->close();
+    renderThread.join();
+  }
+
+  const auto latency = renderer->getLatencyStatistics().summarize();
+  if (auto it = latency.find("input_latency_ms"); it != latency.end())
+    spdlog::info(
+      "Input to GPU completion {}: mean {:.2f} ms, p50 {:.2f} ms, p99 {:.2f} ms",
+      useRenderThread ? "with a render thread" : "on a single thread",
+      it->second.mean,
+      it->second.p50,
+      it->second.p99);
+
+  const auto pacing = renderer->getPacingStatistics().summarize();
+  auto interval = pacing.find("frame_interval_ms");
+  auto jitter = pacing.find("frame_jitter_ms");
+  if (interval != pacing.end() && jitter != pacing.end())
+    spdlog::info(
+      "Frame interval: mean {:.2f} ms, p99 {:.2f} ms, jitter between frames: mean {:.2f} ms, "
+      "p99 {:.2f} ms",
+      interval->second.mean,
+      interval->second.p99,
+      jitter->second.mean,
+      jitter->second.p99);
+
+  if (benchmark)
+    finishBenchmark();
+
+  if (!recordCameraPath.empty() && recordedCameraPath.save(recordCameraPath))
+    spdlog::info("Camera path saved to '{}'", recordCameraPath.string());
+}
+
+void App::recordBenchmarkFrame(double frame_ms)
+{
+  if (benchmark->frame++ < BENCHMARK_WARMUP_FRAMES)
+    return;
+
+  auto& stats = benchmark->statistics;
+  const auto& worldRenderer = renderer->getWorldRenderer();
+
+  stats.record("cpu_frame_ms", frame_ms);
+  if (const auto latencyMs = renderer->getLastInputLatencyMs())
+    stats.record("input_latency_ms", *latencyMs);
+
+  const auto& renderStats = worldRenderer.getRenderStats();
+  stats.record("draw_calls", renderStats.drawCalls);
+  stats.record("triangles", static_cast<double>(renderStats.triangles));
+  stats.record(
+    "fragment_shader_invocations", static_cast<double>(renderStats.fragmentShaderInvocations));
+
+  for (const auto& zone : renderer->getGpuTimer().getResults())
+    stats.record(fmt::format("gpu_{}_ms", zone.name), zone.milliseconds);
+}
+
+void App::finishBenchmark()
+{
+  // Every report is named after the same base, without whatever extension was given
+  const auto base = std::filesystem::path{benchmark->reportPath}.replace_extension();
+  const auto withExtension = [&base](std::string_view extension) {
+    auto path = base;
+    path += extension;
+    return path;
+  };
+
+  const auto& stats = benchmark->statistics;
+  if (stats.writeJson(withExtension(".json")) && stats.writeCsv(withExtension(".csv")) &&
+      get_memory_tracker().writeJson(withExtension(".memory.json")))
+    spdlog::info("Benchmark report written to '{}'", base.string());
+}
+
+void App::pollWindows()
+{
+  {
+    // ImGui's input callbacks are called while polling
+    auto guiLock = renderer->lockGui();
+    windowing.poll();
+    renderer->prepareGui();
+  }
+
+  // Presses and releases have exact times, everything else is as old as this poll
+  lastInputTime = std::chrono::steady_clock::now();
+  if (mainWindow && !mainWindow->inputEvents.empty())
+    lastInputTime -= std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(windowing.getTime() - mainWindow->inputEvents.front().time));
 }
 
 void App::processInput(float dt)
@@ -88,20 +285,50 @@ void App::processInput(float dt)
   moveCam(camToControl, mainWindow->keyboard, dt);
   if (mainWindow->captureMouse)
     rotateCam(camToControl, mainWindow->mouse, dt);
+}
 
-  renderer->debugInput(mainWindow->keyboard);
+FramePacket App::makeFramePacket()
+{
+  return FramePacket{
+    .mainCam = mainCam,
+    .shadowCam = shadowCam,
+    .currentTime = benchmark ? static_cast<float>(benchmark->frame * BENCHMARK_TIME_STEP)
+                             : static_cast<float>(windowing.getTime()),
+    .keyboard = mainWindow ? mainWindow->keyboard : Keyboard{},
+    .inputTime = lastInputTime,
+  };
 }
 
 void App::drawFrame()
 {
   ZoneScoped;
 
-  renderer->update(FramePacket{
-    .mainCam = mainCam,
-    .shadowCam = shadowCam,
-    .currentTime = static_cast<float>(windowing.getTime()),
-  });
-  renderer->drawFrame();
+  renderer->acquireFrame();
+  renderer->drawFrame(makeFramePacket());
+}
+
+void App::renderLoop()
+{
+  tracy::SetThreadName("Render");
+
+  FramePacket packet;
+  while (true)
+  {
+    renderer->acquireFrame();
+    renderer->waitJustInTime();
+
+    // Waiting for the GPU and the display is done, so the packet is as fresh as it gets.
+    // The frame is still drawn once closed, as the swapchain image is already acquired.
+    auto latest = framePackets->pop();
+    if (latest)
+      packet = std::move(*latest);
+
+    renderer->drawFrame(packet);
+    FrameMark;
+
+    if (!latest)
+      break;
+  }
 }
 
 void App::moveCam(Camera& cam, const Keyboard& kb, float dt)
@@ -1,32 +1,83 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+
 #include "wsi/OsWindowingManager.hpp"
 #include "scene/Camera.hpp"
+#include "benchmark/CameraPath.hpp"
+#include "benchmark/FrameStatistics.hpp"
 
 #include "Renderer.hpp"
+#include "LatestWinsQueue.hpp"
 
 
 /**
  * Main class of the application. Contains things that are not strictly
  * related to rendering, e.g. OS window creation, input handling.
+ * By default, the main thread only handles the OS window and input and hands
+ * frame packets over to a render thread, so slow frames don't delay input.
  */
 class App
 {
 public:
-  App();
+  struct CreateInfo
+  {
+    // Renders offscreen without an OS window, input and GUI
+    bool headless = false;
+    // Zero means running until the window is closed
+    std::uint32_t frameLimit = 0;
+
+    // Replays a camera path with a fixed time step and writes a report
+    // to `reportPath` with .json, .csv and .memory.json extensions when done
+    bool benchmark = false;
+    // Empty means orbiting around the scene
+    std::filesystem::path cameraPath;
+    std::filesystem::path reportPath = "benchmark";
+
+    // Camera movement is saved into this file on exit, can be replayed with `cameraPath`
+    std::filesystem::path recordCameraPath;
+
+    // Headless runs, benchmarks and runs with a frame limit always use a single thread,
+    // as they need every frame to be drawn
+    bool renderThread = true;
+
+    // Benchmarks with repeated shadow passes compare vertex fetch costs between formats
+    WorldRenderer::VertexFetchOptions vertexFetch;
+
+    // Can also be switched at runtime
+    bool vsync = true;
+    std::uint32_t framesInFlight = 2;
+  };
+
+  explicit App(CreateInfo info);
 
   void run();
 
 private:
+  void pollWindows();
   void processInput(float dt);
+  FramePacket makeFramePacket();
   void drawFrame();
+  void renderLoop();
+  void recordBenchmarkFrame(double frame_ms);
+  void finishBenchmark();
 
   void moveCam(Camera& cam, const Keyboard& kb, float dt);
   void rotateCam(Camera& cam, const Mouse& ms, float dt);
 
 private:
+  bool headless;
+  std::uint32_t frameLimit;
+  bool useRenderThread;
+
   OsWindowingManager windowing;
+  // Null in headless mode
   std::unique_ptr<OsWindow> mainWindow;
+  // Written by resize callbacks, the renderer reads it from the render thread
+  std::atomic<glm::uvec2> windowResolution;
+  // Of the oldest input since the previous poll
+  std::chrono::steady_clock::time_point lastInputTime;
 
   float camMoveSpeed = 1;
   float camRotateSpeed = 0.1f;
@@ -36,5 +87,19 @@ private:
 
   bool controlShadowCam = false;
 
+  struct Benchmark
+  {
+    CameraPath cameraPath;
+    FrameStatistics statistics;
+    std::filesystem::path reportPath;
+    std::uint32_t frame = 0;
+  };
+  std::optional<Benchmark> benchmark;
+
+  std::filesystem::path recordCameraPath;
+  CameraPath recordedCameraPath;
+
   std::unique_ptr<Renderer> renderer;
+  // Only with a render thread
+  std::optional<LatestWinsQueue<FramePacket>> framePackets;
 };
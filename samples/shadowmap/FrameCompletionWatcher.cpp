@@ -0,0 +1,86 @@
+#include "FrameCompletionWatcher.hpp"
+
+#include <utility>
+
+#include <etna/Assert.hpp>
+#include <etna/GlobalContext.hpp>
+
+
+// Fences are waited for in slices, so that stopping doesn't hang on a lost device
+static constexpr std::uint64_t WAIT_SLICE_NS = 10'000'000;
+
+FrameCompletionWatcher::FrameCompletionWatcher(std::size_t max_pending)
+{
+  auto device = etna::get_context().getDevice();
+
+  for (std::size_t i = 0; i < max_pending; ++i)
+  {
+    auto fence = device.createFenceUnique(vk::FenceCreateInfo{});
+    ETNA_CHECK_VK_RESULT(fence.result);
+    freeFences.push_back(fence.value.get());
+    fences.push_back(std::move(fence.value));
+  }
+
+  thread = std::jthread{[this](std::stop_token stop) { work(stop); }};
+}
+
+FrameCompletionWatcher::~FrameCompletionWatcher()
+{
+  // Fences still in use by the queue can't be destroyed
+  ETNA_CHECK_VK_RESULT(etna::get_context().getQueue().waitIdle());
+}
+
+void FrameCompletionWatcher::onFrameSubmitted(vk::Queue queue, Clock::time_point input_time)
+{
+  vk::Fence fence;
+  {
+    std::lock_guard lock{mutex};
+    if (freeFences.empty())
+      return;
+    fence = freeFences.back();
+    freeFences.pop_back();
+  }
+
+  // Signals once everything submitted to the queue before it is done
+  ETNA_CHECK_VK_RESULT(queue.submit({}, fence));
+
+  {
+    std::lock_guard lock{mutex};
+    pending.push_back(PendingFrame{.fence = fence, .inputTime = input_time});
+  }
+  frameSubmitted.notify_one();
+}
+
+std::vector<double> FrameCompletionWatcher::takeLatenciesMs()
+{
+  std::lock_guard lock{mutex};
+  return std::exchange(latenciesMs, {});
+}
+
+void FrameCompletionWatcher::work(std::stop_token stop)
+{
+  auto device = etna::get_context().getDevice();
+
+  std::unique_lock lock{mutex};
+  while (frameSubmitted.wait(lock, stop, [this] { return !pending.empty(); }))
+  {
+    // Only this thread pops frames, so the front one stays while unlocked
+    const PendingFrame frame = pending.front();
+    lock.unlock();
+
+    vk::Result result = vk::Result::eTimeout;
+    while (result == vk::Result::eTimeout && !stop.stop_requested())
+      result = device.waitForFences({frame.fence}, VK_TRUE, WAIT_SLICE_NS);
+    const auto completionTime = Clock::now();
+    if (result != vk::Result::eSuccess)
+      return;
+    ETNA_CHECK_VK_RESULT(device.resetFences({frame.fence}));
+
+    lock.lock();
+    pending.pop_front();
+    freeFences.push_back(frame.fence);
+    if (frame.inputTime != Clock::time_point{})
+      latenciesMs.push_back(
+        std::chrono::duration<double, std::milli>(completionTime - frame.inputTime).count());
+  }
+}
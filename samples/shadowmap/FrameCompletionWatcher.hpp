@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+
+
+/**
+ * Notices frames finishing on the GPU right when it happens. The slot of a frame in
+ * flight is only waited for when it is reused, up to several frames later, which
+ * would count time the frame spent finished as latency. Instead, an empty submission
+ * after every frame signals a fence once the queue is done with it, and a thread
+ * waits for these fences.
+ */
+class FrameCompletionWatcher
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // At most this many frames are watched at once, others are skipped
+  explicit FrameCompletionWatcher(std::size_t max_pending);
+  ~FrameCompletionWatcher();
+
+  // Right after submitting the frame, on the same thread and queue
+  void onFrameSubmitted(vk::Queue queue, Clock::time_point input_time);
+
+  // From input to completion of frames finished since the last call, in the order they finished
+  std::vector<double> takeLatenciesMs();
+
+private:
+  void work(std::stop_token stop);
+
+private:
+  struct PendingFrame
+  {
+    vk::Fence fence;
+    Clock::time_point inputTime;
+  };
+
+  std::vector<vk::UniqueFence> fences;
+
+  std::mutex mutex;
+  std::condition_variable_any frameSubmitted;
+  std::vector<vk::Fence> freeFences;
+  std::deque<PendingFrame> pending;
+  std::vector<double> latenciesMs;
+
+  // Last, so that it is stopped before the fences are destroyed
+  std::jthread thread;
+};
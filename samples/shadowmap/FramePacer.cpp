@@ -0,0 +1,142 @@
+#include "FramePacer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <utility>
+
+#include <imgui.h>
+#include <tracy/Tracy.hpp>
+
+
+// Weight of the newest frame in smoothed predictions
+static constexpr double PACING_SMOOTHING = 0.05;
+// The delay grows slowly, as overshooting costs a whole refresh
+static constexpr double DELAY_SMOOTHING = 0.02;
+// A frame this much later than predicted missed the refresh it was meant for
+static constexpr double MISSED_REFRESH_FACTOR = 1.5;
+
+static double ms_between(FramePacer::Clock::time_point from, FramePacer::Clock::time_point to)
+{
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+void FramePacer::onImageAcquired()
+{
+  const auto now = Clock::now();
+  sampleTime = now;
+
+  if (!lastAcquireTime)
+  {
+    lastAcquireTime = now;
+    return;
+  }
+
+  const double intervalMs = ms_between(std::exchange(*lastAcquireTime, now), now);
+
+  intervalHistory[historyOffset] = static_cast<float>(intervalMs);
+  historyOffset = (historyOffset + 1) % HISTORY_SIZE;
+
+  statistics.record("frame_interval_ms", intervalMs);
+  if (lastIntervalMs > 0)
+    statistics.record("frame_jitter_ms", std::abs(intervalMs - lastIntervalMs));
+  lastIntervalMs = intervalMs;
+
+  // Waiting too long made the frame miss its refresh. Longer intervals would make us
+  // wait even longer, so they only count once waiting can't be the reason anymore.
+  if (periodMs > 0 && delayMs > 0 && intervalMs > MISSED_REFRESH_FACTOR * periodMs)
+  {
+    ++missedRefreshes;
+    delayMs *= 0.5;
+    return;
+  }
+
+  periodMs = periodMs > 0 ? std::lerp(periodMs, intervalMs, PACING_SMOOTHING) : intervalMs;
+}
+
+void FramePacer::waitJustInTime(std::optional<double> gpu_frame_ms)
+{
+  justInTimeAvailable = true;
+
+  if (!justInTime || periodMs == 0 || !gpu_frame_ms)
+  {
+    delayMs = 0;
+    return;
+  }
+
+  // The next image is expected a period after this one, the frame has to be done by then.
+  // When the GPU or the CPU is the bottleneck instead of the display, there is no slack.
+  const double slackMs = periodMs - cpuWorkMs - *gpu_frame_ms - safetyMarginMs;
+  const double targetMs = std::max(slackMs, 0.0);
+  delayMs = std::min(std::lerp(delayMs, targetMs, DELAY_SMOOTHING), targetMs);
+
+  if (delayMs > 0)
+  {
+    ZoneScopedN("waitJustInTime");
+    const auto delay = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double, std::milli>(delayMs));
+    std::this_thread::sleep_until(sampleTime + delay);
+  }
+
+  sampleTime = Clock::now();
+}
+
+void FramePacer::onFrameSubmitted()
+{
+  const double workMs = ms_between(sampleTime, Clock::now());
+  cpuWorkMs = cpuWorkMs > 0 ? std::lerp(cpuWorkMs, workMs, PACING_SMOOTHING) : workMs;
+}
+
+void FramePacer::drawGui()
+{
+  ImGui::BeginDisabled(!justInTimeAvailable);
+  ImGui::Checkbox("Just-in-time input sampling", &justInTime);
+  ImGui::EndDisabled();
+
+  if (!justInTimeAvailable)
+    ImGui::TextUnformatted("Input is only sampled after waiting with a render thread");
+  else if (justInTime)
+  {
+    ImGui::SliderFloat("Safety margin, ms", &safetyMarginMs, 0.0f, 8.0f, "%.1f");
+    ImGui::Text("Waiting %.2f ms, missed %u refreshes", delayMs, missedRefreshes);
+  }
+  ImGui::Text("CPU work after sampling input: %.2f ms", cpuWorkMs);
+
+  // Same jitter as in the statistics, the change of the interval from one frame to the next
+  double mean = 0;
+  double jitter = 0;
+  std::size_t count = 0;
+  std::size_t jitterCount = 0;
+  float previous = 0;
+  for (std::size_t i = 0; i < HISTORY_SIZE; ++i)
+  {
+    const float interval = intervalHistory[(historyOffset + i) % HISTORY_SIZE];
+    if (interval > 0)
+    {
+      mean += interval;
+      ++count;
+      if (previous > 0)
+      {
+        jitter += std::abs(interval - previous);
+        ++jitterCount;
+      }
+    }
+    previous = interval;
+  }
+  if (count == 0)
+    return;
+  mean /= static_cast<double>(count);
+  if (jitterCount > 0)
+    jitter /= static_cast<double>(jitterCount);
+
+  ImGui::PlotLines(
+    "##frame_intervals",
+    intervalHistory.data(),
+    static_cast<int>(HISTORY_SIZE),
+    static_cast<int>(historyOffset),
+    nullptr,
+    0.0f,
+    std::max(2.0f * static_cast<float>(periodMs), 1.0f),
+    ImVec2{0, 80});
+  ImGui::Text("Frame interval: %.2f ms, jitter: %.2f ms", mean, jitter);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#include "benchmark/FrameStatistics.hpp"
+
+
+/**
+ * Measures how evenly frames are delivered by the swapchain and optionally delays
+ * sampling input, so that frames are finished right before the display takes them
+ * instead of waiting for it with input that was sampled way earlier.
+ */
+class FramePacer
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // The display paces frames by handing swapchain images out
+  void onImageAcquired();
+  // Sleeps until the predicted last moment to sample input and start recording the frame
+  void waitJustInTime(std::optional<double> gpu_frame_ms);
+  void onFrameSubmitted();
+
+  void drawGui();
+
+  // Intervals between frames and jitter, which is how much they change from one frame to
+  // the next. The GUI shows the mean of both over the last frames.
+  const FrameStatistics& getStatistics() const { return statistics; }
+
+  bool justInTime = false;
+  // Left for sleeps oversleeping and frames taking longer than predicted
+  float safetyMarginMs = 2.0f;
+
+private:
+  static constexpr std::size_t HISTORY_SIZE = 240;
+
+  std::optional<Clock::time_point> lastAcquireTime;
+  // When input of the current frame was sampled, as far as we know
+  Clock::time_point sampleTime;
+
+  // Ring buffer of frame intervals, `historyOffset` points to the oldest one
+  std::array<float, HISTORY_SIZE> intervalHistory{};
+  std::size_t historyOffset = 0;
+  double lastIntervalMs = 0;
+
+  // Smoothed predictions
+  double periodMs = 0;
+  double cpuWorkMs = 0;
+
+  double delayMs = 0;
+  std::uint32_t missedRefreshes = 0;
+  // Input is only sampled after the wait when drawing on a render thread
+  bool justInTimeAvailable = false;
+
+  FrameStatistics statistics;
+};
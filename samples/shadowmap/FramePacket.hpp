@@ -1,15 +1,23 @@
 #pragma once
 
+#include <chrono>
+
 #include <scene/Camera.hpp>
+#include <wsi/Keyboard.hpp>
 
 
 /**
  * Contains data sent from the gameplay/logic part of the application
- * to the renderer on every frame.
+ * to the renderer on every frame. Packets are copied over to the render
+ * thread, so they must not point to anything owned by the main thread.
  */
 struct FramePacket
 {
   Camera mainCam;
   Camera shadowCam;
   float currentTime = 0;
+  // Debug toggles of the renderer are bound to keys
+  Keyboard keyboard;
+  // Of the oldest input that is reflected in this packet, for measuring latency
+  std::chrono::steady_clock::time_point inputTime;
 };
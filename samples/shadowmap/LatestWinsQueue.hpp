@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include <function2/function2.hpp>
+
+
+/**
+ * Hands values over from one thread to another through a single slot. Pushing
+ * replaces a value the consumer didn't take yet, so the producer never waits
+ * and the consumer always gets the latest value. Things that must not be lost
+ * along with a replaced value, e.g. key presses, are passed on by a merge function.
+ */
+template <class T>
+class LatestWinsQueue
+{
+public:
+  // Receives the replaced value and the one replacing it
+  using MergeFn = fu2::unique_function<void(const T& replaced, T& latest)>;
+
+  explicit LatestWinsQueue(MergeFn merge_fn = {})
+    : merge{std::move(merge_fn)}
+  {
+  }
+
+  void push(T value)
+  {
+    {
+      std::lock_guard lock{mutex};
+      if (pending.has_value() && merge)
+        merge(*pending, value);
+      pending.emplace(std::move(value));
+    }
+    available.notify_one();
+  }
+
+  // Blocks until there is a value, returns nullopt once the queue is closed
+  std::optional<T> pop()
+  {
+    std::unique_lock lock{mutex};
+    available.wait(lock, [this] { return pending.has_value() || closed; });
+    if (closed)
+      return std::nullopt;
+    return std::exchange(pending, std::nullopt);
+  }
+
+  // Wakes up the consumer, nothing is popped after this
+  void close()
+  {
+    {
+      std::lock_guard lock{mutex};
+      closed = true;
+    }
+    available.notify_all();
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable available;
+  std::optional<T> pending;
+  MergeFn merge;
+  bool closed = false;
+};
@@ -0,0 +1,231 @@
+#include "MeshletCuller.hpp"
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/Profiling.hpp>
+
+#include "render_utils/MemoryTracker.hpp"
+
+
+static std::array<glm::vec4, 6> extract_frustum_planes(const glm::mat4x4& proj_view)
+{
+  // Gribb-Hartmann, adapted for [0, 1] depth range
+  auto row = [&proj_view](int i) {
+    return glm::vec4(proj_view[0][i], proj_view[1][i], proj_view[2][i], proj_view[3][i]);
+  };
+
+  std::array planes{
+    row(3) + row(0),
+    row(3) - row(0),
+    row(3) + row(1),
+    row(3) - row(1),
+    row(2),
+    row(3) - row(2),
+  };
+
+  for (auto& plane : planes)
+    plane /= length(glm::vec3(plane));
+
+  return planes;
+}
+
+MeshletCuller::MeshletCuller()
+{
+  if (etna::get_program_id("meshlet_cull") == etna::ShaderProgramId::Invalid)
+    etna::create_program("meshlet_cull", {SHADOWMAP_SHADERS_ROOT "meshlet_cull.comp.spv"});
+
+  pipeline =
+    etna::get_context().getPipelineManager().createComputePipeline("meshlet_cull", {});
+}
+
+void MeshletCuller::prepareScene(SceneManager& scene_mgr)
+{
+  scene = &scene_mgr;
+
+  auto instanceMeshes = scene->getInstanceMeshes();
+  auto instanceSkins = scene->getInstanceSkins();
+  auto meshes = scene->getMeshes();
+  auto relems = scene->getRenderElements();
+  auto meshlets = scene->getMeshlets();
+
+  std::vector<glm::uvec2> items;
+  initialDrawCommands.clear();
+  initialDrawCommands.reserve(instanceMeshes.size());
+
+  std::uint32_t totalIndices = 0;
+  for (std::uint32_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
+  {
+    const auto& mesh = meshes[instanceMeshes[instIdx]];
+    // Meshlet bounds of skinned meshes don't follow the joints, these are drawn unculled
+    const bool skinned = instanceSkins[instIdx] != SceneManager::NO_SKIN;
+
+    std::uint32_t instanceIndices = 0;
+    for (std::uint32_t i = 0; i < (skinned ? 0 : mesh.relemCount); ++i)
+    {
+      const auto& relem = relems[mesh.firstRelem + i];
+      for (std::uint32_t j = 0; j < relem.meshletCount; ++j)
+      {
+        items.emplace_back(instIdx, relem.firstMeshlet + j);
+        instanceIndices += 3 * meshlets[relem.firstMeshlet + j].triangleCount;
+      }
+    }
+
+    // Every instance gets a region of the culled index buffer big enough to fit all of it
+    initialDrawCommands.push_back(vk::DrawIndexedIndirectCommand{
+      .indexCount = 0,
+      .instanceCount = 1,
+      .firstIndex = totalIndices,
+      .vertexOffset = 0,
+      .firstInstance = 0,
+    });
+    totalIndices += instanceIndices;
+  }
+
+  workItemCount = static_cast<std::uint32_t>(items.size());
+
+  workItems = {};
+  culledIndices.reset();
+  drawCommands.reset();
+  stats.reset();
+
+  // Buffers of the previous scene are gone even when there is nothing to create
+  auto& tracker = get_memory_tracker();
+  tracker.untrack("meshlet_work_items");
+  tracker.untrackPrefix("culled_indices");
+  tracker.untrackPrefix("meshlet_draw_commands");
+  tracker.untrackPrefix("meshlet_culling_stats");
+
+  if (workItemCount == 0)
+    return;
+
+  auto& ctx = etna::get_context();
+
+  // NOTE: the set of meshlets is static, so uploading through mapped memory once is fine
+  workItems = create_tracked_buffer(MemoryCategory::Geometry, etna::Buffer::CreateInfo{
+    .size = items.size() * sizeof(items[0]),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+    .name = "meshlet_work_items",
+  });
+  std::memcpy(workItems.map(), items.data(), items.size() * sizeof(items[0]));
+  workItems.unmap();
+
+  culledIndices.emplace(ctx.getMainWorkCount(), [totalIndices](std::size_t i) {
+    return create_tracked_buffer(MemoryCategory::Geometry, etna::Buffer::CreateInfo{
+      .size = totalIndices * sizeof(std::uint32_t),
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndexBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = fmt::format("culled_indices/{}", i),
+    });
+  });
+
+  drawCommands.emplace(ctx.getMainWorkCount(), [this](std::size_t i) {
+    auto buf = create_tracked_buffer(MemoryCategory::Geometry, etna::Buffer::CreateInfo{
+      .size = initialDrawCommands.size() * DRAW_COMMAND_STRIDE,
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+      .name = fmt::format("meshlet_draw_commands/{}", i),
+    });
+    buf.map();
+    return buf;
+  });
+
+  stats.emplace(ctx.getMainWorkCount(), [](std::size_t i) {
+    auto buf = create_tracked_buffer(MemoryCategory::Other, etna::Buffer::CreateInfo{
+      .size = sizeof(MeshletCullingStats),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+      .name = fmt::format("meshlet_culling_stats/{}", i),
+    });
+    std::memset(buf.map(), 0, sizeof(MeshletCullingStats));
+    return buf;
+  });
+}
+
+void MeshletCuller::cull(
+  vk::CommandBuffer cmd_buf, const glm::mat4x4& proj_view, glm::vec3 camera_position)
+{
+  ETNA_PROFILE_GPU(cmd_buf, cullMeshlets);
+
+  // The GPU is done with this frame's buffers by now, so we can
+  // both read back old statistics and reset everything on the CPU.
+  {
+    auto& currentStats = stats->get();
+    std::memcpy(&lastStats, currentStats.data(), sizeof(lastStats));
+    std::memset(currentStats.data(), 0, sizeof(MeshletCullingStats));
+
+    std::memcpy(
+      drawCommands->get().data(),
+      initialDrawCommands.data(),
+      initialDrawCommands.size() * DRAW_COMMAND_STRIDE);
+  }
+
+  MeshletCullingParams params{
+    .frustumPlanes = {},
+    .cameraPosition = glm::vec4(camera_position, 1.0f),
+    .workItemCount = workItemCount,
+    .enabledTests = (frustumCulling ? MESHLET_CULLING_FRUSTUM : 0u) |
+      (coneCulling ? MESHLET_CULLING_CONE : 0u),
+  };
+  const auto planes = extract_frustum_planes(proj_view);
+  std::copy(planes.begin(), planes.end(), params.frustumPlanes);
+
+  auto programInfo = etna::get_shader_program("meshlet_cull");
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{0, scene->genMeshletBufferBinding()},
+      etna::Binding{1, workItems.genBinding()},
+      etna::Binding{2, scene->genInstanceBufferBinding()},
+      etna::Binding{3, scene->genIndexBufferBinding()},
+      etna::Binding{4, culledIndices->get().genBinding()},
+      etna::Binding{5, drawCommands->get().genBinding()},
+      etna::Binding{6, stats->get().genBinding()},
+    });
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, {set.getVkSet()}, {});
+  cmd_buf.pushConstants<MeshletCullingParams>(
+    pipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, {params});
+
+  etna::flush_barriers(cmd_buf);
+
+  // NOTE: 65535 is the minimal maxComputeWorkGroupCount guaranteed by the spec
+  constexpr std::uint32_t MAX_GROUPS = 65535;
+  cmd_buf.dispatch(
+    std::min(workItemCount, MAX_GROUPS), (workItemCount + MAX_GROUPS - 1) / MAX_GROUPS, 1);
+
+  // Etna only tracks images, so buffer barriers have to be placed manually.
+  // Nothing on the GPU waits for the host, so this one doesn't stall anything.
+  const vk::MemoryBarrier2 statsBarrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+    .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &statsBarrier,
+  });
+}
+
+void MeshletCuller::barrierForDraws(vk::CommandBuffer cmd_buf)
+{
+  // NOTE: waits for all compute dispatches recorded before this, not only for culling
+  const vk::MemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+    .dstStageMask =
+      vk::PipelineStageFlagBits2::eIndexInput | vk::PipelineStageFlagBits2::eDrawIndirect,
+    .dstAccessMask = vk::AccessFlagBits2::eIndexRead | vk::AccessFlagBits2::eIndirectCommandRead,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <optional>
+
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/GpuSharedResource.hpp>
+#include <glm/glm.hpp>
+
+#include "scene/SceneManager.hpp"
+#include "shaders/MeshletCulling.h"
+
+
+/**
+ * Culls meshlets of every scene instance on the GPU and produces a compacted
+ * index buffer together with one indirect draw command per instance.
+ * The result is drawn with the regular vertex pipeline, so mesh shaders are not required.
+ */
+class MeshletCuller
+{
+public:
+  MeshletCuller();
+
+  // Must be called every time a new scene is selected
+  void prepareScene(SceneManager& scene_mgr);
+
+  // False if the current scene has nothing to cull, buffers below are not available then
+  bool isReady() const { return workItemCount > 0; }
+
+  void cull(vk::CommandBuffer cmd_buf, const glm::mat4x4& proj_view, glm::vec3 camera_position);
+  // Makes results of `cull` available to draws. Work recorded in between doesn't
+  // wait for culling, so recording this as late as possible lets the two overlap.
+  void barrierForDraws(vk::CommandBuffer cmd_buf);
+
+  // Valid after `cull` has been recorded for the current frame
+  vk::Buffer getIndexBuffer() { return culledIndices->get().get(); }
+  vk::Buffer getDrawCommandBuffer() { return drawCommands->get().get(); }
+  static constexpr vk::DeviceSize DRAW_COMMAND_STRIDE = sizeof(vk::DrawIndexedIndirectCommand);
+
+  // NOTE: these lag behind by the amount of frames in flight
+  const MeshletCullingStats& getStats() const { return lastStats; }
+
+  bool frustumCulling = true;
+  bool coneCulling = true;
+
+private:
+  etna::ComputePipeline pipeline;
+
+  SceneManager* scene = nullptr;
+
+  std::uint32_t workItemCount = 0;
+  std::vector<vk::DrawIndexedIndirectCommand> initialDrawCommands;
+  etna::Buffer workItems;
+
+  std::optional<etna::GpuSharedResource<etna::Buffer>> culledIndices;
+  std::optional<etna::GpuSharedResource<etna::Buffer>> drawCommands;
+  std::optional<etna::GpuSharedResource<etna::Buffer>> stats;
+
+  MeshletCullingStats lastStats{};
+};
@@ -1,21 +1,63 @@
 #include "Renderer.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
 #include <etna/GlobalContext.hpp>
 #include <etna/Etna.hpp>
 #include <etna/RenderTargetStates.hpp>
 #include <etna/PipelineManager.hpp>
 #include <etna/Profiling.hpp>
 #include <imgui.h>
+#include <spdlog/spdlog.h>
 
 #include <gui/ImGuiRenderer.hpp>
 
+#include "render_utils/MemoryTracker.hpp"
+
+
+// Weight of the newest frame in the smoothed latency
+static constexpr double LATENCY_SMOOTHING = 0.05;
+// The watcher may still be resetting fences of frames the GPU has finished
+static constexpr std::size_t FRAMES_WATCHED_AFTER_COMPLETION = 2;
+// Long enough to wait for a poll to finish, short enough to not stall on modal loops
+static constexpr std::chrono::milliseconds GUI_LOCK_TIMEOUT{2};
+// Numbers in the GUI change without any input, this is how often they are refreshed
+static constexpr std::chrono::milliseconds GUI_REFRESH_INTERVAL{100};
+static constexpr std::uint32_t GUI_SETTLE_FRAMES = 3;
+// Weight of the newest frame in smoothed GUI costs
+static constexpr double GUI_COST_SMOOTHING = 0.05;
+
+// Requesting a feature the device lacks makes device creation fail, but etna only picks
+// the device while initializing, so the feature is requested if every device has it
+static bool pipeline_statistics_supported()
+{
+  VULKAN_HPP_DEFAULT_DISPATCHER.init();
+
+  const vk::ApplicationInfo appInfo{.apiVersion = VK_API_VERSION_1_3};
+  auto instance = vk::createInstanceUnique(vk::InstanceCreateInfo{.pApplicationInfo = &appInfo});
+  if (instance.result != vk::Result::eSuccess)
+    return false;
+  VULKAN_HPP_DEFAULT_DISPATCHER.init(*instance.value);
+
+  auto devices = instance.value->enumeratePhysicalDevices();
+  if (devices.result != vk::Result::eSuccess || devices.value.empty())
+    return false;
+
+  return std::ranges::all_of(devices.value, [](vk::PhysicalDevice device) {
+    return device.getFeatures().pipelineStatisticsQuery == VK_TRUE;
+  });
+}
 
 Renderer::Renderer(glm::uvec2 res)
   : resolution{res}
+  , requestedResolution{res}
 {
 }
 
-void Renderer::initVulkan(std::span<const char*> instance_extensions)
+void Renderer::initVulkan(
+  std::span<const char*> instance_extensions, bool headless, std::uint32_t frames_in_flight)
 {
   std::vector<const char*> instanceExtensions;
 
@@ -24,18 +66,22 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
 
   std::vector<const char*> deviceExtensions;
 
-  deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  if (!headless)
+    deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
   etna::initialize(etna::InitParams{
     .applicationName = "ShadowmapSample",
     .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
     .instanceExtensions = instanceExtensions,
     .deviceExtensions = deviceExtensions,
-    .features = vk::PhysicalDeviceFeatures2{.features = {}},
+    // Pipeline statistics show how much a depth prepass saves on shading
+    .features = vk::PhysicalDeviceFeatures2{
+      .features = {.pipelineStatisticsQuery = pipeline_statistics_supported()}},
     // Replace with an index if etna detects your preferred GPU incorrectly
     .physicalDeviceIndexOverride = {},
-    // How much frames we buffer on the GPU without waiting for their completion on the CPU
-    .numFramesInFlight = 2,
+    // How much frames we buffer on the GPU without waiting for their completion on the CPU.
+    // More of them smooth out spikes, but every one of them adds a frame of latency.
+    .numFramesInFlight = frames_in_flight,
   });
 }
 
@@ -52,17 +98,58 @@ void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvi
 
   auto [w, h] = window->recreateSwapchain(etna::Window::DesiredProperties{
     .resolution = {resolution.x, resolution.y},
-    .vsync = true,
+    .vsync = vsync,
   });
   resolution = {w, h};
+  swapchainVsync = vsync;
 
-  worldRenderer = std::make_unique<WorldRenderer>();
+  requestedResolution = resolutionProvider();
+
+  gpuTimer = std::make_unique<GpuTimer>();
+  worldRenderer = std::make_unique<WorldRenderer>(*gpuTimer);
+  completionWatcher = std::make_unique<FrameCompletionWatcher>(
+    ctx.getMainWorkCount().multiBufferingCount() + FRAMES_WATCHED_AFTER_COMPLETION);
 
   worldRenderer->allocateResources(resolution);
   worldRenderer->loadShaders();
   worldRenderer->setupPipelines(window->getCurrentFormat());
 
+  // The GUI layer has the swapchain's format, so colors are blended exactly the same
   guiRenderer = std::make_unique<ImGuiRenderer>(window->getCurrentFormat());
+  allocateGuiLayer();
+
+#ifdef RENDER_UTILS_SHADER_HOT_RELOAD
+  shaderReloader = std::make_unique<ShaderHotReloader>(ShaderHotReloader::CreateInfo{
+    .sourceDirectories = {GRAPHICS_COURSE_ROOT "/samples/shadowmap/shaders"},
+    .includeDirectories =
+      {
+        GRAPHICS_COURSE_ROOT "/samples/shadowmap/shaders",
+        GRAPHICS_COURSE_ROOT "/common/render_utils/shaders",
+        GRAPHICS_COURSE_ROOT "/common/scene/shaders",
+      },
+    .outputDirectory = SHADOWMAP_SHADERS_ROOT,
+  });
+#endif
+}
+
+void Renderer::initOffscreenFrameDelivery()
+{
+  auto& ctx = etna::get_context();
+
+  commandManager = ctx.createPerFrameCmdMgr();
+
+  offscreenWindow = std::make_unique<OffscreenWindow>(OffscreenWindow::CreateInfo{
+    .resolution = resolution,
+  });
+
+  gpuTimer = std::make_unique<GpuTimer>();
+  worldRenderer = std::make_unique<WorldRenderer>(*gpuTimer);
+  completionWatcher = std::make_unique<FrameCompletionWatcher>(
+    ctx.getMainWorkCount().multiBufferingCount() + FRAMES_WATCHED_AFTER_COMPLETION);
+
+  worldRenderer->allocateResources(resolution);
+  worldRenderer->loadShaders();
+  worldRenderer->setupPipelines(offscreenWindow->getCurrentFormat());
 }
 
 void Renderer::recreateSwapchain(glm::uvec2 res)
@@ -73,15 +160,38 @@ void Renderer::recreateSwapchain(glm::uvec2 res)
 
   auto [w, h] = window->recreateSwapchain(etna::Window::DesiredProperties{
     .resolution = {res.x, res.y},
-    .vsync = true,
+    .vsync = vsync,
   });
   resolution = {w, h};
+  requestedResolution = res;
+  swapchainVsync = vsync;
 
   // Most resources depend on the current resolution, so we recreate them.
   worldRenderer->allocateResources(resolution);
 
   // Format of the swapchain CAN change on android
   worldRenderer->setupPipelines(window->getCurrentFormat());
+
+  allocateGuiLayer();
+}
+
+void Renderer::allocateGuiLayer()
+{
+  guiLayer = create_tracked_image(MemoryCategory::RenderTargets, etna::Image::CreateInfo{
+    .extent = vk::Extent3D{resolution.x, resolution.y, 1},
+    .name = "gui_layer",
+    .format = window->getCurrentFormat(),
+    .imageUsage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled,
+  });
+
+  // ImGui only learns about the new size in the next frame
+  guiLayerDirty = true;
+  guiSettleFrames = GUI_SETTLE_FRAMES;
+}
+
+void Renderer::setVertexFetchOptions(const WorldRenderer::VertexFetchOptions& options)
+{
+  worldRenderer->setVertexFetchOptions(options);
 }
 
 void Renderer::loadScene(std::filesystem::path path)
@@ -93,6 +203,12 @@ void Renderer::debugInput(const Keyboard& kb)
 {
   worldRenderer->debugInput(kb);
 
+#ifdef RENDER_UTILS_SHADER_HOT_RELOAD
+  // Shaders are also recompiled as soon as they are saved, this forces all of them
+  if (kb[KeyboardKey::kB] == ButtonState::Falling && shaderReloader)
+    shaderReloader->requestRebuild();
+#else
+  // Without glslang, shaders can only be rebuilt by CMake, which freezes the app
   if (kb[KeyboardKey::kB] == ButtonState::Falling)
   {
     const int retval = std::system("cd " GRAPHICS_COURSE_ROOT "/build"
@@ -106,60 +222,129 @@ void Renderer::debugInput(const Keyboard& kb)
       spdlog::info("Successfully reloaded shaders!");
     }
   }
+#endif
 }
 
-void Renderer::update(const FramePacket& packet)
+void Renderer::prepareGui()
 {
-  worldRenderer->update(packet);
+  // A GUI frame is only started once the previous one was built, otherwise
+  // polling more often than drawing would make ImGui's frame times too short
+  if (guiRenderer && !guiPrepared)
+  {
+    ImGuiRenderer::nextPlatformFrame();
+    guiPrepared = true;
+  }
 }
 
-void Renderer::drawFrame()
+void Renderer::acquireFrame()
 {
   ZoneScoped;
 
+#ifdef RENDER_UTILS_SHADER_HOT_RELOAD
+  // Nothing is being recorded yet, so this is the only safe place to swap pipelines
+  if (shaderReloader)
+    shaderReloader->reloadIfReady();
+#endif
+
+  // Waits for the GPU when something was changed in the GUI, which is why it isn't
+  // done while building it, as polling on the main thread would wait for the lock
+  worldRenderer->applyPendingChanges();
+
+  // With a render thread, the main one doesn't touch the swapchain and only tells us
+  if (window)
   {
-    ZoneScopedN("drawGui");
-    guiRenderer->nextFrame();
-    ImGui::NewFrame();
-    worldRenderer->drawGui();
-    ImGui::Render();
+    const auto res = resolutionProvider();
+    const bool changed = res != requestedResolution || vsync != swapchainVsync;
+    if (changed && res.x != 0 && res.y != 0)
+      recreateSwapchain(res);
   }
 
-  auto currentCmdBuf = commandManager->acquireNext();
+  currentCmdBuf = commandManager->acquireNext();
 
   // TODO: this makes literally 0 sense here, rename/refactor,
   // it doesn't actually begin anything, just resets descriptor pools
   etna::begin_frame();
 
-  auto nextSwapchainImage = window->acquireNext();
+  for (double latencyMs : completionWatcher->takeLatenciesMs())
+  {
+    smoothedInputLatencyMs = lastInputLatencyMs
+      ? std::lerp(smoothedInputLatencyMs, latencyMs, LATENCY_SMOOTHING)
+      : latencyMs;
+    lastInputLatencyMs = latencyMs;
+    latencyStatistics.record("input_latency_ms", latencyMs);
+  }
+
+  currentImage = window ? window->acquireNext() : offscreenWindow->acquireNext();
+  framePacer.onImageAcquired();
+}
+
+void Renderer::waitJustInTime()
+{
+  // Nothing is going to be displayed, waiting would only make things worse
+  if (currentImage)
+    framePacer.waitJustInTime(gpuTimer->getSmoothedMilliseconds("renderFrame"));
+}
+
+void Renderer::drawFrame(const FramePacket& packet)
+{
+  ZoneScoped;
+
+  debugInput(packet.keyboard);
+  worldRenderer->update(packet);
+
+  guiFrameCpuTime = {};
+  guiRendered = false;
+
+  if (guiRenderer)
+    buildGui();
 
   // NOTE: here, we skip frames when the window is in the process of being
   // re-sized. This is not mandatory, it is possible to submit frames to a
   // "sub-optimal" swap chain and still get something drawn while resizing,
   // but only on some platforms (not windows+nvidia, sadly).
+  auto nextSwapchainImage = std::exchange(currentImage, std::nullopt);
   if (nextSwapchainImage)
   {
     auto [image, view, availableSem] = *nextSwapchainImage;
 
     ETNA_CHECK_VK_RESULT(currentCmdBuf.begin(vk::CommandBufferBeginInfo{}));
     {
+      gpuTimer->beginFrame(currentCmdBuf);
+
       ETNA_PROFILE_GPU(currentCmdBuf, renderFrame);
+      GpuTimer::Scope frameZone{*gpuTimer, currentCmdBuf, "renderFrame"};
 
-      worldRenderer->renderWorld(currentCmdBuf, image, view);
+      // Nothing to draw until the GUI was built once
+      ImDrawData* pDrawData = guiRenderer ? ImGui::GetDrawData() : nullptr;
+      const bool useGuiLayer = pDrawData && cacheGui;
 
+      if (useGuiLayer && guiLayerDirty)
       {
-        ImDrawData* pDrawData = ImGui::GetDrawData();
-        guiRenderer->render(
-          currentCmdBuf, {{0, 0}, {resolution.x, resolution.y}}, image, view, pDrawData);
+        renderGui(pDrawData, guiLayer.get(), guiLayer.getView({}), vk::AttachmentLoadOp::eClear);
+        guiLayerDirty = false;
       }
 
-      etna::set_state(
-        currentCmdBuf,
-        image,
-        vk::PipelineStageFlagBits2::eColorAttachmentOutput,
-        {},
-        vk::ImageLayout::ePresentSrcKHR,
-        vk::ImageAspectFlagBits::eColor);
+      worldRenderer->renderWorld(currentCmdBuf, image, view, useGuiLayer ? &guiLayer : nullptr);
+
+      if (pDrawData && !useGuiLayer)
+        renderGui(pDrawData, image, view, vk::AttachmentLoadOp::eLoad);
+
+      if (window)
+        etna::set_state(
+          currentCmdBuf,
+          image,
+          vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+          {},
+          vk::ImageLayout::ePresentSrcKHR,
+          vk::ImageAspectFlagBits::eColor);
+      else
+        etna::set_state(
+          currentCmdBuf,
+          image,
+          vk::PipelineStageFlagBits2::eTransfer,
+          vk::AccessFlagBits2::eTransferRead,
+          OffscreenWindow::PRESENT_LAYOUT,
+          vk::ImageAspectFlagBits::eColor);
 
       etna::flush_barriers(currentCmdBuf);
 
@@ -168,16 +353,34 @@ void Renderer::drawFrame()
     ETNA_CHECK_VK_RESULT(currentCmdBuf.end());
 
     auto renderingDone = commandManager->submit(std::move(currentCmdBuf), std::move(availableSem));
+    completionWatcher->onFrameSubmitted(etna::get_context().getQueue(), packet.inputTime);
 
-    const bool presented = window->present(std::move(renderingDone), view);
+    const bool presented = window ? window->present(std::move(renderingDone), view)
+                                  : offscreenWindow->present(std::move(renderingDone), view);
 
     if (!presented)
       nextSwapchainImage = std::nullopt;
+
+    framePacer.onFrameSubmitted();
+  }
+
+  if (guiRenderer)
+  {
+    const double cpuMs = std::chrono::duration<double, std::milli>(guiFrameCpuTime).count();
+    guiCpuMs = std::lerp(guiCpuMs, cpuMs, GUI_COST_SMOOTHING);
+    guiRenderRate = std::lerp(guiRenderRate, guiRendered ? 1.0 : 0.0, GUI_COST_SMOOTHING);
+
+    // Zones are missing from frames that didn't render the GUI, these cost nothing
+    double gpuMs = 0;
+    for (const auto& zone : gpuTimer->getResults())
+      if (zone.name == "gui" || zone.name == "compositeOverlay")
+        gpuMs += zone.milliseconds;
+    guiGpuMs = std::lerp(guiGpuMs, gpuMs, GUI_COST_SMOOTHING);
   }
 
   etna::end_frame();
 
-  if (!nextSwapchainImage)
+  if (!nextSwapchainImage && window)
   {
     auto res = resolutionProvider();
     // On windows, we get 0,0 while the window is minimized and
@@ -187,6 +390,140 @@ void Renderer::drawFrame()
   }
 }
 
+void Renderer::buildGui()
+{
+  ZoneScoped;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  // The main thread may be stuck polling in a modal loop, the old GUI is drawn then
+  std::unique_lock lock{guiMutex, GUI_LOCK_TIMEOUT};
+  if (!lock.owns_lock() || !guiPrepared)
+    return;
+
+  if (ImGuiRenderer::hasPendingInput())
+    guiSettleFrames = GUI_SETTLE_FRAMES;
+
+  const bool refresh = start - lastGuiBuildTime >= GUI_REFRESH_INTERVAL;
+  const bool build = !cacheGui || guiSettleFrames > 0 || refresh;
+  guiBuildRate = std::lerp(guiBuildRate, build ? 1.0 : 0.0, GUI_COST_SMOOTHING);
+  if (!build)
+    return;
+
+  if (guiSettleFrames > 0)
+    --guiSettleFrames;
+  lastGuiBuildTime = start;
+
+  guiRenderer->nextRenderFrame();
+  ImGui::NewFrame();
+  drawGui();
+  ImGui::Render();
+  guiPrepared = false;
+
+  // Often nothing visible changes, e.g. when the mouse moves over the scene
+  if (guiRenderer->drawDataChanged(ImGui::GetDrawData()))
+    guiLayerDirty = true;
+
+  guiFrameCpuTime += std::chrono::steady_clock::now() - start;
+}
+
+void Renderer::renderGui(
+  ImDrawData* draw_data, vk::Image image, vk::ImageView view, vk::AttachmentLoadOp load_op)
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  GpuTimer::Scope zone{*gpuTimer, currentCmdBuf, "gui"};
+  guiRenderer->render(
+    currentCmdBuf, {{0, 0}, {resolution.x, resolution.y}}, image, view, draw_data, load_op);
+  guiRendered = true;
+
+  guiFrameCpuTime += std::chrono::steady_clock::now() - start;
+}
+
+void Renderer::drawGui()
+{
+  worldRenderer->drawGui();
+#ifdef RENDER_UTILS_SHADER_HOT_RELOAD
+  if (shaderReloader)
+    drawShaderReloadGui();
+#endif
+  drawPacingGui();
+  drawGuiCostGui();
+}
+
+void Renderer::drawGuiCostGui()
+{
+  ImGui::Begin("GUI cost");
+
+  // The layer wasn't kept up to date while not in use
+  if (ImGui::Checkbox("Cache in a layer", &cacheGui))
+    guiLayerDirty = true;
+  ImGui::Text(
+    "Built in %.0f%% of frames, rendered in %.0f%%",
+    100.0 * guiBuildRate,
+    100.0 * guiRenderRate);
+  ImGui::Text("Per frame on average, CPU: %.3f ms, GPU: %.3f ms", guiCpuMs, guiGpuMs);
+
+  ImGui::End();
+}
+
+void Renderer::drawPacingGui()
+{
+  ImGui::Begin("Frame pacing");
+
+  // There is no way to ask etna for MAILBOX or IMMEDIATE in particular
+  int presentMode = vsync ? 0 : 1;
+  if (window && ImGui::Combo("Present mode", &presentMode, "FIFO (vsync)\0MAILBOX/IMMEDIATE\0"))
+    vsync = presentMode == 0;
+  ImGui::Text(
+    "Frames in flight: %u, change with --frames-in-flight",
+    static_cast<std::uint32_t>(etna::get_context().getMainWorkCount()));
+
+  framePacer.drawGui();
+
+  ImGui::SeparatorText("Latency");
+
+  if (lastInputLatencyMs)
+  {
+    ImGui::Text("Input to GPU completion: %.1f ms", *lastInputLatencyMs);
+    ImGui::Text("Smoothed: %.1f ms", smoothedInputLatencyMs);
+  }
+  else
+    ImGui::TextUnformatted("Waiting for the first frames to finish");
+
+  ImGui::End();
+}
+
+#ifdef RENDER_UTILS_SHADER_HOT_RELOAD
+void Renderer::drawShaderReloadGui()
+{
+  const auto status = shaderReloader->getStatus();
+
+  ImGui::Begin("Shaders");
+
+  if (status.compiling)
+    ImGui::Text("Compiling...");
+  else if (status.generation == 0)
+    ImGui::Text("Watching for changes, press B to rebuild all");
+  else
+    ImGui::Text(
+      "Reloaded %zu shaders compiled in %.1f ms",
+      status.compiledShaders,
+      std::chrono::duration<double, std::milli>(status.compileTime).count());
+
+  // The old shaders keep working until the error is fixed
+  if (!status.errorLog.empty())
+  {
+    ImGui::TextColored(ImVec4{1.0f, 0.4f, 0.4f, 1.0f}, "Compilation failed:");
+    ImGui::BeginChild("shader_log", ImVec2{0, 200}, ImGuiChildFlags_Border);
+    ImGui::TextUnformatted(status.errorLog.c_str());
+    ImGui::EndChild();
+  }
+
+  ImGui::End();
+}
+#endif
+
 Renderer::~Renderer()
 {
   ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
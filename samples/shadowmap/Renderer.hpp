@@ -1,23 +1,36 @@
 #pragma once
 
+#include <chrono>
+#include <mutex>
+
 #include <etna/GlobalContext.hpp>
 #include <etna/PerFrameCmdMgr.hpp>
+#include <etna/Image.hpp>
 #include <glm/glm.hpp>
 #include <function2/function2.hpp>
 
 #include "wsi/Keyboard.hpp"
+#include "render_utils/OffscreenWindow.hpp"
+#ifdef RENDER_UTILS_SHADER_HOT_RELOAD
+#include "render_utils/ShaderHotReloader.hpp"
+#endif
+#include "benchmark/FrameStatistics.hpp"
 
+#include "FrameCompletionWatcher.hpp"
 #include "FramePacket.hpp"
+#include "FramePacer.hpp"
 #include "WorldRenderer.hpp"
 
 
 class ImGuiRenderer;
+struct ImDrawData;
 
 using ResolutionProvider = fu2::unique_function<glm::uvec2() const>;
 
 /**
  * This class encapsulates things that are very unlikely to change from one sample to another.
  * E.g. initialization, frame delivery logic, window resizing, gui setup, etc.
+ * Frames may be drawn on a thread other than the main one, which owns the OS window.
  */
 class Renderer
 {
@@ -26,23 +39,109 @@ public:
   ~Renderer();
 
   // Initializing all of rendering is a tricky multi-step dance
-  void initVulkan(std::span<const char*> instance_extensions);
+  // Headless rendering doesn't need the swapchain extension. The amount of frames in
+  // flight can't change afterwards, as all per-frame resources depend on it.
+  void initVulkan(
+    std::span<const char*> instance_extensions,
+    bool headless = false,
+    std::uint32_t frames_in_flight = 2);
   void initFrameDelivery(vk::UniqueSurfaceKHR surface, ResolutionProvider res_provider);
+  // Renders into offscreen images instead of a window, there is no GUI in this mode
+  void initOffscreenFrameDelivery();
   void recreateSwapchain(glm::uvec2 res);
+  // FIFO when enabled, otherwise etna picks MAILBOX or IMMEDIATE, whatever is supported.
+  // Applied when the next frame is acquired.
+  void setVsync(bool enabled) { vsync = enabled; }
+  void setVertexFetchOptions(const WorldRenderer::VertexFetchOptions& options);
   void loadScene(std::filesystem::path path);
 
-  void debugInput(const Keyboard& kb);
-  void update(const FramePacket& packet);
-  void drawFrame();
+  // Polling the OS window runs ImGui's input callbacks, which must not happen while
+  // the GUI is being built. Lock this around polling, then call prepareGui.
+  std::unique_lock<std::recursive_timed_mutex> lockGui() { return std::unique_lock{guiMutex}; }
+  // Only on the main thread, as it uses GLFW
+  void prepareGui();
+
+  // Waits for a free frame in flight and a swapchain image. This is where the CPU
+  // blocks when the GPU or the display can't keep up, so the packet for drawing
+  // the frame should be sampled after this returns.
+  void acquireFrame();
+  // Optionally sleeps so that the frame is finished right before it is displayed,
+  // input should be sampled after this. Pointless when input was sampled earlier.
+  void waitJustInTime();
+  void drawFrame(const FramePacket& packet);
+
+  const WorldRenderer& getWorldRenderer() const { return *worldRenderer; }
+  // Timings of all passes of the frame, lagging behind by the amount of frames in flight
+  const GpuTimer& getGpuTimer() const { return *gpuTimer; }
+  // From the oldest input of a frame to the GPU finishing the frame, lagging
+  // behind by the amount of frames in flight
+  std::optional<double> getLastInputLatencyMs() const { return lastInputLatencyMs; }
+  const FrameStatistics& getLatencyStatistics() const { return latencyStatistics; }
+  const FrameStatistics& getPacingStatistics() const { return framePacer.getStatistics(); }
 
 
+private:
+  void allocateGuiLayer();
+  // Skipped when nothing could have changed in the GUI
+  void buildGui();
+  void renderGui(
+    ImDrawData* draw_data, vk::Image image, vk::ImageView view, vk::AttachmentLoadOp load_op);
+  void debugInput(const Keyboard& kb);
+  void drawGui();
+#ifdef RENDER_UTILS_SHADER_HOT_RELOAD
+  void drawShaderReloadGui();
+#endif
+  void drawPacingGui();
+  void drawGuiCostGui();
+
 private:
   ResolutionProvider resolutionProvider;
+  // Exactly one of these is used for frame delivery
   std::unique_ptr<etna::Window> window;
+  std::unique_ptr<OffscreenWindow> offscreenWindow;
   std::unique_ptr<etna::PerFrameCmdMgr> commandManager;
 
   glm::uvec2 resolution;
+  // Resizes are only requested by the main thread when drawing on another one
+  glm::uvec2 requestedResolution;
+  bool vsync = true;
+  bool swapchainVsync = true;
   std::unique_ptr<ImGuiRenderer> guiRenderer;
+  // Timed, so that the old GUI is drawn while Windows blocks polling during resizes
+  std::recursive_timed_mutex guiMutex;
+  bool guiPrepared = false;
+
+  // The GUI is only rendered into this when it changes, other frames just blend it over
+  etna::Image guiLayer;
+  bool cacheGui = true;
+  bool guiLayerDirty = true;
+  // Some widgets only react to input a frame later, so building continues for a bit
+  std::uint32_t guiSettleFrames = 0;
+  std::chrono::steady_clock::time_point lastGuiBuildTime;
+  // Of building and recording the GUI in the current frame
+  std::chrono::steady_clock::duration guiFrameCpuTime{};
+  bool guiRendered = false;
+  // Smoothed, to compare the costs with and without the cache
+  double guiCpuMs = 0;
+  double guiGpuMs = 0;
+  double guiBuildRate = 0;
+  double guiRenderRate = 0;
+
+  // Acquired by acquireFrame
+  vk::CommandBuffer currentCmdBuf;
+  std::optional<etna::Window::SwapchainImage> currentImage;
 
+  std::unique_ptr<FrameCompletionWatcher> completionWatcher;
+  std::optional<double> lastInputLatencyMs;
+  double smoothedInputLatencyMs = 0;
+  FrameStatistics latencyStatistics;
+  FramePacer framePacer;
+
+  std::unique_ptr<GpuTimer> gpuTimer;
   std::unique_ptr<WorldRenderer> worldRenderer;
+
+  // Only when rendering to a window, benchmarks shouldn't change shaders midway
+#ifdef RENDER_UTILS_SHADER_HOT_RELOAD
+  std::unique_ptr<ShaderHotReloader> shaderReloader;
+#endif
 };
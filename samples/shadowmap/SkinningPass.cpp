@@ -0,0 +1,204 @@
+#include "SkinningPass.hpp"
+
+#include <chrono>
+
+#include <spdlog/spdlog.h>
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/Profiling.hpp>
+
+#include "render_utils/MemoryTracker.hpp"
+
+#include "shaders/Skinning.h"
+
+
+SkinningPass::SkinningPass()
+{
+  if (etna::get_program_id("skinning") == etna::ShaderProgramId::Invalid)
+    etna::create_program("skinning", {SHADOWMAP_SHADERS_ROOT "skinning.comp.spv"});
+
+  pipeline = etna::get_context().getPipelineManager().createComputePipeline("skinning", {});
+}
+
+void SkinningPass::prepareScene(SceneManager& scene_mgr)
+{
+  scene = &scene_mgr;
+
+  skinnedInstances.clear();
+  vertexOffsetBiases.clear();
+  totalJoints = 0;
+
+  jointMatrices.reset();
+  skinnedVertices.reset();
+  skinnedPositions.reset();
+
+  // Buffers of the previous scene are gone even when there is nothing to create
+  auto& tracker = get_memory_tracker();
+  tracker.untrackPrefix("joint_matrices");
+  tracker.untrackPrefix("skinned_vertices");
+  tracker.untrackPrefix("skinned_positions");
+
+  auto instanceSkins = scene->getInstanceSkins();
+  if (!scene->hasSkinVertices())
+    return;
+
+  // Skinned vertices are written in the full vertex format
+  if (scene->getVertexFormat() != VertexFormat::Full)
+  {
+    spdlog::warn("Skinning requires the full vertex format, skinned meshes will not animate!");
+    return;
+  }
+
+  auto instanceMeshes = scene->getInstanceMeshes();
+  auto meshes = scene->getMeshes();
+  auto relems = scene->getRenderElements();
+  auto skins = scene->getSkins();
+
+  vertexOffsetBiases.resize(instanceMeshes.size());
+
+  std::uint32_t totalVertices = 0;
+  for (std::uint32_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
+  {
+    const auto& mesh = meshes[instanceMeshes[instIdx]];
+    if (instanceSkins[instIdx] == SceneManager::NO_SKIN || mesh.relemCount == 0)
+      continue;
+
+    // Relems of a mesh and their vertices are laid out contiguously
+    const auto& firstRelem = relems[mesh.firstRelem];
+    const auto& lastRelem = relems[mesh.firstRelem + mesh.relemCount - 1];
+    const std::uint32_t firstVertex = firstRelem.vertexOffset;
+    const std::uint32_t vertexCount = lastRelem.vertexOffset + lastRelem.vertexCount - firstVertex;
+
+    skinnedInstances.push_back(SkinnedInstance{
+      .instance = instIdx,
+      .skin = instanceSkins[instIdx],
+      .firstSourceVertex = firstVertex,
+      .vertexCount = vertexCount,
+      .firstOutputVertex = totalVertices,
+      .firstJointMatrix = totalJoints,
+    });
+    vertexOffsetBiases[instIdx] =
+      static_cast<std::int32_t>(totalVertices) - static_cast<std::int32_t>(firstVertex);
+
+    totalVertices += vertexCount;
+    totalJoints += static_cast<std::uint32_t>(skins[instanceSkins[instIdx]].joints.size());
+  }
+
+  if (skinnedInstances.empty())
+    return;
+
+  auto& ctx = etna::get_context();
+
+  jointMatrices.emplace(ctx.getMainWorkCount(), [this](std::size_t i) {
+    auto buf = create_tracked_buffer(MemoryCategory::Transforms, etna::Buffer::CreateInfo{
+      .size = std::max(totalJoints, 1u) * sizeof(glm::mat4x4),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+      .name = fmt::format("joint_matrices/{}", i),
+    });
+    buf.map();
+    return buf;
+  });
+
+  skinnedVertices.emplace(ctx.getMainWorkCount(), [totalVertices](std::size_t i) {
+    return create_tracked_buffer(MemoryCategory::Geometry, etna::Buffer::CreateInfo{
+      .size = totalVertices * 2 * sizeof(glm::vec4),
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = fmt::format("skinned_vertices/{}", i),
+    });
+  });
+
+  skinnedPositions.emplace(ctx.getMainWorkCount(), [totalVertices](std::size_t i) {
+    return create_tracked_buffer(MemoryCategory::Geometry, etna::Buffer::CreateInfo{
+      .size = totalVertices * sizeof(glm::vec3),
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = fmt::format("skinned_positions/{}", i),
+    });
+  });
+}
+
+void SkinningPass::skin(vk::CommandBuffer cmd_buf)
+{
+  ETNA_PROFILE_GPU(cmd_buf, skinning);
+
+  // Joint matrices bring skinned vertices into the space of the instance,
+  // so that they are drawn with the instance's matrix like everything else.
+  {
+    ZoneScopedN("evaluateJointMatrices");
+    const auto start = std::chrono::steady_clock::now();
+
+    const auto& graph = scene->getSceneGraph();
+    auto instanceMatrices = scene->getInstanceMatrices();
+    auto skins = scene->getSkins();
+    auto* matrices = reinterpret_cast<glm::mat4x4*>(jointMatrices->get().data());
+
+    for (const auto& skinned : skinnedInstances)
+    {
+      const auto invInstanceTm = glm::inverse(instanceMatrices[skinned.instance]);
+      const auto& skin = skins[skinned.skin];
+
+      for (std::size_t j = 0; j < skin.joints.size(); ++j)
+      {
+        const auto joint = skin.joints[j];
+        const auto& jointTm = joint != SceneGraph::NO_NODE
+          ? graph.getWorldTransform(joint)
+          : instanceMatrices[skinned.instance];
+        matrices[skinned.firstJointMatrix + j] =
+          invInstanceTm * jointTm * skin.inverseBindMatrices[j];
+      }
+    }
+
+    const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+    lastJointCostNs = totalJoints > 0 ? elapsed.count() / totalJoints : 0;
+  }
+
+  auto programInfo = etna::get_shader_program("skinning");
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{0, scene->genVertexBufferBinding()},
+      etna::Binding{1, scene->genSkinVertexBufferBinding()},
+      etna::Binding{2, jointMatrices->get().genBinding()},
+      etna::Binding{3, skinnedVertices->get().genBinding()},
+      etna::Binding{4, skinnedPositions->get().genBinding()},
+    });
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, {set.getVkSet()}, {});
+
+  etna::flush_barriers(cmd_buf);
+
+  for (const auto& skinned : skinnedInstances)
+  {
+    const SkinningParams params{
+      .firstSourceVertex = skinned.firstSourceVertex,
+      .vertexCount = skinned.vertexCount,
+      .firstOutputVertex = skinned.firstOutputVertex,
+      .firstJointMatrix = skinned.firstJointMatrix,
+    };
+    cmd_buf.pushConstants<SkinningParams>(
+      pipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, {params});
+    cmd_buf.dispatch(
+      (skinned.vertexCount + SKINNING_WORKGROUP_SIZE - 1) / SKINNING_WORKGROUP_SIZE, 1, 1);
+  }
+
+  // Etna only tracks images, so buffer barriers have to be placed manually
+  const vk::MemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eVertexAttributeInput,
+    .dstAccessMask = vk::AccessFlagBits2::eVertexAttributeRead,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <optional>
+
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/GpuSharedResource.hpp>
+#include <glm/glm.hpp>
+
+#include "scene/SceneManager.hpp"
+
+
+/**
+ * Skins every instance of a skinned mesh on the GPU. Every such instance gets
+ * its own copy of the mesh's vertices in a per-frame vertex buffer, together with
+ * a matching position-only stream, which are then drawn instead of the scene's buffers.
+ */
+class SkinningPass
+{
+public:
+  SkinningPass();
+
+  // Must be called every time a new scene is selected
+  void prepareScene(SceneManager& scene_mgr);
+
+  bool isReady() const { return !skinnedInstances.empty(); }
+
+  // Evaluates joint matrices from the current state of the scene graph
+  // and records the skinning dispatches.
+  void skin(vk::CommandBuffer cmd_buf);
+
+  // Add this to vertex offsets of the instance's relems when drawing from the skinned
+  // buffers, empty for instances that are not skinned.
+  std::optional<std::int32_t> getVertexOffsetBias(std::uint32_t instance) const
+  {
+    return instance < vertexOffsetBiases.size() ? vertexOffsetBiases[instance] : std::nullopt;
+  }
+
+  // Valid after `skin` has been recorded for the current frame
+  vk::Buffer getVertexBuffer() { return skinnedVertices->get().get(); }
+  vk::Buffer getPositionBuffer() { return skinnedPositions->get().get(); }
+
+  std::uint32_t getJointCount() const { return totalJoints; }
+  // CPU time spent on a single joint matrix last frame
+  double getJointCostNs() const { return lastJointCostNs; }
+
+private:
+  etna::ComputePipeline pipeline;
+
+  SceneManager* scene = nullptr;
+
+  struct SkinnedInstance
+  {
+    std::uint32_t instance;
+    std::uint32_t skin;
+    std::uint32_t firstSourceVertex;
+    std::uint32_t vertexCount;
+    std::uint32_t firstOutputVertex;
+    std::uint32_t firstJointMatrix;
+  };
+  std::vector<SkinnedInstance> skinnedInstances;
+  std::vector<std::optional<std::int32_t>> vertexOffsetBiases;
+  std::uint32_t totalJoints = 0;
+  double lastJointCostNs = 0;
+
+  std::optional<etna::GpuSharedResource<etna::Buffer>> jointMatrices;
+  std::optional<etna::GpuSharedResource<etna::Buffer>> skinnedVertices;
+  std::optional<etna::GpuSharedResource<etna::Buffer>> skinnedPositions;
+};
@@ -1,15 +1,28 @@
 #include "WorldRenderer.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <utility>
+
+#include <fmt/format.h>
 #include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
 #include <etna/PipelineManager.hpp>
 #include <etna/RenderTargetStates.hpp>
 #include <etna/Profiling.hpp>
 #include <glm/ext.hpp>
 #include <imgui.h>
 
+#include "render_utils/MemoryTracker.hpp"
+
 
-WorldRenderer::WorldRenderer()
+WorldRenderer::WorldRenderer(GpuTimer& gpu_timer)
   : sceneMgr{std::make_unique<SceneManager>()}
+  , meshletCuller{std::make_unique<MeshletCuller>()}
+  , skinningPass{std::make_unique<SkinningPass>()}
+  , gpuTimer{gpu_timer}
+  , pipelineStats{std::make_unique<PipelineStatistics>()}
 {
 }
 
@@ -17,37 +30,82 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
 {
   resolution = swapchain_resolution;
 
-  auto& ctx = etna::get_context();
+  allocateShadowMap();
 
-  mainViewDepth = ctx.createImage(etna::Image::CreateInfo{
-    .extent = vk::Extent3D{resolution.x, resolution.y, 1},
-    .name = "main_view_depth",
-    .format = vk::Format::eD32Sfloat,
-    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
+  defaultSampler = etna::Sampler(etna::Sampler::CreateInfo{.name = "default_sampler"});
+  constants = create_tracked_buffer(MemoryCategory::Uniforms, etna::Buffer::CreateInfo{
+    .size = sizeof(UniformParams),
+    .bufferUsage = vk::BufferUsageFlagBits::eUniformBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+    .name = "constants",
   });
 
-  shadowMap = ctx.createImage(etna::Image::CreateInfo{
-    .extent = vk::Extent3D{2048, 2048, 1},
+  constants.map();
+}
+
+void WorldRenderer::allocateShadowMap()
+{
+  shadowMap = create_tracked_image(MemoryCategory::RenderTargets, etna::Image::CreateInfo{
+    .extent = vk::Extent3D{shadowMapSize, shadowMapSize, 1},
     .name = "shadow_map",
     .format = vk::Format::eD16Unorm,
     .imageUsage =
       vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
   });
+}
 
-  defaultSampler = etna::Sampler(etna::Sampler::CreateInfo{.name = "default_sampler"});
-  constants = ctx.createBuffer(etna::Buffer::CreateInfo{
-    .size = sizeof(UniformParams),
-    .bufferUsage = vk::BufferUsageFlagBits::eUniformBuffer,
-    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
-    .name = "constants",
-  });
+void WorldRenderer::setVertexFetchOptions(const VertexFetchOptions& options)
+{
+  ETNA_VERIFY(scenePath.empty());
 
-  constants.map();
+  usePositionStream = options.positionStream;
+  shadowPassRepeats = options.shadowPassRepeats;
+  if (options.shadowMapSize != shadowMapSize)
+  {
+    shadowMapSize = options.shadowMapSize;
+    allocateShadowMap();
+  }
+  if (options.vertexFormat != vertexFormat)
+  {
+    vertexFormat = options.vertexFormat;
+    setupPipelines(swapchainFormat);
+  }
 }
 
 void WorldRenderer::loadScene(std::filesystem::path path)
 {
-  sceneMgr->selectScene(path);
+  scenePath = path;
+  sceneMgr->selectScene(path, vertexFormat, usePositionStream);
+  meshletCuller->prepareScene(*sceneMgr);
+  skinningPass->prepareScene(*sceneMgr);
+
+  animationPlayers.clear();
+  for (const auto& clip : sceneMgr->getAnimations())
+    animationPlayers.emplace_back(clip);
+}
+
+void WorldRenderer::applyPendingChanges()
+{
+  if (!requestedVertexFormat && !requestedShadowMapSize && !sceneReloadRequested)
+    return;
+
+  // Scene buffers and the shadow map are re-created, so nothing may still be using them
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
+
+  if (requestedVertexFormat || sceneReloadRequested)
+  {
+    vertexFormat = std::exchange(requestedVertexFormat, std::nullopt).value_or(vertexFormat);
+    sceneReloadRequested = false;
+    if (!scenePath.empty())
+      loadScene(scenePath);
+    setupPipelines(swapchainFormat);
+  }
+
+  if (requestedShadowMapSize)
+  {
+    shadowMapSize = *std::exchange(requestedShadowMapSize, std::nullopt);
+    allocateShadowMap();
+  }
 }
 
 void WorldRenderer::loadShaders()
@@ -56,10 +114,47 @@ void WorldRenderer::loadShaders()
     "simple_material",
     {SHADOWMAP_SHADERS_ROOT "simple_shadow.frag.spv", SHADOWMAP_SHADERS_ROOT "simple.vert.spv"});
   etna::create_program("simple_shadow", {SHADOWMAP_SHADERS_ROOT "simple.vert.spv"});
+  etna::create_program(
+    "simple_material_compact",
+    {SHADOWMAP_SHADERS_ROOT "simple_shadow.frag.spv",
+     SHADOWMAP_SHADERS_ROOT "simple_compact.vert.spv"});
+  etna::create_program(
+    "simple_shadow_compact", {SHADOWMAP_SHADERS_ROOT "simple_compact.vert.spv"});
+  etna::create_program("depth_only", {SHADOWMAP_SHADERS_ROOT "depth_only.vert.spv"});
+  etna::create_program(
+    "overlay",
+    {SHADOWMAP_SHADERS_ROOT "overlay.vert.spv", SHADOWMAP_SHADERS_ROOT "overlay.frag.spv"});
+}
+
+etna::GraphicsPipeline WorldRenderer::createDepthOnlyPipeline(vk::Format depth_format)
+{
+  return etna::get_context().getPipelineManager().createGraphicsPipeline(
+    "depth_only",
+    etna::GraphicsPipeline::CreateInfo{
+      .vertexShaderInput =
+        {
+          .bindings = {etna::VertexShaderInputDescription::Binding{
+            .byteStreamDescription = SceneManager::getPositionFormatDescription(),
+          }},
+        },
+      .rasterizationConfig =
+        vk::PipelineRasterizationStateCreateInfo{
+          .polygonMode = vk::PolygonMode::eFill,
+          .cullMode = vk::CullModeFlagBits::eBack,
+          .frontFace = vk::FrontFace::eCounterClockwise,
+          .lineWidth = 1.f,
+        },
+      .fragmentShaderOutput =
+        {
+          .depthAttachmentFormat = depth_format,
+        },
+    });
 }
 
 void WorldRenderer::setupPipelines(vk::Format swapchain_format)
 {
+  swapchainFormat = swapchain_format;
+
   quadRenderer = std::make_unique<QuadRenderer>(QuadRenderer::CreateInfo{
     .format = swapchain_format,
     .rect = {{0, 0}, {512, 512}},
@@ -67,35 +162,66 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
 
   etna::VertexShaderInputDescription sceneVertexInputDesc{
     .bindings = {etna::VertexShaderInputDescription::Binding{
-      .byteStreamDescription = sceneMgr->getVertexFormatDescription(),
+      .byteStreamDescription = SceneManager::getVertexFormatDescription(vertexFormat),
     }},
   };
 
+  const bool compact = vertexFormat == VertexFormat::Compact;
+
 
   auto& pipelineManager = etna::get_context().getPipelineManager();
 
+  etna::GraphicsPipeline::CreateInfo forwardInfo{
+    .vertexShaderInput = sceneVertexInputDesc,
+    .rasterizationConfig =
+      vk::PipelineRasterizationStateCreateInfo{
+        .polygonMode = vk::PolygonMode::eFill,
+        .cullMode = vk::CullModeFlagBits::eBack,
+        .frontFace = vk::FrontFace::eCounterClockwise,
+        .lineWidth = 1.f,
+      },
+    .fragmentShaderOutput =
+      {
+        .colorAttachmentFormats = {swapchain_format},
+        .depthAttachmentFormat = vk::Format::eD32Sfloat,
+      },
+  };
+
   basicForwardPipeline = {};
   basicForwardPipeline = pipelineManager.createGraphicsPipeline(
-    "simple_material",
+    compact ? "simple_material_compact" : "simple_material", forwardInfo);
+
+  // After a depth prepass, only the closest fragment of every pixel gets shaded
+  forwardInfo.depthConfig = vk::PipelineDepthStencilStateCreateInfo{
+    .depthTestEnable = VK_TRUE,
+    .depthWriteEnable = VK_FALSE,
+    .depthCompareOp = vk::CompareOp::eEqual,
+    .maxDepthBounds = 1.f,
+  };
+  prepassForwardPipeline = {};
+  prepassForwardPipeline = pipelineManager.createGraphicsPipeline(
+    compact ? "simple_material_compact" : "simple_material", forwardInfo);
+
+  // Runs the main pass's vertex shader, for when the position stream doesn't
+  // match the main pass's positions exactly, e.g. with quantized vertices
+  depthPrepassPipeline = {};
+  depthPrepassPipeline = pipelineManager.createGraphicsPipeline(
+    compact ? "simple_shadow_compact" : "simple_shadow",
     etna::GraphicsPipeline::CreateInfo{
       .vertexShaderInput = sceneVertexInputDesc,
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = vk::PolygonMode::eFill,
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
+      .rasterizationConfig = forwardInfo.rasterizationConfig,
       .fragmentShaderOutput =
         {
-          .colorAttachmentFormats = {swapchain_format},
           .depthAttachmentFormat = vk::Format::eD32Sfloat,
         },
     });
 
+  depthOnlyPrepassPipeline = {};
+  depthOnlyPrepassPipeline = createDepthOnlyPipeline(vk::Format::eD32Sfloat);
+
   shadowPipeline = {};
   shadowPipeline = pipelineManager.createGraphicsPipeline(
-    "simple_shadow",
+    compact ? "simple_shadow_compact" : "simple_shadow",
     etna::GraphicsPipeline::CreateInfo{
       .vertexShaderInput = sceneVertexInputDesc,
       .rasterizationConfig =
@@ -110,6 +236,36 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
           .depthAttachmentFormat = vk::Format::eD16Unorm,
         },
     });
+
+  depthOnlyShadowPipeline = {};
+  depthOnlyShadowPipeline = createDepthOnlyPipeline(vk::Format::eD16Unorm);
+
+  overlayPipeline = {};
+  overlayPipeline = pipelineManager.createGraphicsPipeline(
+    "overlay",
+    etna::GraphicsPipeline::CreateInfo{
+      .blendingConfig =
+        {
+          .attachments = {vk::PipelineColorBlendAttachmentState{
+            .blendEnable = VK_TRUE,
+            .srcColorBlendFactor = vk::BlendFactor::eOne,
+            .dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha,
+            .colorBlendOp = vk::BlendOp::eAdd,
+            .srcAlphaBlendFactor = vk::BlendFactor::eOne,
+            .dstAlphaBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha,
+            .alphaBlendOp = vk::BlendOp::eAdd,
+            .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
+              vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
+          }},
+        },
+      .fragmentShaderOutput =
+        {
+          .colorAttachmentFormats = {swapchain_format},
+        },
+    });
+
+  // Needs both the resolution and the swapchain format
+  buildRenderGraph();
 }
 
 void WorldRenderer::debugInput(const Keyboard& kb)
@@ -129,6 +285,7 @@ void WorldRenderer::update(const FramePacket& packet)
   {
     const float aspect = float(resolution.x) / float(resolution.y);
     worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
+    mainCamPos = packet.mainCam.position;
   }
 
   // calc light matrix
@@ -149,6 +306,23 @@ void WorldRenderer::update(const FramePacket& packet)
     lightPos = packet.shadowCam.position;
   }
 
+  if (playAnimations && !animationPlayers.empty())
+  {
+    ZoneScopedN("sampleAnimations");
+    const auto start = std::chrono::steady_clock::now();
+
+    std::size_t channels = 0;
+    for (auto& player : animationPlayers)
+    {
+      player.apply(packet.currentTime, sceneMgr->getSceneGraph());
+      channels += player.getChannelCount();
+    }
+
+    const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+    lastChannelCostNs = channels > 0 ? elapsed.count() / static_cast<double>(channels) : 0;
+  }
+
   // Upload everything to GPU-mapped memory
   {
     uniformParams.lightMatrix = lightMatrix;
@@ -159,94 +333,516 @@ void WorldRenderer::update(const FramePacket& packet)
   }
 }
 
+std::int32_t WorldRenderer::bindInstance(
+  vk::CommandBuffer cmd_buf,
+  std::uint32_t inst_idx,
+  vk::PipelineLayout pipeline_layout,
+  bool position_only,
+  vk::Buffer& bound_vertex_buffer)
+{
+  const auto meshIdx = sceneMgr->getInstanceMeshes()[inst_idx];
+  const auto& mesh = sceneMgr->getMeshes()[meshIdx];
+
+  // Skinned instances have their own copy of the mesh's vertices
+  const auto bias = skinningPass->getVertexOffsetBias(inst_idx);
+  vk::Buffer vertexBuffer;
+  if (bias.has_value())
+    vertexBuffer =
+      position_only ? skinningPass->getPositionBuffer() : skinningPass->getVertexBuffer();
+  else
+    vertexBuffer = position_only ? sceneMgr->getPositionBuffer() : sceneMgr->getVertexBuffer();
+
+  if (vertexBuffer != bound_vertex_buffer)
+  {
+    cmd_buf.bindVertexBuffers(0, {vertexBuffer}, {0});
+    bound_vertex_buffer = vertexBuffer;
+  }
+
+  // The position stream is never quantized
+  const auto& instanceTm = sceneMgr->getInstanceMatrices()[inst_idx];
+  pushConst2M.model = position_only ? instanceTm : instanceTm * mesh.dequantizationTm;
+
+  cmd_buf.pushConstants<PushConstants>(
+    pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
+
+  return bias.value_or(0);
+}
+
+void WorldRenderer::renderRelem(
+  vk::CommandBuffer cmd_buf, const RenderElement& relem, std::int32_t vertex_bias)
+{
+  cmd_buf.drawIndexed(
+    relem.indexCount,
+    1,
+    relem.indexOffset,
+    static_cast<std::int32_t>(relem.vertexOffset) + vertex_bias,
+    0);
+  renderStats.drawCalls += 1;
+  renderStats.triangles += relem.indexCount / 3;
+}
+
+void WorldRenderer::renderInstance(
+  vk::CommandBuffer cmd_buf,
+  std::uint32_t inst_idx,
+  vk::PipelineLayout pipeline_layout,
+  bool position_only,
+  vk::Buffer& bound_vertex_buffer)
+{
+  const auto& mesh = sceneMgr->getMeshes()[sceneMgr->getInstanceMeshes()[inst_idx]];
+  auto relems = sceneMgr->getRenderElements();
+
+  const auto bias =
+    bindInstance(cmd_buf, inst_idx, pipeline_layout, position_only, bound_vertex_buffer);
+
+  for (std::size_t j = 0; j < mesh.relemCount; ++j)
+    renderRelem(cmd_buf, relems[mesh.firstRelem + j], bias);
+}
+
 void WorldRenderer::renderScene(
-  vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout)
+  vk::CommandBuffer cmd_buf,
+  const glm::mat4x4& glob_tm,
+  vk::PipelineLayout pipeline_layout,
+  bool position_only,
+  std::span<const std::uint32_t> instance_order)
 {
-  if (!sceneMgr->getVertexBuffer())
+  if (!(position_only ? sceneMgr->getPositionBuffer() : sceneMgr->getVertexBuffer()))
     return;
 
-  cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
   cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
 
   pushConst2M.projView = glob_tm;
 
+  vk::Buffer boundVertexBuffer;
+  if (!instance_order.empty())
+  {
+    for (std::uint32_t instIdx : instance_order)
+      renderInstance(cmd_buf, instIdx, pipeline_layout, position_only, boundVertexBuffer);
+    return;
+  }
+
+  const auto instanceCount = static_cast<std::uint32_t>(sceneMgr->getInstanceMeshes().size());
+  for (std::uint32_t instIdx = 0; instIdx < instanceCount; ++instIdx)
+    renderInstance(cmd_buf, instIdx, pipeline_layout, position_only, boundVertexBuffer);
+}
+
+void WorldRenderer::renderSceneCulled(
+  vk::CommandBuffer cmd_buf,
+  const glm::mat4x4& glob_tm,
+  vk::PipelineLayout pipeline_layout,
+  bool position_only,
+  std::span<const std::uint32_t> instance_order)
+{
+  const vk::Buffer sceneVertexBuffer =
+    position_only ? sceneMgr->getPositionBuffer() : sceneMgr->getVertexBuffer();
+  if (!sceneVertexBuffer)
+    return;
+
+  pushConst2M.projView = glob_tm;
+
   auto instanceMeshes = sceneMgr->getInstanceMeshes();
   auto instanceMatrices = sceneMgr->getInstanceMatrices();
-
   auto meshes = sceneMgr->getMeshes();
-  auto relems = sceneMgr->getRenderElements();
 
-  for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
+  std::vector<std::uint32_t> identityOrder;
+  if (instance_order.empty())
   {
-    pushConst2M.model = instanceMatrices[instIdx];
+    identityOrder.resize(instanceMatrices.size());
+    std::iota(identityOrder.begin(), identityOrder.end(), 0u);
+    instance_order = identityOrder;
+  }
+
+  vk::Buffer boundVertexBuffer;
+
+  // Skinned instances are not culled, as their meshlet bounds don't move with the joints
+  cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
+  for (std::uint32_t instIdx : instance_order)
+    if (sceneMgr->getInstanceSkins()[instIdx] != SceneManager::NO_SKIN)
+      renderInstance(cmd_buf, instIdx, pipeline_layout, position_only, boundVertexBuffer);
+
+  // Skinned instances may have left their own vertices bound, culled draws read the scene's
+  // vertex buffer, which is either the position stream or the full or compact vertices
+  if (boundVertexBuffer != sceneVertexBuffer)
+    cmd_buf.bindVertexBuffers(0, {sceneVertexBuffer}, {0});
+  cmd_buf.bindIndexBuffer(meshletCuller->getIndexBuffer(), 0, vk::IndexType::eUint32);
+
+  // All relems of an instance were merged into a single draw by the culling shader
+  for (std::uint32_t instIdx : instance_order)
+  {
+    if (sceneMgr->getInstanceSkins()[instIdx] != SceneManager::NO_SKIN)
+      continue;
+
+    // The position stream is never quantized
+    pushConst2M.model = position_only
+      ? instanceMatrices[instIdx]
+      : instanceMatrices[instIdx] * meshes[instanceMeshes[instIdx]].dequantizationTm;
 
     cmd_buf.pushConstants<PushConstants>(
       pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
 
-    const auto meshIdx = instanceMeshes[instIdx];
+    cmd_buf.drawIndexedIndirect(
+      meshletCuller->getDrawCommandBuffer(),
+      instIdx * MeshletCuller::DRAW_COMMAND_STRIDE,
+      1,
+      MeshletCuller::DRAW_COMMAND_STRIDE);
+    renderStats.drawCalls += 1;
+  }
+
+  // NOTE: lags behind by the amount of frames in flight
+  renderStats.triangles += meshletCuller->getStats().visibleTriangles;
+}
+
+void WorldRenderer::renderMainView(
+  vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout, bool position_only)
+{
+  const std::span<const std::uint32_t> order =
+    sortFrontToBack ? std::span<const std::uint32_t>{drawOrder} : std::span<const std::uint32_t>{};
+
+  if (cullMeshletsThisFrame)
+    renderSceneCulled(cmd_buf, worldViewProj, pipeline_layout, position_only, order);
+  else if (useDrawList)
+    renderDrawList(cmd_buf, pipeline_layout, position_only);
+  else
+    renderScene(cmd_buf, worldViewProj, pipeline_layout, position_only, order);
+}
+
+void WorldRenderer::buildDrawList()
+{
+  ZoneScoped;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  auto instanceMeshes = sceneMgr->getInstanceMeshes();
+  auto instanceMatrices = sceneMgr->getInstanceMatrices();
+  auto meshes = sceneMgr->getMeshes();
+
+  drawList.clear();
+  for (std::uint32_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
+  {
+    const auto& mesh = meshes[instanceMeshes[instIdx]];
+
+    // There is a single pipeline and no materials yet, so draws are grouped by mesh.
+    // Relems have no bounds of their own, the instance origin is used for depth.
+    const glm::vec3 offset = glm::vec3(instanceMatrices[instIdx][3]) - mainCamPos;
+    const std::uint64_t key = DrawList::makeKey(
+      0, 0, 0, instanceMeshes[instIdx], glm::length(offset));
+
+    for (std::uint32_t j = 0; j < mesh.relemCount; ++j)
+      drawList.add(key, DrawList::Draw{.instance = instIdx, .relem = mesh.firstRelem + j});
+  }
+
+  drawList.sort();
+
+  lastDrawListTime = std::chrono::steady_clock::now() - start;
+}
+
+void WorldRenderer::renderDrawList(
+  vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout, bool position_only)
+{
+  if (drawList.empty() ||
+      !(position_only ? sceneMgr->getPositionBuffer() : sceneMgr->getVertexBuffer()))
+    return;
+
+  cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
+
+  pushConst2M.projView = worldViewProj;
 
-    for (std::size_t j = 0; j < meshes[meshIdx].relemCount; ++j)
+  auto relems = sceneMgr->getRenderElements();
+
+  // Draws of the same instance end up next to each other, so most of them
+  // don't change any state and are just a drawIndexed
+  vk::Buffer boundVertexBuffer;
+  std::uint32_t boundInstance = ~0u;
+  std::int32_t bias = 0;
+  for (std::size_t i = 0; i < drawList.size(); ++i)
+  {
+    const auto draw = drawList.getDraw(i);
+    if (draw.instance != boundInstance)
     {
-      const auto relemIdx = meshes[meshIdx].firstRelem + j;
-      const auto& relem = relems[relemIdx];
-      cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, 0);
+      bias =
+        bindInstance(cmd_buf, draw.instance, pipeline_layout, position_only, boundVertexBuffer);
+      boundInstance = draw.instance;
     }
+    renderRelem(cmd_buf, relems[draw.relem], bias);
+  }
+}
+
+void WorldRenderer::sortInstancesFrontToBack()
+{
+  ZoneScoped;
+
+  // Instance origins are a good enough estimate for scenes made of many small objects
+  auto matrices = sceneMgr->getInstanceMatrices();
+  std::vector<float> distances(matrices.size());
+  for (std::size_t i = 0; i < matrices.size(); ++i)
+  {
+    const glm::vec3 offset = glm::vec3(matrices[i][3]) - mainCamPos;
+    distances[i] = glm::dot(offset, offset);
   }
+
+  drawOrder.resize(matrices.size());
+  std::iota(drawOrder.begin(), drawOrder.end(), 0u);
+  std::sort(drawOrder.begin(), drawOrder.end(), [&distances](std::uint32_t a, std::uint32_t b) {
+    return distances[a] < distances[b];
+  });
+}
+
+void WorldRenderer::beginMainView(vk::CommandBuffer cmd_buf)
+{
+  if (mainViewBegun)
+    return;
+  mainViewBegun = true;
+
+  gpuTimer.endZone(cmd_buf, cullAndShadowsZone);
+
+  if (cullMeshletsThisFrame && overlapCulling)
+    meshletCuller->barrierForDraws(cmd_buf);
+
+  pipelineStats->begin(cmd_buf);
+}
+
+void WorldRenderer::compositeOverlay(vk::CommandBuffer cmd_buf)
+{
+  GpuTimer::Scope zone{gpuTimer, cmd_buf, "compositeOverlay"};
+
+  auto overlayInfo = etna::get_shader_program("overlay");
+  auto set = etna::create_descriptor_set(
+    overlayInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {etna::Binding{
+      0, overlay->genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}});
+
+  etna::RenderTargetState renderTargets(
+    cmd_buf,
+    {{0, 0}, {resolution.x, resolution.y}},
+    {{.image = renderGraph->getImage(backbufferRes),
+      .view = renderGraph->getView(backbufferRes),
+      .loadOp = vk::AttachmentLoadOp::eLoad}},
+    {});
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, overlayPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eGraphics,
+    overlayPipeline.getVkPipelineLayout(),
+    0,
+    {set.getVkSet()},
+    {});
+  cmd_buf.draw(3, 1, 0, 0);
 }
 
 void WorldRenderer::renderWorld(
-  vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view)
+  vk::CommandBuffer cmd_buf,
+  vk::Image target_image,
+  vk::ImageView target_image_view,
+  const etna::Image* overlay_image)
 {
+  renderStats = {};
+  mainViewBegun = false;
+
+  pipelineStats->beginFrame(cmd_buf);
+  if (const auto& stats = pipelineStats->getLastResult())
+    renderStats.fragmentShaderInvocations = stats->fragmentShaderInvocations;
+
   ETNA_PROFILE_GPU(cmd_buf, renderWorld);
+  GpuTimer::Scope worldZone{gpuTimer, cmd_buf, "renderWorld"};
 
-  // draw scene to shadowmap
+  // The GPU is done with this frame's instance buffer by now
+  {
+    const auto start = std::chrono::steady_clock::now();
+    sceneMgr->updateInstances();
+    lastGraphUpdateTime = std::chrono::steady_clock::now() - start;
+  }
 
+  if (sortFrontToBack)
+    sortInstancesFrontToBack();
+
+  if (useDrawList)
+    buildDrawList();
+
+  // Shadows and the main view both use skinned vertices
+  if (skinningPass->isReady())
   {
-    ETNA_PROFILE_GPU(cmd_buf, renderShadowMap);
+    GpuTimer::Scope zone{gpuTimer, cmd_buf, "skinning"};
+    skinningPass->skin(cmd_buf);
+  }
 
-    etna::RenderTargetState renderTargets(
-      cmd_buf,
-      {{0, 0}, {2048, 2048}},
-      {},
-      {.image = shadowMap.get(), .view = shadowMap.getView({})});
+  cullMeshletsThisFrame = useMeshletCulling && meshletCuller->isReady();
 
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
-    renderScene(cmd_buf, lightMatrix, shadowPipeline.getVkPipelineLayout());
+  // Ends after the shadow pass, so that it shows the effect of overlapping
+  cullAndShadowsZone = gpuTimer.beginZone(cmd_buf, "cullAndShadows");
+
+  // cull meshlets for the main view, shadows are drawn without culling for now
+  if (cullMeshletsThisFrame)
+  {
+    GpuTimer::Scope zone{gpuTimer, cmd_buf, "cullMeshlets"};
+    meshletCuller->cull(cmd_buf, worldViewProj, mainCamPos);
+    if (!overlapCulling)
+      meshletCuller->barrierForDraws(cmd_buf);
   }
 
+  // The overlay isn't in the graph, as it only exists when rendering to a window
+  overlay = overlay_image;
+  if (overlay)
+    etna::set_state(
+      cmd_buf,
+      overlay->get(),
+      vk::PipelineStageFlagBits2::eFragmentShader,
+      vk::AccessFlagBits2::eShaderSampledRead,
+      vk::ImageLayout::eShaderReadOnlyOptimal,
+      vk::ImageAspectFlagBits::eColor);
+
+  // Images are transitioned by the graph, passes only need to record their commands
+  renderGraph->bindImported(backbufferRes, target_image, target_image_view);
+  renderGraph->bindImported(shadowMapRes, shadowMap.get(), shadowMap.getView({}));
+  renderGraph->execute(cmd_buf);
+
+  overlay = nullptr;
+}
+
+void WorldRenderer::buildRenderGraph()
+{
+  // Drop the old graph first, so that its memory is free for the new one
+  renderGraph.reset();
+  renderGraph = std::make_unique<RenderGraph>("world_graph");
+
+  backbufferRes = renderGraph->importImage("backbuffer", swapchainFormat);
+  shadowMapRes = renderGraph->importImage("shadow_map", vk::Format::eD16Unorm);
+  mainViewDepthRes = renderGraph->createImage(RenderGraph::ImageInfo{
+    .name = "main_view_depth",
+    .extent = {resolution.x, resolution.y},
+    .format = vk::Format::eD32Sfloat,
+  });
+
+  // draw scene to shadowmap
+
+  renderGraph
+    ->addPass(
+      "renderShadowMap",
+      [this](vk::CommandBuffer cmd_buf) {
+        ETNA_PROFILE_GPU(cmd_buf, renderShadowMap);
+        GpuTimer::Scope zone{gpuTimer, cmd_buf, "renderShadowMap"};
+
+        etna::RenderTargetState renderTargets(
+          cmd_buf,
+          {{0, 0}, {shadowMapSize, shadowMapSize}},
+          {},
+          {.image = shadowMap.get(), .view = shadowMap.getView({})});
+
+        const bool positionOnly = usePositionStream && sceneMgr->getPositionBuffer();
+        auto& pipeline = positionOnly ? depthOnlyShadowPipeline : shadowPipeline;
+
+        cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.getVkPipeline());
+        for (int i = 0; i < shadowPassRepeats; ++i)
+          renderScene(cmd_buf, lightMatrix, pipeline.getVkPipelineLayout(), positionOnly);
+      })
+    .use(shadowMapRes, RenderGraph::Usage::DepthAttachment);
+
+  // fill the main view's depth, so that the main pass shades every pixel once
+
+  renderGraph
+    ->addPass(
+      "depthPrepass",
+      [this](vk::CommandBuffer cmd_buf) {
+        if (!useDepthPrepass)
+          return;
+
+        beginMainView(cmd_buf);
+
+        ETNA_PROFILE_GPU(cmd_buf, depthPrepass);
+        GpuTimer::Scope zone{gpuTimer, cmd_buf, "depthPrepass"};
+
+        etna::RenderTargetState renderTargets(
+          cmd_buf,
+          {{0, 0}, {resolution.x, resolution.y}},
+          {},
+          {.image = renderGraph->getImage(mainViewDepthRes),
+           .view = renderGraph->getView(mainViewDepthRes)});
+
+        // Quantized positions of compact vertices differ from the position stream
+        const bool positionOnly = usePositionStream && vertexFormat == VertexFormat::Full &&
+          sceneMgr->getPositionBuffer();
+        auto& pipeline = positionOnly ? depthOnlyPrepassPipeline : depthPrepassPipeline;
+
+        cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.getVkPipeline());
+        renderMainView(cmd_buf, pipeline.getVkPipelineLayout(), positionOnly);
+      })
+    .use(mainViewDepthRes, RenderGraph::Usage::DepthAttachment);
+
   // draw final scene to screen
 
-  {
-    ETNA_PROFILE_GPU(cmd_buf, renderForward);
+  renderGraph
+    ->addPass(
+      "renderForward",
+      [this](vk::CommandBuffer cmd_buf) {
+        beginMainView(cmd_buf);
 
-    auto simpleMaterialInfo = etna::get_shader_program("simple_material");
+        {
+          ETNA_PROFILE_GPU(cmd_buf, renderForward);
+          GpuTimer::Scope zone{gpuTimer, cmd_buf, "renderForward"};
 
-    auto set = etna::create_descriptor_set(
-      simpleMaterialInfo.getDescriptorLayoutId(0),
-      cmd_buf,
-      {etna::Binding{0, constants.genBinding()},
-       etna::Binding{
-         1, shadowMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}});
+          auto simpleMaterialInfo = etna::get_shader_program("simple_material");
 
-    etna::RenderTargetState renderTargets(
-      cmd_buf,
-      {{0, 0}, {resolution.x, resolution.y}},
-      {{.image = target_image, .view = target_image_view}},
-      {.image = mainViewDepth.get(), .view = mainViewDepth.getView({})});
-
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, basicForwardPipeline.getVkPipeline());
-    cmd_buf.bindDescriptorSets(
-      vk::PipelineBindPoint::eGraphics,
-      basicForwardPipeline.getVkPipelineLayout(),
-      0,
-      {set.getVkSet()},
-      {});
-
-    renderScene(cmd_buf, worldViewProj, basicForwardPipeline.getVkPipelineLayout());
-  }
+          auto set = etna::create_descriptor_set(
+            simpleMaterialInfo.getDescriptorLayoutId(0),
+            cmd_buf,
+            {etna::Binding{0, constants.genBinding()},
+             etna::Binding{
+               1,
+               shadowMap.genBinding(
+                 defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}});
+
+          // The prepass has already filled the depth buffer
+          const auto depthLoadOp =
+            useDepthPrepass ? vk::AttachmentLoadOp::eLoad : vk::AttachmentLoadOp::eClear;
+          etna::RenderTargetState renderTargets(
+            cmd_buf,
+            {{0, 0}, {resolution.x, resolution.y}},
+            {{.image = renderGraph->getImage(backbufferRes),
+              .view = renderGraph->getView(backbufferRes)}},
+            {.image = renderGraph->getImage(mainViewDepthRes),
+             .view = renderGraph->getView(mainViewDepthRes),
+             .loadOp = depthLoadOp});
+
+          auto& pipeline = useDepthPrepass ? prepassForwardPipeline : basicForwardPipeline;
+          cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.getVkPipeline());
+          cmd_buf.bindDescriptorSets(
+            vk::PipelineBindPoint::eGraphics,
+            pipeline.getVkPipelineLayout(),
+            0,
+            {set.getVkSet()},
+            {});
+
+          renderMainView(cmd_buf, pipeline.getVkPipelineLayout(), false);
+        }
+
+        pipelineStats->end(cmd_buf);
+      })
+    .use(shadowMapRes, RenderGraph::Usage::SampledInFragment)
+    .use(backbufferRes, RenderGraph::Usage::ColorAttachment)
+    .use(mainViewDepthRes, RenderGraph::Usage::DepthAttachment);
 
-  if (drawDebugFSQuad)
-    quadRenderer->render(cmd_buf, target_image, target_image_view, shadowMap, defaultSampler);
+  renderGraph
+    ->addPass(
+      "post",
+      [this](vk::CommandBuffer cmd_buf) {
+        if (drawDebugFSQuad)
+        {
+          GpuTimer::Scope zone{gpuTimer, cmd_buf, "post"};
+          quadRenderer->render(
+            cmd_buf,
+            renderGraph->getImage(backbufferRes),
+            renderGraph->getView(backbufferRes),
+            shadowMap,
+            defaultSampler);
+        }
+
+        // Not in the forward pass, as its pipeline statistics would count the overlay
+        if (overlay)
+          compositeOverlay(cmd_buf);
+      })
+    .use(shadowMapRes, RenderGraph::Usage::SampledInFragment)
+    .use(backbufferRes, RenderGraph::Usage::ColorAttachment);
+
+  renderGraph->compile();
 }
 
 void WorldRenderer::drawGui()
@@ -262,6 +858,223 @@ void WorldRenderer::drawGui()
   ImGui::SliderFloat3("Light source position", pos, -10.f, 10.f);
   uniformParams.lightPos = {pos[0], pos[1], pos[2]};
 
+  if (ImGui::CollapsingHeader("Meshlet culling"))
+  {
+    ImGui::Checkbox("Enabled", &useMeshletCulling);
+    ImGui::Checkbox("Frustum test", &meshletCuller->frustumCulling);
+    ImGui::Checkbox("Normal cone test", &meshletCuller->coneCulling);
+
+    // Comparing the two shows how much of culling is hidden behind the shadow pass
+    if (auto ms = gpuTimer.getSmoothedMilliseconds("cullAndShadows"))
+      cullAndShadowsMs[overlapCulling ? 1 : 0] = ms;
+    ImGui::Checkbox("Overlap with shadow pass", &overlapCulling);
+    if (cullAndShadowsMs[0] && cullAndShadowsMs[1])
+      ImGui::Text(
+        "Culling and shadows: %.3f ms serial, %.3f ms overlapped, %.3f ms saved",
+        *cullAndShadowsMs[0],
+        *cullAndShadowsMs[1],
+        *cullAndShadowsMs[0] - *cullAndShadowsMs[1]);
+    else
+      ImGui::TextUnformatted("Toggle overlap to compare GPU time of culling and shadows");
+
+    const auto& stats = meshletCuller->getStats();
+    ImGui::Text("Visible meshlets: %u", stats.visibleMeshlets);
+    ImGui::Text("Visible triangles: %u", stats.visibleTriangles);
+    ImGui::Text("Triangles culled by frustum: %u", stats.frustumCulledTriangles);
+    ImGui::Text("Triangles culled by normal cone: %u", stats.coneCulledTriangles);
+  }
+
+  if (ImGui::CollapsingHeader("Scene graph"))
+  {
+    ImGui::Text("Nodes: %u", sceneMgr->getSceneGraph().getNodeCount());
+    ImGui::Text("Instances: %zu", sceneMgr->getInstanceMatrices().size());
+    ImGui::Text(
+      "Last update: %.3f ms",
+      std::chrono::duration<double, std::milli>(lastGraphUpdateTime).count());
+  }
+
+  if (ImGui::CollapsingHeader("Animation"))
+  {
+    ImGui::Checkbox("Play animations", &playAnimations);
+    ImGui::Text("Clips: %zu", animationPlayers.size());
+    ImGui::Text("Sampling: %.1f ns/channel", lastChannelCostNs);
+    ImGui::Text("Skinning joints: %u", skinningPass->getJointCount());
+    ImGui::Text("Joint matrices: %.1f ns/joint", skinningPass->getJointCostNs());
+  }
+
+  if (ImGui::CollapsingHeader("Vertex format"))
+  {
+    int format = static_cast<int>(requestedVertexFormat.value_or(vertexFormat));
+    ImGui::RadioButton("Full (32 bytes)", &format, static_cast<int>(VertexFormat::Full));
+    ImGui::SameLine();
+    ImGui::RadioButton("Compact (20 bytes)", &format, static_cast<int>(VertexFormat::Compact));
+
+    if (format != static_cast<int>(vertexFormat))
+      requestedVertexFormat = static_cast<VertexFormat>(format);
+    else
+      requestedVertexFormat.reset();
+
+    ImGui::SliderInt("Shadow pass repeats", &shadowPassRepeats, 1, 16);
+    ImGui::TextWrapped(
+      "Repeats make the frame vertex fetch bound, compare renderShadowMap GPU time between "
+      "formats in the profiler.");
+  }
+
+  if (ImGui::CollapsingHeader("Main view"))
+  {
+    ImGui::Checkbox("Depth prepass", &useDepthPrepass);
+    ImGui::Checkbox("Sort instances front to back", &sortFrontToBack);
+    ImGui::Checkbox("State-sorted draw list", &useDrawList);
+    if (useDrawList)
+      ImGui::Text(
+        "Draw list: %zu draws, built and sorted in %.3f ms",
+        drawList.size(),
+        std::chrono::duration<double, std::milli>(lastDrawListTime).count());
+    ImGui::Text(
+      "Fragment shader invocations: %llu",
+      static_cast<unsigned long long>(renderStats.fragmentShaderInvocations));
+    ImGui::TextWrapped("Compare with renderForward and depthPrepass GPU times.");
+  }
+
+  if (ImGui::CollapsingHeader("Shadows"))
+  {
+    // Without the stream, e.g. with --no-position-stream, the scene has to be reloaded to build it
+    if (
+      ImGui::Checkbox("Position-only vertex stream", &usePositionStream) && usePositionStream &&
+      !sceneMgr->getPositionBuffer())
+      sceneReloadRequested = true;
+
+    static constexpr std::array SHADOW_MAP_SIZE_NAMES{"1024", "2048", "4096"};
+    int sizeIdx = static_cast<int>(
+      std::find(
+        SHADOW_MAP_SIZES.begin(),
+        SHADOW_MAP_SIZES.end(),
+        requestedShadowMapSize.value_or(shadowMapSize)) -
+      SHADOW_MAP_SIZES.begin());
+    if (ImGui::Combo(
+          "Shadow map resolution",
+          &sizeIdx,
+          SHADOW_MAP_SIZE_NAMES.data(),
+          static_cast<int>(SHADOW_MAP_SIZE_NAMES.size())))
+      requestedShadowMapSize = SHADOW_MAP_SIZES[sizeIdx];
+  }
+
+  if (ImGui::CollapsingHeader("GPU timings", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    // Timestamps are read back without waiting, so these are a few frames old
+    if (ImGui::BeginTable("gpu_timings", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders))
+    {
+      ImGui::TableSetupColumn("Pass");
+      ImGui::TableSetupColumn("Smoothed, ms");
+      ImGui::TableSetupColumn("Last, ms");
+      ImGui::TableHeadersRow();
+
+      for (const auto& zone : gpuTimer.getResults())
+      {
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::Indent(static_cast<float>(zone.depth) * ImGui::GetStyle().IndentSpacing);
+        ImGui::TextUnformatted(zone.name.c_str());
+        ImGui::Unindent(static_cast<float>(zone.depth) * ImGui::GetStyle().IndentSpacing);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", zone.smoothedMilliseconds);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", zone.milliseconds);
+      }
+
+      ImGui::EndTable();
+    }
+    ImGui::SliderFloat("Smoothing", &gpuTimer.smoothingFactor, 0.01f, 1.0f);
+
+    ImGui::Text(
+      "Draw calls: %u, triangles: %llu",
+      renderStats.drawCalls,
+      static_cast<unsigned long long>(renderStats.triangles));
+  }
+
+  if (ImGui::CollapsingHeader("Render graph"))
+  {
+    static constexpr double MIB = 1024.0 * 1024.0;
+
+    if (ImGui::BeginTable("render_graph", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders))
+    {
+      ImGui::TableSetupColumn("Image");
+      ImGui::TableSetupColumn("Passes");
+      ImGui::TableSetupColumn("Heap");
+      ImGui::TableSetupColumn("MiB");
+      ImGui::TableHeadersRow();
+
+      for (const auto& lifetime : renderGraph->getLifetimes())
+      {
+        // Not used by any pass
+        if (lifetime.firstPass > lifetime.lastPass)
+          continue;
+
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(lifetime.name.c_str());
+        ImGui::TableNextColumn();
+        ImGui::Text(
+          "%s .. %s",
+          renderGraph->getPassName(lifetime.firstPass).c_str(),
+          renderGraph->getPassName(lifetime.lastPass).c_str());
+        ImGui::TableNextColumn();
+        if (lifetime.transient)
+          ImGui::Text("%zu", lifetime.heap);
+        else
+          ImGui::TextUnformatted("imported");
+        ImGui::TableNextColumn();
+        ImGui::Text("%.2f", static_cast<double>(lifetime.bytes) / MIB);
+      }
+
+      ImGui::EndTable();
+    }
+
+    const auto& report = renderGraph->getAliasingReport();
+    ImGui::Text(
+      "Transient: %.2f MiB in %zu heaps of %.2f MiB, %.2f MiB saved by aliasing",
+      static_cast<double>(report.requiredBytes) / MIB,
+      report.heapCount,
+      static_cast<double>(report.allocatedBytes) / MIB,
+      static_cast<double>(report.savedBytes()) / MIB);
+  }
+
+  if (ImGui::CollapsingHeader("Memory"))
+  {
+    static constexpr double MIB = 1024.0 * 1024.0;
+
+    const auto totals = get_memory_tracker().getCategoryTotals();
+    for (std::size_t i = 0; i < totals.size(); ++i)
+      ImGui::Text(
+        "%-16s %9.2f MiB",
+        memory_category_name(static_cast<MemoryCategory>(i)),
+        static_cast<double>(totals[i]) / MIB);
+
+    ImGui::Separator();
+
+    // Usage includes memory of other processes' allocations made through this device
+    const auto heaps = MemoryTracker::queryHeapBudgets();
+    for (std::size_t i = 0; i < heaps.size(); ++i)
+    {
+      const auto& heap = heaps[i];
+      const double usage = static_cast<double>(heap.usage) / MIB;
+      const double budget = static_cast<double>(heap.budget) / MIB;
+      ImGui::Text(
+        "Heap %zu (%s): %u allocations, %.1f of %.1f MiB in blocks",
+        i,
+        heap.deviceLocal ? "VRAM" : "host",
+        heap.allocationCount,
+        static_cast<double>(heap.allocationBytes) / MIB,
+        static_cast<double>(heap.blockBytes) / MIB);
+      const std::string overlay = fmt::format("{:.1f} / {:.1f} MiB", usage, budget);
+      ImGui::ProgressBar(
+        budget > 0 ? static_cast<float>(usage / budget) : 0.0f, {-1, 0}, overlay.c_str());
+    }
+
+    if (ImGui::Button("Dump to memory_report.json"))
+      get_memory_tracker().writeJson("memory_report.json");
+  }
+
   ImGui::Text(
     "Application average %.3f ms/frame (%.1f FPS)",
     1000.0f / ImGui::GetIO().Framerate,
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <optional>
+#include <span>
+
 #include <etna/Image.hpp>
 #include <etna/Sampler.hpp>
 #include <etna/Buffer.hpp>
@@ -9,9 +14,15 @@
 #include "shaders/UniformParams.h"
 #include "scene/SceneManager.hpp"
 #include "render_utils/QuadRenderer.hpp"
+#include "render_utils/GpuTimer.hpp"
+#include "render_utils/RenderGraph.hpp"
+#include "render_utils/PipelineStatistics.hpp"
+#include "render_utils/DrawList.hpp"
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
+#include "MeshletCuller.hpp"
+#include "SkinningPass.hpp"
 
 
 /**
@@ -21,7 +32,22 @@
 class WorldRenderer
 {
 public:
-  WorldRenderer();
+  // Passes are timed with the renderer's timer, so that they show up together with the GUI
+  explicit WorldRenderer(GpuTimer& gpu_timer);
+
+  // For measuring vertex fetch costs from the command line, all of these can also be
+  // changed in the GUI
+  struct VertexFetchOptions
+  {
+    VertexFormat vertexFormat = VertexFormat::Full;
+    bool positionStream = true;
+    int shadowPassRepeats = 1;
+    // Fetch costs are compared at every resolution we use, one of SHADOW_MAP_SIZES
+    std::uint32_t shadowMapSize = 2048;
+  };
+  static constexpr std::array SHADOW_MAP_SIZES{1024u, 2048u, 4096u};
+  // Only before the scene is loaded, as its buffers are laid out for the vertex format
+  void setVertexFetchOptions(const VertexFetchOptions& options);
 
   void loadScene(std::filesystem::path path);
 
@@ -29,21 +55,81 @@ public:
   void allocateResources(glm::uvec2 swapchain_resolution);
   void setupPipelines(vk::Format swapchain_format);
 
+  // Changes from the GUI that re-create resources wait for the GPU to be idle, so they
+  // are only applied here, before recording a frame and outside of building the GUI
+  void applyPendingChanges();
+
   void debugInput(const Keyboard& kb);
   void update(const FramePacket& packet);
   void drawGui();
+  // The overlay, e.g. the GUI, must be premultiplied by alpha and of the target's
+  // resolution, it is blended over everything else in the final pass
   void renderWorld(
-    vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view);
+    vk::CommandBuffer cmd_buf,
+    vk::Image target_image,
+    vk::ImageView target_image_view,
+    const etna::Image* overlay = nullptr);
+
+  // Counted on the CPU while recording, so triangles of
+  // indirect draws are taken from the culling statistics
+  struct RenderStats
+  {
+    std::uint32_t drawCalls = 0;
+    std::uint64_t triangles = 0;
+    // Of the main view, read back from a query of an older frame, 0 if not supported
+    std::uint64_t fragmentShaderInvocations = 0;
+  };
+  const RenderStats& getRenderStats() const { return renderStats; }
 
 private:
+  void allocateShadowMap();
+  void buildRenderGraph();
+  etna::GraphicsPipeline createDepthOnlyPipeline(vk::Format depth_format);
+
+  // With position_only, the scene's position stream is bound instead of full vertices.
+  // Instances are drawn in the given order, or in scene order if it is empty.
   void renderScene(
-    vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout);
+    vk::CommandBuffer cmd_buf,
+    const glm::mat4x4& glob_tm,
+    vk::PipelineLayout pipeline_layout,
+    bool position_only = false,
+    std::span<const std::uint32_t> instance_order = {});
+  // Binds the instance's vertices and transform, returns the vertex offset bias of its relems
+  std::int32_t bindInstance(
+    vk::CommandBuffer cmd_buf,
+    std::uint32_t inst_idx,
+    vk::PipelineLayout pipeline_layout,
+    bool position_only,
+    vk::Buffer& bound_vertex_buffer);
+  void renderRelem(vk::CommandBuffer cmd_buf, const RenderElement& relem, std::int32_t vertex_bias);
+  void renderInstance(
+    vk::CommandBuffer cmd_buf,
+    std::uint32_t inst_idx,
+    vk::PipelineLayout pipeline_layout,
+    bool position_only,
+    vk::Buffer& bound_vertex_buffer);
+  void renderSceneCulled(
+    vk::CommandBuffer cmd_buf,
+    const glm::mat4x4& glob_tm,
+    vk::PipelineLayout pipeline_layout,
+    bool position_only = false,
+    std::span<const std::uint32_t> instance_order = {});
+  // Both the depth prepass and the main pass draw exactly the same geometry
+  void renderMainView(
+    vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout, bool position_only);
+  void sortInstancesFrontToBack();
+  void buildDrawList();
+  // Only used for the main view when meshlet culling is off
+  void renderDrawList(
+    vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout, bool position_only);
+  // Called by whichever main view pass runs first
+  void beginMainView(vk::CommandBuffer cmd_buf);
+  void compositeOverlay(vk::CommandBuffer cmd_buf);
 
 
 private:
   std::unique_ptr<SceneManager> sceneMgr;
 
-  etna::Image mainViewDepth;
   etna::Image shadowMap;
   etna::Sampler defaultSampler;
   etna::Buffer constants;
@@ -55,6 +141,7 @@ private:
   } pushConst2M;
 
   glm::mat4x4 worldViewProj;
+  glm::vec3 mainCamPos;
   glm::mat4x4 lightMatrix;
   glm::vec3 lightPos;
 
@@ -74,9 +161,68 @@ private:
 
   etna::GraphicsPipeline basicForwardPipeline{};
   etna::GraphicsPipeline shadowPipeline{};
+  // Only fetches positions, used for shadows and depth prepasses
+  etna::GraphicsPipeline depthOnlyShadowPipeline{};
+  etna::GraphicsPipeline depthOnlyPrepassPipeline{};
+  etna::GraphicsPipeline depthPrepassPipeline{};
+  // Tests for equal depth and doesn't write it
+  etna::GraphicsPipeline prepassForwardPipeline{};
+  bool useDepthPrepass = true;
+  // Improves early depth test rejection, mostly useful without the prepass
+  bool sortFrontToBack = true;
+  std::vector<std::uint32_t> drawOrder;
+  // Sorted by mesh and then front to back, every relem is a separate draw
+  bool useDrawList = false;
+  DrawList drawList;
+  std::chrono::steady_clock::duration lastDrawListTime{};
+  bool usePositionStream = true;
+  std::uint32_t shadowMapSize = 2048;
+  std::optional<std::uint32_t> requestedShadowMapSize;
+
+  // Changing the format reloads the scene and recreates pipelines
+  VertexFormat vertexFormat = VertexFormat::Full;
+  std::optional<VertexFormat> requestedVertexFormat;
+  // The position stream is only built while loading the scene
+  bool sceneReloadRequested = false;
+  std::filesystem::path scenePath;
+  vk::Format swapchainFormat = vk::Format::eUndefined;
+  // Repeating the depth-only shadow pass makes the frame vertex fetch bound
+  int shadowPassRepeats = 1;
+
+  std::unique_ptr<MeshletCuller> meshletCuller;
+  bool useMeshletCulling = true;
+  // Draws wait for culling only right before the main view, so that
+  // culling runs on the GPU at the same time as the shadow pass
+  bool overlapCulling = true;
+  // Smoothed GPU time of culling and shadows together, without and with overlap
+  std::array<std::optional<double>, 2> cullAndShadowsMs;
+  std::uint32_t cullAndShadowsZone = 0;
+  bool mainViewBegun = false;
+
+  std::unique_ptr<SkinningPass> skinningPass;
+  std::vector<AnimationPlayer> animationPlayers;
+  bool playAnimations = true;
+  double lastChannelCostNs = 0;
+
+  GpuTimer& gpuTimer;
+  std::unique_ptr<PipelineStatistics> pipelineStats;
+  RenderStats renderStats;
+
+  // Main view depth is transient, the shadow map is also sampled by the debug quad
+  std::unique_ptr<RenderGraph> renderGraph;
+  RenderGraph::ResourceId backbufferRes = 0;
+  RenderGraph::ResourceId shadowMapRes = 0;
+  RenderGraph::ResourceId mainViewDepthRes = 0;
+  bool cullMeshletsThisFrame = false;
 
   std::unique_ptr<QuadRenderer> quadRenderer;
   bool drawDebugFSQuad = false;
 
+  etna::GraphicsPipeline overlayPipeline{};
+  // Only valid while rendering a frame
+  const etna::Image* overlay = nullptr;
+
+  std::chrono::steady_clock::duration lastGraphUpdateTime{};
+
   glm::uvec2 resolution;
 };
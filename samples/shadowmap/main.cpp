@@ -1,10 +1,66 @@
 #include "App.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+#include <string_view>
 
-int main()
+#include <spdlog/spdlog.h>
+
+
+int main(int argc, char** argv)
 {
+  App::CreateInfo info{};
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg = argv[i];
+    if (arg == "--headless")
+      info.headless = true;
+    else if (arg == "--frames" && i + 1 < argc)
+      info.frameLimit = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    else if (arg == "--benchmark")
+      info.benchmark = true;
+    else if (arg == "--camera-path" && i + 1 < argc)
+      info.cameraPath = argv[++i];
+    else if (arg == "--report" && i + 1 < argc)
+      info.reportPath = argv[++i];
+    else if (arg == "--record-camera-path" && i + 1 < argc)
+      info.recordCameraPath = argv[++i];
+    else if (arg == "--single-thread")
+      info.renderThread = false;
+    else if (arg == "--no-vsync")
+      info.vsync = false;
+    else if (arg == "--frames-in-flight" && i + 1 < argc)
+      info.framesInFlight = std::max(
+        static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10)), std::uint32_t{1});
+    else if (arg == "--compact-vertices")
+      info.vertexFetch.vertexFormat = VertexFormat::Compact;
+    else if (arg == "--no-position-stream")
+      info.vertexFetch.positionStream = false;
+    else if (arg == "--shadow-pass-repeats" && i + 1 < argc)
+      info.vertexFetch.shadowPassRepeats = std::max(std::atoi(argv[++i]), 1);
+    else if (
+      arg == "--shadow-map-size" && i + 1 < argc &&
+      std::ranges::count(WorldRenderer::SHADOW_MAP_SIZES, std::strtoul(argv[i + 1], nullptr, 10)))
+      info.vertexFetch.shadowMapSize =
+        static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    else
+      spdlog::warn(
+        "Unknown argument '{}', usage: [--headless] [--frames N] [--benchmark] "
+        "[--camera-path FILE] [--report FILE] [--record-camera-path FILE] [--single-thread] "
+        "[--no-vsync] [--frames-in-flight N] [--compact-vertices] [--no-position-stream] "
+        "[--shadow-pass-repeats N] [--shadow-map-size 1024|2048|4096]",
+        arg);
+  }
+
+  // Benchmarks stop by themselves
+  if (info.headless && info.frameLimit == 0 && !info.benchmark)
+  {
+    spdlog::error("--headless requires --frames N, nothing would ever stop the app otherwise");
+    return 1;
+  }
+
   {
-    App app;
+    App app(info);
     app.run();
   }
 
@@ -0,0 +1,32 @@
+#ifndef MESHLET_CULLING_H_INCLUDED
+#define MESHLET_CULLING_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+#define MESHLET_CULLING_WORKGROUP_SIZE 64
+
+#define MESHLET_CULLING_FRUSTUM 1u
+#define MESHLET_CULLING_CONE 2u
+
+struct MeshletCullingParams
+{
+  // Normalized planes of the view frustum in world space, pointing inwards
+  shader_vec4 frustumPlanes[6];
+  shader_vec4 cameraPosition;
+  shader_uint workItemCount;
+  // Bitmask of MESHLET_CULLING_* tests to run
+  shader_uint enabledTests;
+};
+
+// Counted in triangles so that we see how much work was actually saved
+struct MeshletCullingStats
+{
+  shader_uint frustumCulledTriangles;
+  shader_uint coneCulledTriangles;
+  shader_uint visibleTriangles;
+  shader_uint visibleMeshlets;
+};
+
+
+#endif // MESHLET_CULLING_H_INCLUDED
@@ -0,0 +1,20 @@
+#ifndef SKINNING_H_INCLUDED
+#define SKINNING_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+#define SKINNING_WORKGROUP_SIZE 64
+
+// Skins a contiguous range of vertices of a single instance
+struct SkinningParams
+{
+  shader_uint firstSourceVertex;
+  shader_uint vertexCount;
+  shader_uint firstOutputVertex;
+  // Joint indices of skin vertices are relative to this
+  shader_uint firstJointMatrix;
+};
+
+
+#endif // SKINNING_H_INCLUDED
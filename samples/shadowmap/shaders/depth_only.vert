@@ -0,0 +1,21 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+
+layout(location = 0) in vec3 vPos;
+
+layout(push_constant) uniform params_t
+{
+  mat4 mProjView;
+  mat4 mModel;
+} params;
+
+
+// The depth prepass and the main pass must produce bit-identical depth
+out gl_PerVertex { invariant vec4 gl_Position; };
+void main(void)
+{
+  // Same order of operations as in simple.vert, otherwise depth may differ
+  const vec3 wPos = (params.mModel * vec4(vPos, 1.0f)).xyz;
+  gl_Position = params.mProjView * vec4(wPos, 1.0f);
+}
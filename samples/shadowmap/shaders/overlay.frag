@@ -0,0 +1,13 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) out vec4 color;
+
+// Premultiplied by alpha, blending scales whatever is below by one minus alpha
+layout(binding = 0) uniform sampler2D overlay;
+
+
+void main()
+{
+  color = texelFetch(overlay, ivec2(gl_FragCoord.xy), 0);
+}
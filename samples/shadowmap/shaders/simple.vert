@@ -20,10 +20,12 @@ layout (location = 0 ) out VS_OUT
   vec3 wPos;
   vec3 wNorm;
   vec3 wTangent;
+  vec3 wBitangent;
   vec2 texCoord;
 } vOut;
 
-out gl_PerVertex { vec4 gl_Position; };
+// The depth prepass and the main pass must produce bit-identical depth
+out gl_PerVertex { invariant vec4 gl_Position; };
 void main(void)
 {
   const vec4 wNorm = vec4(decode_normal(floatBitsToInt(vPosNorm.w)),     0.0f);
@@ -32,6 +34,8 @@ void main(void)
   vOut.wPos = (params.mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
   vOut.wNorm = normalize(mat3(transpose(inverse(params.mModel))) * wNorm.xyz);
   vOut.wTangent = normalize(mat3(transpose(inverse(params.mModel))) * wTang.xyz);
+  // Mirrored UVs flip the bitangent, glTF keeps its sign in the tangent's w
+  vOut.wBitangent = cross(vOut.wNorm, vOut.wTangent) * vTexCoordAndTang.w;
   vOut.texCoord = vTexCoordAndTang.xy;
 
   gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
@@ -0,0 +1,46 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "unpack_attributes.glsl"
+
+
+// See compact_vertex.h for the layout
+layout(location = 0) in uvec4 vPosNormTang;
+layout(location = 1) in uint vTexCoord;
+
+layout(push_constant) uniform params_t
+{
+  mat4 mProjView;
+  // Includes dequantization of positions
+  mat4 mModel;
+} params;
+
+
+layout (location = 0 ) out VS_OUT
+{
+  vec3 wPos;
+  vec3 wNorm;
+  vec3 wTangent;
+  vec3 wBitangent;
+  vec2 texCoord;
+} vOut;
+
+// The depth prepass and the main pass must produce bit-identical depth
+out gl_PerVertex { invariant vec4 gl_Position; };
+void main(void)
+{
+  const vec3 pos  = decode_compact_position(vPosNormTang.x, vPosNormTang.y);
+  const vec4 wNorm = vec4(decode_compact_direction(vPosNormTang.z), 0.0f);
+  const vec4 wTang = vec4(decode_compact_direction(vPosNormTang.w), 0.0f);
+
+  vOut.wPos = (params.mModel * vec4(pos, 1.0f)).xyz;
+  vOut.wNorm = normalize(mat3(transpose(inverse(params.mModel))) * wNorm.xyz);
+  vOut.wTangent = normalize(mat3(transpose(inverse(params.mModel))) * wTang.xyz);
+  // Mirrored UVs flip the bitangent
+  vOut.wBitangent =
+    cross(vOut.wNorm, vOut.wTangent) * decode_compact_bitangent_sign(vPosNormTang.y);
+  vOut.texCoord = decode_compact_tex_coord(vTexCoord);
+
+  gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
+}
@@ -12,6 +12,7 @@ layout(location = 0) in VS_OUT
   vec3 wPos;
   vec3 wNorm;
   vec3 wTangent;
+  vec3 wBitangent;
   vec2 texCoord;
 } surf;
 
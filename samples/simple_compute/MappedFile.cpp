@@ -0,0 +1,226 @@
+#include "MappedFile.hpp"
+
+#include <cstdint>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#if defined(_WIN32)
+
+std::optional<MappedFile> MappedFile::openForReading(const std::filesystem::path& path)
+{
+  MappedFile result;
+  result.file = CreateFileW(
+    path.c_str(),
+    GENERIC_READ,
+    FILE_SHARE_READ,
+    nullptr,
+    OPEN_EXISTING,
+    FILE_FLAG_SEQUENTIAL_SCAN,
+    nullptr);
+  if (result.file == INVALID_HANDLE_VALUE)
+  {
+    result.file = nullptr;
+    spdlog::error("Unable to open '{}'", path.string());
+    return std::nullopt;
+  }
+
+  LARGE_INTEGER fileSize{};
+  GetFileSizeEx(result.file, &fileSize);
+  result.size = static_cast<std::size_t>(fileSize.QuadPart);
+  if (result.size == 0)
+    return result;
+
+  result.mapping = CreateFileMappingW(result.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (result.mapping != nullptr)
+    result.data =
+      static_cast<std::byte*>(MapViewOfFile(result.mapping, FILE_MAP_READ, 0, 0, result.size));
+  if (result.data == nullptr)
+  {
+    spdlog::error("Unable to map '{}'", path.string());
+    return std::nullopt;
+  }
+  return result;
+}
+
+std::optional<MappedFile> MappedFile::create(const std::filesystem::path& path, std::size_t size)
+{
+  MappedFile result;
+  result.file = CreateFileW(
+    path.c_str(),
+    GENERIC_READ | GENERIC_WRITE,
+    0,
+    nullptr,
+    CREATE_ALWAYS,
+    FILE_ATTRIBUTE_NORMAL,
+    nullptr);
+  if (result.file == INVALID_HANDLE_VALUE)
+  {
+    result.file = nullptr;
+    spdlog::error("Unable to create '{}'", path.string());
+    return std::nullopt;
+  }
+
+  result.size = size;
+  if (size == 0)
+    return result;
+
+  // Mapping a file with a size extends the file to it
+  const auto size64 = static_cast<std::uint64_t>(size);
+  result.mapping = CreateFileMappingW(
+    result.file,
+    nullptr,
+    PAGE_READWRITE,
+    static_cast<DWORD>(size64 >> 32),
+    static_cast<DWORD>(size64),
+    nullptr);
+  if (result.mapping != nullptr)
+    result.data =
+      static_cast<std::byte*>(MapViewOfFile(result.mapping, FILE_MAP_WRITE, 0, 0, size));
+  if (result.data == nullptr)
+  {
+    spdlog::error("Unable to map '{}'", path.string());
+    return std::nullopt;
+  }
+  return result;
+}
+
+void MappedFile::close()
+{
+  if (data != nullptr)
+    UnmapViewOfFile(data);
+  if (mapping != nullptr)
+    CloseHandle(mapping);
+  if (file != nullptr)
+    CloseHandle(file);
+  data = nullptr;
+  mapping = nullptr;
+  file = nullptr;
+  size = 0;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : data{std::exchange(other.data, nullptr)}
+  , size{std::exchange(other.size, 0)}
+  , file{std::exchange(other.file, nullptr)}
+  , mapping{std::exchange(other.mapping, nullptr)}
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this != &other)
+  {
+    close();
+    data = std::exchange(other.data, nullptr);
+    size = std::exchange(other.size, 0);
+    file = std::exchange(other.file, nullptr);
+    mapping = std::exchange(other.mapping, nullptr);
+  }
+  return *this;
+}
+
+#else
+
+std::optional<MappedFile> MappedFile::openForReading(const std::filesystem::path& path)
+{
+  MappedFile result;
+  result.fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (result.fd < 0)
+  {
+    spdlog::error("Unable to open '{}'", path.string());
+    return std::nullopt;
+  }
+
+  struct stat fileStat{};
+  fstat(result.fd, &fileStat);
+  result.size = static_cast<std::size_t>(fileStat.st_size);
+  if (result.size == 0)
+    return result;
+
+  void* mapped = mmap(nullptr, result.size, PROT_READ, MAP_PRIVATE, result.fd, 0);
+  if (mapped == MAP_FAILED)
+  {
+    spdlog::error("Unable to map '{}'", path.string());
+    return std::nullopt;
+  }
+  result.data = static_cast<std::byte*>(mapped);
+
+  // Chunks are read strictly front to back, let the kernel read ahead aggressively
+  madvise(mapped, result.size, MADV_SEQUENTIAL);
+  return result;
+}
+
+std::optional<MappedFile> MappedFile::create(const std::filesystem::path& path, std::size_t size)
+{
+  MappedFile result;
+  result.fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (result.fd < 0 || ftruncate(result.fd, static_cast<off_t>(size)) != 0)
+  {
+    spdlog::error("Unable to create '{}'", path.string());
+    return std::nullopt;
+  }
+
+  result.size = size;
+  if (size == 0)
+    return result;
+
+  void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, result.fd, 0);
+  if (mapped == MAP_FAILED)
+  {
+    spdlog::error("Unable to map '{}'", path.string());
+    return std::nullopt;
+  }
+  result.data = static_cast<std::byte*>(mapped);
+  madvise(mapped, size, MADV_SEQUENTIAL);
+  return result;
+}
+
+void MappedFile::close()
+{
+  if (data != nullptr)
+    munmap(data, size);
+  if (fd >= 0)
+    ::close(fd);
+  data = nullptr;
+  size = 0;
+  fd = -1;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : data{std::exchange(other.data, nullptr)}
+  , size{std::exchange(other.size, 0)}
+  , fd{std::exchange(other.fd, -1)}
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this != &other)
+  {
+    close();
+    data = std::exchange(other.data, nullptr);
+    size = std::exchange(other.size, 0);
+    fd = std::exchange(other.fd, -1);
+  }
+  return *this;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+  close();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+
+/**
+ * A whole file mapped into memory. Reading it pulls pages in on demand and
+ * writes go straight to the page cache, so huge files never have to fit
+ * into memory and no extra copies are made.
+ */
+class MappedFile
+{
+public:
+  // Read-only, nullopt if the file can't be opened
+  static std::optional<MappedFile> openForReading(const std::filesystem::path& path);
+  // Creates or truncates the file to exactly `size` bytes
+  static std::optional<MappedFile> create(const std::filesystem::path& path, std::size_t size);
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+  ~MappedFile();
+
+  std::span<const std::byte> getData() const { return {data, size}; }
+  // Only valid for created files
+  std::span<std::byte> getWritableData() { return {data, size}; }
+
+private:
+  MappedFile() = default;
+  void close();
+
+  std::byte* data = nullptr;
+  std::size_t size = 0;
+#if defined(_WIN32)
+  void* file = nullptr;
+  void* mapping = nullptr;
+#else
+  int fd = -1;
+#endif
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+};
@@ -5,9 +5,13 @@
 
 void SimpleCompute::init()
 {
+  vk::PhysicalDeviceVulkan12Features vulkan12Features{.timelineSemaphore = VK_TRUE};
+
   etna::initialize(etna::InitParams{
     .applicationName = "ComputeSample",
     .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
+    // The streaming executor sequences its stages with timeline semaphores
+    .features = vk::PhysicalDeviceFeatures2{.pNext = &vulkan12Features},
     // Uncomment if etna selects the incorrect GPU for you
     // .physicalDeviceIndexOverride = 0,
   });
@@ -16,8 +20,9 @@ void SimpleCompute::init()
 
   cmdMgr = context->createOneShotCmdMgr();
 
-  transferHelper =
-    std::make_unique<etna::BlockingTransferHelper>(etna::BlockingTransferHelper::CreateInfo{
-      .stagingSize = static_cast<std::uint32_t>(length * sizeof(float)),
-    });
+  // Both inputs fit into the ring at once
+  uploader = std::make_unique<AsyncUploader>(AsyncUploader::CreateInfo{
+    .stagingSize = 2 * length * sizeof(float),
+    .name = "simple_compute_upload_ring",
+  });
 }
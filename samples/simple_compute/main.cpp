@@ -1,17 +1,71 @@
 #include "simple_compute.h"
+
+#include <cstdlib>
+#include <string_view>
+
 #include <etna/Etna.hpp>
+#include <spdlog/spdlog.h>
 
-int main()
+
+int main(int argc, char** argv)
 {
+  bool benchmark = false;
+  bool tune = false;
+  // 256M elements, sizes that don't fit into device memory are skipped anyway
+  std::uint32_t maxCount = 1u << 28;
+  bool stream = false;
+  SimpleCompute::StreamingInfo streamingInfo;
+  std::uint64_t generatedCount = 0;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg = argv[i];
+    if (arg == "--benchmark")
+      benchmark = true;
+    else if (arg == "--tune")
+      tune = true;
+    else if (arg == "--max-elements" && i + 1 < argc)
+      maxCount = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    else if (arg == "--stream" && i + 3 < argc)
+    {
+      streamingInfo.inputA = argv[++i];
+      streamingInfo.inputB = argv[++i];
+      streamingInfo.output = argv[++i];
+      stream = true;
+    }
+    else if (arg == "--chunk-mb" && i + 1 < argc)
+      streamingInfo.chunkBytes = std::strtoull(argv[++i], nullptr, 10) << 20;
+    else if (arg == "--generate" && i + 1 < argc)
+      generatedCount = std::strtoull(argv[++i], nullptr, 10);
+    else
+      spdlog::warn(
+        "Unknown argument '{}', usage: [--tune] [--benchmark] [--max-elements N] "
+        "[--stream A B OUT [--chunk-mb N] [--generate N]]",
+        arg);
+  }
+
+  bool passed = true;
   {
     SimpleCompute app;
 
     app.init();
+    if (tune)
+      app.tuneKernels();
     app.execute();
+
+    passed = app.validatePrimitives();
+    if (passed && benchmark)
+      app.benchmarkPrimitives(maxCount);
+
+    if (passed && stream)
+    {
+      if (generatedCount != 0)
+        passed = SimpleCompute::generateStreamingInput(streamingInfo, generatedCount);
+      passed = passed && app.executeStreaming(streamingInfo);
+    }
   }
 
   if (etna::is_initilized())
     etna::shutdown();
 
-  return 0;
+  return passed ? 0 : 1;
 }
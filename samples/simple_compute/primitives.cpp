@@ -0,0 +1,324 @@
+#include "simple_compute.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <random>
+
+#include <etna/Etna.hpp>
+#include <gpgpu/ComputePrimitives.hpp>
+
+
+using KeyType = ComputePrimitives::KeyType;
+
+static constexpr auto STORAGE_USAGE = vk::BufferUsageFlagBits::eStorageBuffer |
+  vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc;
+
+// Host-cached, so that results are quick to read back, and small enough for that not to matter
+static etna::Buffer create_readback_buffer(vk::DeviceSize size, const char* name)
+{
+  return etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+    .size = std::max<vk::DeviceSize>(size, 4),
+    .bufferUsage = STORAGE_USAGE,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+    .name = name,
+  });
+}
+
+template <class T>
+static void write_buffer(etna::Buffer& buffer, std::span<const T> data)
+{
+  std::memcpy(buffer.map(), data.data(), data.size_bytes());
+  buffer.unmap();
+}
+
+template <class T>
+static std::vector<T> read_buffer(etna::Buffer& buffer, std::size_t count)
+{
+  std::vector<T> result(count);
+  std::memcpy(result.data(), buffer.map(), count * sizeof(T));
+  buffer.unmap();
+  return result;
+}
+
+void SimpleCompute::submit(const std::function<void(vk::CommandBuffer)>& record)
+{
+  // Resets descriptor pools, nothing uses sets of older submissions as they are waited for
+  etna::begin_frame();
+
+  auto cmdBuf = cmdMgr->start();
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+
+  record(cmdBuf);
+
+  const vk::MemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+    .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+  };
+  cmdBuf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+  cmdMgr->submitAndWait(std::move(cmdBuf));
+
+  etna::end_frame();
+}
+
+template <class Key>
+bool SimpleCompute::validateSort(ComputePrimitives& primitives, std::span<const Key> keys)
+{
+  const auto count = static_cast<std::uint32_t>(keys.size());
+  const auto keyType = sizeof(Key) == 8 ? KeyType::Uint64 : KeyType::Uint32;
+
+  // Values are original indices, so they show whether equal keys kept their order
+  std::vector<std::uint32_t> values(count);
+  std::iota(values.begin(), values.end(), 0u);
+
+  auto keyBuffer = create_readback_buffer(count * sizeof(Key), "primitives_keys");
+  auto valueBuffer = create_readback_buffer(count * sizeof(std::uint32_t), "primitives_values");
+  write_buffer(keyBuffer, keys);
+  write_buffer<std::uint32_t>(valueBuffer, values);
+
+  submit([&](vk::CommandBuffer cmd_buf) {
+    primitives.sort(cmd_buf, keyBuffer, valueBuffer, count, keyType);
+  });
+
+  std::vector<std::uint32_t> expected = values;
+  std::stable_sort(expected.begin(), expected.end(), [&keys](std::uint32_t a, std::uint32_t b) {
+    return keys[a] < keys[b];
+  });
+
+  return read_buffer<std::uint32_t>(valueBuffer, count) == expected;
+}
+
+bool SimpleCompute::validatePrimitives()
+{
+  // Sizes around tile and block boundaries, and one big enough for many blocks
+  constexpr std::array<std::uint32_t, 8> SIZES{
+    1, 255, 1024, 1025, 4096, 4097, 100'000, (1u << 20) + 123};
+
+  ComputePrimitives primitives{{.maxCount = SIZES.back()}};
+  std::mt19937 rng{42};
+  bool allPassed = true;
+
+  for (std::uint32_t count : SIZES)
+  {
+    auto check = [&](const char* name, bool passed) {
+      if (passed)
+        spdlog::info("{} of {} elements: ok", name, count);
+      else
+        spdlog::error("{} of {} elements: MISMATCH with the CPU reference", name, count);
+      allPassed = allPassed && passed;
+    };
+
+    std::vector<std::uint32_t> data(count);
+    for (auto& value : data)
+      value = rng();
+
+    auto input = create_readback_buffer(count * sizeof(std::uint32_t), "primitives_input");
+    auto output = create_readback_buffer(count * sizeof(std::uint32_t), "primitives_output");
+    auto single = create_readback_buffer(sizeof(std::uint32_t), "primitives_single");
+    write_buffer<std::uint32_t>(input, data);
+
+    // Sums wrap around on both sides
+    submit([&](vk::CommandBuffer cmd_buf) { primitives.reduce(cmd_buf, input, single, count); });
+    check(
+      "reduce", read_buffer<std::uint32_t>(single, 1)[0] == std::reduce(data.begin(), data.end()));
+
+    submit([&](vk::CommandBuffer cmd_buf) {
+      primitives.exclusiveScan(cmd_buf, input, output, count);
+    });
+    {
+      std::vector<std::uint32_t> expected(count);
+      std::exclusive_scan(data.begin(), data.end(), expected.begin(), 0u);
+      check("exclusive scan", read_buffer<std::uint32_t>(output, count) == expected);
+    }
+
+    // Keeps about a third of elements, the flags are the input itself
+    for (auto& value : data)
+      value = value % 3 == 0 ? value : 0;
+    write_buffer<std::uint32_t>(input, data);
+    submit([&](vk::CommandBuffer cmd_buf) {
+      primitives.compact(cmd_buf, input, input, output, single, count);
+    });
+    {
+      std::vector<std::uint32_t> expected;
+      std::copy_if(data.begin(), data.end(), std::back_inserter(expected), [](std::uint32_t v) {
+        return v != 0;
+      });
+      const auto kept = read_buffer<std::uint32_t>(single, 1)[0];
+      check(
+        "compaction",
+        kept == expected.size() && read_buffer<std::uint32_t>(output, kept) == expected);
+    }
+
+    // Few distinct keys, so that stability actually gets tested
+    std::vector<std::uint32_t> keys32(count);
+    for (auto& key : keys32)
+      key = rng() % 1000 * 0x00FF'FFFFu;
+    check("32-bit key sort", validateSort<std::uint32_t>(primitives, keys32));
+
+    std::vector<std::uint64_t> keys64(count);
+    for (auto& key : keys64)
+      key = (std::uint64_t{rng()} << 32 | rng()) & 0xFF00'0F00'0000'00FFull;
+    check("64-bit key sort", validateSort<std::uint64_t>(primitives, keys64));
+  }
+
+  return allPassed;
+}
+
+void SimpleCompute::benchmarkPrimitives(std::uint32_t max_count)
+{
+  auto& ctx = etna::get_context();
+  const auto physicalDevice = ctx.getPhysicalDevice();
+  const auto limits = physicalDevice.getProperties().limits;
+
+  // Sizes that would not fit are skipped instead of failing to allocate
+  vk::DeviceSize deviceMemory = 0;
+  const auto memoryProperties = physicalDevice.getMemoryProperties();
+  for (std::uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+    if (memoryProperties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+      deviceMemory = std::max(deviceMemory, memoryProperties.memoryHeaps[i].size);
+  const vk::DeviceSize memoryBudget = deviceMemory / 4 * 3;
+
+  auto queryPool = ctx.getDevice().createQueryPoolUnique(vk::QueryPoolCreateInfo{
+    .queryType = vk::QueryType::eTimestamp,
+    .queryCount = 2,
+  });
+  ETNA_CHECK_VK_RESULT(queryPool.result);
+
+  // Returns GPU time of the fastest repeat in seconds, the setup isn't measured
+  auto measure = [&](
+                   const std::function<void(vk::CommandBuffer)>& setup,
+                   const std::function<void(vk::CommandBuffer)>& work) {
+    constexpr int REPEATS = 5;
+    double best = std::numeric_limits<double>::max();
+    for (int repeat = 0; repeat < REPEATS; ++repeat)
+    {
+      submit([&](vk::CommandBuffer cmd_buf) {
+        cmd_buf.resetQueryPool(queryPool.value.get(), 0, 2);
+        setup(cmd_buf);
+        cmd_buf.writeTimestamp2(
+          vk::PipelineStageFlagBits2::eAllCommands, queryPool.value.get(), 0);
+        work(cmd_buf);
+        cmd_buf.writeTimestamp2(
+          vk::PipelineStageFlagBits2::eAllCommands, queryPool.value.get(), 1);
+      });
+
+      std::array<std::uint64_t, 2> timestamps{};
+      ETNA_CHECK_VK_RESULT(ctx.getDevice().getQueryPoolResults(
+        queryPool.value.get(),
+        0,
+        2,
+        sizeof(timestamps),
+        timestamps.data(),
+        sizeof(std::uint64_t),
+        vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait));
+      best = std::min(
+        best, 1e-9 * limits.timestampPeriod * static_cast<double>(timestamps[1] - timestamps[0]));
+    }
+    return best;
+  };
+
+  // Random data is uploaded once per size and copied before every sort, as sorting
+  // already sorted keys is way friendlier to caches than the real thing
+  AsyncUploader bigUploader{AsyncUploader::CreateInfo{.name = "primitives_benchmark_upload"}};
+  std::mt19937 rng{42};
+
+  for (std::uint64_t count = 1 << 20; count <= max_count; count *= 4)
+  {
+    const auto n = static_cast<std::uint32_t>(count);
+    const vk::DeviceSize words = count * sizeof(std::uint32_t);
+
+    for (const auto keyType : {KeyType::Uint32, KeyType::Uint64})
+    {
+      const vk::DeviceSize keyWords = keyType == KeyType::Uint64 ? 2 : 1;
+
+      // Scratch of the primitives plus source, keys, values and output
+      const vk::DeviceSize required = (3 + keyWords) * words + (2 * keyWords + 2) * words;
+      if (required > memoryBudget || keyWords * words > limits.maxStorageBufferRange)
+      {
+        spdlog::warn(
+          "{:>10} elements, {}-bit keys: skipped, needs {:.1f} GiB",
+          n,
+          32 * keyWords,
+          static_cast<double>(required) / (1 << 30));
+        continue;
+      }
+
+      ComputePrimitives primitives{{.maxCount = n, .maxKeyType = keyType}};
+
+      auto createBuffer = [&ctx](vk::DeviceSize size, const char* name) {
+        return ctx.createBuffer(etna::Buffer::CreateInfo{
+          .size = size,
+          .bufferUsage = STORAGE_USAGE,
+          .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+          .name = name,
+        });
+      };
+      auto source = createBuffer(keyWords * words, "primitives_source");
+      auto keys = createBuffer(keyWords * words, "primitives_keys");
+      auto values = createBuffer(words, "primitives_values");
+      auto output = createBuffer(words, "primitives_output");
+      auto single = createBuffer(sizeof(std::uint32_t), "primitives_single");
+
+      {
+        std::vector<std::uint32_t> data(keyWords * count);
+        for (auto& value : data)
+          value = rng();
+        bigUploader.uploadBuffer<std::uint32_t>(source, 0, data);
+        bigUploader.waitIdle();
+      }
+
+      auto noSetup = [](vk::CommandBuffer) {};
+      auto copySource = [&](vk::CommandBuffer cmd_buf) {
+        cmd_buf.copyBuffer(source.get(), keys.get(), {vk::BufferCopy{.size = keyWords * words}});
+        const vk::MemoryBarrier2 barrier{
+          .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+          .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+          .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+          .dstAccessMask =
+            vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+        };
+        cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+          .memoryBarrierCount = 1,
+          .pMemoryBarriers = &barrier,
+        });
+      };
+
+      auto report = [n](const char* name, double seconds) {
+        spdlog::info(
+          "{:>10} elements, {:<16} {:8.3f} ms, {:7.3f} G elements/s",
+          n,
+          name,
+          1e3 * seconds,
+          1e-9 * n / seconds);
+      };
+
+      const double sortSeconds = measure(copySource, [&](vk::CommandBuffer cmd_buf) {
+        primitives.sort(cmd_buf, keys, values, n, keyType);
+      });
+      report(keyType == KeyType::Uint64 ? "64-bit key sort" : "32-bit key sort", sortSeconds);
+
+      // The rest doesn't depend on the key size
+      if (keyType == KeyType::Uint64)
+        continue;
+
+      report("reduce", measure(noSetup, [&](vk::CommandBuffer cmd_buf) {
+               primitives.reduce(cmd_buf, source, single, n);
+             }));
+      report("exclusive scan", measure(noSetup, [&](vk::CommandBuffer cmd_buf) {
+               primitives.exclusiveScan(cmd_buf, source, output, n);
+             }));
+      report("compaction", measure(noSetup, [&](vk::CommandBuffer cmd_buf) {
+               primitives.compact(cmd_buf, source, source, output, single, n);
+             }));
+    }
+  }
+}
@@ -1,9 +1,10 @@
 #include "simple_compute.h"
 
+#include <cstring>
+
 #include <fmt/ranges.h> // NOTE: vector and co are only printable with this included
 
 #include <etna/Etna.hpp>
-#include <etna/PipelineManager.hpp>
 
 SimpleCompute::SimpleCompute()
   : length{16}
@@ -12,7 +13,7 @@ SimpleCompute::SimpleCompute()
 
 void SimpleCompute::setup()
 {
-  etna::create_program("simple_compute", {SIMPLE_COMPUTE_SHADERS_ROOT "simple.comp.spv"});
+  loadPipeline();
 
   // Buffer creation
 
@@ -30,7 +31,9 @@ void SimpleCompute::setup()
 
   bufResult = context->createBuffer(etna::Buffer::CreateInfo{
     .size = sizeof(float) * length,
-    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    // Read directly on the CPU, there's no need for a transfer
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_TO_CPU,
     .name = "m_sum",
   });
 
@@ -42,7 +45,7 @@ void SimpleCompute::setup()
     {
       values[i] = (float)i;
     }
-    transferHelper->uploadBuffer<float>(*cmdMgr, bufA, 0, values);
+    uploader->uploadBuffer<float>(bufA, 0, values);
   }
 
   {
@@ -51,11 +54,26 @@ void SimpleCompute::setup()
     {
       values[i] = static_cast<float>(i * i);
     }
-    transferHelper->uploadBuffer<float>(*cmdMgr, bufB, 0, values);
+    uploader->uploadBuffer<float>(bufB, 0, values);
   }
 
-  // Compute pipeline creation
-  pipeline = context->getPipelineManager().createComputePipeline("simple_compute", {});
+  // Both uploads go in a single submission, which precedes the compute one on the queue
+  uploader->flush();
+}
+
+void SimpleCompute::loadPipeline()
+{
+  if (pipeline)
+    return;
+
+  // The workgroup size tuned for this GPU, if --tune was ever run on it
+  const TuningCache cache;
+  pipeline = TunedComputePipeline{{
+    .program = "simple_compute",
+    .spirvPath = SIMPLE_COMPUTE_SHADERS_ROOT "simple.comp.spv",
+    .workgroupSize = {.x = 32},
+    .cache = &cache,
+  }};
 }
 
 void SimpleCompute::buildCommandBuffer(vk::CommandBuffer cmd_buf)
@@ -84,7 +102,20 @@ void SimpleCompute::buildCommandBuffer(vk::CommandBuffer cmd_buf)
 
   etna::flush_barriers(cmd_buf);
 
-  cmd_buf.dispatch(1, 1, 1);
+  const auto groups = pipeline.linearGroupCount(length);
+  cmd_buf.dispatch(groups.width, groups.height, groups.depth);
+
+  // Make the result visible to the CPU
+  const vk::MemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+    .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
 
   ETNA_CHECK_VK_RESULT(cmd_buf.end());
 }
@@ -92,7 +123,8 @@ void SimpleCompute::buildCommandBuffer(vk::CommandBuffer cmd_buf)
 void SimpleCompute::readback()
 {
   std::vector<float> values(length);
-  transferHelper->readbackBuffer<float>(*cmdMgr, values, bufResult, 0);
+  std::memcpy(values.data(), bufResult.map(), length * sizeof(float));
+  bufResult.unmap();
 
   spdlog::info("Result on cpu:\n{}", values);
 }
@@ -1,14 +1,19 @@
 #ifndef SIMPLE_COMPUTE_H
 #define SIMPLE_COMPUTE_H
 
+#include <filesystem>
+#include <functional>
 #include <memory>
+#include <span>
 
 #include <etna/GlobalContext.hpp>
-#include <etna/ComputePipeline.hpp>
 #include <etna/OneShotCmdMgr.hpp>
-#include <etna/BlockingTransferHelper.hpp>
+#include <render_utils/AsyncUploader.hpp>
+#include <gpgpu/TunedComputePipeline.hpp>
 
 
+class ComputePrimitives;
+
 class SimpleCompute
 {
 public:
@@ -17,24 +22,55 @@ public:
   void init();
   void execute();
 
+  // Checks every compute primitive against a CPU reference, returns whether all match
+  bool validatePrimitives();
+  // Throughput of compute primitives from 1M elements up to `max_count`
+  void benchmarkPrimitives(std::uint32_t max_count);
+  // Finds the best workgroup size of simple.comp for this GPU and stores it in the tuning cache
+  void tuneKernels();
+
+  struct StreamingInfo
+  {
+    // Raw arrays of floats of the same length
+    std::filesystem::path inputA;
+    std::filesystem::path inputB;
+    std::filesystem::path output;
+    // Of every input, per slot of the pipeline
+    std::size_t chunkBytes = 16 << 20;
+  };
+
+  // Writes `count` random floats into both inputs
+  static bool generateStreamingInput(const StreamingInfo& info, std::uint64_t count);
+  // Sums inputs of any size chunk by chunk, overlapping reading inputs, computing and writing
+  // the output. Reports throughput against a run without overlap, returns whether the output
+  // matches the CPU.
+  bool executeStreaming(const StreamingInfo& info);
+
   //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 private:
   etna::GlobalContext* context;
 
   std::unique_ptr<etna::OneShotCmdMgr> cmdMgr;
-  std::unique_ptr<etna::BlockingTransferHelper> transferHelper;
+  std::unique_ptr<AsyncUploader> uploader;
 
   std::uint32_t length;
 
-  etna::ComputePipeline pipeline;
+  TunedComputePipeline pipeline;
 
   etna::Buffer bufA;
   etna::Buffer bufB;
   etna::Buffer bufResult;
 
   void setup();
+  // Only once, with the workgroup size from the tuning cache
+  void loadPipeline();
   void buildCommandBuffer(vk::CommandBuffer cmd_buf);
   void readback();
+
+  // Records commands and waits for them, results are visible to the host afterwards
+  void submit(const std::function<void(vk::CommandBuffer)>& record);
+  template <class Key>
+  bool validateSort(ComputePrimitives& primitives, std::span<const Key> keys);
 };
 
 
@@ -0,0 +1,489 @@
+#include "simple_compute.h"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <thread>
+
+#include <etna/Etna.hpp>
+#include <render_utils/MemoryTracker.hpp>
+
+
+// Upload of chunk N+1, compute of chunk N and readback of chunk N-1 happen at once
+static constexpr std::uint32_t SLOT_COUNT = 3;
+
+using Clock = std::chrono::steady_clock;
+
+static double seconds_since(Clock::time_point start)
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static vk::UniqueSemaphore create_timeline()
+{
+  const vk::SemaphoreTypeCreateInfo typeInfo{
+    .semaphoreType = vk::SemaphoreType::eTimeline,
+    .initialValue = 0,
+  };
+  auto sem = etna::get_context().getDevice().createSemaphoreUnique(vk::SemaphoreCreateInfo{
+    .pNext = &typeInfo,
+  });
+  ETNA_CHECK_VK_RESULT(sem.result);
+  return std::move(sem.value);
+}
+
+static etna::Buffer create_chunk_buffer(
+  vk::DeviceSize size,
+  MemoryCategory category,
+  vk::BufferUsageFlags usage,
+  VmaMemoryUsage memory_usage,
+  const char* name)
+{
+  return create_tracked_buffer(
+    category,
+    etna::Buffer::CreateInfo{
+      .size = size,
+      .bufferUsage = usage,
+      .memoryUsage = memory_usage,
+      .name = name,
+    });
+}
+
+static void wait_timeline(vk::Semaphore sem, std::uint64_t value)
+{
+  const vk::SemaphoreWaitInfo info{
+    .semaphoreCount = 1,
+    .pSemaphores = &sem,
+    .pValues = &value,
+  };
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitSemaphores(info, ~std::uint64_t{0}));
+}
+
+static void signal_timeline(vk::Semaphore sem, std::uint64_t value)
+{
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().signalSemaphore(vk::SemaphoreSignalInfo{
+    .semaphore = sem,
+    .value = value,
+  }));
+}
+
+namespace
+{
+
+struct StreamingFiles
+{
+  std::span<const float> a;
+  std::span<const float> b;
+  std::span<float> result;
+};
+
+struct StageTimes
+{
+  double upload = 0;
+  double compute = 0;
+  double readback = 0;
+  double total = 0;
+};
+
+/**
+ * Every chunk goes through three stages, each sequenced by its own timeline semaphore
+ * whose value is the amount of chunks that went through the stage:
+ *  - upload: a host thread copies the chunk from the input files into staging memory,
+ *  - compute: the GPU copies it into device memory, sums it and copies the sum back,
+ *  - readback: another host thread copies the sum into the output file.
+ * Chunk N lives in slot N % SLOT_COUNT, which is free again once chunk N - SLOT_COUNT
+ * has been read back.
+ */
+class StreamingPipeline
+{
+public:
+  StreamingPipeline(const TunedComputePipeline& pipeline, std::uint32_t chunk_elements);
+
+  StageTimes runSerial(const StreamingFiles& files);
+  double runOverlapped(const StreamingFiles& files);
+
+private:
+  struct Slot
+  {
+    etna::Buffer uploadA;
+    etna::Buffer uploadB;
+    etna::Buffer a;
+    etna::Buffer b;
+    etna::Buffer result;
+    etna::Buffer download;
+    std::byte* uploadAData = nullptr;
+    std::byte* uploadBData = nullptr;
+    std::byte* downloadData = nullptr;
+    vk::UniqueCommandBuffer cmdBuf;
+  };
+
+  struct Timelines
+  {
+    vk::UniqueSemaphore uploaded = create_timeline();
+    vk::UniqueSemaphore computed = create_timeline();
+    vk::UniqueSemaphore readBack = create_timeline();
+  };
+
+  void recordSlot(Slot& slot, const TunedComputePipeline& pipeline);
+
+  std::pair<std::size_t, std::size_t> chunkRange(std::uint64_t chunk, std::size_t total) const;
+  void upload(std::uint64_t chunk, const StreamingFiles& files);
+  void submit(std::uint64_t chunk, vk::Semaphore computed);
+  void readback(std::uint64_t chunk, const StreamingFiles& files);
+
+private:
+  std::uint32_t chunkElements;
+  vk::UniqueCommandPool commandPool;
+  std::array<Slot, SLOT_COUNT> slots;
+};
+
+} // namespace
+
+StreamingPipeline::StreamingPipeline(
+  const TunedComputePipeline& pipeline, std::uint32_t chunk_elements)
+  : chunkElements{chunk_elements}
+{
+  auto& ctx = etna::get_context();
+  const vk::DeviceSize chunkBytes = vk::DeviceSize{chunk_elements} * sizeof(float);
+
+  auto pool = ctx.getDevice().createCommandPoolUnique(vk::CommandPoolCreateInfo{
+    .queueFamilyIndex = ctx.getQueueFamilyIdx(),
+  });
+  ETNA_CHECK_VK_RESULT(pool.result);
+  commandPool = std::move(pool.value);
+
+  auto cmdBufs = ctx.getDevice().allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+    .commandPool = commandPool.get(),
+    .level = vk::CommandBufferLevel::ePrimary,
+    .commandBufferCount = SLOT_COUNT,
+  });
+  ETNA_CHECK_VK_RESULT(cmdBufs.result);
+
+  constexpr auto SRC = vk::BufferUsageFlagBits::eTransferSrc;
+  constexpr auto DST = vk::BufferUsageFlagBits::eTransferDst;
+  constexpr auto STORAGE = vk::BufferUsageFlagBits::eStorageBuffer;
+
+  for (std::uint32_t i = 0; i < SLOT_COUNT; ++i)
+  {
+    auto& slot = slots[i];
+    // Written sequentially by the CPU, so write-combined memory is fine
+    slot.uploadA = create_chunk_buffer(
+      chunkBytes, MemoryCategory::Staging, SRC, VMA_MEMORY_USAGE_CPU_ONLY, "stream_upload_a");
+    slot.uploadB = create_chunk_buffer(
+      chunkBytes, MemoryCategory::Staging, SRC, VMA_MEMORY_USAGE_CPU_ONLY, "stream_upload_b");
+    slot.a = create_chunk_buffer(
+      chunkBytes, MemoryCategory::Other, STORAGE | DST, VMA_MEMORY_USAGE_GPU_ONLY, "stream_a");
+    slot.b = create_chunk_buffer(
+      chunkBytes, MemoryCategory::Other, STORAGE | DST, VMA_MEMORY_USAGE_GPU_ONLY, "stream_b");
+    slot.result = create_chunk_buffer(
+      chunkBytes, MemoryCategory::Other, STORAGE | SRC, VMA_MEMORY_USAGE_GPU_ONLY, "stream_sum");
+    // Host-cached, reading write-combined memory back would be painfully slow
+    slot.download = create_chunk_buffer(
+      chunkBytes, MemoryCategory::Staging, DST, VMA_MEMORY_USAGE_GPU_TO_CPU, "stream_download");
+
+    // Mapped for the lifetime of the pipeline
+    slot.uploadAData = slot.uploadA.map();
+    slot.uploadBData = slot.uploadB.map();
+    slot.downloadData = slot.download.map();
+
+    slot.cmdBuf = std::move(cmdBufs.value[i]);
+    recordSlot(slot, pipeline);
+  }
+}
+
+void StreamingPipeline::recordSlot(Slot& slot, const TunedComputePipeline& pipeline)
+{
+  // Every chunk of a slot runs exactly the same commands, so they are recorded once. The last
+  // chunk is usually shorter, the sum of the stale tail is computed, but never read back.
+  auto cmdBuf = slot.cmdBuf.get();
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+
+  const vk::BufferCopy region{.size = vk::DeviceSize{chunkElements} * sizeof(float)};
+  cmdBuf.copyBuffer(slot.uploadA.get(), slot.a.get(), {region});
+  cmdBuf.copyBuffer(slot.uploadB.get(), slot.b.get(), {region});
+
+  const vk::MemoryBarrier2 uploadBarrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead,
+  };
+  cmdBuf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &uploadBarrier,
+  });
+
+  // The set lives in etna's per-frame pool, executeStreaming doesn't start frames until it's done
+  auto set = etna::create_descriptor_set(
+    etna::get_shader_program("simple_compute").getDescriptorLayoutId(0),
+    cmdBuf,
+    {
+      etna::Binding{0, slot.a.genBinding()},
+      etna::Binding{1, slot.b.genBinding()},
+      etna::Binding{2, slot.result.genBinding()},
+    });
+  vk::DescriptorSet vkSet = set.getVkSet();
+
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmdBuf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, 1, &vkSet, 0, nullptr);
+  cmdBuf.pushConstants(
+    pipeline.getVkPipelineLayout(),
+    vk::ShaderStageFlagBits::eCompute,
+    0,
+    sizeof(chunkElements),
+    &chunkElements);
+
+  const auto groups = pipeline.linearGroupCount(chunkElements);
+  cmdBuf.dispatch(groups.width, groups.height, groups.depth);
+
+  const vk::MemoryBarrier2 computeBarrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .dstAccessMask = vk::AccessFlagBits2::eTransferRead,
+  };
+  cmdBuf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &computeBarrier,
+  });
+
+  cmdBuf.copyBuffer(slot.result.get(), slot.download.get(), {region});
+
+  const vk::MemoryBarrier2 readbackBarrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+    .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+  };
+  cmdBuf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &readbackBarrier,
+  });
+
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+}
+
+std::pair<std::size_t, std::size_t> StreamingPipeline::chunkRange(
+  std::uint64_t chunk, std::size_t total) const
+{
+  const std::size_t begin = static_cast<std::size_t>(chunk) * chunkElements;
+  return {begin, std::min<std::size_t>(chunkElements, total - begin)};
+}
+
+void StreamingPipeline::upload(std::uint64_t chunk, const StreamingFiles& files)
+{
+  auto& slot = slots[chunk % SLOT_COUNT];
+  const auto [begin, count] = chunkRange(chunk, files.a.size());
+  std::memcpy(slot.uploadAData, files.a.data() + begin, count * sizeof(float));
+  std::memcpy(slot.uploadBData, files.b.data() + begin, count * sizeof(float));
+}
+
+void StreamingPipeline::submit(std::uint64_t chunk, vk::Semaphore computed)
+{
+  const vk::CommandBufferSubmitInfo cmdBufInfo{
+    .commandBuffer = slots[chunk % SLOT_COUNT].cmdBuf.get(),
+  };
+  const vk::SemaphoreSubmitInfo signalInfo{
+    .semaphore = computed,
+    .value = chunk + 1,
+    .stageMask = vk::PipelineStageFlagBits2::eAllCommands,
+  };
+  ETNA_CHECK_VK_RESULT(etna::get_context().getQueue().submit2({vk::SubmitInfo2{
+    .commandBufferInfoCount = 1,
+    .pCommandBufferInfos = &cmdBufInfo,
+    .signalSemaphoreInfoCount = 1,
+    .pSignalSemaphoreInfos = &signalInfo,
+  }}));
+}
+
+void StreamingPipeline::readback(std::uint64_t chunk, const StreamingFiles& files)
+{
+  auto& slot = slots[chunk % SLOT_COUNT];
+  const auto [begin, count] = chunkRange(chunk, files.result.size());
+  std::memcpy(files.result.data() + begin, slot.downloadData, count * sizeof(float));
+}
+
+StageTimes StreamingPipeline::runSerial(const StreamingFiles& files)
+{
+  const std::uint64_t chunkCount = (files.a.size() + chunkElements - 1) / chunkElements;
+  const Timelines timelines;
+  StageTimes times;
+
+  const auto start = Clock::now();
+  for (std::uint64_t chunk = 0; chunk < chunkCount; ++chunk)
+  {
+    auto stageStart = Clock::now();
+    upload(chunk, files);
+    times.upload += seconds_since(stageStart);
+
+    stageStart = Clock::now();
+    submit(chunk, timelines.computed.get());
+    wait_timeline(timelines.computed.get(), chunk + 1);
+    times.compute += seconds_since(stageStart);
+
+    stageStart = Clock::now();
+    readback(chunk, files);
+    times.readback += seconds_since(stageStart);
+  }
+  times.total = seconds_since(start);
+
+  return times;
+}
+
+double StreamingPipeline::runOverlapped(const StreamingFiles& files)
+{
+  const std::uint64_t chunkCount = (files.a.size() + chunkElements - 1) / chunkElements;
+  const Timelines timelines;
+
+  const auto start = Clock::now();
+  {
+    std::jthread uploadThread([&] {
+      for (std::uint64_t chunk = 0; chunk < chunkCount; ++chunk)
+      {
+        // The slot's previous chunk is completely done once it has been read back
+        if (chunk >= SLOT_COUNT)
+          wait_timeline(timelines.readBack.get(), chunk - SLOT_COUNT + 1);
+        upload(chunk, files);
+        signal_timeline(timelines.uploaded.get(), chunk + 1);
+      }
+    });
+
+    std::jthread readbackThread([&] {
+      for (std::uint64_t chunk = 0; chunk < chunkCount; ++chunk)
+      {
+        wait_timeline(timelines.computed.get(), chunk + 1);
+        readback(chunk, files);
+        signal_timeline(timelines.readBack.get(), chunk + 1);
+      }
+    });
+
+    // The queue is only touched from this thread. It waits for uploads on the host instead
+    // of in the submission: a host-side signal doesn't make host writes visible to the GPU,
+    // a submission issued after them does.
+    for (std::uint64_t chunk = 0; chunk < chunkCount; ++chunk)
+    {
+      wait_timeline(timelines.uploaded.get(), chunk + 1);
+      submit(chunk, timelines.computed.get());
+    }
+  }
+
+  return seconds_since(start);
+}
+
+bool SimpleCompute::generateStreamingInput(const StreamingInfo& info, std::uint64_t count)
+{
+  const std::size_t size = static_cast<std::size_t>(count) * sizeof(float);
+  auto a = MappedFile::create(info.inputA, size);
+  auto b = MappedFile::create(info.inputB, size);
+  if (!a || !b)
+    return false;
+
+  auto* aData = reinterpret_cast<float*>(a->getWritableData().data());
+  auto* bData = reinterpret_cast<float*>(b->getWritableData().data());
+  std::minstd_rand rng{42};
+  std::uniform_real_distribution<float> dist{-1000.0f, 1000.0f};
+  for (std::uint64_t i = 0; i < count; ++i)
+  {
+    aData[i] = dist(rng);
+    bData[i] = dist(rng);
+  }
+
+  spdlog::info(
+    "Generated {} elements into '{}' and '{}'",
+    count,
+    info.inputA.string(),
+    info.inputB.string());
+  return true;
+}
+
+bool SimpleCompute::executeStreaming(const StreamingInfo& info)
+{
+  const auto a = MappedFile::openForReading(info.inputA);
+  const auto b = MappedFile::openForReading(info.inputB);
+  if (!a || !b)
+    return false;
+
+  if (a->getData().size() != b->getData().size() || a->getData().size() % sizeof(float) != 0)
+  {
+    spdlog::error("Streaming inputs must be float arrays of the same length");
+    return false;
+  }
+
+  const std::size_t count = a->getData().size() / sizeof(float);
+  auto output = MappedFile::create(info.output, count * sizeof(float));
+  if (!output)
+    return false;
+  if (count == 0)
+    return true;
+
+  const StreamingFiles files{
+    .a = {reinterpret_cast<const float*>(a->getData().data()), count},
+    .b = {reinterpret_cast<const float*>(b->getData().data()), count},
+    .result = {reinterpret_cast<float*>(output->getWritableData().data()), count},
+  };
+
+  // Both runs should read inputs from the page cache rather than one of them from the disk
+  {
+    std::uint8_t touched = 0;
+    for (auto input : {a->getData(), b->getData()})
+      for (std::size_t i = 0; i < input.size(); i += 4096)
+        touched ^= std::to_integer<std::uint8_t>(input[i]);
+    spdlog::debug("Input pages touched ({})", touched);
+  }
+
+  loadPipeline();
+
+  const auto chunkElements = static_cast<std::uint32_t>(
+    std::clamp<std::size_t>(info.chunkBytes / sizeof(float), 1, count));
+
+  etna::begin_frame();
+
+  StageTimes serial;
+  double overlapped = 0;
+  {
+    StreamingPipeline streaming{pipeline, chunkElements};
+    serial = streaming.runSerial(files);
+    overlapped = streaming.runOverlapped(files);
+    ETNA_CHECK_VK_RESULT(context->getQueue().waitIdle());
+  }
+
+  etna::end_frame();
+
+  // Reading both inputs and writing the output
+  const double gigabytes = 3.0 * static_cast<double>(count * sizeof(float)) / 1e9;
+  // Perfect overlap hides everything but the slowest stage
+  const double bottleneck = std::max({serial.upload, serial.compute, serial.readback});
+  const double efficiency = serial.total > bottleneck
+    ? (serial.total - overlapped) / (serial.total - bottleneck)
+    : 1.0;
+
+  spdlog::info(
+    "Streamed {} elements in {}-element chunks: {:.2f} GB/s sustained ({:.3f} s), "
+    "{:.2f} GB/s serial ({:.3f} s)",
+    count,
+    chunkElements,
+    gigabytes / overlapped,
+    overlapped,
+    gigabytes / serial.total,
+    serial.total);
+  spdlog::info(
+    "Serial stages: upload {:.3f} s, compute {:.3f} s, readback {:.3f} s; "
+    "overlap efficiency {:.0f}%",
+    serial.upload,
+    serial.compute,
+    serial.readback,
+    100.0 * efficiency);
+
+  std::size_t mismatches = 0;
+  for (std::size_t i = 0; i < count; ++i)
+    if (files.result[i] != files.a[i] + files.b[i])
+      ++mismatches;
+  if (mismatches != 0)
+    spdlog::error("Streamed output has {} elements that differ from the CPU sum", mismatches);
+
+  return mismatches == 0;
+}
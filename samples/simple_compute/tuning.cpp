@@ -0,0 +1,95 @@
+#include "simple_compute.h"
+
+#include <string>
+
+#include <etna/Etna.hpp>
+#include <gpgpu/KernelTuner.hpp>
+
+
+void SimpleCompute::tuneKernels()
+{
+  // From fitting into caches to way bigger than them
+  const std::vector<std::uint32_t> problemSizes{1u << 16, 1u << 20, 1u << 24};
+  const vk::DeviceSize maxBytes = vk::DeviceSize{problemSizes.back()} * sizeof(float);
+
+  auto createBuffer = [this, maxBytes](const char* name) {
+    return context->createBuffer(etna::Buffer::CreateInfo{
+      .size = maxBytes,
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = name,
+    });
+  };
+  auto a = createBuffer("tuning_a");
+  auto b = createBuffer("tuning_b");
+  auto sum = createBuffer("tuning_sum");
+
+  // Garbage may contain denormals and NaNs, which are slow on some GPUs
+  submit([&](vk::CommandBuffer cmd_buf) {
+    for (const auto* buffer : {&a, &b, &sum})
+      cmd_buf.fillBuffer(buffer->get(), 0, maxBytes, 0);
+
+    const vk::MemoryBarrier2 barrier{
+      .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask =
+        vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &barrier,
+    });
+  });
+
+  KernelTuner::Kernel kernel{
+    .program = "simple_compute",
+    .spirvPath = SIMPLE_COMPUTE_SHADERS_ROOT "simple.comp.spv",
+    .candidates = {{.x = 32}, {.x = 64}, {.x = 128}, {.x = 256}, {.x = 512}, {.x = 1024}},
+    .problemSizes = problemSizes,
+    .record =
+      [&](vk::CommandBuffer cmd_buf, const TunedComputePipeline& tuned, std::uint32_t size) {
+        auto set = etna::create_descriptor_set(
+          etna::get_shader_program("simple_compute").getDescriptorLayoutId(0),
+          cmd_buf,
+          {
+            etna::Binding{0, a.genBinding()},
+            etna::Binding{1, b.genBinding()},
+            etna::Binding{2, sum.genBinding()},
+          });
+        vk::DescriptorSet vkSet = set.getVkSet();
+
+        cmd_buf.bindDescriptorSets(
+          vk::PipelineBindPoint::eCompute, tuned.getVkPipelineLayout(), 0, 1, &vkSet, 0, nullptr);
+        cmd_buf.pushConstants(
+          tuned.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(size), &size);
+
+        const auto groups = tuned.linearGroupCount(size);
+        cmd_buf.dispatch(groups.width, groups.height, groups.depth);
+      },
+  };
+
+  TuningCache cache;
+  KernelTuner tuner;
+  const auto result = tuner.tune(kernel, cache);
+  if (!result)
+    return;
+
+  for (std::size_t c = 0; c < result->candidates.size(); ++c)
+  {
+    std::string times;
+    for (std::size_t i = 0; i < problemSizes.size(); ++i)
+      times += fmt::format(" {:>9}: {:7.3f} ms", problemSizes[i], result->milliseconds[c][i]);
+    spdlog::info("simple.comp, workgroup of {:>4}:{}", result->candidates[c].x, times);
+  }
+  spdlog::info(
+    "Best workgroup size of simple.comp on {}: {}, stored in '{}'",
+    TuningCache::currentDeviceKey(),
+    result->best.x,
+    TuningCache::DEFAULT_PATH);
+
+  // Apps only read the cache when creating pipelines
+  pipeline = {};
+  loadPipeline();
+}
@@ -1,8 +1,43 @@
 #include "App.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
 #include <etna/Etna.hpp>
 #include <etna/GlobalContext.hpp>
 #include <etna/PipelineManager.hpp>
+#include <etna/Profiling.hpp>
+#include <imgui.h>
+#include <gui/ImGuiRenderer.hpp>
+#include <spdlog/spdlog.h>
+
+
+// Below that, upscaling can't hide the blur anymore
+static constexpr float MIN_RENDER_SCALE = 0.25f;
+// After that many frames of a still camera, the image doesn't visibly change anymore,
+// so the scene isn't rendered at all
+static constexpr std::uint32_t MAX_ACCUMULATED_FRAMES = 512;
+static constexpr float CAMERA_TAN_HALF_FOV = 0.6f;
+static constexpr std::uint32_t TILE_SIZE = TOY_TILE_SIZE;
+// Results lag behind by the frames in flight, so the first frames of a benchmark pass
+// are measured with the settings of the previous one
+static constexpr std::uint32_t BENCHMARK_WARMUP_FRAMES = 16;
+static constexpr std::uint32_t BENCHMARK_FRAMES = 480;
+
+// Low-discrepancy sub-pixel offsets in [-0.5, 0.5)
+static glm::vec2 halton_jitter(std::uint32_t index)
+{
+  auto radicalInverse = [](std::uint32_t i, std::uint32_t base) {
+    float result = 0.0f;
+    float fraction = 1.0f / static_cast<float>(base);
+    for (; i > 0; i /= base, fraction /= static_cast<float>(base))
+      result += static_cast<float>(i % base) * fraction;
+    return result;
+  };
+  return glm::vec2{radicalInverse(index, 2), radicalInverse(index, 3)} - 0.5f;
+}
 
 
 App::App()
@@ -73,8 +108,59 @@ App::App()
   // How it is actually performed is not trivial, but we can skip this for now.
   commandManager = etna::get_context().createPerFrameCmdMgr();
 
+  guiRenderer = std::make_unique<ImGuiRenderer>(vkWindow->getCurrentFormat());
+  ImGuiRenderer::enableImGuiForWindow(osWindow->native());
+
+  // Frame times drive the render resolution
+  gpuTimer = std::make_unique<GpuTimer>();
+
+  // The workgroup size tuned for this GPU, if there is one
+  const TuningCache tuningCache;
+  toyPipeline = TunedComputePipeline{{
+    .program = "toy",
+    .spirvPath = LOCAL_SHADERTOY1_SHADERS_ROOT "toy.comp.spv",
+    .workgroupSize = {.x = 8, .y = 8},
+    .cache = &tuningCache,
+  }};
+
+  etna::create_program("cone", {LOCAL_SHADERTOY1_SHADERS_ROOT "cone.comp.spv"});
+  conePipeline = etna::get_context().getPipelineManager().createComputePipeline("cone", {});
+
+  etna::create_program("upscale", {LOCAL_SHADERTOY1_SHADERS_ROOT "upscale.comp.spv"});
+  upscalePipeline =
+    etna::get_context().getPipelineManager().createComputePipeline("upscale", {});
+
+  auto createImage = [this](const char* name, vk::Format format, vk::ImageUsageFlags usage) {
+    return etna::get_context().createImage(etna::Image::CreateInfo{
+      .extent = vk::Extent3D{resolution.x, resolution.y, 1},
+      .name = name,
+      .format = format,
+      .imageUsage = vk::ImageUsageFlagBits::eStorage | usage,
+    });
+  };
+  sceneImage = createImage("scene", vk::Format::eR16G16B16A16Sfloat, {});
+  accumulationImage = createImage("accumulation", vk::Format::eR32G32B32A32Sfloat, {});
+  displayImage = createImage(
+    "display", vk::Format::eR16G16B16A16Sfloat, vk::ImageUsageFlagBits::eTransferSrc);
+
+  const glm::uvec2 tileCount = (resolution + (TILE_SIZE - 1)) / TILE_SIZE;
+  tileDistanceImage = etna::get_context().createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{tileCount.x, tileCount.y, 1},
+    .name = "tile_distance",
+    .format = vk::Format::eR32Sfloat,
+    .imageUsage = vk::ImageUsageFlagBits::eStorage,
+  });
 
-  // TODO: Initialize any additional resources you require here!
+  stats.emplace(etna::get_context().getMainWorkCount(), [](std::size_t i) {
+    auto buf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+      .size = sizeof(ToyStats),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+      .name = fmt::format("toy_stats{}", i),
+    });
+    std::memset(buf.map(), 0, sizeof(ToyStats));
+    return buf;
+  });
 }
 
 App::~App()
@@ -88,6 +174,8 @@ void App::run()
   {
     windowing.poll();
 
+    processInput();
+
     drawFrame();
   }
 
@@ -96,8 +184,369 @@ void App::run()
   ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
 }
 
+void App::processInput()
+{
+  if (osWindow->keyboard[KeyboardKey::kEscape] == ButtonState::Falling)
+    osWindow->askToClose();
+
+  // Dragging with the left mouse button orbits, scrolling zooms
+  const glm::vec2 mouseDelta = osWindow->mouse.freePos - lastMousePos;
+  lastMousePos = osWindow->mouse.freePos;
+  if (ImGui::GetIO().WantCaptureMouse)
+    return;
+
+  if (is_held_down(osWindow->mouse[MouseButton::mb1]) && mouseDelta != glm::vec2{0, 0})
+  {
+    cameraYaw -= 0.005f * mouseDelta.x;
+    cameraPitch = std::clamp(cameraPitch + 0.005f * mouseDelta.y, 0.05f, 1.5f);
+    cameraMoved = true;
+  }
+
+  if (osWindow->mouse.scrollDelta.y != 0)
+  {
+    cameraDistance =
+      std::clamp(cameraDistance * std::pow(0.9f, osWindow->mouse.scrollDelta.y), 2.0f, 40.0f);
+    cameraMoved = true;
+  }
+}
+
+void App::updateRenderScale()
+{
+  // A still image only gets better over time, there's no need to adapt
+  if (!adaptiveScale || (!cameraMoved && accumulatedFrames > 0))
+    return;
+
+  const auto frameMs = gpuTimer->getSmoothedMilliseconds("frame");
+  if (!frameMs)
+    return;
+
+  // Raymarching dominates and costs proportionally to the amount of pixels. Steps are
+  // limited to make the smoothed timings keep up and not oscillate.
+  const float ratio = gpuBudgetMs / std::max(static_cast<float>(*frameMs), 0.01f);
+  const float oldScale = renderScale;
+  renderScale *= std::clamp(std::sqrt(ratio), 0.95f, 1.05f);
+  renderScale = std::clamp(renderScale, MIN_RENDER_SCALE, 1.0f);
+
+  // Samples of different resolutions can't be averaged
+  if (renderScale != oldScale)
+    accumulatedFrames = 0;
+}
+
+void App::drawGui()
+{
+  ImGui::Begin("Adaptive resolution");
+
+  // The benchmark controls everything while it runs
+  ImGui::BeginDisabled(benchmark.has_value());
+  bool scaleChanged = ImGui::Checkbox("Adaptive", &adaptiveScale);
+  if (adaptiveScale)
+    scaleChanged |= ImGui::SliderFloat("GPU budget, ms", &gpuBudgetMs, 1.0f, 33.0f, "%.1f");
+  else
+    scaleChanged |=
+      ImGui::SliderFloat("Render scale", &renderScale, MIN_RENDER_SCALE, 1.0f, "%.2f");
+  ImGui::EndDisabled();
+
+  // Starts over at the new resolution, and lets the adaptive one settle first
+  if (scaleChanged)
+    cameraMoved = true;
+
+  const auto frameMs = gpuTimer->getSmoothedMilliseconds("frame");
+  const auto toyMs = gpuTimer->getSmoothedMilliseconds("toy");
+  ImGui::Text("GPU frame: %.2f ms of %.1f ms", frameMs.value_or(0.0), gpuBudgetMs);
+  ImGui::Text("Raymarching: %.2f ms", toyMs.value_or(0.0));
+  ImGui::Text(
+    "Scale: %.0f%% (%ux%u)",
+    100.0f * renderScale,
+    static_cast<std::uint32_t>(std::round(renderScale * static_cast<float>(resolution.x))),
+    static_cast<std::uint32_t>(std::round(renderScale * static_cast<float>(resolution.y))));
+
+  if (accumulatedFrames >= MAX_ACCUMULATED_FRAMES)
+    ImGui::Text("Converged after %u frames", accumulatedFrames);
+  else if (accumulatedFrames > 1)
+    ImGui::Text("Accumulating: %u frames", accumulatedFrames);
+  else
+    ImGui::Text("Moving, drag to orbit, scroll to zoom");
+
+  ImGui::SeparatorText("Cone prepass");
+
+  ImGui::BeginDisabled(benchmark.has_value());
+  ImGui::Checkbox("Enabled", &conePrepass);
+  ImGui::EndDisabled();
+
+  if (lastStats.pixels > 0)
+  {
+    const double pixels = lastStats.pixels;
+    ImGui::Text(
+      "SDF evaluations per pixel: %.2f + %.2f in the prepass",
+      lastStats.primaryEvaluations / pixels,
+      lastStats.coneEvaluations / pixels);
+    ImGui::Text("Empty tiles: %u of %u", lastStats.emptyTiles, lastStats.tiles);
+  }
+  if (const auto coneMs = gpuTimer->getSmoothedMilliseconds("cone"))
+    ImGui::Text("Prepass: %.2f ms", *coneMs);
+
+  if (benchmark)
+    ImGui::Text("Benchmarking: pass %u of 2, frame %u", benchmark->pass + 1, benchmark->frame);
+  else if (ImGui::Button("Run benchmark"))
+    benchmark = Benchmark{
+      .renderScale = renderScale,
+      .adaptiveScale = adaptiveScale,
+      .conePrepass = conePrepass,
+    };
+
+  if (benchmarkResults)
+  {
+    const auto& results = *benchmarkResults;
+    for (std::uint32_t pass = 0; pass < 2; ++pass)
+      ImGui::Text(
+        "%s: %.2f evaluations per pixel, %.2f ms",
+        pass == 0 ? "Without prepass" : "With prepass",
+        results.evaluationsPerPixel[pass],
+        results.milliseconds[pass]);
+  }
+
+  ImGui::End();
+}
+
+void App::recordToy(vk::CommandBuffer cmd_buf)
+{
+  if (cameraMoved)
+    accumulatedFrames = 0;
+
+  const glm::uvec2 renderResolution = glm::max(
+    glm::uvec2{glm::round(renderScale * glm::vec2{resolution})}, glm::uvec2{1, 1});
+  // The first frame of a still camera starts from pixel centers
+  const glm::vec2 jitter =
+    accumulatedFrames == 0 ? glm::vec2{0, 0} : halton_jitter(accumulatedFrames);
+
+  {
+    ETNA_PROFILE_GPU(cmd_buf, toy);
+    GpuTimer::Scope zone{*gpuTimer, cmd_buf, "toy"};
+
+    const glm::vec3 target{0, 1, 0};
+    const glm::vec3 position = target +
+      cameraDistance *
+        glm::vec3{
+          std::cos(cameraPitch) * std::sin(cameraYaw),
+          std::sin(cameraPitch),
+          std::cos(cameraPitch) * std::cos(cameraYaw)};
+    const glm::vec3 forward = glm::normalize(target - position);
+    const glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3{0, 1, 0}));
+    const glm::vec3 up = glm::cross(right, forward);
+    const float aspect = static_cast<float>(resolution.x) / static_cast<float>(resolution.y);
+
+    const ToyParams params{
+      .cameraPosition = glm::vec4{position, 1},
+      .cameraForward = glm::vec4{forward, 0},
+      .cameraRight = glm::vec4{right * aspect * CAMERA_TAN_HALF_FOV, 0},
+      .cameraUp = glm::vec4{up * CAMERA_TAN_HALF_FOV, 0},
+      .renderResolution = renderResolution,
+      .jitter = jitter,
+      .conePrepass = conePrepass,
+    };
+
+    if (conePrepass)
+    {
+      ETNA_PROFILE_GPU(cmd_buf, cone);
+      GpuTimer::Scope coneZone{*gpuTimer, cmd_buf, "cone"};
+
+      auto set = etna::create_descriptor_set(
+        etna::get_shader_program("cone").getDescriptorLayoutId(0),
+        cmd_buf,
+        {
+          etna::Binding{0, tileDistanceImage.genBinding({}, vk::ImageLayout::eGeneral)},
+          etna::Binding{1, stats->get().genBinding()},
+        });
+      vk::DescriptorSet vkSet = set.getVkSet();
+
+      cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, conePipeline.getVkPipeline());
+      cmd_buf.bindDescriptorSets(
+        vk::PipelineBindPoint::eCompute,
+        conePipeline.getVkPipelineLayout(),
+        0,
+        1,
+        &vkSet,
+        0,
+        nullptr);
+      cmd_buf.pushConstants(
+        conePipeline.getVkPipelineLayout(),
+        vk::ShaderStageFlagBits::eCompute,
+        0,
+        sizeof(params),
+        &params);
+
+      etna::flush_barriers(cmd_buf);
+
+      const glm::uvec2 tiles = (renderResolution + (TILE_SIZE - 1)) / TILE_SIZE;
+      cmd_buf.dispatch((tiles.x + 7) / 8, (tiles.y + 7) / 8, 1);
+
+      // The toy pass reads the tile distances in the same state they were written in,
+      // a transition that etna would drop unless forced
+      etna::set_state(
+        cmd_buf,
+        tileDistanceImage.get(),
+        vk::PipelineStageFlagBits2::eComputeShader,
+        vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+        vk::ImageLayout::eGeneral,
+        vk::ImageAspectFlagBits::eColor,
+        etna::ForceSetState::eTrue);
+    }
+
+    auto set = etna::create_descriptor_set(
+      etna::get_shader_program("toy").getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, sceneImage.genBinding({}, vk::ImageLayout::eGeneral)},
+        etna::Binding{1, tileDistanceImage.genBinding({}, vk::ImageLayout::eGeneral)},
+        etna::Binding{2, stats->get().genBinding()},
+      });
+    vk::DescriptorSet vkSet = set.getVkSet();
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, toyPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, toyPipeline.getVkPipelineLayout(), 0, 1, &vkSet, 0, nullptr);
+    cmd_buf.pushConstants(
+      toyPipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      sizeof(params),
+      &params);
+
+    etna::flush_barriers(cmd_buf);
+
+    const auto groups = toyPipeline.groupCount(renderResolution.x, renderResolution.y);
+    cmd_buf.dispatch(groups.width, groups.height, groups.depth);
+
+    // Statistics are read back on the CPU once the frame is done
+    const vk::MemoryBarrier2 statsBarrier{
+      .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+      .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &statsBarrier,
+    });
+  }
+
+  {
+    ETNA_PROFILE_GPU(cmd_buf, upscale);
+    GpuTimer::Scope zone{*gpuTimer, cmd_buf, "upscale"};
+
+    const UpscaleParams params{
+      .renderResolution = renderResolution,
+      .outputResolution = resolution,
+      .jitter = jitter,
+      .accumulate = accumulatedFrames > 0,
+    };
+
+    // The toy pass wrote the scene image in the very same state, and etna drops
+    // transitions that change nothing, so the barrier has to be forced
+    etna::set_state(
+      cmd_buf,
+      sceneImage.get(),
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+      vk::ImageLayout::eGeneral,
+      vk::ImageAspectFlagBits::eColor,
+      etna::ForceSetState::eTrue);
+
+    auto set = etna::create_descriptor_set(
+      etna::get_shader_program("upscale").getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, sceneImage.genBinding({}, vk::ImageLayout::eGeneral)},
+        etna::Binding{1, accumulationImage.genBinding({}, vk::ImageLayout::eGeneral)},
+        etna::Binding{2, displayImage.genBinding({}, vk::ImageLayout::eGeneral)},
+      });
+    vk::DescriptorSet vkSet = set.getVkSet();
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, upscalePipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute,
+      upscalePipeline.getVkPipelineLayout(),
+      0,
+      1,
+      &vkSet,
+      0,
+      nullptr);
+    cmd_buf.pushConstants(
+      upscalePipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      sizeof(params),
+      &params);
+
+    etna::flush_barriers(cmd_buf);
+
+    cmd_buf.dispatch((resolution.x + 7) / 8, (resolution.y + 7) / 8, 1);
+  }
+
+  ++accumulatedFrames;
+  cameraMoved = false;
+}
+
+void App::advanceBenchmark()
+{
+  auto& bench = *benchmark;
+  const std::uint32_t passFrames = BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES;
+
+  if (bench.frame > BENCHMARK_WARMUP_FRAMES && lastStats.pixels > 0)
+  {
+    const auto evaluations =
+      static_cast<double>(lastStats.primaryEvaluations) + lastStats.coneEvaluations;
+    bench.evaluationsPerPixel[bench.pass] += evaluations / lastStats.pixels / BENCHMARK_FRAMES;
+    for (const auto& zone : gpuTimer->getResults())
+      if (zone.name == "toy")
+        bench.milliseconds[bench.pass] += zone.milliseconds / BENCHMARK_FRAMES;
+  }
+
+  if (bench.frame == passFrames)
+  {
+    bench.frame = 0;
+    if (++bench.pass == 2)
+    {
+      spdlog::info(
+        "Cone prepass benchmark: {:.2f} -> {:.2f} SDF evaluations per pixel, {:.2f} -> {:.2f} ms",
+        bench.evaluationsPerPixel[0],
+        bench.evaluationsPerPixel[1],
+        bench.milliseconds[0],
+        bench.milliseconds[1]);
+
+      renderScale = bench.renderScale;
+      adaptiveScale = bench.adaptiveScale;
+      conePrepass = bench.conePrepass;
+      benchmarkResults = bench;
+      benchmark.reset();
+      return;
+    }
+  }
+
+  // An orbit that goes from grazing the ground, which is the slowest to march through,
+  // to looking down at the scene, with the sky in view for a part of it
+  const float progress = static_cast<float>(bench.frame) / static_cast<float>(passFrames);
+  const float angle = 2.0f * std::numbers::pi_v<float> * progress;
+  cameraYaw = angle;
+  cameraPitch = 0.1f + 0.3f * (1.0f - std::cos(2.0f * angle));
+  cameraDistance = 12.0f + 8.0f * std::sin(angle);
+  cameraMoved = true;
+
+  // Every frame is rendered in full, at the full resolution
+  renderScale = 1.0f;
+  adaptiveScale = false;
+  conePrepass = bench.pass == 1;
+
+  ++bench.frame;
+}
+
 void App::drawFrame()
 {
+  guiRenderer->nextFrame();
+  ImGui::NewFrame();
+  drawGui();
+  ImGui::Render();
+
   // First, get a command buffer to write GPU commands into.
   auto currentCmdBuf = commandManager->acquireNext();
 
@@ -137,9 +586,58 @@ void App::drawFrame()
       // and blit/copy operations.
       etna::flush_barriers(currentCmdBuf);
 
-
-      // TODO: Record your commands here!
-
+      gpuTimer->beginFrame(currentCmdBuf);
+
+      // Just like timestamps, statistics of this frame's previous use are done by now
+      {
+        auto& currentStats = stats->get();
+        std::memcpy(&lastStats, currentStats.data(), sizeof(lastStats));
+        std::memset(currentStats.data(), 0, sizeof(lastStats));
+      }
+
+      if (benchmark)
+        advanceBenchmark();
+
+      {
+        GpuTimer::Scope frameZone{*gpuTimer, currentCmdBuf, "frame"};
+
+        updateRenderScale();
+        if (cameraMoved || accumulatedFrames < MAX_ACCUMULATED_FRAMES)
+          recordToy(currentCmdBuf);
+
+        // Blits convert formats, unlike copies
+        etna::set_state(
+          currentCmdBuf,
+          displayImage.get(),
+          vk::PipelineStageFlagBits2::eTransfer,
+          vk::AccessFlagBits2::eTransferRead,
+          vk::ImageLayout::eTransferSrcOptimal,
+          vk::ImageAspectFlagBits::eColor);
+        etna::flush_barriers(currentCmdBuf);
+
+        const vk::Offset3D extent{
+          static_cast<std::int32_t>(resolution.x), static_cast<std::int32_t>(resolution.y), 1};
+        const vk::ImageBlit region{
+          .srcSubresource = {vk::ImageAspectFlagBits::eColor, 0, 0, 1},
+          .srcOffsets = {{vk::Offset3D{0, 0, 0}, extent}},
+          .dstSubresource = {vk::ImageAspectFlagBits::eColor, 0, 0, 1},
+          .dstOffsets = {{vk::Offset3D{0, 0, 0}, extent}},
+        };
+        currentCmdBuf.blitImage(
+          displayImage.get(),
+          vk::ImageLayout::eTransferSrcOptimal,
+          backbuffer,
+          vk::ImageLayout::eTransferDstOptimal,
+          {region},
+          vk::Filter::eNearest);
+
+        guiRenderer->render(
+          currentCmdBuf,
+          {{0, 0}, {resolution.x, resolution.y}},
+          backbuffer,
+          backbufferView,
+          ImGui::GetDrawData());
+      }
 
       // At the end of "rendering", we are required to change how the pixels of the
       // swpchain image are laid out in memory to something that is appropriate
@@ -1,12 +1,21 @@
 #pragma once
 
+#include <optional>
+
 #include <etna/Window.hpp>
 #include <etna/PerFrameCmdMgr.hpp>
 #include <etna/ComputePipeline.hpp>
 #include <etna/Image.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/GpuSharedResource.hpp>
+#include <gpgpu/TunedComputePipeline.hpp>
+#include <render_utils/GpuTimer.hpp>
 
 #include "wsi/OsWindowingManager.hpp"
+#include "shaders/Toy.h"
+
 
+class ImGuiRenderer;
 
 class App
 {
@@ -17,7 +26,12 @@ public:
   void run();
 
 private:
+  void processInput();
+  void updateRenderScale();
+  void drawGui();
   void drawFrame();
+  void recordToy(vk::CommandBuffer cmd_buf);
+  void advanceBenchmark();
 
 private:
   OsWindowingManager windowing;
@@ -28,4 +42,52 @@ private:
 
   std::unique_ptr<etna::Window> vkWindow;
   std::unique_ptr<etna::PerFrameCmdMgr> commandManager;
+  std::unique_ptr<ImGuiRenderer> guiRenderer;
+  std::unique_ptr<GpuTimer> gpuTimer;
+
+  TunedComputePipeline toyPipeline;
+  etna::ComputePipeline conePipeline;
+  etna::ComputePipeline upscalePipeline;
+
+  // Rendered at a fraction of the resolution, only its top-left part is used
+  etna::Image sceneImage;
+  // Samples of all frames since the camera last moved
+  etna::Image accumulationImage;
+  etna::Image displayImage;
+  // One texel per tile, see TOY_TILE_SIZE
+  etna::Image tileDistanceImage;
+
+  std::optional<etna::GpuSharedResource<etna::Buffer>> stats;
+  ToyStats lastStats{};
+
+  // Orbits around the center of the scene
+  float cameraYaw = 0.6f;
+  float cameraPitch = 0.35f;
+  float cameraDistance = 12.0f;
+  bool cameraMoved = true;
+  glm::vec2 lastMousePos = {0, 0};
+
+  // Fraction of the window resolution the scene is raymarched at
+  float renderScale = 1.0f;
+  bool adaptiveScale = true;
+  float gpuBudgetMs = 8.0f;
+  std::uint32_t accumulatedFrames = 0;
+
+  bool conePrepass = true;
+
+  // Flies the camera along a fixed path without and then with the cone prepass
+  struct Benchmark
+  {
+    std::uint32_t pass = 0;
+    std::uint32_t frame = 0;
+    // Per pass
+    double evaluationsPerPixel[2] = {};
+    double milliseconds[2] = {};
+    // Restored once done
+    float renderScale;
+    bool adaptiveScale;
+    bool conePrepass;
+  };
+  std::optional<Benchmark> benchmark;
+  std::optional<Benchmark> benchmarkResults;
 };
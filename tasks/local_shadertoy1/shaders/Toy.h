@@ -0,0 +1,50 @@
+#ifndef TOY_H_INCLUDED
+#define TOY_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Hit distance of rays that hit nothing
+#define TOY_MAX_DISTANCE 100.0
+// Side of the square of pixels the cone prepass finds a common starting distance for
+#define TOY_TILE_SIZE 8
+
+struct ToyParams
+{
+  // Only xyz are used
+  shader_vec4 cameraPosition;
+  shader_vec4 cameraForward;
+  // Span from the center of the screen to its right and top edges
+  shader_vec4 cameraRight;
+  shader_vec4 cameraUp;
+  // Only this top-left part of the scene image is rendered
+  shader_uvec2 renderResolution;
+  // Offset of rays from pixel centers, in render pixels
+  shader_vec2 jitter;
+  // Start rays from distances found by the cone prepass
+  shader_bool conePrepass;
+};
+
+// Evaluations of the scene SDF while looking for hits, shading ones are excluded as
+// the prepass doesn't change them
+struct ToyStats
+{
+  shader_uint primaryEvaluations;
+  shader_uint coneEvaluations;
+  shader_uint pixels;
+  shader_uint tiles;
+  // Tiles where every ray misses the scene
+  shader_uint emptyTiles;
+};
+
+struct UpscaleParams
+{
+  shader_uvec2 renderResolution;
+  shader_uvec2 outputResolution;
+  shader_vec2 jitter;
+  // Starts accumulating samples from scratch when false
+  shader_bool accumulate;
+};
+
+
+#endif // TOY_H_INCLUDED
@@ -0,0 +1,66 @@
+#ifndef SCENE_GLSL_INCLUDED
+#define SCENE_GLSL_INCLUDED
+
+// Signed distance field of the scene, shared by the cone prepass and the raymarcher
+
+const float HIT_EPSILON = 0.001;
+
+const uint MATERIAL_GROUND = 0;
+const uint MATERIAL_PILLAR = 1;
+const uint MATERIAL_BLOB = 2;
+const uint MATERIAL_SKY = 3;
+
+float sd_sphere(vec3 p, float r)
+{
+  return length(p) - r;
+}
+
+float sd_round_box(vec3 p, vec3 half_size, float r)
+{
+  vec3 q = abs(p) - half_size;
+  return length(max(q, 0.0)) + min(max(q.x, max(q.y, q.z)), 0.0) - r;
+}
+
+float sd_torus(vec3 p, float major_radius, float minor_radius)
+{
+  return length(vec2(length(p.xz) - major_radius, p.y)) - minor_radius;
+}
+
+float smooth_min(float a, float b, float k)
+{
+  float h = clamp(0.5 + 0.5 * (b - a) / k, 0.0, 1.0);
+  return mix(b, a, h) - k * h * (1.0 - h);
+}
+
+// Distance in x, material in y. The distance never overestimates, which is what
+// lets the cone prepass skip space for many rays at once.
+vec2 scene(vec3 p)
+{
+  // A 7x7 grid of pillars
+  vec3 cell = p;
+  cell.xz -= 4.0 * clamp(round(cell.xz / 4.0), -3.0, 3.0);
+  float pillars = sd_round_box(cell - vec3(0, 1.5, 0), vec3(0.3, 1.5, 0.3), 0.1);
+
+  // A blob of spheres around the central one
+  float blob = sd_sphere(p - vec3(0, 1.2, 0), 1.0);
+  blob = smooth_min(blob, sd_sphere(p - vec3(1.1, 0.9, 0.4), 0.6), 0.4);
+  blob = smooth_min(blob, sd_sphere(p - vec3(-0.8, 1.8, -0.5), 0.5), 0.4);
+  blob = smooth_min(blob, sd_torus(p - vec3(0, 0.3, 0), 1.6, 0.25), 0.3);
+
+  vec2 result = vec2(p.y, MATERIAL_GROUND);
+  if (pillars < result.x)
+    result = vec2(pillars, MATERIAL_PILLAR);
+  if (blob < result.x)
+    result = vec2(blob, MATERIAL_BLOB);
+  return result;
+}
+
+// Through a point of the render target given in render pixels
+vec3 camera_ray(vec2 render_pos, ToyParams params)
+{
+  vec2 ndc = render_pos / vec2(params.renderResolution) * 2.0 - 1.0;
+  return normalize(
+    params.cameraForward.xyz + ndc.x * params.cameraRight.xyz - ndc.y * params.cameraUp.xyz);
+}
+
+#endif // SCENE_GLSL_INCLUDED
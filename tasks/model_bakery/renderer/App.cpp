@@ -3,15 +3,29 @@
 #include <tracy/Tracy.hpp>
 
 
-App::App()
+App::App(CreateInfo info)
+  : headless{info.headless}
+  , frameLimit{info.frameLimit}
+  , windowing{info.headless}
 {
   glm::uvec2 initialRes = {1280, 720};
+
+  mainCam.lookAt({0, 10, 10}, {0, 0, 0}, {0, 1, 0});
+
+  renderer.reset(new Renderer(initialRes));
+
+  if (headless)
+  {
+    renderer->initVulkan({}, true);
+    renderer->initOffscreenFrameDelivery();
+    renderer->loadScene(GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town/scene.gltf");
+    return;
+  }
+
   mainWindow = windowing.createWindow(OsWindow::CreateInfo{
     .resolution = initialRes,
   });
 
-  renderer.reset(new Renderer(initialRes));
-
   auto instExts = windowing.getRequiredVulkanInstanceExtensions();
   renderer->initVulkan(instExts);
 
@@ -19,23 +33,26 @@ App::App()
 
   renderer->initFrameDelivery(std::move(surface), [this]() { return mainWindow->getResolution(); });
 
-  mainCam.lookAt({0, 10, 10}, {0, 0, 0}, {0, 1, 0});
-
   renderer->loadScene(GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town/scene.gltf");
 }
 
 void App::run()
 {
   double lastTime = windowing.getTime();
-  while (!mainWindow->isBeingClosed())
+  std::uint32_t frameCount = 0;
+  while (headless || !mainWindow->isBeingClosed())
   {
+    if (frameLimit != 0 && frameCount++ == frameLimit)
+      break;
+
     const double currTime = windowing.getTime();
     const float diffTime = static_cast<float>(currTime - lastTime);
     lastTime = currTime;
 
     windowing.poll();
 
-    processInput(diffTime);
+    if (mainWindow)
+      processInput(diffTime);
 
     drawFrame();
 
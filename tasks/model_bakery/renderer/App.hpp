@@ -9,7 +9,15 @@
 class App
 {
 public:
-  App();
+  struct CreateInfo
+  {
+    // Renders offscreen without an OS window and input
+    bool headless = false;
+    // Zero means running until the window is closed
+    std::uint32_t frameLimit = 0;
+  };
+
+  explicit App(CreateInfo info);
 
   void run();
 
@@ -21,7 +29,11 @@ private:
   void rotateCam(Camera& cam, const Mouse& ms, float dt);
 
 private:
+  bool headless;
+  std::uint32_t frameLimit;
+
   OsWindowingManager windowing;
+  // Null in headless mode
   std::unique_ptr<OsWindow> mainWindow;
 
   float camMoveSpeed = 1;
@@ -12,7 +12,7 @@ Renderer::Renderer(glm::uvec2 res)
 {
 }
 
-void Renderer::initVulkan(std::span<const char*> instance_extensions)
+void Renderer::initVulkan(std::span<const char*> instance_extensions, bool headless)
 {
   std::vector<const char*> instanceExtensions;
 
@@ -21,7 +21,8 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
 
   std::vector<const char*> deviceExtensions;
 
-  deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  if (!headless)
+    deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
   etna::initialize(etna::InitParams{
     .applicationName = "model_bakery_renderer",
@@ -60,6 +61,23 @@ void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvi
   worldRenderer->setupPipelines(window->getCurrentFormat());
 }
 
+void Renderer::initOffscreenFrameDelivery()
+{
+  auto& ctx = etna::get_context();
+
+  commandManager = ctx.createPerFrameCmdMgr();
+
+  offscreenWindow = std::make_unique<OffscreenWindow>(OffscreenWindow::CreateInfo{
+    .resolution = resolution,
+  });
+
+  worldRenderer = std::make_unique<WorldRenderer>();
+
+  worldRenderer->allocateResources(resolution);
+  worldRenderer->loadShaders();
+  worldRenderer->setupPipelines(offscreenWindow->getCurrentFormat());
+}
+
 void Renderer::loadScene(std::filesystem::path path)
 {
   worldRenderer->loadScene(path);
@@ -97,7 +115,7 @@ void Renderer::drawFrame()
 
   etna::begin_frame();
 
-  auto nextSwapchainImage = window->acquireNext();
+  auto nextSwapchainImage = window ? window->acquireNext() : offscreenWindow->acquireNext();
 
   if (nextSwapchainImage)
   {
@@ -109,13 +127,22 @@ void Renderer::drawFrame()
 
       worldRenderer->renderWorld(currentCmdBuf, image, view);
 
-      etna::set_state(
-        currentCmdBuf,
-        image,
-        vk::PipelineStageFlagBits2::eColorAttachmentOutput,
-        {},
-        vk::ImageLayout::ePresentSrcKHR,
-        vk::ImageAspectFlagBits::eColor);
+      if (window)
+        etna::set_state(
+          currentCmdBuf,
+          image,
+          vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+          {},
+          vk::ImageLayout::ePresentSrcKHR,
+          vk::ImageAspectFlagBits::eColor);
+      else
+        etna::set_state(
+          currentCmdBuf,
+          image,
+          vk::PipelineStageFlagBits2::eTransfer,
+          vk::AccessFlagBits2::eTransferRead,
+          OffscreenWindow::PRESENT_LAYOUT,
+          vk::ImageAspectFlagBits::eColor);
 
       etna::flush_barriers(currentCmdBuf);
 
@@ -125,13 +152,14 @@ void Renderer::drawFrame()
 
     auto renderingDone = commandManager->submit(std::move(currentCmdBuf), std::move(availableSem));
 
-    const bool presented = window->present(std::move(renderingDone), view);
+    const bool presented = window ? window->present(std::move(renderingDone), view)
+                                  : offscreenWindow->present(std::move(renderingDone), view);
 
     if (!presented)
       nextSwapchainImage = std::nullopt;
   }
 
-  if (!nextSwapchainImage && resolutionProvider() != glm::uvec2{0, 0})
+  if (!nextSwapchainImage && window && resolutionProvider() != glm::uvec2{0, 0})
   {
     auto [w, h] = window->recreateSwapchain(etna::Window::DesiredProperties{
       .resolution = {resolution.x, resolution.y},
@@ -6,6 +6,7 @@
 #include <function2/function2.hpp>
 
 #include "wsi/Keyboard.hpp"
+#include "render_utils/OffscreenWindow.hpp"
 
 #include "FramePacket.hpp"
 #include "WorldRenderer.hpp"
@@ -19,8 +20,11 @@ public:
   explicit Renderer(glm::uvec2 resolution);
   ~Renderer();
 
-  void initVulkan(std::span<const char*> instance_extensions);
+  // Headless rendering doesn't need the swapchain extension
+  void initVulkan(std::span<const char*> instance_extensions, bool headless = false);
   void initFrameDelivery(vk::UniqueSurfaceKHR surface, ResolutionProvider res_provider);
+  // Renders into offscreen images instead of a window
+  void initOffscreenFrameDelivery();
   void recreateSwapchain(glm::uvec2 res);
   void loadScene(std::filesystem::path path);
 
@@ -31,7 +35,9 @@ public:
 private:
   ResolutionProvider resolutionProvider;
 
+  // Exactly one of these is used for frame delivery
   std::unique_ptr<etna::Window> window;
+  std::unique_ptr<OffscreenWindow> offscreenWindow;
   std::unique_ptr<etna::PerFrameCmdMgr> commandManager;
 
   glm::uvec2 resolution;
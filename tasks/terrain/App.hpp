@@ -0,0 +1,45 @@
+#pragma once
+
+#include "wsi/OsWindowingManager.hpp"
+#include "scene/Camera.hpp"
+
+#include "Renderer.hpp"
+
+
+class App
+{
+public:
+  struct CreateInfo
+  {
+    // Renders offscreen without an OS window and input
+    bool headless = false;
+    // Zero means running until the window is closed
+    std::uint32_t frameLimit = 0;
+  };
+
+  explicit App(CreateInfo info);
+
+  void run();
+
+private:
+  void processInput(float dt);
+  void drawFrame();
+
+  void moveCam(Camera& cam, const Keyboard& kb, float dt);
+  void rotateCam(Camera& cam, const Mouse& ms, float dt);
+
+private:
+  bool headless;
+  std::uint32_t frameLimit;
+
+  OsWindowingManager windowing;
+  // Null in headless mode
+  std::unique_ptr<OsWindow> mainWindow;
+
+  float camMoveSpeed = 50;
+  float camRotateSpeed = 0.1f;
+  float zoomSensitivity = 2.0f;
+  Camera mainCam;
+
+  std::unique_ptr<Renderer> renderer;
+};
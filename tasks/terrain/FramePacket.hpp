@@ -0,0 +1,10 @@
+#pragma once
+
+#include <scene/Camera.hpp>
+
+
+struct FramePacket
+{
+  Camera mainCam;
+  float currentTime = 0;
+};
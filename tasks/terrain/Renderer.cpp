@@ -0,0 +1,209 @@
+#include "Renderer.hpp"
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+#include <etna/RenderTargetStates.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/Profiling.hpp>
+#include <imgui.h>
+
+#include "gui/ImGuiRenderer.hpp"
+
+
+Renderer::Renderer(glm::uvec2 res)
+  : resolution{res}
+{
+}
+
+void Renderer::initVulkan(std::span<const char*> instance_extensions, bool headless)
+{
+  std::vector<const char*> instanceExtensions;
+
+  for (auto ext : instance_extensions)
+    instanceExtensions.push_back(ext);
+
+  std::vector<const char*> deviceExtensions;
+
+  if (!headless)
+    deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+  etna::initialize(etna::InitParams{
+    .applicationName = "terrain",
+    .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
+    .instanceExtensions = instanceExtensions,
+    .deviceExtensions = deviceExtensions,
+    .features = vk::PhysicalDeviceFeatures2{.features = {}},
+    .physicalDeviceIndexOverride = {},
+    .numFramesInFlight = 2,
+  });
+}
+
+void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvider res_provider)
+{
+  resolutionProvider = std::move(res_provider);
+
+  auto& ctx = etna::get_context();
+
+  commandManager = ctx.createPerFrameCmdMgr();
+
+  window = ctx.createWindow(etna::Window::CreateInfo{
+    .surface = std::move(a_surface),
+  });
+
+  auto [w, h] = window->recreateSwapchain(etna::Window::DesiredProperties{
+    .resolution = {resolution.x, resolution.y},
+    .vsync = useVsync,
+  });
+
+  resolution = {w, h};
+
+  gpuTimer = std::make_unique<GpuTimer>();
+  worldRenderer = std::make_unique<WorldRenderer>(*gpuTimer);
+
+  worldRenderer->allocateResources(resolution);
+  worldRenderer->setupTerrain(window->getCurrentFormat());
+
+  guiRenderer = std::make_unique<ImGuiRenderer>(window->getCurrentFormat());
+}
+
+void Renderer::initOffscreenFrameDelivery()
+{
+  auto& ctx = etna::get_context();
+
+  commandManager = ctx.createPerFrameCmdMgr();
+
+  offscreenWindow = std::make_unique<OffscreenWindow>(OffscreenWindow::CreateInfo{
+    .resolution = resolution,
+  });
+
+  gpuTimer = std::make_unique<GpuTimer>();
+  worldRenderer = std::make_unique<WorldRenderer>(*gpuTimer);
+
+  worldRenderer->allocateResources(resolution);
+  worldRenderer->setupTerrain(offscreenWindow->getCurrentFormat());
+}
+
+void Renderer::debugInput(const Keyboard& kb)
+{
+  worldRenderer->debugInput(kb);
+
+  if (kb[KeyboardKey::kB] == ButtonState::Falling)
+  {
+    const int retval = std::system("cd " GRAPHICS_COURSE_ROOT "/build"
+                                   " && cmake --build . --target terrain_shaders");
+    if (retval != 0)
+      spdlog::warn("Shader recompilation returned a non-zero return code!");
+    else
+    {
+      ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
+      etna::reload_shaders();
+      spdlog::info("Successfully reloaded shaders!");
+    }
+  }
+}
+
+void Renderer::update(const FramePacket& packet)
+{
+  worldRenderer->update(packet);
+}
+
+void Renderer::drawGui()
+{
+  ImGui::Begin("Terrain");
+
+  const auto frameMs = gpuTimer->getSmoothedMilliseconds("renderFrame");
+  const auto terrainMs = gpuTimer->getSmoothedMilliseconds("terrain");
+  ImGui::Text(
+    "GPU frame: %.2f ms, terrain: %.2f ms", frameMs.value_or(0.0), terrainMs.value_or(0.0));
+
+  worldRenderer->drawGui();
+
+  ImGui::End();
+}
+
+void Renderer::drawFrame()
+{
+  ZoneScoped;
+
+  if (guiRenderer)
+  {
+    guiRenderer->nextFrame();
+    ImGui::NewFrame();
+    drawGui();
+    ImGui::Render();
+  }
+
+  auto currentCmdBuf = commandManager->acquireNext();
+
+  etna::begin_frame();
+
+  auto nextSwapchainImage = window ? window->acquireNext() : offscreenWindow->acquireNext();
+
+  if (nextSwapchainImage)
+  {
+    auto [image, view, availableSem] = *nextSwapchainImage;
+
+    ETNA_CHECK_VK_RESULT(currentCmdBuf.begin(vk::CommandBufferBeginInfo{}));
+    gpuTimer->beginFrame(currentCmdBuf);
+    {
+      ETNA_PROFILE_GPU(currentCmdBuf, renderFrame);
+      GpuTimer::Scope frameZone{*gpuTimer, currentCmdBuf, "renderFrame"};
+
+      worldRenderer->renderWorld(currentCmdBuf, image, view);
+
+      if (guiRenderer)
+        guiRenderer->render(
+          currentCmdBuf,
+          {{0, 0}, {resolution.x, resolution.y}},
+          image,
+          view,
+          ImGui::GetDrawData());
+
+      if (window)
+        etna::set_state(
+          currentCmdBuf,
+          image,
+          vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+          {},
+          vk::ImageLayout::ePresentSrcKHR,
+          vk::ImageAspectFlagBits::eColor);
+      else
+        etna::set_state(
+          currentCmdBuf,
+          image,
+          vk::PipelineStageFlagBits2::eTransfer,
+          vk::AccessFlagBits2::eTransferRead,
+          OffscreenWindow::PRESENT_LAYOUT,
+          vk::ImageAspectFlagBits::eColor);
+
+      etna::flush_barriers(currentCmdBuf);
+
+      ETNA_READ_BACK_GPU_PROFILING(currentCmdBuf);
+    }
+    ETNA_CHECK_VK_RESULT(currentCmdBuf.end());
+
+    auto renderingDone = commandManager->submit(std::move(currentCmdBuf), std::move(availableSem));
+
+    const bool presented = window ? window->present(std::move(renderingDone), view)
+                                  : offscreenWindow->present(std::move(renderingDone), view);
+
+    if (!presented)
+      nextSwapchainImage = std::nullopt;
+  }
+
+  if (!nextSwapchainImage && window && resolutionProvider() != glm::uvec2{0, 0})
+  {
+    auto [w, h] = window->recreateSwapchain(etna::Window::DesiredProperties{
+      .resolution = {resolution.x, resolution.y},
+      .vsync = useVsync,
+    });
+    ETNA_VERIFY((resolution == glm::uvec2{w, h}));
+  }
+
+  etna::end_frame();
+}
+
+Renderer::~Renderer()
+{
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
+}
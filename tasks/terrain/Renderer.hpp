@@ -0,0 +1,57 @@
+#pragma once
+
+#include <etna/GlobalContext.hpp>
+#include <etna/PerFrameCmdMgr.hpp>
+#include <glm/glm.hpp>
+#include <function2/function2.hpp>
+
+#include "wsi/Keyboard.hpp"
+#include "render_utils/GpuTimer.hpp"
+#include "render_utils/OffscreenWindow.hpp"
+
+#include "FramePacket.hpp"
+#include "WorldRenderer.hpp"
+
+
+class ImGuiRenderer;
+
+using ResolutionProvider = fu2::unique_function<glm::uvec2() const>;
+
+class Renderer
+{
+public:
+  explicit Renderer(glm::uvec2 resolution);
+  ~Renderer();
+
+  // Headless rendering doesn't need the swapchain extension
+  void initVulkan(std::span<const char*> instance_extensions, bool headless = false);
+  void initFrameDelivery(vk::UniqueSurfaceKHR surface, ResolutionProvider res_provider);
+  // Renders into offscreen images instead of a window
+  void initOffscreenFrameDelivery();
+  void recreateSwapchain(glm::uvec2 res);
+
+  void debugInput(const Keyboard& kb);
+  void update(const FramePacket& packet);
+  void drawFrame();
+
+  const Terrain::Stats& getTerrainStats() const { return worldRenderer->getTerrain().getStats(); }
+
+private:
+  void drawGui();
+
+private:
+  ResolutionProvider resolutionProvider;
+
+  // Exactly one of these is used for frame delivery
+  std::unique_ptr<etna::Window> window;
+  std::unique_ptr<OffscreenWindow> offscreenWindow;
+  std::unique_ptr<etna::PerFrameCmdMgr> commandManager;
+  // Only there when drawing into a window
+  std::unique_ptr<ImGuiRenderer> guiRenderer;
+  std::unique_ptr<GpuTimer> gpuTimer;
+
+  glm::uvec2 resolution;
+  bool useVsync = true;
+
+  std::unique_ptr<WorldRenderer> worldRenderer;
+};
@@ -0,0 +1,478 @@
+#include "Terrain.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/Profiling.hpp>
+#include <imgui.h>
+#include <spdlog/spdlog.h>
+
+#include "render_utils/AsyncUploader.hpp"
+
+
+static constexpr std::uint32_t LEAF_COUNT = TERRAIN_HEIGHTMAP_SIZE / TERRAIN_GRID_SIZE;
+static_assert(std::has_single_bit(LEAF_COUNT));
+static_assert(std::countr_zero(LEAF_COUNT) + 1 == TERRAIN_LEVEL_COUNT);
+// In meters, a vertex per heightmap texel at the finest level
+static constexpr float LEAF_SIZE = TERRAIN_GRID_SIZE;
+
+static constexpr std::uint32_t PATCH_QUADS = TERRAIN_GRID_SIZE / 2;
+static constexpr std::uint32_t PATCH_INDEX_COUNT = PATCH_QUADS * PATCH_QUADS * 6;
+static constexpr std::uint32_t ALL_QUADRANTS = 0b1111;
+
+static constexpr std::uint32_t MIN_OCTAVES = 1;
+static constexpr std::uint32_t MAX_OCTAVES = 16;
+
+static std::array<glm::vec4, 6> extract_frustum_planes(const glm::mat4x4& proj_view)
+{
+  // Gribb-Hartmann, adapted for [0, 1] depth range
+  auto row = [&proj_view](int i) {
+    return glm::vec4(proj_view[0][i], proj_view[1][i], proj_view[2][i], proj_view[3][i]);
+  };
+
+  std::array planes{
+    row(3) + row(0),
+    row(3) - row(0),
+    row(3) + row(1),
+    row(3) - row(1),
+    row(2),
+    row(3) - row(2),
+  };
+
+  for (auto& plane : planes)
+    plane /= length(glm::vec3(plane));
+
+  return planes;
+}
+
+static bool inside_frustum(
+  const std::array<glm::vec4, 6>& planes, glm::vec3 box_min, glm::vec3 box_max)
+{
+  for (const auto& plane : planes)
+  {
+    // The corner furthest along the plane normal
+    const glm::vec3 corner{
+      plane.x > 0 ? box_max.x : box_min.x,
+      plane.y > 0 ? box_max.y : box_min.y,
+      plane.z > 0 ? box_max.z : box_min.z,
+    };
+    if (dot(glm::vec3(plane), corner) + plane.w < 0)
+      return false;
+  }
+  return true;
+}
+
+static bool intersects_sphere(glm::vec3 box_min, glm::vec3 box_max, glm::vec3 center, float radius)
+{
+  const glm::vec3 closest = glm::clamp(center, box_min, box_max);
+  const glm::vec3 offset = closest - center;
+  return dot(offset, offset) <= radius * radius;
+}
+
+std::uint64_t Terrain::Stats::triangles() const
+{
+  return std::uint64_t{patches} * PATCH_QUADS * PATCH_QUADS * 2;
+}
+
+Terrain::Terrain(CreateInfo info)
+{
+  auto& ctx = etna::get_context();
+
+  etna::create_program("terrain_heightmap", {TERRAIN_SHADERS_ROOT "heightmap.comp.spv"});
+  etna::create_program(
+    "terrain_heightmap_bounds", {TERRAIN_SHADERS_ROOT "heightmap_bounds.comp.spv"});
+  etna::create_program(
+    "terrain", {TERRAIN_SHADERS_ROOT "terrain.vert.spv", TERRAIN_SHADERS_ROOT "terrain.frag.spv"});
+
+  auto& pipelineManager = ctx.getPipelineManager();
+  heightmapPipeline = pipelineManager.createComputePipeline("terrain_heightmap", {});
+  boundsPipeline = pipelineManager.createComputePipeline("terrain_heightmap_bounds", {});
+  terrainPipeline = pipelineManager.createGraphicsPipeline(
+    "terrain",
+    etna::GraphicsPipeline::CreateInfo{
+      .rasterizationConfig =
+        vk::PipelineRasterizationStateCreateInfo{
+          .polygonMode = vk::PolygonMode::eFill,
+          .cullMode = vk::CullModeFlagBits::eBack,
+          .frontFace = vk::FrontFace::eCounterClockwise,
+          .lineWidth = 1.f,
+        },
+      .fragmentShaderOutput =
+        {
+          .colorAttachmentFormats = {info.colorFormat},
+          .depthAttachmentFormat = info.depthFormat,
+        },
+    });
+
+  heightmap = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{TERRAIN_HEIGHTMAP_SIZE, TERRAIN_HEIGHTMAP_SIZE, 1},
+    .name = "terrain_heightmap",
+    .format = vk::Format::eR32Sfloat,
+    .imageUsage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+  });
+  heightmapSampler = etna::Sampler(etna::Sampler::CreateInfo{
+    .filter = vk::Filter::eLinear,
+    .addressMode = vk::SamplerAddressMode::eClampToEdge,
+    .name = "terrain_heightmap_sampler",
+  });
+
+  leafBounds = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = LEAF_COUNT * LEAF_COUNT * sizeof(glm::vec2),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+    .name = "terrain_leaf_bounds",
+  });
+  leafBounds.map();
+
+  patchBuffer.emplace(ctx.getMainWorkCount(), [](std::size_t i) {
+    auto buf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+      .size = MAX_PATCHES * sizeof(TerrainPatch),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+      .name = fmt::format("terrain_patches{}", i),
+    });
+    buf.map();
+    return buf;
+  });
+
+  std::vector<std::uint32_t> indices;
+  indices.reserve(PATCH_INDEX_COUNT);
+  for (std::uint32_t z = 0; z < PATCH_QUADS; ++z)
+    for (std::uint32_t x = 0; x < PATCH_QUADS; ++x)
+    {
+      const std::uint32_t v00 = z * (PATCH_QUADS + 1) + x;
+      const std::uint32_t v01 = v00 + PATCH_QUADS + 1;
+      // Wound the same way as meshes, facing up
+      indices.insert(indices.end(), {v00, v01, v00 + 1, v00 + 1, v01, v01 + 1});
+    }
+
+  const vk::DeviceSize indexBytes = indices.size() * sizeof(std::uint32_t);
+  gridIndices = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = indexBytes,
+    .bufferUsage = vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "terrain_grid_indices",
+  });
+
+  // Waits for the upload when going out of scope
+  AsyncUploader uploader{{
+    .stagingSize = indexBytes,
+    .batchSize = indexBytes,
+    .name = "terrain_upload",
+  }};
+  uploader.uploadBuffer<std::uint32_t>(gridIndices, 0, indices);
+  uploader.flush();
+}
+
+void Terrain::select(const glm::mat4x4& proj_view, glm::vec3 camera_position)
+{
+  ZoneScoped;
+
+  projView = proj_view;
+  if (freezeSelection)
+    return;
+
+  frustumPlanes = extract_frustum_planes(proj_view);
+  selectionCamera = camera_position;
+  patches.clear();
+  stats = {};
+
+  // The root's range is unlimited, so it covers whatever its descendants don't
+  selectNode(TERRAIN_LEVEL_COUNT - 1, {0, 0});
+  stats.patches = static_cast<std::uint32_t>(patches.size());
+}
+
+bool Terrain::selectNode(std::uint32_t level, glm::uvec2 node)
+{
+  const float size = LEAF_SIZE * static_cast<float>(1u << level);
+  const glm::vec2 heights = nodeHeights(level, node);
+  const glm::vec3 boxMin{
+    static_cast<float>(node.x) * size, heights.x, static_cast<float>(node.y) * size};
+  const glm::vec3 boxMax = boxMin + glm::vec3{size, heights.y - heights.x, size};
+
+  if (!intersects_sphere(boxMin, boxMax, selectionCamera, lodRange(level)))
+    return false;
+
+  // Culled nodes count as selected, otherwise their parents would draw them
+  if (!inside_frustum(frustumPlanes, boxMin, boxMax))
+  {
+    ++stats.culledNodes;
+    return true;
+  }
+
+  if (level == 0 || !intersects_sphere(boxMin, boxMax, selectionCamera, lodRange(level - 1)))
+  {
+    addPatches(level, node, ALL_QUADRANTS);
+    return true;
+  }
+
+  std::uint32_t uncovered = 0;
+  for (std::uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+    if (!selectNode(level - 1, node * 2u + glm::uvec2{quadrant & 1, quadrant >> 1}))
+      uncovered |= 1u << quadrant;
+
+  if (uncovered != 0)
+    addPatches(level, node, uncovered);
+
+  return true;
+}
+
+void Terrain::addPatches(std::uint32_t level, glm::uvec2 node, std::uint32_t quadrant_mask)
+{
+  ++stats.selectedNodes;
+
+  const float size = LEAF_SIZE * static_cast<float>(1u << level) / 2;
+  for (std::uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+  {
+    if ((quadrant_mask & (1u << quadrant)) == 0)
+      continue;
+
+    if (patches.size() == MAX_PATCHES)
+    {
+      ++stats.droppedPatches;
+      continue;
+    }
+
+    const glm::uvec2 cell = node * 2u + glm::uvec2{quadrant & 1, quadrant >> 1};
+    patches.push_back(TerrainPatch{
+      .offset = glm::vec2(cell) * size,
+      .size = size,
+      .level = level,
+    });
+    ++stats.patchesPerLevel[level];
+  }
+}
+
+float Terrain::lodRange(std::uint32_t level) const
+{
+  if (level + 1 == TERRAIN_LEVEL_COUNT)
+    return std::numeric_limits<float>::infinity();
+  return LEAF_SIZE * lodRangeFactor * static_cast<float>(1u << level);
+}
+
+glm::vec2 Terrain::nodeHeights(std::uint32_t level, glm::uvec2 node) const
+{
+  const auto& bounds = nodeBounds[level];
+  if (bounds.empty())
+    return {0, heightScale};
+
+  const std::uint32_t side = LEAF_COUNT >> level;
+  return bounds[node.y * side + node.x] * heightScale;
+}
+
+void Terrain::prepare(vk::CommandBuffer cmd_buf)
+{
+  ZoneScoped;
+
+  if (heightmapDirty)
+  {
+    generateHeightmap(cmd_buf);
+    heightmapDirty = false;
+    for (auto& bounds : nodeBounds)
+      bounds.clear();
+    framesUntilBoundsReady = etna::get_context().getMainWorkCount();
+  }
+  else if (framesUntilBoundsReady && --*framesUntilBoundsReady == 0)
+  {
+    // The frame that generated the heightmap used the same resources as this one
+    // and is done by now, just like timestamps are
+    readBackBounds();
+    framesUntilBoundsReady.reset();
+  }
+
+  auto& currentPatches = patchBuffer->get();
+  std::memcpy(currentPatches.data(), patches.data(), patches.size() * sizeof(TerrainPatch));
+
+  drawSet = etna::create_descriptor_set(
+              etna::get_shader_program("terrain").getDescriptorLayoutId(0),
+              cmd_buf,
+              {
+                etna::Binding{
+                  0,
+                  heightmap.genBinding(
+                    heightmapSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+                etna::Binding{1, currentPatches.genBinding()},
+              })
+              .getVkSet();
+
+  etna::flush_barriers(cmd_buf);
+}
+
+void Terrain::generateHeightmap(vk::CommandBuffer cmd_buf)
+{
+  ETNA_PROFILE_GPU(cmd_buf, generateHeightmap);
+
+  {
+    auto set = etna::create_descriptor_set(
+      etna::get_shader_program("terrain_heightmap").getDescriptorLayoutId(0),
+      cmd_buf,
+      {etna::Binding{0, heightmap.genBinding({}, vk::ImageLayout::eGeneral)}});
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, heightmapPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute,
+      heightmapPipeline.getVkPipelineLayout(),
+      0,
+      {set.getVkSet()},
+      {});
+    cmd_buf.pushConstants<HeightmapParams>(
+      heightmapPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, {noise});
+
+    etna::flush_barriers(cmd_buf);
+
+    constexpr std::uint32_t groups = TERRAIN_HEIGHTMAP_SIZE / TERRAIN_WORKGROUP_SIZE;
+    cmd_buf.dispatch(groups, groups, 1);
+  }
+
+  // Bounds are computed from the heightmap in the same state it was generated in
+  etna::set_state(
+    cmd_buf,
+    heightmap.get(),
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::ImageLayout::eGeneral,
+    vk::ImageAspectFlagBits::eColor,
+    etna::ForceSetState::eTrue);
+
+  {
+    auto set = etna::create_descriptor_set(
+      etna::get_shader_program("terrain_heightmap_bounds").getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, heightmap.genBinding({}, vk::ImageLayout::eGeneral)},
+        etna::Binding{1, leafBounds.genBinding()},
+      });
+
+    const HeightmapBoundsParams params{.leafCount = LEAF_COUNT};
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, boundsPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute,
+      boundsPipeline.getVkPipelineLayout(),
+      0,
+      {set.getVkSet()},
+      {});
+    cmd_buf.pushConstants<HeightmapBoundsParams>(
+      boundsPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, {params});
+
+    etna::flush_barriers(cmd_buf);
+
+    constexpr std::uint32_t groups =
+      (LEAF_COUNT + TERRAIN_WORKGROUP_SIZE - 1) / TERRAIN_WORKGROUP_SIZE;
+    cmd_buf.dispatch(groups, groups, 1);
+  }
+
+  // Bounds are read back on the CPU once the frame is done
+  const vk::MemoryBarrier2 boundsBarrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+    .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &boundsBarrier,
+  });
+}
+
+void Terrain::readBackBounds()
+{
+  ZoneScoped;
+
+  auto& leaves = nodeBounds[0];
+  leaves.resize(LEAF_COUNT * LEAF_COUNT);
+  std::memcpy(leaves.data(), leafBounds.data(), leaves.size() * sizeof(glm::vec2));
+
+  for (std::uint32_t level = 1; level < TERRAIN_LEVEL_COUNT; ++level)
+  {
+    const std::uint32_t side = LEAF_COUNT >> level;
+    const auto& children = nodeBounds[level - 1];
+    auto& parents = nodeBounds[level];
+    parents.resize(side * side);
+
+    for (std::uint32_t y = 0; y < side; ++y)
+      for (std::uint32_t x = 0; x < side; ++x)
+      {
+        glm::vec2 range{1, 0};
+        for (std::uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+        {
+          const glm::vec2 child =
+            children[(2 * y + (quadrant >> 1)) * 2 * side + 2 * x + (quadrant & 1)];
+          range = {std::min(range.x, child.x), std::max(range.y, child.y)};
+        }
+        parents[y * side + x] = range;
+      }
+  }
+
+  spdlog::info(
+    "Terrain heights range from {:.0f} to {:.0f} m",
+    nodeBounds.back()[0].x * heightScale,
+    nodeBounds.back()[0].y * heightScale);
+}
+
+void Terrain::draw(vk::CommandBuffer cmd_buf)
+{
+  if (patches.empty())
+    return;
+
+  const TerrainParams params{
+    .projView = projView,
+    .cameraPosition = glm::vec4(selectionCamera, 1.0f),
+    .heightScale = heightScale,
+    .lodRange = LEAF_SIZE * lodRangeFactor,
+    .showLevels = showLevels,
+  };
+
+  const auto layout = terrainPipeline.getVkPipelineLayout();
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, terrainPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, {drawSet}, {});
+  cmd_buf.bindIndexBuffer(gridIndices.get(), 0, vk::IndexType::eUint32);
+  cmd_buf.pushConstants<TerrainParams>(
+    layout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, {params});
+
+  // Every selected node is an instance of the same grid
+  cmd_buf.drawIndexed(PATCH_INDEX_COUNT, static_cast<std::uint32_t>(patches.size()), 0, 0, 0);
+}
+
+void Terrain::drawGui()
+{
+  ImGui::SeparatorText("Heightmap");
+
+  bool noiseChanged = false;
+  noiseChanged |= ImGui::InputScalar("Seed", ImGuiDataType_U32, &noise.seed);
+  noiseChanged |=
+    ImGui::SliderScalar("Octaves", ImGuiDataType_U32, &noise.octaves, &MIN_OCTAVES, &MAX_OCTAVES);
+  noiseChanged |= ImGui::SliderFloat("Frequency", &noise.frequency, 1.0f, 32.0f, "%.1f");
+  noiseChanged |= ImGui::SliderFloat("Lacunarity", &noise.lacunarity, 1.5f, 3.0f, "%.2f");
+  noiseChanged |= ImGui::SliderFloat("Gain", &noise.gain, 0.2f, 0.8f, "%.2f");
+  heightmapDirty |= noiseChanged;
+
+  ImGui::SliderFloat("Height scale, m", &heightScale, 50.0f, 1500.0f, "%.0f");
+  if (framesUntilBoundsReady)
+    ImGui::TextUnformatted("Culling conservatively until node heights are read back");
+
+  ImGui::SeparatorText("Level of detail");
+
+  ImGui::SliderFloat("Range, leaves", &lodRangeFactor, 4.0f, 16.0f, "%.1f");
+  ImGui::Checkbox("Show levels", &showLevels);
+  ImGui::Checkbox("Freeze selection", &freezeSelection);
+
+  ImGui::Text("Nodes: %u selected, %u culled", stats.selectedNodes, stats.culledNodes);
+  ImGui::Text("Patches: %u of %u", stats.patches, MAX_PATCHES);
+  ImGui::Text(
+    "Triangles: %llu of %llu (%.0f%%)",
+    static_cast<unsigned long long>(stats.triangles()),
+    static_cast<unsigned long long>(TRIANGLE_BUDGET),
+    100.0 * static_cast<double>(stats.triangles()) / static_cast<double>(TRIANGLE_BUDGET));
+  if (stats.droppedPatches > 0)
+    ImGui::Text("Over budget, %u patches dropped", stats.droppedPatches);
+
+  for (std::uint32_t level = 0; level < TERRAIN_LEVEL_COUNT; ++level)
+    if (stats.patchesPerLevel[level] > 0)
+      ImGui::Text("Level %u: %u patches", level, stats.patchesPerLevel[level]);
+}
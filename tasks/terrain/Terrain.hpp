@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/GpuSharedResource.hpp>
+#include <etna/GraphicsPipeline.hpp>
+#include <etna/Image.hpp>
+#include <etna/Sampler.hpp>
+#include <glm/glm.hpp>
+
+#include "shaders/Terrain.h"
+
+
+/**
+ * Terrain drawn with continuous distance-dependent LOD (CDLOD). A quadtree over
+ * a heightmap generated on the GPU is traversed on the CPU every frame, and all
+ * selected nodes are drawn by a single instanced draw of one grid mesh. Every level
+ * of the quadtree is used up to a distance twice as large as the previous one,
+ * and vertices morph into the next level before reaching it, so there are no cracks.
+ */
+class Terrain
+{
+public:
+  struct CreateInfo
+  {
+    vk::Format colorFormat;
+    vk::Format depthFormat;
+  };
+
+  // Of the last selection
+  struct Stats
+  {
+    std::uint32_t selectedNodes = 0;
+    std::uint32_t culledNodes = 0;
+    std::uint32_t patches = 0;
+    // Didn't fit into MAX_PATCHES
+    std::uint32_t droppedPatches = 0;
+    std::array<std::uint32_t, TERRAIN_LEVEL_COUNT> patchesPerLevel{};
+
+    std::uint64_t triangles() const;
+  };
+
+  static constexpr std::uint32_t MAX_PATCHES = 4096;
+  static constexpr std::uint64_t TRIANGLE_BUDGET =
+    std::uint64_t{MAX_PATCHES} * (TERRAIN_GRID_SIZE / 2) * (TERRAIN_GRID_SIZE / 2) * 2;
+
+  explicit Terrain(CreateInfo info);
+
+  // Traverses the quadtree, no GPU work is involved
+  void select(const glm::mat4x4& proj_view, glm::vec3 camera_position);
+  // Generates the heightmap when needed and uploads the selection, can't be done while rendering
+  void prepare(vk::CommandBuffer cmd_buf);
+  void draw(vk::CommandBuffer cmd_buf);
+
+  void drawGui();
+
+  const Stats& getStats() const { return stats; }
+
+private:
+  void generateHeightmap(vk::CommandBuffer cmd_buf);
+  void readBackBounds();
+
+  // Returns false when the node is out of its level's range and its parent has to cover it
+  bool selectNode(std::uint32_t level, glm::uvec2 node);
+  // Quadrants are bits of the mask, X is the lowest bit of the quadrant index and Z the next one
+  void addPatches(std::uint32_t level, glm::uvec2 node, std::uint32_t quadrant_mask);
+
+  float lodRange(std::uint32_t level) const;
+  // In world units, conservative until the bounds are read back
+  glm::vec2 nodeHeights(std::uint32_t level, glm::uvec2 node) const;
+
+private:
+  etna::Image heightmap;
+  etna::Sampler heightmapSampler;
+  etna::ComputePipeline heightmapPipeline;
+  etna::ComputePipeline boundsPipeline;
+  etna::GraphicsPipeline terrainPipeline;
+
+  // A quadrant of a node, shared by all patches
+  etna::Buffer gridIndices;
+  std::optional<etna::GpuSharedResource<etna::Buffer>> patchBuffer;
+  // Allocated for the current frame by prepare
+  vk::DescriptorSet drawSet;
+
+  HeightmapParams noise{
+    .seed = 1,
+    .octaves = 10,
+    .frequency = 6.0f,
+    .lacunarity = 2.0f,
+    .gain = 0.5f,
+  };
+  bool heightmapDirty = true;
+
+  // Heights of quadtree leaves are read back once the frame generating them is done
+  etna::Buffer leafBounds;
+  std::optional<std::size_t> framesUntilBoundsReady;
+  // Height ranges of all nodes from 0 to 1, starting with leaves, empty until read back
+  std::array<std::vector<glm::vec2>, TERRAIN_LEVEL_COUNT> nodeBounds;
+
+  float heightScale = 600.0f;
+  // Range of the finest level in leaf sizes. Neighbouring nodes may only be one
+  // level apart for morphing to close cracks, which takes at least about 4.
+  float lodRangeFactor = 6.0f;
+  bool showLevels = false;
+  // Keeps drawing the same nodes to look at them from elsewhere
+  bool freezeSelection = false;
+
+  std::array<glm::vec4, 6> frustumPlanes;
+  glm::vec3 selectionCamera{};
+  glm::mat4x4 projView{1.0f};
+  std::vector<TerrainPatch> patches;
+  Stats stats;
+};
@@ -0,0 +1,75 @@
+#include "WorldRenderer.hpp"
+
+#include <array>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/RenderTargetStates.hpp>
+#include <etna/Profiling.hpp>
+
+
+// Matches the fog of the terrain shader
+static constexpr std::array SKY_COLOR{0.55f, 0.7f, 0.85f, 1.0f};
+
+WorldRenderer::WorldRenderer(GpuTimer& gpu_timer)
+  : gpuTimer{gpu_timer}
+{
+}
+
+void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
+{
+  resolution = swapchain_resolution;
+
+  auto& ctx = etna::get_context();
+
+  mainViewDepth = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{resolution.x, resolution.y, 1},
+    .name = "main_view_depth",
+    .format = vk::Format::eD32Sfloat,
+    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
+  });
+}
+
+void WorldRenderer::setupTerrain(vk::Format swapchain_format)
+{
+  terrain = std::make_unique<Terrain>(Terrain::CreateInfo{
+    .colorFormat = swapchain_format,
+    .depthFormat = vk::Format::eD32Sfloat,
+  });
+}
+
+void WorldRenderer::debugInput(const Keyboard&) {}
+
+void WorldRenderer::update(const FramePacket& packet)
+{
+  ZoneScoped;
+
+  const float aspect = float(resolution.x) / float(resolution.y);
+  const glm::mat4x4 worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
+  terrain->select(worldViewProj, packet.mainCam.position);
+}
+
+void WorldRenderer::drawGui()
+{
+  terrain->drawGui();
+}
+
+void WorldRenderer::renderWorld(
+  vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view)
+{
+  ETNA_PROFILE_GPU(cmd_buf, renderWorld);
+  GpuTimer::Scope zone{gpuTimer, cmd_buf, "terrain"};
+
+  terrain->prepare(cmd_buf);
+
+  {
+    ETNA_PROFILE_GPU(cmd_buf, renderForward);
+
+    etna::RenderTargetState renderTargets(
+      cmd_buf,
+      {{0, 0}, {resolution.x, resolution.y}},
+      {{.image = target_image, .view = target_image_view, .clearColorValue = SKY_COLOR}},
+      {.image = mainViewDepth.get(), .view = mainViewDepth.getView({})});
+
+    terrain->draw(cmd_buf);
+  }
+}
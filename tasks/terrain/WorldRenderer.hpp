@@ -0,0 +1,36 @@
+#pragma once
+
+#include <etna/Image.hpp>
+#include <glm/glm.hpp>
+
+#include "render_utils/GpuTimer.hpp"
+#include "wsi/Keyboard.hpp"
+
+#include "FramePacket.hpp"
+#include "Terrain.hpp"
+
+
+class WorldRenderer
+{
+public:
+  explicit WorldRenderer(GpuTimer& gpu_timer);
+
+  void allocateResources(glm::uvec2 swapchain_resolution);
+  void setupTerrain(vk::Format swapchain_format);
+
+  void debugInput(const Keyboard& kb);
+  void update(const FramePacket& packet);
+  void drawGui();
+  void renderWorld(
+    vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view);
+
+  const Terrain& getTerrain() const { return *terrain; }
+
+private:
+  GpuTimer& gpuTimer;
+
+  etna::Image mainViewDepth;
+  std::unique_ptr<Terrain> terrain;
+
+  glm::uvec2 resolution;
+};
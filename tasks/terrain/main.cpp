@@ -0,0 +1,40 @@
+#include "App.hpp"
+
+#include <cstdlib>
+#include <string_view>
+
+#include <spdlog/spdlog.h>
+
+
+int main(int argc, char** argv)
+{
+  App::CreateInfo info{};
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg = argv[i];
+    if (arg == "--headless")
+      info.headless = true;
+    else if (arg == "--frames" && i + 1 < argc)
+      info.frameLimit = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    else
+      spdlog::warn("Unknown argument '{}', usage: [--headless] [--frames N]", arg);
+  }
+
+  if (info.headless && info.frameLimit == 0)
+  {
+    spdlog::error("--headless requires --frames N, nothing would ever stop the app otherwise");
+    return 1;
+  }
+
+  {
+    App app(info);
+    app.run();
+  }
+
+  // Etna needs to be de-initialized after all resources allocated by app
+  // and it's sub-fields are already freed.
+  if (etna::is_initilized())
+    etna::shutdown();
+
+  return 0;
+}
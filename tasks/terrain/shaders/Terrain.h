@@ -0,0 +1,56 @@
+#ifndef TERRAIN_H_INCLUDED
+#define TERRAIN_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// One texel per meter
+#define TERRAIN_HEIGHTMAP_SIZE 4096
+// Quads along a side of a quadtree node, a multiple of 4 so that quadrants have
+// an even number of quads and morph the same way the whole node does
+#define TERRAIN_GRID_SIZE 32
+// Leaves are TERRAIN_GRID_SIZE texels wide, so there are 128 of them along a side
+#define TERRAIN_LEVEL_COUNT 8
+// Part of each level's range where vertices morph into the next level
+#define TERRAIN_MORPH_FRACTION 0.3
+#define TERRAIN_WORKGROUP_SIZE 8
+
+struct HeightmapParams
+{
+  shader_uint seed;
+  shader_uint octaves;
+  // Periods of the first octave across the whole heightmap
+  shader_float frequency;
+  shader_float lacunarity;
+  shader_float gain;
+};
+
+struct HeightmapBoundsParams
+{
+  // Quadtree leaves along a side, each one gets the range of heights it covers
+  shader_uint leafCount;
+};
+
+// A quadrant of a selected quadtree node, drawn as one instance of the grid mesh
+struct TerrainPatch
+{
+  // Corner with the smallest coordinates on the XZ plane
+  shader_vec2 offset;
+  shader_float size;
+  shader_uint level;
+};
+
+struct TerrainParams
+{
+  shader_mat4 projView;
+  // Morphing is driven by the camera the nodes were selected for, only xyz are used
+  shader_vec4 cameraPosition;
+  shader_float heightScale;
+  // Range of the finest level, each next level's range is twice as large
+  shader_float lodRange;
+  // Tints patches by their level
+  shader_bool showLevels;
+};
+
+
+#endif // TERRAIN_H_INCLUDED
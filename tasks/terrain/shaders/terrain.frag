@@ -0,0 +1,65 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "Terrain.h"
+
+
+layout(push_constant) uniform params_t
+{
+  TerrainParams params;
+};
+
+layout(binding = 0) uniform sampler2D heightmap;
+
+layout(location = 0) out vec4 out_fragColor;
+
+layout(location = 0) in VS_OUT
+{
+  vec3 wPos;
+  flat uint level;
+} surf;
+
+// Matches the clear color, so that the terrain fades into the sky
+const vec3 SKY_COLOR = vec3(0.55, 0.7, 0.85);
+const float FOG_DENSITY = 2e-4;
+
+const vec3 LEVEL_COLORS[4] = vec3[](
+  vec3(1.0, 0.3, 0.3), vec3(0.3, 1.0, 0.3), vec3(0.3, 0.3, 1.0), vec3(1.0, 1.0, 0.3));
+
+float height_at(vec2 xz)
+{
+  return textureLod(heightmap, xz / float(TERRAIN_HEIGHTMAP_SIZE), 0).r * params.heightScale;
+}
+
+void main()
+{
+  // Normals come from the heightmap rather than the mesh, so that lighting doesn't
+  // change as vertices morph between levels
+  const float step = 1.0;
+  float dx = height_at(surf.wPos.xz + vec2(step, 0)) - height_at(surf.wPos.xz - vec2(step, 0));
+  float dz = height_at(surf.wPos.xz + vec2(0, step)) - height_at(surf.wPos.xz - vec2(0, step));
+  vec3 normal = normalize(vec3(-dx, 2.0 * step, -dz));
+
+  const vec3 grass = vec3(0.25, 0.4, 0.15);
+  const vec3 rock = vec3(0.4, 0.37, 0.33);
+  const vec3 snow = vec3(0.9, 0.92, 0.95);
+  float slope = 1.0 - normal.y;
+  float relativeHeight = surf.wPos.y / params.heightScale;
+  vec3 surfaceColor = mix(grass, rock, smoothstep(0.15, 0.3, slope));
+  surfaceColor = mix(surfaceColor, snow, smoothstep(0.6, 0.7, relativeHeight - slope));
+
+  if (params.showLevels)
+    surfaceColor *= LEVEL_COLORS[surf.level % 4u];
+
+  const vec3 lightDir = normalize(vec3(0.4, 0.6, 0.3));
+  const vec3 lightColor = vec3(1.0, 0.95, 0.85);
+  vec3 diffuse = max(dot(normal, lightDir), 0.0f) * lightColor;
+  const float ambient = 0.15;
+  vec3 color = (diffuse + ambient) * surfaceColor;
+
+  float distanceToCamera = distance(surf.wPos, params.cameraPosition.xyz);
+  color = mix(SKY_COLOR, color, exp(-distanceToCamera * FOG_DENSITY));
+
+  out_fragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,62 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "Terrain.h"
+
+
+layout(push_constant) uniform params_t
+{
+  TerrainParams params;
+};
+
+layout(binding = 0) uniform sampler2D heightmap;
+layout(binding = 1) readonly buffer patches_t
+{
+  TerrainPatch patches[];
+};
+
+layout(location = 0) out VS_OUT
+{
+  vec3 wPos;
+  flat uint level;
+} vOut;
+
+out gl_PerVertex { vec4 gl_Position; };
+
+// The grid mesh covers a quadrant of a node
+const uint PATCH_QUADS = TERRAIN_GRID_SIZE / 2;
+
+vec3 world_position(vec2 xz)
+{
+  float height = textureLod(heightmap, xz / float(TERRAIN_HEIGHTMAP_SIZE), 0).r;
+  return vec3(xz.x, height * params.heightScale, xz.y);
+}
+
+void main(void)
+{
+  TerrainPatch terrainPatch = patches[gl_InstanceIndex];
+
+  // The index buffer is the only input, vertices are laid out row by row
+  uint vertex = uint(gl_VertexIndex);
+  uvec2 gridPos = uvec2(vertex % (PATCH_QUADS + 1), vertex / (PATCH_QUADS + 1));
+  float quadSize = terrainPatch.size / float(PATCH_QUADS);
+  vec2 xz = terrainPatch.offset + vec2(gridPos) * quadSize;
+
+  // Towards the end of the level's range, odd vertices slide onto their even
+  // neighbours, turning the grid into the one of the next level. Nodes of the next
+  // level only start past the range, so their shared edges match exactly.
+  if (terrainPatch.level + 1 < TERRAIN_LEVEL_COUNT)
+  {
+    float range = params.lodRange * exp2(float(terrainPatch.level));
+    float morphStart = range * (1.0 - TERRAIN_MORPH_FRACTION);
+    float distanceToCamera = distance(world_position(xz), params.cameraPosition.xyz);
+    float morph = clamp((distanceToCamera - morphStart) / (range - morphStart), 0.0, 1.0);
+    xz -= vec2(gridPos % 2u) * quadSize * morph;
+  }
+
+  vOut.wPos = world_position(xz);
+  vOut.level = terrainPatch.level;
+
+  gl_Position = params.projView * vec4(vOut.wPos, 1.0);
+}